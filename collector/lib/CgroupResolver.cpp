@@ -0,0 +1,183 @@
+#include "CgroupResolver.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+
+#if defined(__x86_64__)
+#  include <emmintrin.h>
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#endif
+
+#include "FileSystem.h"
+
+namespace collector {
+
+namespace {
+
+constexpr std::string_view kScopeSuffix = ".scope";
+constexpr std::string_view kConmonSuffix = "-conmon";
+
+// Files in /proc are generated on read, so their size is unknown upfront.
+constexpr size_t kReadChunkSize = 4096;
+
+#if defined(__x86_64__)
+
+// Returns a mask with the bits of hexadecimal characters set. Bytes above
+// 0x7f are negative in the signed comparisons and never match.
+inline int HexMask(const char* p) {
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  const __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                       _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  const __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  return _mm_movemask_epi8(_mm_or_si128(digits, letters));
+}
+
+bool AllHex(const char* p) {
+  return (HexMask(p) & HexMask(p + 16) & HexMask(p + 32) & HexMask(p + 48)) == 0xFFFF;
+}
+
+#elif defined(__aarch64__)
+
+inline uint8x16_t HexMask(const char* p) {
+  const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+  const uint8x16_t digits = vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9')));
+  const uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+  const uint8x16_t letters = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('f')));
+  return vorrq_u8(digits, letters);
+}
+
+bool AllHex(const char* p) {
+  uint8x16_t mask = vandq_u8(vandq_u8(HexMask(p), HexMask(p + 16)), vandq_u8(HexMask(p + 32), HexMask(p + 48)));
+  return vminvq_u8(mask) == 0xFF;
+}
+
+#else
+
+bool AllHex(const char* p) {
+  for (size_t i = 0; i < CgroupResolver::kContainerIDLength; i++) {
+    if (std::isxdigit(static_cast<unsigned char>(p[i])) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
+
+// Reads the whole content of the file at path, relative to dirfd, into buf.
+bool ReadFileAt(int dirfd, const char* path, std::string* buf) {
+  FDHandle fd(openat(dirfd, path, O_RDONLY));
+  if (!fd.valid()) {
+    return false;
+  }
+
+  buf->clear();
+  size_t size = 0;
+  for (;;) {
+    buf->resize(size + kReadChunkSize);
+    ssize_t n = read(fd.get(), buf->data() + size, kReadChunkSize);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0) {
+      break;
+    }
+    size += n;
+  }
+  buf->resize(size);
+  return true;
+}
+
+}  // namespace
+
+bool CgroupResolver::IsContainerID(std::string_view str) {
+  if (str.size() != kContainerIDLength) {
+    return false;
+  }
+  return AllHex(str.data());
+}
+
+std::optional<std::string_view> CgroupResolver::ExtractContainerID(std::string_view cgroup_path) {
+  if (cgroup_path.size() < kContainerIDLength + 1) {
+    return {};
+  }
+
+  auto scope = cgroup_path.rfind(kScopeSuffix);
+  if (scope != std::string_view::npos) {
+    cgroup_path.remove_suffix(cgroup_path.length() - scope);
+    if (cgroup_path.size() < kContainerIDLength + 1) {
+      return {};
+    }
+  }
+
+  auto container_id_part = cgroup_path.substr(cgroup_path.size() - (kContainerIDLength + 1));
+  if (container_id_part[0] != '/' && container_id_part[0] != '-' && container_id_part[0] != ':') {
+    return {};
+  }
+
+  cgroup_path.remove_suffix(kContainerIDLength + 1);
+  // conmon runs as its own container, we ignore it.
+  if (cgroup_path.size() >= kConmonSuffix.size() &&
+      cgroup_path.substr(cgroup_path.size() - kConmonSuffix.size()) == kConmonSuffix) {
+    return {};
+  }
+
+  container_id_part.remove_prefix(1);
+
+  if (!IsContainerID(container_id_part)) {
+    return {};
+  }
+  return container_id_part.substr(0, kShortContainerIDLength);
+}
+
+std::optional<std::string_view> CgroupResolver::ExtractContainerIDFromLine(std::string_view cgroup_line) {
+  auto pos = cgroup_line.find(':');
+  if (pos == std::string_view::npos) {
+    return {};
+  }
+  pos = cgroup_line.find(':', pos + 1);
+  if (pos == std::string_view::npos) {
+    return {};
+  }
+
+  return ExtractContainerID(cgroup_line.substr(pos + 1));
+}
+
+std::optional<std::string_view> CgroupResolver::ExtractContainerIDFromFile(std::string_view content) {
+  while (!content.empty()) {
+    auto eol = content.find('\n');
+    std::string_view line = content.substr(0, eol);
+    if (auto id = ExtractContainerIDFromLine(line)) {
+      return id;
+    }
+    if (eol == std::string_view::npos) {
+      break;
+    }
+    content.remove_prefix(eol + 1);
+  }
+  return {};
+}
+
+std::optional<std::string> CgroupResolver::ResolveProcess(int dirfd) {
+  thread_local std::string content;
+  if (!ReadFileAt(dirfd, "cgroup", &content)) {
+    return {};
+  }
+
+  auto id = ExtractContainerIDFromFile(content);
+  if (!id) {
+    return {};
+  }
+  return std::string(*id);
+}
+
+}  // namespace collector
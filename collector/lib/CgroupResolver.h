@@ -0,0 +1,46 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace collector {
+
+// CgroupResolver maps cgroups to the (short) ID of the container they
+// belong to. It is shared by the event path, which gets cgroup paths from
+// sinsp thread info, and the procfs scraper, which reads them from
+// /proc/<pid>/cgroup.
+//
+// Validating the 64 hex characters of a container ID is vectorized on
+// x86_64 (SSE2) and aarch64 (NEON). It holds no state, so procfs scraping
+// workers can resolve processes concurrently.
+class CgroupResolver {
+ public:
+  static constexpr size_t kContainerIDLength = 64;
+  static constexpr size_t kShortContainerIDLength = 12;
+
+  CgroupResolver() = delete;
+
+  // Extracts the short container ID from a cgroup path, e.g.
+  // /kubepods/burstable/pod<uid>/<64 hex chars>. The returned view points
+  // into the given path.
+  static std::optional<std::string_view> ExtractContainerID(std::string_view cgroup_path);
+
+  // Extracts the short container ID from a line of /proc/<pid>/cgroup,
+  // formatted as <hierarchy-id>:<controllers>:<path>.
+  static std::optional<std::string_view> ExtractContainerIDFromLine(std::string_view cgroup_line);
+
+  // Extracts the short container ID from the whole content of a
+  // /proc/<pid>/cgroup file, using the first line with a container ID.
+  static std::optional<std::string_view> ExtractContainerIDFromFile(std::string_view content);
+
+  // IsContainerID returns whether the given string is exactly 64
+  // hexadecimal characters.
+  static bool IsContainerID(std::string_view str);
+
+  // Resolves the container ID of the process represented by dirfd (a
+  // /proc/<pid> directory).
+  static std::optional<std::string> ResolveProcess(int dirfd);
+};
+
+}  // namespace collector
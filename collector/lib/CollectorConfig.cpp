@@ -66,6 +66,9 @@ BoolEnvVar use_podman_ce("ROX_COLLECTOR_CE_USE_PODMAN", false);
 BoolEnvVar enable_introspection("ROX_COLLECTOR_INTROSPECTION_ENABLE", false);
 
 BoolEnvVar track_send_recv("ROX_COLLECTOR_TRACK_SEND_RECV", false);
+// With send/recv tracking, repeated activity on a socket within this window
+// does not update the connection tracker again.
+IntEnvVar send_recv_refresh_window("ROX_COLLECTOR_SEND_RECV_REFRESH_WINDOW_MS", CollectorConfig::kSendRecvRefreshWindowMs);
 
 // Collector arguments alternatives
 StringEnvVar log_level("ROX_COLLECTOR_LOG_LEVEL");
@@ -82,6 +85,41 @@ PathEnvVar tls_client_cert_path("ROX_COLLECTOR_TLS_CLIENT_CERT");
 PathEnvVar tls_client_key_path("ROX_COLLECTOR_TLS_CLIENT_KEY");
 
 BoolEnvVar disable_process_arguments("ROX_COLLECTOR_NO_PROCESS_ARGUMENTS", false);
+
+// If true, signal handlers are run on worker threads fed by bounded lanes.
+BoolEnvVar enable_event_pipeline("ROX_COLLECTOR_EVENT_PIPELINE", false);
+IntEnvVar event_pipeline_lane_size("ROX_COLLECTOR_EVENT_PIPELINE_LANE_SIZE", CollectorConfig::kEventPipelineLaneSize);
+StringEnvVar event_pipeline_lane_policy("ROX_COLLECTOR_EVENT_PIPELINE_LANE_POLICY", "drop");
+
+// If true, process signals are queued and written to Sensor by a dedicated thread.
+BoolEnvVar enable_async_signal_send("ROX_COLLECTOR_ASYNC_SIGNAL_SEND", false);
+IntEnvVar signal_queue_size("ROX_COLLECTOR_SIGNAL_QUEUE_SIZE", CollectorConfig::kSignalQueueSize);
+BoolEnvVar signal_queue_drop_oldest("ROX_COLLECTOR_SIGNAL_QUEUE_DROP_OLDEST", true);
+
+// If true, connection updates from events are merged into the tracker in batches.
+BoolEnvVar batch_connection_updates("ROX_COLLECTOR_BATCH_CONNECTION_UPDATES", false);
+IntEnvVar connection_batch_size("ROX_COLLECTOR_CONNECTION_BATCH_SIZE", CollectorConfig::kConnectionBatchSize);
+IntEnvVar connection_batch_delay("ROX_COLLECTOR_CONNECTION_BATCH_DELAY_MS", CollectorConfig::kConnectionBatchDelayMs);
+
+// Number of threads snapshotting the connection tracker shards when reporting connections.
+IntEnvVar conn_tracker_fetch_workers("ROX_COLLECTOR_CONN_TRACKER_FETCH_WORKERS", CollectorConfig::kConnTrackerFetchWorkers);
+// If true, wait and hold times of the connection tracker locks are exported, per shard.
+BoolEnvVar conn_tracker_lock_metrics("ROX_COLLECTOR_CONN_TRACKER_LOCK_METRICS", false);
+// Connections stored by the tracker per container, and in total, before the least recently updated are evicted.
+IntEnvVar conn_tracker_max_connections_per_container("ROX_COLLECTOR_CONN_TRACKER_MAX_CONNECTIONS_PER_CONTAINER",
+                                                     CollectorConfig::kConnTrackerMaxConnectionsPerContainer);
+IntEnvVar conn_tracker_max_connections("ROX_COLLECTOR_CONN_TRACKER_MAX_CONNECTIONS", CollectorConfig::kConnTrackerMaxConnections);
+// If true, the connections and endpoints of a container are closed once the last process seen using the network in
+// it exits.
+BoolEnvVar conn_tracker_purge_on_exit("ROX_COLLECTOR_CONN_TRACKER_PURGE_ON_EXIT", false);
+
+// Number of threads reading /proc when scraping connections, at most the CPUs allowed by the collector's quota.
+IntEnvVar procfs_scrape_workers("ROX_COLLECTOR_PROCFS_SCRAPE_WORKERS", CollectorConfig::kProcfsScrapeWorkers);
+
+// Detailed metrics: time one event out of this many, for each event type.
+IntEnvVar event_timing_sample_rate("ROX_COLLECTOR_EVENT_TIMING_SAMPLE_RATE", 1);
+// Detailed metrics: event types which are never timed.
+StringListEnvVar event_timing_excluded("ROX_COLLECTOR_EVENT_TIMING_EXCLUDE", std::vector<std::string>());
 }  // namespace
 
 constexpr bool CollectorConfig::kTurnOffScrape;
@@ -89,6 +127,15 @@ constexpr int CollectorConfig::kScrapeInterval;
 constexpr CollectionMethod CollectorConfig::kCollectionMethod;
 constexpr const char* CollectorConfig::kSyscalls[];
 constexpr bool CollectorConfig::kEnableProcessesListeningOnPorts;
+constexpr int CollectorConfig::kEventPipelineLaneSize;
+constexpr int CollectorConfig::kSignalQueueSize;
+constexpr int CollectorConfig::kSendRecvRefreshWindowMs;
+constexpr int CollectorConfig::kConnectionBatchSize;
+constexpr int CollectorConfig::kConnectionBatchDelayMs;
+constexpr int CollectorConfig::kConnTrackerFetchWorkers;
+constexpr int CollectorConfig::kConnTrackerMaxConnectionsPerContainer;
+constexpr int CollectorConfig::kConnTrackerMaxConnections;
+constexpr int CollectorConfig::kProcfsScrapeWorkers;
 
 const UnorderedSet<L4ProtoPortPair> CollectorConfig::kIgnoredL4ProtoPortPairs = {{L4Proto::UDP, 9}};
 
@@ -121,6 +168,14 @@ void CollectorConfig::InitCollectorConfig(CollectorArgs* args) {
     for (const auto& syscall : kSendRecvSyscalls) {
       syscalls_.emplace_back(syscall);
     }
+
+    int refresh_window = send_recv_refresh_window.value();
+    if (refresh_window < 0) {
+      CLOG(ERROR) << "Invalid send/recv refresh window " << refresh_window
+                  << ". ROX_COLLECTOR_SEND_RECV_REFRESH_WINDOW_MS must not be negative.";
+    } else {
+      send_recv_refresh_window_ms_ = refresh_window;
+    }
   }
 
   // Get path to host proc dir
@@ -275,6 +330,12 @@ void CollectorConfig::InitCollectorConfig(CollectorArgs* args) {
   HandleAfterglowEnvVars();
   HandleConnectionStatsEnvVars();
   HandleSinspEnvVars();
+  HandleEventPipelineEnvVars();
+  HandleAsyncSignalSendEnvVars();
+  HandleConnectionBatchEnvVars();
+  HandleConnTrackerEnvVars();
+  HandleProcfsScrapeEnvVars();
+  HandleEventTimingEnvVars();
 
   host_config_ = ProcessHostHeuristics(*this);
 }
@@ -392,6 +453,137 @@ void CollectorConfig::HandleSinspEnvVars() {
   }
 }
 
+void CollectorConfig::HandleEventPipelineEnvVars() {
+  enable_event_pipeline_ = enable_event_pipeline.value();
+  if (!enable_event_pipeline_) {
+    return;
+  }
+
+  int lane_size = event_pipeline_lane_size.value();
+  if (lane_size <= 0) {
+    CLOG(ERROR) << "Invalid event pipeline lane size " << lane_size
+                << ". ROX_COLLECTOR_EVENT_PIPELINE_LANE_SIZE must be positive.";
+  } else {
+    event_pipeline_lane_size_ = lane_size;
+  }
+
+  if (!ParseLanePolicy(event_pipeline_lane_policy.value(), &event_pipeline_lane_policy_)) {
+    CLOG(ERROR) << "Invalid event pipeline lane policy '" << event_pipeline_lane_policy.value()
+                << "'. Using " << event_pipeline_lane_policy_;
+  }
+
+  CLOG(INFO) << "Event pipeline enabled (lane size: " << event_pipeline_lane_size_
+             << ", policy: " << event_pipeline_lane_policy_ << ")";
+}
+
+void CollectorConfig::HandleAsyncSignalSendEnvVars() {
+  enable_async_signal_send_ = enable_async_signal_send.value();
+  if (!enable_async_signal_send_) {
+    return;
+  }
+
+  int queue_size = signal_queue_size.value();
+  if (queue_size <= 0) {
+    CLOG(ERROR) << "Invalid signal queue size " << queue_size
+                << ". ROX_COLLECTOR_SIGNAL_QUEUE_SIZE must be positive.";
+  } else {
+    signal_queue_size_ = queue_size;
+  }
+
+  signal_queue_drop_oldest_ = signal_queue_drop_oldest.value();
+
+  CLOG(INFO) << "Asynchronous signal sending enabled (queue size: " << signal_queue_size_
+             << ", on overflow drop: " << (signal_queue_drop_oldest_ ? "oldest" : "newest") << ")";
+}
+
+void CollectorConfig::HandleConnectionBatchEnvVars() {
+  batch_connection_updates_ = batch_connection_updates.value();
+  if (!batch_connection_updates_) {
+    return;
+  }
+
+  int batch_size = connection_batch_size.value();
+  if (batch_size <= 0) {
+    CLOG(ERROR) << "Invalid connection batch size " << batch_size
+                << ". ROX_COLLECTOR_CONNECTION_BATCH_SIZE must be positive.";
+  } else {
+    connection_batch_size_ = batch_size;
+  }
+
+  int batch_delay = connection_batch_delay.value();
+  if (batch_delay < 0) {
+    CLOG(ERROR) << "Invalid connection batch delay " << batch_delay
+                << ". ROX_COLLECTOR_CONNECTION_BATCH_DELAY_MS must not be negative.";
+  } else {
+    connection_batch_delay_ms_ = batch_delay;
+  }
+
+  CLOG(INFO) << "Connection update batching enabled (size: " << connection_batch_size_
+             << ", delay: " << connection_batch_delay_ms_ << "ms)";
+}
+
+void CollectorConfig::HandleConnTrackerEnvVars() {
+  int fetch_workers = conn_tracker_fetch_workers.value();
+  if (fetch_workers <= 0) {
+    CLOG(ERROR) << "Invalid number of connection tracker fetch workers " << fetch_workers
+                << ". ROX_COLLECTOR_CONN_TRACKER_FETCH_WORKERS must be positive.";
+  } else {
+    conn_tracker_fetch_workers_ = fetch_workers;
+  }
+
+  conn_tracker_lock_metrics_ = conn_tracker_lock_metrics.value();
+  conn_tracker_purge_on_exit_ = conn_tracker_purge_on_exit.value();
+
+  int max_per_container = conn_tracker_max_connections_per_container.value();
+  if (max_per_container < 0) {
+    CLOG(ERROR) << "Invalid connection tracker limit " << max_per_container
+                << ". ROX_COLLECTOR_CONN_TRACKER_MAX_CONNECTIONS_PER_CONTAINER must not be negative.";
+  } else {
+    conn_tracker_max_connections_per_container_ = max_per_container;
+  }
+
+  int max_connections = conn_tracker_max_connections.value();
+  if (max_connections < 0) {
+    CLOG(ERROR) << "Invalid connection tracker limit " << max_connections
+                << ". ROX_COLLECTOR_CONN_TRACKER_MAX_CONNECTIONS must not be negative.";
+  } else {
+    conn_tracker_max_connections_ = max_connections;
+  }
+}
+
+void CollectorConfig::HandleProcfsScrapeEnvVars() {
+  int workers = procfs_scrape_workers.value();
+  if (workers <= 0) {
+    CLOG(ERROR) << "Invalid number of procfs scrape workers " << workers
+                << ". ROX_COLLECTOR_PROCFS_SCRAPE_WORKERS must be positive.";
+    return;
+  }
+
+  unsigned int cpus = AvailableCPUs();
+  if (static_cast<unsigned int>(workers) > cpus) {
+    CLOG(INFO) << "Limiting procfs scrape workers to " << cpus << " (requested " << workers
+               << "), the number of CPUs available to the collector.";
+    workers = cpus;
+  }
+  procfs_scrape_workers_ = workers;
+}
+
+void CollectorConfig::HandleEventTimingEnvVars() {
+  int sample_rate = event_timing_sample_rate.value();
+  if (sample_rate <= 0) {
+    CLOG(ERROR) << "Invalid event timing sample rate " << sample_rate
+                << ". ROX_COLLECTOR_EVENT_TIMING_SAMPLE_RATE must be positive.";
+  } else {
+    event_timing_sample_rate_ = sample_rate;
+  }
+
+  for (const auto& name : event_timing_excluded.value()) {
+    if (!name.empty()) {
+      event_timing_excluded_.emplace_back(name);
+    }
+  }
+}
+
 bool CollectorConfig::TurnOffScrape() const {
   return turn_off_scrape_;
 }
@@ -439,7 +631,16 @@ std::ostream& operator<<(std::ostream& os, const CollectorConfig& c) {
          << ", collect_connection_status:" << c.CollectConnectionStatus()
          << ", enable_detailed_metrics:" << c.EnableDetailedMetrics()
          << ", external_ips:" << c.GetExternalIPsConf()
-         << ", track_send_recv:" << c.TrackingSendRecv();
+         << ", track_send_recv:" << c.TrackingSendRecv()
+         << ", send_recv_refresh_window_ms:" << c.SendRecvRefreshWindowMs()
+         << ", event_pipeline:" << c.EnableEventPipeline()
+         << ", async_signal_send:" << c.EnableAsyncSignalSend()
+         << ", batch_connection_updates:" << c.BatchConnectionUpdates()
+         << ", conn_tracker_fetch_workers:" << c.ConnTrackerFetchWorkers()
+         << ", conn_tracker_max_connections_per_container:" << c.ConnTrackerMaxConnectionsPerContainer()
+         << ", conn_tracker_max_connections:" << c.ConnTrackerMaxConnections()
+         << ", conn_tracker_purge_on_exit:" << c.ConnTrackerPurgeOnExit()
+         << ", procfs_scrape_workers:" << c.ProcfsScrapeWorkers();
 }
 
 // Returns size of ring buffers to be allocated.
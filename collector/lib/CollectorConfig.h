@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <optional>
 #include <ostream>
@@ -14,10 +15,12 @@
 #include <internalapi/sensor/collector.pb.h>
 
 #include "CollectionMethod.h"
+#include "EventLane.h"
 #include "ExternalIPsConfig.h"
 #include "HostConfig.h"
 #include "Logging.h"
 #include "NetworkConnection.h"
+#include "NetworkExclusions.h"
 #include "TlsConfig.h"
 #include "json/value.h"
 #include "optionparser.h"
@@ -67,6 +70,15 @@ class CollectorConfig {
   };
   static const UnorderedSet<L4ProtoPortPair> kIgnoredL4ProtoPortPairs;
   static constexpr bool kEnableProcessesListeningOnPorts = true;
+  static constexpr int kEventPipelineLaneSize = 16384;
+  static constexpr int kSignalQueueSize = 4096;
+  static constexpr int kSendRecvRefreshWindowMs = 1000;
+  static constexpr int kConnectionBatchSize = 256;
+  static constexpr int kConnectionBatchDelayMs = 100;
+  static constexpr int kConnTrackerFetchWorkers = 1;
+  static constexpr int kConnTrackerMaxConnectionsPerContainer = 65536;
+  static constexpr int kConnTrackerMaxConnections = 1048576;
+  static constexpr int kProcfsScrapeWorkers = 1;
 
   CollectorConfig();
   CollectorConfig(const CollectorConfig&) = delete;
@@ -143,8 +155,38 @@ class CollectorConfig {
     auto lock = WriteLock();
     CLOG(INFO) << "Resetting runtime configuration";
     runtime_config_.reset();
+    if (!disabled_syscalls_.empty()) {
+      disabled_syscalls_.clear();
+      syscalls_version_.fetch_add(1, std::memory_order_release);
+    }
+    network_exclusions_.SetContainers({});
+  }
+
+  // Syscalls, out of Syscalls(), that the runtime configuration asks to
+  // stop capturing.
+  std::vector<std::string> DisabledSyscalls() const {
+    auto lock = ReadLock();
+    return disabled_syscalls_;
   }
 
+  void SetDisabledSyscalls(std::vector<std::string> syscalls) {
+    auto lock = WriteLock();
+    if (syscalls == disabled_syscalls_) {
+      return;
+    }
+    disabled_syscalls_ = std::move(syscalls);
+    syscalls_version_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Incremented whenever DisabledSyscalls() changes, cheap enough to be
+  // polled from the event loop.
+  uint64_t SyscallsVersion() const { return syscalls_version_.load(std::memory_order_acquire); }
+
+  // Containers excluded from network processing by the runtime
+  // configuration. The rules keep track of what they skipped, hence
+  // the mutable access.
+  NetworkExclusions& GetNetworkExclusions() const { return network_exclusions_; }
+
   bool EnableConnectionStats() const { return enable_connection_stats_; }
   bool EnableDetailedMetrics() const { return enable_detailed_metrics_; }
   bool EnableRuntimeConfig() const { return enable_runtime_config_; }
@@ -152,6 +194,7 @@ class CollectorConfig {
   bool UsePodmanCe() const { return use_podman_ce_; }
   bool IsIntrospectionEnabled() const { return enable_introspection_; }
   bool TrackingSendRecv() const { return track_send_recv_; }
+  unsigned int SendRecvRefreshWindowMs() const { return send_recv_refresh_window_ms_; }
   const std::vector<double>& GetConnectionStatsQuantiles() const { return connection_stats_quantiles_; }
   double GetConnectionStatsError() const { return connection_stats_error_; }
   unsigned int GetConnectionStatsWindow() const { return connection_stats_window_; }
@@ -161,6 +204,23 @@ class CollectorConfig {
   unsigned int GetSinspTotalBufferSize() const { return sinsp_total_buffer_size_; }
   unsigned int GetSinspThreadCacheSize() const { return sinsp_thread_cache_size_; }
   bool DisableProcessArguments() const { return disable_process_arguments_; }
+  bool EnableEventPipeline() const { return enable_event_pipeline_; }
+  unsigned int EventPipelineLaneSize() const { return event_pipeline_lane_size_; }
+  LanePolicy EventPipelineLanePolicy() const { return event_pipeline_lane_policy_; }
+  bool EnableAsyncSignalSend() const { return enable_async_signal_send_; }
+  unsigned int SignalQueueSize() const { return signal_queue_size_; }
+  bool SignalQueueDropOldest() const { return signal_queue_drop_oldest_; }
+  bool BatchConnectionUpdates() const { return batch_connection_updates_; }
+  unsigned int ConnectionBatchSize() const { return connection_batch_size_; }
+  unsigned int ConnectionBatchDelayMs() const { return connection_batch_delay_ms_; }
+  unsigned int ConnTrackerFetchWorkers() const { return conn_tracker_fetch_workers_; }
+  bool ConnTrackerLockMetrics() const { return conn_tracker_lock_metrics_; }
+  unsigned int ConnTrackerMaxConnectionsPerContainer() const { return conn_tracker_max_connections_per_container_; }
+  unsigned int ConnTrackerMaxConnections() const { return conn_tracker_max_connections_; }
+  bool ConnTrackerPurgeOnExit() const { return conn_tracker_purge_on_exit_; }
+  unsigned int ProcfsScrapeWorkers() const { return procfs_scrape_workers_; }
+  unsigned int EventTimingSampleRate() const { return event_timing_sample_rate_; }
+  const std::vector<std::string>& EventTimingExcluded() const { return event_timing_excluded_; }
 
   static std::pair<option::ArgStatus, std::string> CheckConfiguration(const char* config, Json::Value* root);
 
@@ -226,6 +286,49 @@ class CollectorConfig {
 
   bool disable_process_arguments_ = false;
 
+  // With send/recv tracking, activity on a socket updated less than this
+  // long ago is not reported to the connection tracker again.
+  unsigned int send_recv_refresh_window_ms_ = kSendRecvRefreshWindowMs;
+
+  // Run signal handlers on dedicated worker threads, fed through bounded
+  // lanes, instead of on the thread consuming events from sinsp.
+  bool enable_event_pipeline_ = false;
+  unsigned int event_pipeline_lane_size_ = kEventPipelineLaneSize;
+  LanePolicy event_pipeline_lane_policy_ = LanePolicy::DROP;
+
+  // Write process signals to Sensor from a dedicated thread, through a
+  // bounded queue.
+  bool enable_async_signal_send_ = false;
+  unsigned int signal_queue_size_ = kSignalQueueSize;
+  bool signal_queue_drop_oldest_ = true;
+
+  // Merge connection updates from events into the connection tracker in
+  // batches, instead of one by one.
+  bool batch_connection_updates_ = false;
+  unsigned int connection_batch_size_ = kConnectionBatchSize;
+  unsigned int connection_batch_delay_ms_ = kConnectionBatchDelayMs;
+
+  // Threads used to snapshot the connection tracker shards, and whether
+  // the wait and hold times of their locks are exported.
+  unsigned int conn_tracker_fetch_workers_ = kConnTrackerFetchWorkers;
+  bool conn_tracker_lock_metrics_ = false;
+  // Number of connections the tracker stores per container, and in total,
+  // before evicting the least recently updated ones. 0 means unlimited.
+  unsigned int conn_tracker_max_connections_per_container_ = kConnTrackerMaxConnectionsPerContainer;
+  unsigned int conn_tracker_max_connections_ = kConnTrackerMaxConnections;
+  // Close the connections and endpoints of a container once the last
+  // process seen using the network in it exits.
+  bool conn_tracker_purge_on_exit_ = false;
+
+  // Threads reading /proc when scraping connections, capped by the CPU
+  // quota of the collector.
+  unsigned int procfs_scrape_workers_ = kProcfsScrapeWorkers;
+
+  // Per event type parse and process timings are measured on one event
+  // out of this many, for each type not excluded.
+  unsigned int event_timing_sample_rate_ = 1;
+  std::vector<std::string> event_timing_excluded_;
+
   // One ring buffer will be initialized for this many CPUs
   unsigned int sinsp_cpu_per_buffer_ = 0;
   // Size of one ring buffer, in bytes.
@@ -244,11 +347,20 @@ class CollectorConfig {
   std::optional<TlsConfig> tls_config_;
 
   std::optional<sensor::CollectorConfig> runtime_config_;
+  std::vector<std::string> disabled_syscalls_;
+  std::atomic<uint64_t> syscalls_version_ = 0;
+  mutable NetworkExclusions network_exclusions_;
   mutable std::shared_mutex mutex_{};
 
   void HandleAfterglowEnvVars();
   void HandleConnectionStatsEnvVars();
   void HandleSinspEnvVars();
+  void HandleEventPipelineEnvVars();
+  void HandleAsyncSignalSendEnvVars();
+  void HandleConnectionBatchEnvVars();
+  void HandleConnTrackerEnvVars();
+  void HandleProcfsScrapeEnvVars();
+  void HandleEventTimingEnvVars();
 
   // Protected, used for testing purposes
   void SetSinspBufferSize(unsigned int buffer_size);
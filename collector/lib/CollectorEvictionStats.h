@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+#include "ConnTracker.h"
+#include "Hash.h"
+#include "prometheus/gauge.h"
+#include "prometheus/registry.h"
+
+namespace collector {
+
+// CollectorEvictionStats exports the number of connections the connection
+// tracker evicted because of its limits, labeled by container. Only the
+// containers which had connections evicted are exported.
+class CollectorEvictionStats {
+ public:
+  CollectorEvictionStats(prometheus::Registry* registry, ConnectionTracker* conn_tracker)
+      : family_(&prometheus::BuildGauge()
+                     .Name("rox_collector_conn_tracker_evictions")
+                     .Help("Connections evicted from the connection tracker because of its limits, by container")
+                     .Register(*registry)),
+        conn_tracker_(conn_tracker) {}
+
+  // Adds the evictions since the previous update.
+  void Update() {
+    for (const auto& [container_id, count] : conn_tracker_->ConsumeEvictedConnections()) {
+      auto& gauge = gauges_[container_id];
+      if (gauge == nullptr) {
+        gauge = &family_->Add({{"container_id", container_id}});
+      }
+      gauge->Increment(count);
+    }
+  }
+
+ private:
+  // Owned by the prometheus registry.
+  prometheus::Family<prometheus::Gauge>* family_;
+  UnorderedMap<std::string, prometheus::Gauge*> gauges_;
+  ConnectionTracker* conn_tracker_;
+};
+
+}  // namespace collector
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ConnTracker.h"
+#include "prometheus/histogram.h"
+#include "prometheus/registry.h"
+
+namespace collector {
+
+// CollectorLockStats exports the wait and hold times of the connection
+// tracker shard locks as prometheus histograms, in microseconds, labeled by
+// shard.
+class CollectorLockStats {
+ public:
+  CollectorLockStats(prometheus::Registry* registry, const ConnectionTracker* conn_tracker) {
+    auto& family = prometheus::BuildHistogram()
+                       .Name("rox_collector_conn_tracker_lock_us")
+                       .Help("Time spent waiting for and holding the connection tracker locks, in microseconds")
+                       .Register(*registry);
+    auto boundaries = LockTimeHistogram::BucketBoundaries();
+
+    for (size_t shard = 0; shard < ConnectionTracker::kNumShards; shard++) {
+      std::string shard_label = std::to_string(shard);
+      entries_.push_back({&conn_tracker->ShardLockWaitTimes(shard),
+                          &family.Add({{"shard", shard_label}, {"lock", "wait"}}, boundaries)});
+      entries_.push_back({&conn_tracker->ShardLockHoldTimes(shard),
+                          &family.Add({{"shard", shard_label}, {"lock", "hold"}}, boundaries)});
+    }
+  }
+
+  // Observes what was recorded since the previous update.
+  void Update() {
+    std::vector<double> increments(LockTimeHistogram::kNumBuckets);
+    for (auto& entry : entries_) {
+      for (size_t i = 0; i < LockTimeHistogram::kNumBuckets; i++) {
+        uint64_t count = entry.source->Count(i);
+        increments[i] = count - entry.last_counts[i];
+        entry.last_counts[i] = count;
+      }
+      uint64_t sum = entry.source->SumMicros();
+      entry.histogram->ObserveMultiple(increments, sum - entry.last_sum);
+      entry.last_sum = sum;
+    }
+  }
+
+ private:
+  struct Entry {
+    const LockTimeHistogram* source;
+    // Owned by the prometheus registry.
+    prometheus::Histogram* histogram;
+    std::array<uint64_t, LockTimeHistogram::kNumBuckets> last_counts = {};
+    uint64_t last_sum = 0;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+}  // namespace collector
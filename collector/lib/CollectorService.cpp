@@ -46,6 +46,8 @@ CollectorService::CollectorService(CollectorConfig& config, std::atomic<ControlV
     conn_tracker_->UpdateIgnoredL4ProtoPortPairs(std::move(ignored_l4proto_port_pairs));
     conn_tracker_->UpdateIgnoredNetworks(config_.IgnoredNetworks());
     conn_tracker_->UpdateNonAggregatedNetworks(config_.NonAggregatedNetworks());
+    conn_tracker_->SetFetchWorkers(config_.ConnTrackerFetchWorkers());
+    conn_tracker_->SetConnectionLimits(config_.ConnTrackerMaxConnectionsPerContainer(), config_.ConnTrackerMaxConnections());
 
     net_status_notifier_ = std::make_unique<NetworkStatusNotifier>(
         conn_tracker_,
@@ -56,7 +58,20 @@ CollectorService::CollectorService(CollectorConfig& config, std::atomic<ControlV
     auto network_signal_handler = std::make_unique<NetworkSignalHandler>(system_inspector_.GetInspector(), conn_tracker_, system_inspector_.GetUserspaceStats());
     network_signal_handler->SetCollectConnectionStatus(config_.CollectConnectionStatus());
     network_signal_handler->SetTrackSendRecv(config_.TrackingSendRecv());
-    system_inspector_.AddSignalHandler(std::move(network_signal_handler));
+    if (config_.TrackingSendRecv()) {
+      network_signal_handler->EnableConnectionCache(std::chrono::milliseconds(config_.SendRecvRefreshWindowMs()));
+    }
+    network_signal_handler->SetContainerIDCache(system_inspector_.GetContainerIDCache());
+    if (config_.BatchConnectionUpdates()) {
+      network_signal_handler->EnableBatching(config_.ConnectionBatchSize(), std::chrono::milliseconds(config_.ConnectionBatchDelayMs()));
+    }
+    if (config_.ConnTrackerPurgeOnExit()) {
+      network_signal_handler->EnablePurgeOnExit(system_inspector_.GetContainerProcesses());
+    }
+    if (config_.EnableEventPipeline()) {
+      network_signal_handler->EnablePipeline(config_.EventPipelineLaneSize(), config_.EventPipelineLanePolicy());
+    }
+    system_inspector_.AddNetworkSignalHandler(std::move(network_signal_handler));
   }
 
   // Initialize civetweb server handlers
@@ -20,12 +20,20 @@
   X(net_conn_updates)                       \
   X(net_conn_deltas)                        \
   X(net_conn_inactive)                      \
+  X(net_conn_evicted)                       \
+  X(net_conn_purged)                        \
   X(net_conn_rate_limited)                  \
+  X(net_conn_cache_hits)                    \
+  X(net_conn_cache_misses)                  \
+  X(net_conn_updates_skipped)               \
   X(net_cep_updates)                        \
   X(net_cep_deltas)                         \
   X(net_cep_inactive)                       \
+  X(net_cep_purged)                         \
   X(net_known_ip_networks)                  \
   X(net_known_public_ips)                   \
+  X(net_normalize_cache_hits)               \
+  X(net_normalize_cache_misses)             \
   X(process_lineage_counts)                 \
   X(process_lineage_total)                  \
   X(process_lineage_sqr_total)              \
@@ -42,7 +50,13 @@
   X(procfs_could_not_read_cmdline)          \
   X(procfs_zombie_process)                  \
   X(event_timestamp_distant_past)           \
-  X(event_timestamp_future)
+  X(event_timestamp_future)                 \
+  X(pipeline_network_lane_depth)            \
+  X(pipeline_network_lane_stalls)           \
+  X(pipeline_network_lane_drops)            \
+  X(pipeline_process_lane_depth)            \
+  X(pipeline_process_lane_stalls)           \
+  X(pipeline_process_lane_drops)
 
 namespace collector {
 
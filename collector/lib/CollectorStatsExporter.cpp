@@ -58,12 +58,17 @@ void CollectorStatsExporter::run() {
   auto& preemptions = collectorEventCounters.Add({{"type", "preemptions"}});
   auto& grpcSendFailures = collectorEventCounters.Add({{"type", "grpcSendFailures"}});
   auto& threadTableSize = collectorEventCounters.Add({{"type", "threadCacheSize"}});
+  auto& containerIDCacheHits = collectorEventCounters.Add({{"type", "containerIDCacheHits"}});
+  auto& containerIDCacheMisses = collectorEventCounters.Add({{"type", "containerIDCacheMisses"}});
 
   auto& processSent = collectorEventCounters.Add({{"type", "processSent"}});
   auto& processSendFailures = collectorEventCounters.Add({{"type", "processSendFailures"}});
   auto& processResolutionFailuresByEvt = collectorEventCounters.Add({{"type", "processResolutionFailuresByEvt"}});
   auto& processResolutionFailuresByTinfo = collectorEventCounters.Add({{"type", "processResolutionFailuresByTinfo"}});
   auto& processRateLimitCount = collectorEventCounters.Add({{"type", "processRateLimitCount"}});
+  auto& signalQueueDepth = collectorEventCounters.Add({{"type", "signalQueueDepth"}});
+  auto& signalQueueDroppedOldest = collectorEventCounters.Add({{"type", "signalQueueDroppedOldest"}});
+  auto& signalQueueDroppedNewest = collectorEventCounters.Add({{"type", "signalQueueDroppedNewest"}});
 
   auto& collector_timers_gauge = prometheus::BuildGauge()
                                      .Name("rox_collector_timers")
@@ -111,6 +116,13 @@ void CollectorStatsExporter::run() {
     prometheus::Gauge* process_micros_avg = nullptr;
   } typed[PPM_EVENT_MAX] = {};
 
+  auto& networkExclusionCounters = prometheus::BuildGauge()
+                                       .Name("rox_collector_network_exclusions")
+                                       .Help("Activity skipped for containers excluded from network processing")
+                                       .Register(*registry_);
+  // container ID -> (events, scraped processes)
+  UnorderedMap<std::string, std::pair<prometheus::Gauge*, prometheus::Gauge*>> network_exclusion_gauges;
+
   const auto& active_syscalls = config_->Syscalls();
   UnorderedSet<std::string> syscall_set(active_syscalls.begin(), active_syscalls.end());
 
@@ -170,6 +182,8 @@ void CollectorStatsExporter::run() {
     ringbufferDrops.Set(stats.nDropsBuffer);
     preemptions.Set(stats.nPreemptions);
     threadTableSize.Set(stats.nThreadCacheSize);
+    containerIDCacheHits.Set(stats.nContainerIDCacheHits);
+    containerIDCacheMisses.Set(stats.nContainerIDCacheMisses);
 
     if (config_->EnableDetailedMetrics()) {
       uint64_t nUserspace = 0;
@@ -210,6 +224,9 @@ void CollectorStatsExporter::run() {
     processResolutionFailuresByEvt.Set(stats.nProcessResolutionFailuresByEvt);
     processResolutionFailuresByTinfo.Set(stats.nProcessResolutionFailuresByTinfo);
     processRateLimitCount.Set(stats.nProcessRateLimitCount);
+    signalQueueDepth.Set(stats.nSignalQueueDepth);
+    signalQueueDroppedOldest.Set(stats.nSignalQueueDroppedOldest);
+    signalQueueDroppedNewest.Set(stats.nSignalQueueDroppedNewest);
 
     for (int i = 0; i < CollectorStats::timer_type_max; i++) {
       auto tt = (CollectorStats::TimerType)(i);
@@ -221,6 +238,26 @@ void CollectorStatsExporter::run() {
       collector_counters[ct]->Set(CollectorStats::GetOrCreate().GetCounter(ct));
     }
 
+    auto network_exclusions = config_->GetNetworkExclusions().Get();
+    for (auto it = network_exclusion_gauges.begin(); it != network_exclusion_gauges.end();) {
+      if (network_exclusions->ByContainer().count(it->first) == 0) {
+        networkExclusionCounters.Remove(it->second.first);
+        networkExclusionCounters.Remove(it->second.second);
+        it = network_exclusion_gauges.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (const auto& [container_id, rule] : network_exclusions->ByContainer()) {
+      auto& gauges = network_exclusion_gauges[container_id];
+      if (gauges.first == nullptr) {
+        gauges.first = &networkExclusionCounters.Add({{"container_id", container_id}, {"type", "events"}});
+        gauges.second = &networkExclusionCounters.Add({{"container_id", container_id}, {"type", "scraped_processes"}});
+      }
+      gauges.first->Set(rule->events.load(std::memory_order_relaxed));
+      gauges.second->Set(rule->scraped_processes.load(std::memory_order_relaxed));
+    }
+
     int64_t lineage_count_stat = CollectorStats::GetOrCreate().GetCounter(CollectorStats::process_lineage_counts);
     int64_t lineage_count_total = CollectorStats::GetOrCreate().GetCounter(CollectorStats::process_lineage_total);
     int64_t lineage_count_sqr_total = CollectorStats::GetOrCreate().GetCounter(CollectorStats::process_lineage_sqr_total);
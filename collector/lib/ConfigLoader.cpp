@@ -6,7 +6,10 @@
 
 #include "internalapi/sensor/collector.pb.h"
 
+#include "CgroupResolver.h"
+#include "CollectorException.h"
 #include "EnvVar.h"
+#include "EventNames.h"
 #include "Logging.h"
 
 namespace collector {
@@ -52,15 +55,24 @@ namespace stdf = std::filesystem;
 
 ParserResult ParserYaml::Parse(google::protobuf::Message* msg) {
   YAML::Node node;
+  auto errors = Load(&node);
+  if (errors) {
+    return errors;
+  }
+
+  return Parse(msg, node);
+}
+
+ParserResult ParserYaml::Load(YAML::Node* node) {
   try {
-    node = YAML::LoadFile(file_);
+    *node = YAML::LoadFile(file_);
   } catch (const YAML::BadFile& e) {
     return {{WrapError(e)}};
   } catch (const YAML::ParserException& e) {
     return {{WrapError(e)}};
   }
 
-  return Parse(msg, node);
+  return {};
 }
 
 ParserResult ParserYaml::Parse(google::protobuf::Message* msg, const YAML::Node& node) {
@@ -493,16 +505,30 @@ void ConfigLoader::Stop() {
 
 ConfigLoader::Result ConfigLoader::LoadConfiguration(const std::optional<const YAML::Node>& node) {
   sensor::CollectorConfig runtime_config = NewRuntimeConfig();
+  YAML::Node yaml;
   ParserResult errors;
 
   if (!node.has_value()) {
     if (!stdf::exists(parser_.GetFile())) {
       return FILE_NOT_FOUND;
     }
-    errors = parser_.Parse(&runtime_config);
-
+    errors = parser_.Load(&yaml);
   } else {
-    errors = parser_.Parse(&runtime_config, *node);
+    yaml = *node;
+  }
+
+  if (!errors) {
+    errors = parser_.Parse(&runtime_config, yaml);
+  }
+
+  std::vector<std::string> disabled_syscalls;
+  if (!errors) {
+    errors = ParseDisabledSyscalls(yaml, &disabled_syscalls);
+  }
+
+  std::vector<std::string> excluded_containers;
+  if (!errors) {
+    errors = ParseNetworkExclusions(yaml, &excluded_containers);
   }
 
   if (errors) {
@@ -512,6 +538,8 @@ ConfigLoader::Result ConfigLoader::LoadConfiguration(const std::optional<const Y
   }
 
   config_.SetRuntimeConfig(std::move(runtime_config));
+  config_.SetDisabledSyscalls(std::move(disabled_syscalls));
+  config_.GetNetworkExclusions().SetContainers(excluded_containers);
   CLOG(INFO) << "Runtime configuration:\n"
              << config_.GetRuntimeConfigStr();
   return SUCCESS;
@@ -526,6 +554,116 @@ sensor::CollectorConfig ConfigLoader::NewRuntimeConfig() {
   return runtime_config;
 }
 
+ParserResult ConfigLoader::ParseDisabledSyscalls(const YAML::Node& node, std::vector<std::string>* disabled) {
+  const YAML::Node syscalls = node["syscalls"];
+  if (!syscalls || syscalls.IsNull()) {
+    return {};
+  }
+  if (!syscalls.IsMap()) {
+    ParserError err;
+    err << "Invalid type '" << NodeTypeToString(syscalls.Type()) << "' for field syscalls, expected 'Map'";
+    return {{err}};
+  }
+
+  const YAML::Node list = syscalls["disabled"];
+  if (!list || list.IsNull()) {
+    return {};
+  }
+  if (!list.IsSequence()) {
+    ParserError err;
+    err << "Invalid type '" << NodeTypeToString(list.Type()) << "' for field syscalls.disabled, expected 'Sequence'";
+    return {{err}};
+  }
+
+  std::vector<ParserError> errors;
+  const EventNames& event_names = EventNames::GetInstance();
+  for (const auto& item : list) {
+    if (!item.IsScalar()) {
+      ParserError err;
+      err << "Invalid type '" << NodeTypeToString(item.Type()) << "' in syscalls.disabled, expected 'Scalar'";
+      errors.emplace_back(err);
+      continue;
+    }
+
+    auto name = item.as<std::string>();
+    if (name == "procexit") {
+      // Needed to keep the thread table under control.
+      errors.emplace_back("procexit cannot be disabled");
+      continue;
+    }
+
+    try {
+      event_names.GetEventIDs(name);
+    } catch (const CollectorException& e) {
+      errors.emplace_back(e.what());
+      continue;
+    }
+
+    disabled->push_back(std::move(name));
+  }
+
+  if (!errors.empty()) {
+    return errors;
+  }
+  return {};
+}
+
+ParserResult ConfigLoader::ParseNetworkExclusions(const YAML::Node& node, std::vector<std::string>* container_ids) {
+  const YAML::Node exclusions = node["networkExclusions"];
+  if (!exclusions || exclusions.IsNull()) {
+    return {};
+  }
+  if (!exclusions.IsMap()) {
+    ParserError err;
+    err << "Invalid type '" << NodeTypeToString(exclusions.Type()) << "' for field networkExclusions, expected 'Map'";
+    return {{err}};
+  }
+
+  const YAML::Node list = exclusions["containerIds"];
+  if (!list || list.IsNull()) {
+    return {};
+  }
+  if (!list.IsSequence()) {
+    ParserError err;
+    err << "Invalid type '" << NodeTypeToString(list.Type()) << "' for field networkExclusions.containerIds, expected 'Sequence'";
+    return {{err}};
+  }
+
+  std::vector<ParserError> errors;
+  for (const auto& item : list) {
+    if (!item.IsScalar()) {
+      ParserError err;
+      err << "Invalid type '" << NodeTypeToString(item.Type()) << "' in networkExclusions.containerIds, expected 'Scalar'";
+      errors.emplace_back(err);
+      continue;
+    }
+
+    // Both full and short IDs are accepted, collector works with the
+    // short ones.
+    auto container_id = item.as<std::string>();
+    if (CgroupResolver::IsContainerID(container_id)) {
+      container_id.resize(CgroupResolver::kShortContainerIDLength);
+    }
+    bool is_short_id = container_id.size() == CgroupResolver::kShortContainerIDLength &&
+                       std::all_of(container_id.begin(), container_id.end(), [](char c) {
+                         return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+                       });
+    if (!is_short_id) {
+      ParserError err;
+      err << "Invalid container ID '" << container_id << "' in networkExclusions.containerIds";
+      errors.emplace_back(err);
+      continue;
+    }
+
+    container_ids->push_back(std::move(container_id));
+  }
+
+  if (!errors.empty()) {
+    return errors;
+  }
+  return {};
+}
+
 void ConfigLoader::WatchFile() {
   const auto& file = parser_.GetFile();
 
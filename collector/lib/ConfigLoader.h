@@ -77,6 +77,14 @@ class ParserYaml {
    */
   ParserResult Parse(google::protobuf::Message* msg, const YAML::Node& node);
 
+  /**
+   * Load the configuration file assigned to this parser.
+   *
+   * @param node The YAML::Node to be populated.
+   * @returns an optional vector of parser errors.
+   */
+  ParserResult Load(YAML::Node* node);
+
   const std::filesystem::path& GetFile() { return file_; }
 
  private:
@@ -212,6 +220,28 @@ class ConfigLoader {
    */
   static sensor::CollectorConfig NewRuntimeConfig();
 
+  /**
+   * Read the syscalls to stop capturing from the `syscalls.disabled`
+   * list of the configuration. This section is specific to collector,
+   * it is not part of the runtime configuration message.
+   *
+   * @param node The YAML::Node holding the whole configuration.
+   * @param disabled Populated with the names of the disabled syscalls.
+   * @returns an optional vector of parser errors.
+   */
+  static ParserResult ParseDisabledSyscalls(const YAML::Node& node, std::vector<std::string>* disabled);
+
+  /**
+   * Read the containers excluded from network processing from the
+   * `networkExclusions.containerIds` list of the configuration. Like
+   * `syscalls`, this section is specific to collector.
+   *
+   * @param node The YAML::Node holding the whole configuration.
+   * @param container_ids Populated with the short excluded container IDs.
+   * @returns an optional vector of parser errors.
+   */
+  static ParserResult ParseNetworkExclusions(const YAML::Node& node, std::vector<std::string>* container_ids);
+
   /**
    * Wait for inotify events on a configuration file and reload it
    * accordingly.
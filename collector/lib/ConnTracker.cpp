@@ -1,9 +1,12 @@
 #include "ConnTracker.h"
 
+#include <algorithm>
+#include <tuple>
 #include <utility>
 
 #include "CollectorStats.h"
 #include "Containers.h"
+#include "CycleClock.h"
 #include "Logging.h"
 #include "Utility.h"
 
@@ -33,62 +36,225 @@ bool AdvertisedEndpointEquality::operator()(const ContainerEndpoint& lhs, const
     }
   }
 
-  return lhs.container() == rhs.container() && lhs.endpoint() == rhs.endpoint() && lhs.l4proto() == rhs.l4proto();
+  return lhs.container_handle() == rhs.container_handle() && lhs.endpoint() == rhs.endpoint() && lhs.l4proto() == rhs.l4proto();
 }
 
-bool ContainsPrivateNetwork(Address::Family family, NRadixTree tree) {
+bool ContainsPrivateNetwork(Address::Family family, const NRadixTree& tree) {
   return tree.IsAnyIPNetSubset(family, private_networks_tree) || private_networks_tree.IsAnyIPNetSubset(family, tree);
 }
 
+std::vector<double> LockTimeHistogram::BucketBoundaries() {
+  std::vector<double> boundaries;
+  for (size_t i = 0; i < kNumBuckets - 1; i++) {
+    boundaries.push_back(static_cast<double>(1ULL << i));
+  }
+  return boundaries;
+}
+
+ConnectionTracker::ShardLock::ShardLock(Shard* shard) : shard_(shard) {
+  uint64_t start = CycleClock::Now();
+  shard_->mutex.lock();
+  acquired_ = CycleClock::Now();
+  shard_->lock_wait.Record(CycleClock::ToMicros(acquired_ - start));
+}
+
+ConnectionTracker::ShardLock::~ShardLock() {
+  shard_->lock_hold.Record(CycleClock::ToMicros(CycleClock::Now() - acquired_));
+  shard_->mutex.unlock();
+}
+
+template <typename Fn>
+void ConnectionTracker::ForEachShard(const Fn& fn) {
+  ParallelFor(fetch_workers_, kNumShards, [&fn](size_t, size_t shard) { fn(shard); });
+}
+
 void ConnectionTracker::UpdateConnection(const Connection& conn, int64_t timestamp, bool added) {
+  Shard& shard = ShardFor(conn);
+  std::shared_lock config_lock(config_mutex_);
+  ShardLock lock(&shard);
+  EmplaceOrUpdateNoLock(&shard, conn, ConnStatus(timestamp, added));
+}
+
+ConnectionBatch* ConnectionTracker::CreateBatch(size_t max_size, int64_t max_delay_micros) {
+  auto* batch = new ConnectionBatch(this, max_size, max_delay_micros);
+  WITH_LOCK(batches_mutex_) {
+    batches_.emplace_back(batch);
+  }
+  return batch;
+}
+
+void ConnectionTracker::MergeBatch(std::vector<ConnMap>* batch, size_t num_updates) {
+  if (num_updates == 0) {
+    return;
+  }
+
+  COUNTER_ADD(CollectorStats::net_conn_updates, num_updates);
+
+  std::shared_lock config_lock(config_mutex_);
+  auto networks = Networks();
+  for (size_t i = 0; i < kNumShards; i++) {
+    auto& pending = (*batch)[i];
+    if (pending.empty()) {
+      continue;
+    }
+
+    // Connections are classified for the statistics outside of the shard lock, in the order they are merged, even
+    // though only the new ones need it.
+    std::vector<StatsClass> classes;
+    classes.reserve(pending.size());
+    for (const auto& entry : pending) {
+      classes.push_back(ClassifyConnection(entry.first, *networks));
+    }
+
+    Shard& shard = shards_[i];
+    {
+      ShardLock lock(&shard);
+      if (shard.stats_networks_version != networks->version) {
+        // Networks changed since the shard was last classified, maybe after these classes were computed.
+        shard.stats_networks_version = 0;
+      }
+
+      auto cls = classes.begin();
+      for (const auto& [conn, status] : pending) {
+        EmplaceOrUpdateStateNoLock(&shard, conn, status, *cls++);
+      }
+    }
+    pending.clear();
+  }
+}
+
+void ConnectionTracker::FlushBatches() {
+  std::vector<ConnectionBatch*> batches;
+  WITH_LOCK(batches_mutex_) {
+    for (const auto& batch : batches_) {
+      batches.push_back(batch.get());
+    }
+  }
+
+  for (auto* batch : batches) {
+    batch->Flush();
+  }
+}
+
+ConnectionBatch::ConnectionBatch(ConnectionTracker* tracker, size_t max_size, int64_t max_delay_micros)
+    : tracker_(tracker), max_size_(max_size), max_delay_micros_(max_delay_micros), pending_(ConnectionTracker::kNumShards) {}
+
+void ConnectionBatch::Add(const Connection& conn, int64_t timestamp, bool added) {
   WITH_LOCK(mutex_) {
-    EmplaceOrUpdateNoLock(conn, ConnStatus(timestamp, added));
+    if (pending_size_ == 0) {
+      oldest_timestamp_ = timestamp;
+    }
+
+    // Same semantics as updating the tracker with each update in order: the
+    // most recent status wins, and the first one on ties.
+    ConnStatus status(timestamp, added);
+    if (last_ == nullptr || last_->first != conn) {
+      // Events tend to come in bursts on the same connection, which then
+      // does not need to be hashed again.
+      auto& pending = pending_[ConnectionTracker::ShardOf(Hash(conn))];
+      auto emplace_res = pending.emplace(conn, status);
+      last_ = &*emplace_res.first;
+      if (emplace_res.second) {
+        status = ConnStatus();
+        pending_size_++;
+      }
+    }
+    if (status.LastActiveTime() > last_->second.LastActiveTime()) {
+      last_->second = status;
+    }
+    pending_updates_++;
+
+    if (pending_size_ >= max_size_ || timestamp - oldest_timestamp_ >= max_delay_micros_) {
+      FlushNoLock();
+    }
   }
 }
 
+void ConnectionBatch::Flush() {
+  WITH_LOCK(mutex_) {
+    FlushNoLock();
+  }
+}
+
+void ConnectionBatch::FlushNoLock() {
+  tracker_->MergeBatch(&pending_, pending_updates_);
+  pending_size_ = 0;
+  pending_updates_ = 0;
+  last_ = nullptr;
+}
+
 void ConnectionTracker::Update(
     const std::vector<Connection>& all_conns,
     const std::vector<ContainerEndpoint>& all_listen_endpoints,
     int64_t timestamp) {
-  WITH_LOCK(mutex_) {
-    // Mark all existing connections and listen endpoints as inactive
-    for (auto& prev_conn : conn_state_) {
-      prev_conn.second.SetActive(false);
-    }
-    for (auto& prev_endpoint : endpoint_state_) {
+  // Pending updates happened before the scrape.
+  FlushBatches();
+
+  // Split the scrape by shard, hashing outside of the shard locks.
+  std::array<FlatHashSet<Connection>, kNumShards> conns_by_shard;
+  std::array<std::vector<const ContainerEndpoint*>, kNumShards> endpoints_by_shard;
+  for (const auto& curr_conn : all_conns) {
+    conns_by_shard[ShardOf(Hash(curr_conn))].insert(curr_conn);
+  }
+  for (const auto& curr_endpoint : all_listen_endpoints) {
+    endpoints_by_shard[ShardOf(Hash(curr_endpoint))].push_back(&curr_endpoint);
+  }
+
+  ConnStatus new_status(timestamp, true);
+
+  std::shared_lock config_lock(config_mutex_);
+  for (size_t i = 0; i < kNumShards; i++) {
+    Shard& shard = shards_[i];
+    ShardLock lock(&shard);
+
+    // Mark all existing listen endpoints as inactive
+    for (auto& prev_endpoint : shard.endpoint_state) {
       prev_endpoint.second.SetActive(false);
     }
 
-    ConnStatus new_status(timestamp, true);
+    // Mark existing connections as active if they were scraped, unless they were updated more recently, and as
+    // inactive otherwise. Only the connections whose activity changes are recorded as changed.
+    const auto& scraped = conns_by_shard[i];
+    for (auto& [conn, status] : shard.conn_state) {
+      if (new_status.LastActiveTime() > status.LastActiveTime() && scraped.find(conn) != scraped.end()) {
+        if (!status.IsActive()) {
+          shard.changed_conns.emplace(conn, false);
+        }
+        status = new_status;
+      } else if (status.IsActive()) {
+        shard.changed_conns.emplace(conn, true);
+        status.SetActive(false);
+      }
+    }
 
-    // Insert (or mark as active) all current connections and listen endpoints.
-    for (const auto& curr_conn : all_conns) {
-      EmplaceOrUpdateNoLock(curr_conn, new_status);
+    // Insert all new connections and listen endpoints (or mark the latter as active).
+    for (const auto& curr_conn : scraped) {
+      EmplaceOrUpdateNoLock(&shard, curr_conn, new_status);
     }
-    for (const auto& curr_endpoint : all_listen_endpoints) {
-      EmplaceOrUpdateNoLock(curr_endpoint, new_status);
+    for (const auto* curr_endpoint : endpoints_by_shard[i]) {
+      EmplaceOrUpdateNoLock(&shard, *curr_endpoint, new_status);
     }
   }
 }
 
-IPNet ConnectionTracker::NormalizeAddressNoLock(const Address& address, bool enable_external_ips) const {
+IPNet ConnectionTracker::NormalizeAddressNoLock(const Address& address, bool enable_external_ips, const NetworkConfig& networks) const {
   if (address.IsNull()) {
     return {};
   }
 
   bool private_addr = !address.IsPublic();
-  bool do_not_aggregate_addr = !non_aggregated_networks_.Find(address).IsNull();
+  bool do_not_aggregate_addr = !networks.non_aggregated_networks->Find(address).IsNull();
 
   // We want to keep private addresses and explicitely requested ones.
   bool keep_addr = private_addr || do_not_aggregate_addr;
 
-  const bool* known_private_networks_exists = Lookup(known_private_networks_exists_, address.family());
+  const bool* known_private_networks_exists = Lookup(networks.known_private_networks_exists, address.family());
   if (keep_addr && (known_private_networks_exists && !*known_private_networks_exists)) {
     return IPNet(address, 0, true);
   }
 
-  const auto& network = known_ip_networks_.Find(address);
-  if (keep_addr || Contains(known_public_ips_, address)) {
+  const auto& network = networks.known_ip_networks->Find(address);
+  if (keep_addr || Contains(*networks.known_public_ips, address)) {
     return IPNet(address, network.bits(), true);
   }
 
@@ -111,9 +277,49 @@ IPNet ConnectionTracker::NormalizeAddressNoLock(const Address& address, bool ena
   }
 }
 
+IPNet ConnectionTracker::NormalizeAddressNoLock(const Address& address, bool enable_external_ips, const NetworkConfig& networks, NormalizationCache* cache) const {
+  // Bounds the memory used by the cache of each shard, if remote addresses keep changing.
+  static constexpr size_t kMaxNormalizationCacheSize = 1 << 16;
+
+  if (cache->config_version != config_version_ || cache->networks_version != networks.version) {
+    for (auto& normalized : cache->networks) {
+      normalized.clear();
+    }
+    cache->config_version = config_version_;
+    cache->networks_version = networks.version;
+  }
+
+  auto& normalized = cache->networks[enable_external_ips];
+  auto it = normalized.find(address);
+  if (it != normalized.end()) {
+    cache->hits++;
+    return it->second;
+  }
+
+  cache->misses++;
+  if (normalized.size() >= kMaxNormalizationCacheSize) {
+    normalized.clear();
+  }
+  IPNet network = NormalizeAddressNoLock(address, enable_external_ips, networks);
+  normalized.emplace(address, network);
+  return network;
+}
+
+/* static */
+void ConnectionTracker::FlushNormalizationStats(NormalizationCache* cache) {
+  COUNTER_ADD(CollectorStats::net_normalize_cache_hits, cache->hits);
+  COUNTER_ADD(CollectorStats::net_normalize_cache_misses, cache->misses);
+  cache->hits = 0;
+  cache->misses = 0;
+}
+
 bool ConnectionTracker::ShouldNormalizeConnection(const Connection* conn) const {
+  return ShouldNormalizeConnection(conn, *Networks());
+}
+
+bool ConnectionTracker::ShouldNormalizeConnection(const Connection* conn, const NetworkConfig& networks) const {
   Endpoint remote = conn->remote();
-  IPNet ipnet = NormalizeAddressNoLock(remote.address(), false);
+  IPNet ipnet = NormalizeAddressNoLock(remote.address(), false, networks);
 
   return Address::IsCanonicalExternalIp(ipnet.address());
 }
@@ -129,7 +335,7 @@ void ConnectionTracker::CloseConnections(ConnMap* old_conn_state, ConnMap* delta
         old_conn.second.SetActive(false);
       }
       delta_conn->insert(old_conn);
-      it = old_conn_state->erase(it);
+      old_conn_state->erase(it++);
     } else {
       it++;
     }
@@ -140,13 +346,14 @@ void ConnectionTracker::CloseConnectionsOnExternalIPsConfigChange(ExternalIPsCon
   bool ingress = external_ips_config_.IsEnabled(ExternalIPsConfig::Direction::INGRESS);
   bool egress = external_ips_config_.IsEnabled(ExternalIPsConfig::Direction::EGRESS);
 
-  auto should_close = [this](const Connection* conn, bool enabling_extIPs) {
+  auto networks = Networks();
+  auto should_close = [this, &networks](const Connection* conn, bool enabling_extIPs) {
     if (enabling_extIPs) {
       // Enabling: Close connections previously normalized
       return Address::IsCanonicalExternalIp(conn->remote().address());
     } else {
       // Disabling: Close connections that should now be normalized
-      return !Address::IsCanonicalExternalIp(conn->remote().address()) && ShouldNormalizeConnection(conn);
+      return !Address::IsCanonicalExternalIp(conn->remote().address()) && ShouldNormalizeConnection(conn, *networks);
     }
   };
 
@@ -164,7 +371,7 @@ void ConnectionTracker::CloseConnectionsOnExternalIPsConfigChange(ExternalIPsCon
   }
 }
 
-Connection ConnectionTracker::NormalizeConnectionNoLock(const Connection& conn) const {
+Connection ConnectionTracker::NormalizeConnectionNoLock(const Connection& conn, const NetworkConfig& networks, NormalizationCache* cache) const {
   bool is_server = conn.is_server();
   if (conn.l4proto() == L4Proto::UDP) {
     // Inference of server role is unreliable for UDP, so go by port.
@@ -178,21 +385,21 @@ Connection ConnectionTracker::NormalizeConnectionNoLock(const Connection& conn)
   if (is_server) {
     // If this is the server, only the local port is relevant, while the remote port does not matter.
     local = Endpoint(IPNet(Address()), conn.local().port());
-    remote = Endpoint(NormalizeAddressNoLock(conn.remote().address(), extIPs_ingress), 0);
+    remote = Endpoint(NormalizeAddressNoLock(conn.remote().address(), extIPs_ingress, networks, cache), 0);
   } else {
     // If this is the client, the local port and address are not relevant.
     local = Endpoint();
-    remote = Endpoint(NormalizeAddressNoLock(remote.address(), extIPs_egress), remote.port());
+    remote = Endpoint(NormalizeAddressNoLock(remote.address(), extIPs_egress, networks, cache), remote.port());
   }
 
-  return Connection(conn.container(), local, remote, conn.l4proto(), is_server);
+  return Connection(conn.container_handle(), local, remote, conn.l4proto(), is_server);
 }
 
 namespace {
 
 /* return: true if the element has been added */
 template <typename T>
-bool EmplaceOrUpdate(UnorderedMap<T, ConnStatus>* m, const T& obj, ConnStatus status) {
+bool EmplaceOrUpdate(FlatHashMap<T, ConnStatus>* m, const T& obj, ConnStatus status) {
   auto emplace_res = m->emplace(obj, status);
   if (!emplace_res.second && status.LastActiveTime() > emplace_res.first->second.LastActiveTime()) {
     emplace_res.first->second = status;
@@ -202,16 +409,192 @@ bool EmplaceOrUpdate(UnorderedMap<T, ConnStatus>* m, const T& obj, ConnStatus st
 
 }  // namespace
 
-void ConnectionTracker::EmplaceOrUpdateNoLock(const Connection& conn, ConnStatus status) {
+void ConnectionTracker::EmplaceOrUpdateNoLock(Shard* shard, const Connection& conn, ConnStatus status) {
   COUNTER_INC(CollectorStats::net_conn_updates);
-  if (EmplaceOrUpdate(&conn_state_, conn, status)) {
-    IncrementConnectionStats(conn, inserted_connections_counters_);
+  EmplaceOrUpdateStateNoLock(shard, conn, status);
+}
+
+bool ConnectionTracker::EmplaceOrUpdateStateNoLock(Shard* shard, const Connection& conn, ConnStatus status, std::optional<StatsClass> cls) {
+  auto emplace_res = shard->conn_state.emplace(conn, status);
+  if (emplace_res.second) {
+    if (!cls) {
+      auto networks = Networks();
+      cls = ClassifyConnection(conn, *networks);
+      if (shard->stats_networks_version != networks->version) {
+        shard->stats_networks_version = 0;
+      }
+    }
+    if (auto* counter = StatsCounter(&shard->inserted_connections_counters, *cls)) {
+      (*counter)++;
+    }
+    if (auto* counter = StatsCounter(&shard->stored_connections, *cls)) {
+      (*counter)++;
+    }
+    shard->changed_conns.emplace(conn, false);
+    shard->conns_by_container[conn.container_handle()].emplace(conn, *cls);
+    EnforceConnectionLimitsNoLock(shard, conn.container_handle());
+    return true;
+  }
+
+  auto& state = emplace_res.first->second;
+  if (status.LastActiveTime() > state.LastActiveTime()) {
+    // Refreshing an active connection does not change what is reported.
+    if (!state.IsActive() || !status.IsActive()) {
+      shard->changed_conns.emplace(conn, state.IsActive());
+    }
+    state = status;
+  }
+  return false;
+}
+
+/* static */
+void ConnectionTracker::EraseConnNoLock(Shard* shard, ConnMap::iterator it) {
+  auto conns = shard->conns_by_container.find(it->first.container_handle());
+  auto entry = conns->second.find(it->first);
+  if (auto* counter = StatsCounter(&shard->stored_connections, entry->second)) {
+    (*counter)--;
+  }
+  conns->second.erase(entry);
+  if (conns->second.empty()) {
+    shard->conns_by_container.erase(conns);
+  }
+  shard->conn_state.erase(it);
+}
+
+/* static */
+void ConnectionTracker::PruneConnsByContainerNoLock(Shard* shard) {
+  for (auto conns = shard->conns_by_container.begin(); conns != shard->conns_by_container.end();) {
+    for (auto entry = conns->second.begin(); entry != conns->second.end();) {
+      if (shard->conn_state.find(entry->first) != shard->conn_state.end()) {
+        ++entry;
+        continue;
+      }
+      if (auto* counter = StatsCounter(&shard->stored_connections, entry->second)) {
+        (*counter)--;
+      }
+      conns->second.erase(entry++);
+    }
+    if (conns->second.empty()) {
+      shard->conns_by_container.erase(conns++);
+    } else {
+      ++conns;
+    }
+  }
+}
+
+/* static */
+void ConnectionTracker::IndexEndpointsByContainerNoLock(Shard* shard) {
+  shard->endpoints_by_container.clear();
+  for (const auto& [ep, status] : shard->endpoint_state) {
+    shard->endpoints_by_container[ep.container_handle()].insert(ep);
+  }
+}
+
+void ConnectionTracker::EnforceConnectionLimitsNoLock(Shard* shard, ContainerIDInterner::Handle container) {
+  // Connections are evicted in bulk, down to a fraction below the limit, so that finding the ones to evict is
+  // amortized over many insertions.
+  auto excess = [](size_t count, size_t limit) -> size_t {
+    return limit == 0 || count <= limit ? 0 : count - limit + limit / 16;
+  };
+
+  size_t per_container = excess(shard->conns_by_container[container].size(), max_conns_per_container_per_shard_);
+  if (per_container > 0) {
+    EvictConnsNoLock(shard, container, per_container);
+  }
+
+  size_t total = excess(shard->conn_state.size(), max_conns_per_shard_);
+  if (total > 0) {
+    EvictConnsNoLock(shard, std::nullopt, total);
+  }
+}
+
+void ConnectionTracker::EvictConnsNoLock(Shard* shard, std::optional<ContainerIDInterner::Handle> container, size_t count) {
+  struct Candidate {
+    bool active;
+    int64_t last_active_time;
+    const Connection* conn;
+
+    bool operator<(const Candidate& other) const {
+      return std::tie(active, last_active_time) < std::tie(other.active, other.last_active_time);
+    }
+  };
+
+  std::vector<Candidate> candidates;
+  if (container) {
+    for (const auto& [conn, cls] : shard->conns_by_container[*container]) {
+      const auto& status = shard->conn_state.find(conn)->second;
+      candidates.push_back({status.IsActive(), status.LastActiveTime(), &conn});
+    }
+  } else {
+    for (const auto& [conn, status] : shard->conn_state) {
+      candidates.push_back({status.IsActive(), status.LastActiveTime(), &conn});
+    }
+  }
+  count = std::min(count, candidates.size());
+  std::nth_element(candidates.begin(), candidates.begin() + count, candidates.end());
+
+  // Candidates point into the state, so the evicted connections are copied before erasing any.
+  std::vector<Connection> evicted;
+  evicted.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    evicted.push_back(*candidates[i].conn);
+  }
+  for (const auto& conn : evicted) {
+    auto it = shard->conn_state.find(conn);
+    // Evicted connections are reported as removed by the next delta, if they were active at the previous one. Others
+    // are forgotten right away, so that evicting keeps memory bounded between deltas too.
+    auto changed = shard->changed_conns.find(conn);
+    if (changed == shard->changed_conns.end()) {
+      if (it->second.IsActive()) {
+        shard->changed_conns.emplace(conn, true);
+      }
+    } else if (!changed->second) {
+      shard->changed_conns.erase(changed);
+    }
+    shard->evicted_conns[conn.container_handle()]++;
+    EraseConnNoLock(shard, it);
   }
+  COUNTER_ADD(CollectorStats::net_conn_evicted, count);
 }
 
-void ConnectionTracker::EmplaceOrUpdateNoLock(const ContainerEndpoint& ep, ConnStatus status) {
+/* static */
+std::pair<size_t, size_t> ConnectionTracker::PurgeContainerNoLock(Shard* shard, ContainerIDInterner::Handle container, int64_t timestamp) {
+  // Purged entries are only closed: the next fetch reports them as such, and removes them as any inactive entry.
+  auto close = [timestamp](ConnStatus* status) {
+    if (!status->IsActive()) {
+      return false;
+    }
+    *status = ConnStatus(std::max(timestamp, status->LastActiveTime()), false);
+    return true;
+  };
+
+  size_t conns = 0;
+  auto conns_it = shard->conns_by_container.find(container);
+  if (conns_it != shard->conns_by_container.end()) {
+    for (const auto& [conn, cls] : conns_it->second) {
+      if (close(&shard->conn_state.find(conn)->second)) {
+        shard->changed_conns.emplace(conn, true);
+        conns++;
+      }
+    }
+  }
+
+  size_t endpoints = 0;
+  auto endpoints_it = shard->endpoints_by_container.find(container);
+  if (endpoints_it != shard->endpoints_by_container.end()) {
+    for (const auto& ep : endpoints_it->second) {
+      endpoints += close(&shard->endpoint_state.find(ep)->second);
+    }
+  }
+
+  return {conns, endpoints};
+}
+
+void ConnectionTracker::EmplaceOrUpdateNoLock(Shard* shard, const ContainerEndpoint& ep, ConnStatus status) {
   COUNTER_INC(CollectorStats::net_cep_updates);
-  EmplaceOrUpdate(&endpoint_state_, ep, status);
+  if (EmplaceOrUpdate(&shard->endpoint_state, ep, status)) {
+    shard->endpoints_by_container[ep.container_handle()].insert(ep);
+  }
 }
 
 namespace {
@@ -231,12 +614,12 @@ struct dont_filter {
 };
 
 template <typename T, typename ProcessFn, typename FilterFn, typename E = std::equal_to<T>>
-UnorderedMap<T, ConnStatus, E> FetchState(UnorderedMap<T, ConnStatus>* state, bool clear_inactive,
+FlatHashMap<T, ConnStatus, E> FetchState(FlatHashMap<T, ConnStatus>* state, bool clear_inactive,
                                           const ProcessFn& process_fn, const FilterFn& filter_fn) {
   constexpr bool normalize = !std::is_same<ProcessFn, dont_normalize>::value;
   constexpr bool filter = !std::is_same<FilterFn, dont_filter>::value;
 
-  UnorderedMap<T, ConnStatus, E> fetched_state;
+  FlatHashMap<T, ConnStatus, E> fetched_state;
 
   for (auto it = state->begin(); it != state->end();) {
     const auto& entry = *it;
@@ -248,12 +631,17 @@ UnorderedMap<T, ConnStatus, E> FetchState(UnorderedMap<T, ConnStatus>* state, bo
           emplace_res.first->second.MergeFrom(entry.second);
         }
       } else {
-        fetched_state.insert(entry);
+        // Entries are distinct in the state, but may be equal in the fetched
+        // state if it uses another equality (e.g. AdvertisedEndpointEquality).
+        auto insert_res = fetched_state.insert(entry);
+        if (!insert_res.second) {
+          insert_res.first->second.MergeFrom(entry.second);
+        }
       }
     }
 
     if (clear_inactive && !entry.second.IsActive()) {
-      it = state->erase(it);
+      state->erase(it++);
     } else {
       ++it;
     }
@@ -262,118 +650,405 @@ UnorderedMap<T, ConnStatus, E> FetchState(UnorderedMap<T, ConnStatus>* state, bo
   return fetched_state;
 }
 
+// Merges the states fetched from each shard. The same normalized connection
+// can be fetched from several shards, in which case their statuses are merged.
+template <typename T, typename E, size_t N>
+FlatHashMap<T, ConnStatus, E> MergeShards(std::array<FlatHashMap<T, ConnStatus, E>, N>* fetched) {
+  auto merged = std::move((*fetched)[0]);
+  for (size_t i = 1; i < N; i++) {
+    auto& shard_state = (*fetched)[i];
+    merged.merge(shard_state);
+
+    // Only the entries already fetched from another shard are left.
+    for (const auto& [key, status] : shard_state) {
+      merged.find(key)->second.MergeFrom(status);
+    }
+  }
+  return merged;
+}
+
 }  // namespace
 
+ConnMap ConnectionTracker::FetchConnStateNoLock(ConnMap* state, bool normalize, bool clear_inactive, const NetworkConfig& networks, NormalizationCache* cache) const {
+  if (HasConnectionFilters(networks)) {
+    if (normalize) {
+      return FetchState(
+          state, clear_inactive,
+          [this, &networks, cache](const Connection& conn) { return this->NormalizeConnectionNoLock(conn, networks, cache); },
+          [this, &networks](const Connection& conn) { return this->ShouldFetchConnection(conn, networks); });
+    } else {
+      return FetchState(state, clear_inactive, dont_normalize(),
+                        [this, &networks](const Connection& conn) { return this->ShouldFetchConnection(conn, networks); });
+    }
+  } else {
+    if (normalize) {
+      return FetchState(
+          state, clear_inactive,
+          [this, &networks, cache](const Connection& conn) { return this->NormalizeConnectionNoLock(conn, networks, cache); },
+          dont_filter());
+    } else {
+      return FetchState(state, clear_inactive, dont_normalize(), dont_filter());
+    }
+  }
+}
+
+AdvertisedEndpointMap ConnectionTracker::FetchEndpointStateNoLock(ContainerEndpointMap* state, bool normalize, bool clear_inactive) const {
+  // Listen endpoints are only filtered by port.
+  if (!ignored_l4proto_port_pairs_.empty()) {
+    if (normalize) {
+      return FetchState<ContainerEndpoint, std::function<ContainerEndpoint(const ContainerEndpoint&)>, std::function<bool(const ContainerEndpoint&)>, AdvertisedEndpointEquality>(
+          state, clear_inactive,
+          [this](const ContainerEndpoint& cep) { return this->NormalizeContainerEndpoint(cep); },
+          [this](const ContainerEndpoint& cep) { return this->ShouldFetchContainerEndpoint(cep); });
+    } else {
+      return FetchState<ContainerEndpoint, dont_normalize, std::function<bool(const ContainerEndpoint&)>, AdvertisedEndpointEquality>(
+          state, clear_inactive,
+          dont_normalize(),
+          [this](const ContainerEndpoint& cep) { return this->ShouldFetchContainerEndpoint(cep); });
+    }
+  } else {
+    if (normalize) {
+      return FetchState<ContainerEndpoint, std::function<ContainerEndpoint(const ContainerEndpoint&)>, dont_filter, AdvertisedEndpointEquality>(
+          state, clear_inactive,
+          [this](const ContainerEndpoint& cep) { return this->NormalizeContainerEndpoint(cep); },
+          dont_filter());
+    } else {
+      return FetchState<ContainerEndpoint, dont_normalize, dont_filter, AdvertisedEndpointEquality>(
+          state, clear_inactive,
+          dont_normalize(),
+          dont_filter());
+    }
+  }
+}
+
 ConnMap ConnectionTracker::FetchConnState(bool normalize, bool clear_inactive) {
-  ConnMap cm;
-  size_t state_size;
-  WITH_LOCK(mutex_) {
-    state_size = conn_state_.size();
-    if (HasConnectionFilters()) {
-      if (normalize) {
-        cm = FetchState(
-            &conn_state_, clear_inactive,
-            [this](const Connection& conn) { return this->NormalizeConnectionNoLock(conn); },
-            [this](const Connection& conn) { return this->ShouldFetchConnection(conn); });
+  FlushBatches();
+
+  std::array<ConnMap, kNumShards> fetched;
+  std::atomic<size_t> inactive = 0;
+  std::shared_lock config_lock(config_mutex_);
+  auto networks = Networks();
+  ForEachShard([&](size_t i) {
+    Shard& shard = shards_[i];
+    std::lock_guard<std::mutex> cache_lock(shard.normalization_cache.mutex);
+    ShardLock lock(&shard);
+    size_t state_size = shard.conn_state.size();
+    fetched[i] = FetchConnStateNoLock(&shard.conn_state, normalize, clear_inactive, *networks, &shard.normalization_cache);
+    if (shard.conn_state.size() != state_size) {
+      PruneConnsByContainerNoLock(&shard);
+    }
+    if (clear_inactive) {
+      // Only used by FetchConnDelta, which is not to be mixed with clearing the state here.
+      shard.changed_conns.clear();
+    }
+    inactive += state_size - shard.conn_state.size();
+    FlushNormalizationStats(&shard.normalization_cache);
+  });
+  COUNTER_ADD(CollectorStats::net_conn_inactive, inactive.load());
+
+  return MergeShards(&fetched);
+}
+
+ConnMap ConnectionTracker::FetchConnDelta(int64_t time_micros, int64_t time_at_last_scrape, bool afterglow, int64_t afterglow_period_micros) {
+  FlushBatches();
+
+  std::shared_lock config_lock(config_mutex_);
+  std::lock_guard<std::mutex> reported_lock(reported_mutex_);
+
+  // Normalized connections are only recomputed for the connections that changed, which requires the normalization
+  // to be the same as for the previous delta. Otherwise, all connections are recomputed.
+  auto networks = Networks();
+  bool recompute_all = reported_config_version_ != config_version_ || reported_networks_version_ != networks->version;
+
+  struct Change {
+    Connection conn;
+    bool was_active;
+    // Whether the connection is still in the state, with the given status.
+    bool in_state;
+    ConnStatus status;
+  };
+  std::array<std::vector<Change>, kNumShards> changes;
+  std::atomic<size_t> inactive = 0;
+  ForEachShard([&](size_t i) {
+    Shard& shard = shards_[i];
+    std::vector<Change> raw_changes;
+    {
+      ShardLock lock(&shard);
+      size_t state_size = shard.conn_state.size();
+      if (recompute_all) {
+        for (auto it = shard.conn_state.begin(); it != shard.conn_state.end();) {
+          raw_changes.push_back({it->first, false, true, it->second});
+          if (!it->second.IsActive()) {
+            EraseConnNoLock(&shard, it++);
+          } else {
+            ++it;
+          }
+        }
       } else {
-        cm = FetchState(&conn_state_, clear_inactive, dont_normalize(),
-                        [this](const Connection& conn) { return this->ShouldFetchConnection(conn); });
+        for (const auto& [conn, was_active] : shard.changed_conns) {
+          auto it = shard.conn_state.find(conn);
+          if (it == shard.conn_state.end()) {
+            // Removed by FetchConnState.
+            raw_changes.push_back({conn, was_active, false, ConnStatus()});
+            continue;
+          }
+          if (was_active && it->second.IsActive()) {
+            continue;
+          }
+          raw_changes.push_back({conn, was_active, true, it->second});
+          if (!it->second.IsActive()) {
+            EraseConnNoLock(&shard, it);
+          }
+        }
       }
-    } else {
-      if (normalize) {
-        cm = FetchState(
-            &conn_state_, clear_inactive,
-            [this](const Connection& conn) { return this->NormalizeConnectionNoLock(conn); },
-            dont_filter());
+      shard.changed_conns.clear();
+      inactive += state_size - shard.conn_state.size();
+    }
+
+    // Normalization does not need the shard lock.
+    std::lock_guard<std::mutex> cache_lock(shard.normalization_cache.mutex);
+    for (auto& change : raw_changes) {
+      if (HasConnectionFilters(*networks) && !ShouldFetchConnection(change.conn, *networks)) {
+        continue;
+      }
+      change.conn = NormalizeConnectionNoLock(change.conn, *networks, &shard.normalization_cache);
+      changes[i].push_back(change);
+    }
+    FlushNormalizationStats(&shard.normalization_cache);
+  });
+  COUNTER_ADD(CollectorStats::net_conn_inactive, inactive.load());
+
+  // Apply the changes to the normalized connections, and collect those to visit.
+  std::vector<Connection> pending;
+  auto visit = [&pending](const Connection& conn, ReportedConn* reported) {
+    if (!reported->pending) {
+      reported->pending = true;
+      pending.push_back(conn);
+    }
+  };
+  if (recompute_all) {
+    for (auto& [conn, reported] : reported_conns_) {
+      reported.active = 0;
+      visit(conn, &reported);
+    }
+  }
+  for (const auto& shard_changes : changes) {
+    for (const auto& change : shard_changes) {
+      auto& reported = reported_conns_[change.conn];
+      visit(change.conn, &reported);
+      if (change.was_active) {
+        reported.active--;
+      }
+      if (!change.in_state) {
+        continue;
+      }
+      if (change.status.IsActive()) {
+        reported.active++;
+      } else if (reported.has_closed) {
+        reported.closed.MergeFrom(change.status);
       } else {
-        cm = FetchState(&conn_state_, clear_inactive, dont_normalize(), dont_filter());
+        reported.closed = change.status;
+        reported.has_closed = true;
       }
     }
-    COUNTER_ADD(CollectorStats::net_conn_inactive, (state_size - conn_state_.size()));
   }
-  return cm;
-}
+  // Reported connections with no active connection left only change when their afterglow ends, or when the afterglow
+  // settings change.
+  auto visit_closing = [this, &visit](const Connection& conn) { visit(conn, &reported_conns_.find(conn)->second); };
+  if (afterglow != reported_afterglow_ || afterglow_period_micros != reported_afterglow_period_micros_) {
+    closing_conns_.Drain(visit_closing);
+  } else {
+    closing_conns_.Advance(time_micros, visit_closing);
+  }
 
-AdvertisedEndpointMap ConnectionTracker::FetchEndpointState(bool normalize, bool clear_inactive) {
-  AdvertisedEndpointMap cem;
-  size_t state_size;
-  WITH_LOCK(mutex_) {
-    state_size = conn_state_.size();
-    if (HasConnectionFilters()) {
-      if (normalize) {
-        cem = FetchState<ContainerEndpoint, std::function<ContainerEndpoint(const ContainerEndpoint&)>, std::function<bool(const ContainerEndpoint&)>, AdvertisedEndpointEquality>(
-            &endpoint_state_, clear_inactive,
-            [this](const ContainerEndpoint& cep) { return this->NormalizeContainerEndpoint(cep); },
-            [this](const ContainerEndpoint& cep) { return this->ShouldFetchContainerEndpoint(cep); });
-      } else {
-        cem = FetchState<ContainerEndpoint, dont_normalize, std::function<bool(const ContainerEndpoint&)>, AdvertisedEndpointEquality>(
-            &endpoint_state_, clear_inactive,
-            dont_normalize(),
-            [this](const ContainerEndpoint& cep) { return this->ShouldFetchContainerEndpoint(cep); });
+  // Connections whose representation is affected by a change of the External-IPs config are reported as closed.
+  ConnMap closed_by_config;
+  if (afterglow && recompute_all && reported_external_ips_config_.GetDirection() != external_ips_config_.GetDirection()) {
+    ConnMap reported_state;
+    for (const auto& [conn, reported] : reported_conns_) {
+      if (reported.reported) {
+        reported_state.emplace(conn, reported.last);
+      }
+    }
+    CloseConnectionsOnExternalIPsConfigChange(reported_external_ips_config_, &reported_state, &closed_by_config);
+  }
+
+  // Same as ComputeDelta(Afterglow) followed by UpdateOldState, for the visited connections only. Other reported
+  // connections are active, and stay so.
+  ConnMap delta;
+  for (const auto& conn : pending) {
+    auto it = reported_conns_.find(conn);
+    auto& reported = it->second;
+
+    bool present = reported.active > 0 || reported.has_closed;
+    // The time at which active connections were last seen is not reported.
+    ConnStatus status = reported.active > 0 ? ConnStatus(time_micros, true) : reported.closed;
+
+    if (afterglow) {
+      if (present) {
+        std::pair<const Connection, ConnStatus> new_conn(conn, status);
+        if (reported.reported) {
+          ComputeDeltaForAConnectionInOldAndNewStates(new_conn, reported.last, delta, time_micros, time_at_last_scrape, afterglow_period_micros);
+        } else {
+          ComputeDeltaForAConnectionInNewState(new_conn, delta, time_micros, afterglow_period_micros);
+        }
+      } else if (reported.reported && reported.last.WasRecentlyActive(time_at_last_scrape, afterglow_period_micros) &&
+                 !reported.last.IsInAfterglowPeriod(time_micros, afterglow_period_micros)) {
+        delta.emplace(conn, ConnStatus(reported.last.LastActiveTime(), false));
       }
     } else {
-      if (normalize) {
-        cem = FetchState<ContainerEndpoint, std::function<ContainerEndpoint(const ContainerEndpoint&)>, dont_filter, AdvertisedEndpointEquality>(
-            &endpoint_state_, clear_inactive,
-            [this](const ContainerEndpoint& cep) { return this->NormalizeContainerEndpoint(cep); },
-            dont_filter());
-      } else {
-        cem = FetchState<ContainerEndpoint, dont_normalize, dont_filter, AdvertisedEndpointEquality>(
-            &endpoint_state_, clear_inactive,
-            dont_normalize(),
-            dont_filter());
+      if (present) {
+        if (!reported.reported || status.IsActive() != reported.last.IsActive() ||
+            (!status.IsActive() && reported.last.LastActiveTime() < status.LastActiveTime())) {
+          delta.emplace(conn, status);
+        }
+      } else if (reported.reported && reported.last.IsActive()) {
+        delta.emplace(conn, reported.last.WithStatus(false));
       }
     }
-    COUNTER_ADD(CollectorStats::net_cep_inactive, (state_size - endpoint_state_.size()));
+
+    if (present) {
+      reported.last = status;
+      reported.reported = true;
+    } else if (!afterglow || !reported.last.IsInAfterglowPeriod(time_micros, afterglow_period_micros) ||
+               closed_by_config.find(conn) != closed_by_config.end()) {
+      reported.reported = false;
+    }
+    reported.has_closed = false;
+    reported.pending = false;
+
+    if (reported.active > 0) {
+      closing_conns_.Cancel(conn);
+    } else if (reported.reported) {
+      // Without afterglow, the connection is forgotten by the next delta.
+      closing_conns_.Schedule(conn, afterglow ? reported.last.LastActiveTime() + afterglow_period_micros : time_micros);
+    } else {
+      closing_conns_.Cancel(conn);
+      reported_conns_.erase(it);
+    }
   }
-  return cem;
+
+  for (const auto& entry : closed_by_config) {
+    delta.insert(entry);
+  }
+
+  reported_config_version_ = config_version_;
+  reported_networks_version_ = networks->version;
+  reported_external_ips_config_ = external_ips_config_;
+  reported_afterglow_ = afterglow;
+  reported_afterglow_period_micros_ = afterglow_period_micros;
+
+  return delta;
 }
 
-void ConnectionTracker::UpdateKnownPublicIPs(collector::UnorderedSet<collector::Address>&& known_public_ips) {
-  COUNTER_SET(CollectorStats::net_known_public_ips, known_public_ips.size());
-  WITH_LOCK(mutex_) {
-    known_public_ips_ = std::move(known_public_ips);
-    if (CLOG_ENABLED(DEBUG)) {
-      CLOG(DEBUG) << "known public ips:";
-      for (const auto& public_ip : known_public_ips_) {
-        CLOG(DEBUG) << " - " << public_ip;
-      }
+void ConnectionTracker::ResetConnDelta() {
+  WITH_LOCK(reported_mutex_) {
+    reported_conns_.clear();
+    closing_conns_.Clear();
+    reported_config_version_ = 0;
+    reported_networks_version_ = 0;
+  }
+}
+
+AdvertisedEndpointMap ConnectionTracker::FetchEndpointState(bool normalize, bool clear_inactive) {
+  std::array<AdvertisedEndpointMap, kNumShards> fetched;
+  std::atomic<size_t> inactive = 0;
+  std::shared_lock config_lock(config_mutex_);
+  ForEachShard([&](size_t i) {
+    Shard& shard = shards_[i];
+    ShardLock lock(&shard);
+    size_t state_size = shard.endpoint_state.size();
+    fetched[i] = FetchEndpointStateNoLock(&shard.endpoint_state, normalize, clear_inactive);
+    if (shard.endpoint_state.size() != state_size) {
+      IndexEndpointsByContainerNoLock(&shard);
     }
+    inactive += state_size - shard.endpoint_state.size();
+  });
+  COUNTER_ADD(CollectorStats::net_cep_inactive, inactive.load());
+
+  return MergeShards(&fetched);
+}
+
+void ConnectionTracker::UpdateNetworks(const std::function<bool(NetworkConfig*)>& update) {
+  std::lock_guard<std::mutex> lock(networks_update_mutex_);
+  // Copies the pointers to the current sets and trees, not their content.
+  auto networks = std::make_shared<NetworkConfig>(*Networks());
+  if (!update(networks.get())) {
+    return;
   }
+  networks->version++;
+  std::atomic_store(&networks_, std::shared_ptr<const NetworkConfig>(std::move(networks)));
 }
 
-void ConnectionTracker::UpdateKnownIPNetworks(UnorderedMap<Address::Family, std::vector<IPNet>>&& known_ip_networks) {
-  NRadixTree tree;
-  for (const auto& network_pair : known_ip_networks) {
-    for (const auto& network : network_pair.second) {
-      if (!tree.Insert(network)) {
-        // Log error and continue inserting rest of networks.
-        CLOG(ERROR) << "Failed to insert CIDR " << network << " in network tree";
-      }
+namespace {
+
+// Returns `current` if it holds exactly the given networks, or a new tree built from them otherwise.
+std::shared_ptr<const NRadixTree> UpdatedNetworkTree(const std::shared_ptr<const NRadixTree>& current, const std::vector<IPNet>& network_list) {
+  UnorderedSet<IPNet> networks(network_list.begin(), network_list.end());
+  auto stored = current->GetAll();
+  bool unchanged = stored.size() == networks.size() &&
+                   std::all_of(stored.begin(), stored.end(), [&networks](const IPNet& network) { return networks.count(network) > 0; });
+  return unchanged ? current : std::make_shared<const NRadixTree>(network_list);
+}
+
+}  // namespace
+
+void ConnectionTracker::UpdateKnownPublicIPs(collector::UnorderedSet<collector::Address>&& known_public_ips) {
+  COUNTER_SET(CollectorStats::net_known_public_ips, known_public_ips.size());
+  UpdateNetworks([&known_public_ips](NetworkConfig* networks) {
+    const auto& current = *networks->known_public_ips;
+    bool unchanged = current.size() == known_public_ips.size() &&
+                     std::all_of(current.begin(), current.end(), [&known_public_ips](const Address& ip) { return known_public_ips.count(ip) > 0; });
+    if (unchanged) {
+      return false;
+    }
+    networks->known_public_ips = std::make_shared<const FlatHashSet<Address>>(known_public_ips.begin(), known_public_ips.end());
+    return true;
+  });
+
+  if (CLOG_ENABLED(DEBUG)) {
+    CLOG(DEBUG) << "known public ips:";
+    for (const auto& public_ip : known_public_ips) {
+      CLOG(DEBUG) << " - " << public_ip;
     }
   }
+}
 
-  UnorderedMap<Address::Family, bool> known_private_networks_exists;
+void ConnectionTracker::UpdateKnownIPNetworks(UnorderedMap<Address::Family, std::vector<IPNet>>&& known_ip_networks) {
+  std::vector<IPNet> network_list;
   COUNTER_ZERO(CollectorStats::net_known_ip_networks);
   for (const auto& network_pair : known_ip_networks) {
     COUNTER_ADD(CollectorStats::net_known_ip_networks, network_pair.second.size());
-    known_private_networks_exists[network_pair.first] = ContainsPrivateNetwork(network_pair.first, tree);
+    network_list.insert(network_list.end(), network_pair.second.begin(), network_pair.second.end());
   }
 
-  WITH_LOCK(mutex_) {
-    known_ip_networks_ = tree;
-    known_private_networks_exists_ = std::move(known_private_networks_exists);
-    if (CLOG_ENABLED(DEBUG)) {
-      CLOG(DEBUG) << "known ip networks:";
-      for (auto network : known_ip_networks_.GetAll()) {
-        CLOG(DEBUG) << " - " << network;
-      }
+  // The tree is only rebuilt if the networks differ from the current ones. Sensor sends the whole list on every
+  // update, which most of the time is the same, and then neither the tree nor the normalized connections change.
+  UpdateNetworks([&](NetworkConfig* networks) {
+    auto tree = UpdatedNetworkTree(networks->known_ip_networks, network_list);
+    UnorderedMap<Address::Family, bool> known_private_networks_exists;
+    for (const auto& network_pair : known_ip_networks) {
+      known_private_networks_exists[network_pair.first] = ContainsPrivateNetwork(network_pair.first, *tree);
+    }
+    if (tree == networks->known_ip_networks && known_private_networks_exists == networks->known_private_networks_exists) {
+      return false;
+    }
+    networks->known_ip_networks = std::move(tree);
+    networks->known_private_networks_exists = std::move(known_private_networks_exists);
+    return true;
+  });
+
+  if (CLOG_ENABLED(DEBUG)) {
+    CLOG(DEBUG) << "known ip networks:";
+    for (const auto& network : network_list) {
+      CLOG(DEBUG) << " - " << network;
     }
   }
 }
 
 void ConnectionTracker::UpdateIgnoredL4ProtoPortPairs(UnorderedSet<L4ProtoPortPair>&& ignored_l4proto_port_pairs) {
-  WITH_LOCK(mutex_) {
+  WITH_LOCK(config_mutex_) {
+    config_version_++;
     ignored_l4proto_port_pairs_ = std::move(ignored_l4proto_port_pairs);
     if (CLOG_ENABLED(DEBUG)) {
       CLOG(DEBUG) << "ignored l4 protocol and port pairs";
@@ -385,30 +1060,165 @@ void ConnectionTracker::UpdateIgnoredL4ProtoPortPairs(UnorderedSet<L4ProtoPortPa
 }
 
 void ConnectionTracker::UpdateIgnoredNetworks(const std::vector<IPNet>& network_list) {
-  WITH_LOCK(mutex_) {
-    ignored_networks_ = NRadixTree(network_list);
-  }
+  UpdateNetworks([&network_list](NetworkConfig* networks) {
+    auto tree = UpdatedNetworkTree(networks->ignored_networks, network_list);
+    if (tree == networks->ignored_networks) {
+      return false;
+    }
+    networks->ignored_networks = std::move(tree);
+    return true;
+  });
 }
 
 void ConnectionTracker::UpdateNonAggregatedNetworks(const std::vector<IPNet>& network_list) {
-  WITH_LOCK(mutex_) {
-    non_aggregated_networks_ = NRadixTree(network_list);
+  UpdateNetworks([&network_list](NetworkConfig* networks) {
+    auto tree = UpdatedNetworkTree(networks->non_aggregated_networks, network_list);
+    if (tree == networks->non_aggregated_networks) {
+      return false;
+    }
+    networks->non_aggregated_networks = std::move(tree);
+    return true;
+  });
+}
+
+void ConnectionTracker::SetConnectionLimits(size_t max_per_container, size_t max_total) {
+  auto per_shard = [](size_t limit) -> size_t { return limit == 0 ? 0 : (limit + kNumShards - 1) / kNumShards; };
+  WITH_LOCK(config_mutex_) {
+    max_conns_per_container_per_shard_ = per_shard(max_per_container);
+    max_conns_per_shard_ = per_shard(max_total);
+  }
+}
+
+UnorderedMap<std::string, uint64_t> ConnectionTracker::ConsumeEvictedConnections() {
+  UnorderedMap<std::string, uint64_t> evicted;
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    for (const auto& [container, count] : shard.evicted_conns) {
+      evicted[ContainerIDInterner::Instance().Lookup(container)] += count;
+    }
+    shard.evicted_conns.clear();
+  }
+  return evicted;
+}
+
+size_t ConnectionTracker::PurgeContainer(ContainerIDInterner::Handle container, int64_t timestamp) {
+  // Pending updates may belong to the container.
+  FlushBatches();
+
+  size_t conns = 0, endpoints = 0;
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    auto purged = PurgeContainerNoLock(&shard, container, timestamp);
+    conns += purged.first;
+    endpoints += purged.second;
   }
+  COUNTER_ADD(CollectorStats::net_conn_purged, conns);
+  COUNTER_ADD(CollectorStats::net_cep_purged, endpoints);
+  return conns + endpoints;
 }
 
-// Increment the stat counter matching the connection's characteristics
-inline void ConnectionTracker::IncrementConnectionStats(Connection conn, ConnectionTracker::Stats& stats) const {
-  auto& direction = conn.is_server() ? stats.inbound : stats.outbound;
+size_t ConnectionTracker::PurgeContainersExcept(const UnorderedSet<std::string>& container_ids, int64_t timestamp) {
+  FlushBatches();
 
-  if (!ShouldFetchConnection(conn)) {
+  // Whether each container seen so far is to be purged, as most containers have entries in several shards.
+  FlatHashMap<ContainerIDInterner::Handle, bool> purged_containers;
+  auto is_purged = [&](ContainerIDInterner::Handle container) {
+    auto emplace_res = purged_containers.emplace(container, false);
+    if (emplace_res.second) {
+      emplace_res.first->second = !Contains(container_ids, ContainerIDInterner::Instance().Lookup(container));
+    }
+    return emplace_res.first->second;
+  };
+
+  size_t conns = 0, endpoints = 0;
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    std::vector<ContainerIDInterner::Handle> containers;
+    for (const auto& entry : shard.conns_by_container) {
+      if (is_purged(entry.first)) {
+        containers.push_back(entry.first);
+      }
+    }
+    for (const auto& entry : shard.endpoints_by_container) {
+      if (is_purged(entry.first) && !Contains(shard.conns_by_container, entry.first)) {
+        containers.push_back(entry.first);
+      }
+    }
+    for (auto container : containers) {
+      auto purged = PurgeContainerNoLock(&shard, container, timestamp);
+      conns += purged.first;
+      endpoints += purged.second;
+    }
+  }
+  COUNTER_ADD(CollectorStats::net_conn_purged, conns);
+  COUNTER_ADD(CollectorStats::net_cep_purged, endpoints);
+
+  SweepContainerIDs();
+  return conns + endpoints;
+}
+
+void ConnectionTracker::SweepContainerIDs() {
+  FlatHashSet<ContainerIDInterner::Handle> live;
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    for (const auto& entry : shard.conns_by_container) {
+      live.insert(entry.first);
+    }
+    for (const auto& entry : shard.changed_conns) {
+      live.insert(entry.first.container_handle());
+    }
+    for (const auto& entry : shard.evicted_conns) {
+      live.insert(entry.first);
+    }
+    for (const auto& entry : shard.endpoints_by_container) {
+      live.insert(entry.first);
+    }
+  }
+  // Closed connections remain in the reported state during their afterglow.
+  WITH_LOCK(reported_mutex_) {
+    for (const auto& entry : reported_conns_) {
+      live.insert(entry.first.container_handle());
+    }
+  }
+  ContainerIDInterner::Instance().Sweep(live);
+}
+
+void ConnectionTracker::SetExternalIPsConfig(ExternalIPsConfig config) {
+  WITH_LOCK(config_mutex_) {
+    if (config.GetDirection() != external_ips_config_.GetDirection()) {
+      config_version_++;
+      external_ips_config_ = config;
+    }
+  }
+}
+
+// Determine the stat counter matching the connection's characteristics
+ConnectionTracker::StatsClass ConnectionTracker::ClassifyConnection(const Connection& conn, const NetworkConfig& networks) const {
+  if (!ShouldFetchConnection(conn, networks)) {
     // This connection will not be sent, so don't count it.
-    return;
+    return StatsClass::IGNORED;
   }
 
-  if (conn.remote().address().IsPublic()) {
-    direction.public_++;
-  } else {
-    direction.private_++;
+  bool is_public = conn.remote().address().IsPublic();
+  if (conn.is_server()) {
+    return is_public ? StatsClass::INBOUND_PUBLIC : StatsClass::INBOUND_PRIVATE;
+  }
+  return is_public ? StatsClass::OUTBOUND_PUBLIC : StatsClass::OUTBOUND_PRIVATE;
+}
+
+/* static */
+unsigned int* ConnectionTracker::StatsCounter(Stats* stats, StatsClass cls) {
+  switch (cls) {
+    case StatsClass::INBOUND_PUBLIC:
+      return &stats->inbound.public_;
+    case StatsClass::INBOUND_PRIVATE:
+      return &stats->inbound.private_;
+    case StatsClass::OUTBOUND_PUBLIC:
+      return &stats->outbound.public_;
+    case StatsClass::OUTBOUND_PRIVATE:
+      return &stats->outbound.private_;
+    default:
+      return nullptr;
   }
 }
 
@@ -416,10 +1226,30 @@ inline void ConnectionTracker::IncrementConnectionStats(Connection conn, Connect
 ConnectionTracker::Stats ConnectionTracker::GetConnectionStats_StoredConnections() {
   ConnectionTracker::Stats stats = {};
 
-  WITH_LOCK(mutex_) {
-    for (auto& conn : conn_state_) {
-      IncrementConnectionStats(conn.first, stats);
+  std::shared_lock config_lock(config_mutex_);
+  auto networks = Networks();
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    if (shard.stats_config_version != config_version_ || shard.stats_networks_version != networks->version) {
+      // Connections filtered out, and thus not counted, may have changed.
+      shard.stored_connections = {};
+      for (auto& [container, conns] : shard.conns_by_container) {
+        for (auto& [conn, cls] : conns) {
+          cls = ClassifyConnection(conn, *networks);
+          if (auto* counter = StatsCounter(&shard.stored_connections, cls)) {
+            (*counter)++;
+          }
+        }
+      }
+      shard.stats_config_version = config_version_;
+      shard.stats_networks_version = networks->version;
     }
+
+    const auto& counters = shard.stored_connections;
+    stats.inbound.public_ += counters.inbound.public_;
+    stats.inbound.private_ += counters.inbound.private_;
+    stats.outbound.public_ += counters.outbound.public_;
+    stats.outbound.private_ += counters.outbound.private_;
   }
 
   return stats;
@@ -427,10 +1257,15 @@ ConnectionTracker::Stats ConnectionTracker::GetConnectionStats_StoredConnections
 
 // Retrieve the value of the ever-increasing counters of new connection insertion, indexed by in/out and public/private nature.
 ConnectionTracker::Stats ConnectionTracker::GetConnectionStats_NewConnectionCounters() {
-  ConnectionTracker::Stats stats;
+  ConnectionTracker::Stats stats = {};
 
-  WITH_LOCK(mutex_) {
-    stats = inserted_connections_counters_;
+  for (auto& shard : shards_) {
+    ShardLock lock(&shard);
+    const auto& counters = shard.inserted_connections_counters;
+    stats.inbound.public_ += counters.inbound.public_;
+    stats.inbound.private_ += counters.inbound.private_;
+    stats.outbound.public_ += counters.outbound.public_;
+    stats.outbound.private_ += counters.outbound.private_;
   }
   return stats;
 }
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
 #include <vector>
 
+#include "ContainerIDInterner.h"
 #include "Containers.h"
 #include "ExternalIPsConfig.h"
 #include "Hash.h"
 #include "NRadix.h"
 #include "NetworkConnection.h"
+#include "TimerWheel.h"
 
 namespace collector {
 
@@ -76,15 +85,100 @@ class AdvertisedEndpointEquality {
   bool operator()(const ContainerEndpoint& lhs, const ContainerEndpoint& rhs) const;
 };
 
-using ConnMap = UnorderedMap<Connection, ConnStatus>;
-using ContainerEndpointMap = UnorderedMap<ContainerEndpoint, ConnStatus>;
-using AdvertisedEndpointMap = UnorderedMap<ContainerEndpoint, ConnStatus, AdvertisedEndpointEquality>;
+using ConnMap = FlatHashMap<Connection, ConnStatus>;
+using ContainerEndpointMap = FlatHashMap<ContainerEndpoint, ConnStatus>;
+using AdvertisedEndpointMap = FlatHashMap<ContainerEndpoint, ConnStatus, AdvertisedEndpointEquality>;
 
 class CollectorStats;
+class ConnectionTracker;
+
+// LockTimeHistogram is the distribution of the durations a lock was waited
+// for, or held, in power-of-two buckets of microseconds: bucket i counts the
+// durations shorter than 2^i us, except for the last one which is unbounded.
+//
+// It is only written while holding the lock it measures, so there is a
+// single writer at a time, and can be read from any thread.
+class LockTimeHistogram {
+ public:
+  static constexpr size_t kNumBuckets = 16;
+
+  void Record(uint64_t micros) {
+    size_t bucket = micros == 0 ? 0 : std::min<size_t>(64 - __builtin_clzll(micros), kNumBuckets - 1);
+    Add(&counts_[bucket], 1);
+    Add(&sum_micros_, micros);
+  }
+
+  uint64_t Count(size_t bucket) const { return counts_[bucket].load(std::memory_order_relaxed); }
+  uint64_t SumMicros() const { return sum_micros_.load(std::memory_order_relaxed); }
 
+  // Upper bounds of all buckets but the last, in microseconds.
+  static std::vector<double> BucketBoundaries();
+
+ private:
+  static void Add(std::atomic<uint64_t>* value, uint64_t n) {
+    value->store(value->load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, kNumBuckets> counts_ = {{}};
+  std::atomic<uint64_t> sum_micros_ = 0;
+};
+
+// ConnectionBatch buffers the connection updates of one producer (e.g. the
+// thread handling network events), and merges them into the tracker in bulk,
+// under a single acquisition of the tracker lock.
+//
+// Repeated updates of the same connection are coalesced in the batch, and
+// hashing happens when adding them, outside of the tracker lock. Pending
+// connections are kept per tracker shard, each merged under the lock of its
+// shard only. The batch is merged when it holds max_size connections, or
+// when an update comes in max_delay_micros after the oldest pending one. The
+// tracker also merges all pending batches before fetching its state, so the
+// batching is invisible to consumers of the tracker.
+class ConnectionBatch {
+ public:
+  void Add(const Connection& conn, int64_t timestamp, bool added);
+  void Flush();
+
+ private:
+  friend class ConnectionTracker;
+
+  ConnectionBatch(ConnectionTracker* tracker, size_t max_size, int64_t max_delay_micros);
+
+  void FlushNoLock();
+
+  ConnectionTracker* tracker_;
+  size_t max_size_;
+  int64_t max_delay_micros_;
+
+  // Only contended while the tracker is merging the batch. Always acquired
+  // before the tracker locks.
+  std::mutex mutex_;
+  // Pending connections, by tracker shard.
+  std::vector<ConnMap> pending_;
+  // Entry of the connection last added, stable until the batch is merged.
+  ConnMap::value_type* last_ = nullptr;
+  size_t pending_size_ = 0;
+  size_t pending_updates_ = 0;
+  int64_t oldest_timestamp_ = 0;
+};
+
+// ConnectionTracker keeps the state of connections and listen endpoints
+// sharded by hash, with one lock per shard, so that updates coming from
+// network events only ever wait for the shard they belong to. Fetching the
+// state walks it shard by shard, optionally on several threads (see
+// SetFetchWorkers), and merges the results.
+//
+// The configuration used to filter and normalize connections is guarded by
+// its own lock, which is always acquired before the shard locks.
 class ConnectionTracker {
  public:
+  static constexpr size_t kShardBits = 4;
+  static constexpr size_t kNumShards = 1 << kShardBits;
+
   void UpdateConnection(const Connection& conn, int64_t timestamp, bool added);
+  // Creates a batch to ingest connection updates in bulk. The batch is owned
+  // by the tracker and lives as long as it.
+  ConnectionBatch* CreateBatch(size_t max_size, int64_t max_delay_micros);
   void AddConnection(const Connection& conn, int64_t timestamp) {
     UpdateConnection(conn, timestamp, true);
   }
@@ -94,12 +188,48 @@ class ConnectionTracker {
 
   void Update(const std::vector<Connection>& all_conns, const std::vector<ContainerEndpoint>& all_listen_endpoints, int64_t timestamp);
 
-  // Atomically fetch a snapshot of the current state, removing all inactive connections if requested.
+  // Fetch a snapshot of the current state, removing all inactive connections if requested. Each shard is
+  // snapshotted atomically, but not the state as a whole.
   ConnMap FetchConnState(bool normalize = false, bool clear_inactive = true);
+
+  // Fetch the changes of the normalized connections since the previous call, as computed by ComputeDeltaAfterglow
+  // (or ComputeDelta, without afterglow) between successive normalized snapshots, and remove inactive connections.
+  // The tracker keeps the reported state, and only visits the connections that changed and the closed ones still
+  // in afterglow, unless the normalization configuration changed. The two ways of fetching connections must not be
+  // used on the same tracker with clear_inactive.
+  ConnMap FetchConnDelta(int64_t time_micros, int64_t time_at_last_scrape, bool afterglow, int64_t afterglow_period_micros);
+  // Forget the reported state, so that the next delta reports all connections, e.g. to a new consumer.
+  void ResetConnDelta();
   AdvertisedEndpointMap FetchEndpointState(bool normalize = false, bool clear_inactive = true);
 
-  template <typename T>
-  static void UpdateOldState(UnorderedMap<T, ConnStatus>* old_state, const UnorderedMap<T, ConnStatus>& new_state, int64_t time_micros, int64_t afterglow_period_micros);
+  // Number of threads snapshotting shards in parallel when fetching the state, including the calling thread.
+  void SetFetchWorkers(size_t workers) { fetch_workers_ = std::max<size_t>(workers, 1); }
+
+  // Limits the number of connections stored for each container, and in total, so that memory use stays bounded
+  // whatever the workload, e.g. a container scanning ports or addresses. 0 means unlimited. Each shard enforces its
+  // share of the limits, evicting the least recently updated connections when exceeding them, inactive ones first.
+  void SetConnectionLimits(size_t max_per_container, size_t max_total);
+  // Returns the number of connections evicted for each container since the previous call.
+  UnorderedMap<std::string, uint64_t> ConsumeEvictedConnections();
+
+  // Closes all the connections and listen endpoints of a container at the given time, e.g. once it exited, so that
+  // the next fetch reports them as closed and removes them. Only the entries of the container are visited. Returns
+  // the number of entries closed.
+  size_t PurgeContainer(ContainerIDInterner::Handle container, int64_t timestamp);
+  // Purges the containers with entries in the state which are not among the given ones, e.g. the containers found
+  // by a scrape, and releases the IDs of the containers without any entry left (see ContainerIDInterner::Sweep).
+  // Returns the number of entries closed.
+  size_t PurgeContainersExcept(const UnorderedSet<std::string>& container_ids, int64_t timestamp);
+
+  // Index of the shard holding a connection.
+  static size_t ShardIndex(const Connection& conn) { return ShardOf(Hash(conn)); }
+  // Time spent waiting for, and holding, the lock of a shard.
+  const LockTimeHistogram& ShardLockWaitTimes(size_t shard) const { return shards_[shard].lock_wait; }
+  const LockTimeHistogram& ShardLockHoldTimes(size_t shard) const { return shards_[shard].lock_hold; }
+
+  // The following work on any map of ConnStatus, e.g. ConnMap or AdvertisedEndpointMap.
+  template <typename M>
+  static void UpdateOldState(M* old_state, const M& new_state, int64_t time_micros, int64_t afterglow_period_micros);
 
   // Mark all matching connections as closed
   static void CloseConnections(ConnMap* old_conn_state, ConnMap* delta_conn, std::function<bool(const Connection*)> predicate);
@@ -107,43 +237,47 @@ class ConnectionTracker {
   void CloseConnectionsOnExternalIPsConfigChange(ExternalIPsConfig prev_config, ConnMap* old_conn_state, ConnMap* delta_conn) const;
 
   // ComputeDelta computes a diff between new_state and old_state
-  template <typename T>
-  static void ComputeDeltaAfterglow(const UnorderedMap<T, ConnStatus>& new_state, const UnorderedMap<T, ConnStatus>& old_state, UnorderedMap<T, ConnStatus>& delta, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
+  template <typename M>
+  static void ComputeDeltaAfterglow(const M& new_state, const M& old_state, M& delta, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
 
   // Handles the case when a connection appears in both the new and old states and afterglow is used
-  template <typename T>
-  void static ComputeDeltaForAConnectionInOldAndNewStates(const std::pair<const T, ConnStatus>& new_conn, const ConnStatus& old_conn_status, UnorderedMap<T, ConnStatus>& delta, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
+  template <typename M>
+  void static ComputeDeltaForAConnectionInOldAndNewStates(const typename M::value_type& new_conn, const ConnStatus& old_conn_status, M& delta, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
 
   // Determines if a connection being added to the delta should be set to active
   template <typename T>
   static std::pair<T, ConnStatus> ChangeConnToActiveIfNeeded(const std::pair<const T, ConnStatus>& new_conn, const T& conn_key, const ConnStatus& conn_status, bool new_recently_active);
 
   // Handles the case when a connection appears in only the new state and afterglow is used
-  template <typename T>
-  void static ComputeDeltaForAConnectionInNewState(const std::pair<const T, ConnStatus>& new_conn, UnorderedMap<T, ConnStatus>& delta, int64_t time_micros, int64_t afterglow_period_micros);
+  template <typename M>
+  void static ComputeDeltaForAConnectionInNewState(const typename M::value_type& new_conn, M& delta, int64_t time_micros, int64_t afterglow_period_micros);
 
   // Determines if an old connection should be reported as being inactive
-  template <typename T>
-  static bool CheckIfOldConnShouldBeInactiveInDelta(const T& conn_key, const ConnStatus& conn_status, const UnorderedMap<T, ConnStatus>& new_state, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
+  template <typename M>
+  static bool CheckIfOldConnShouldBeInactiveInDelta(const typename M::key_type& conn_key, const ConnStatus& conn_status, const M& new_state, int64_t time_micros, int64_t time_at_last_scrape, int64_t afterglow_period_micros);
 
   // ComputeDelta computes a diff between new_state and *old_state, and stores the diff in *old_state.
-  template <typename T, typename E>
-  static void ComputeDelta(const UnorderedMap<T, ConnStatus, E>& new_state, UnorderedMap<T, ConnStatus, E>* old_state);
+  template <typename M>
+  static void ComputeDelta(const M& new_state, M* old_state);
 
   void UpdateKnownPublicIPs(UnorderedSet<Address>&& known_public_ips);
   void UpdateKnownIPNetworks(UnorderedMap<Address::Family, std::vector<IPNet>>&& known_ip_networks);
-  void SetExternalIPsConfig(ExternalIPsConfig config) { external_ips_config_ = config; }
+  void SetExternalIPsConfig(ExternalIPsConfig config);
   void UpdateIgnoredL4ProtoPortPairs(UnorderedSet<L4ProtoPortPair>&& ignored_l4proto_port_pairs);
   void UpdateIgnoredNetworks(const std::vector<IPNet>& network_list);
   void UpdateNonAggregatedNetworks(const std::vector<IPNet>& network_list);
 
   // Emplace a connection into the state ConnMap, or update its timestamp if the supplied timestamp is more recent
-  // than the stored one.
-  void EmplaceOrUpdateNoLock(const Connection& conn, ConnStatus status);
+  // than the stored one. The lock of the shard of the connection is not acquired.
+  void EmplaceOrUpdateNoLock(const Connection& conn, ConnStatus status) {
+    EmplaceOrUpdateNoLock(&ShardFor(conn), conn, status);
+  }
 
   // Emplace a listen endpoint into the state ContainerEndpointMap, or update its timestamp if the supplied timestamp is more
-  // recent than the stored one.
-  void EmplaceOrUpdateNoLock(const ContainerEndpoint& ep, ConnStatus status);
+  // recent than the stored one. The lock of the shard of the endpoint is not acquired.
+  void EmplaceOrUpdateNoLock(const ContainerEndpoint& ep, ConnStatus status) {
+    EmplaceOrUpdateNoLock(&ShardFor(ep), ep, status);
+  }
 
   //
   // Statistics on the number of stored connections and their rate creation.
@@ -155,6 +289,8 @@ class ConnectionTracker {
     } inbound, outbound;
   };
   // Retrieve the number of connections currently stored in ConnTracker, indexed by in/out and public/private nature.
+  // The counts are maintained as connections are inserted and removed, and only recomputed after the configuration
+  // filtering connections changed.
   Stats GetConnectionStats_StoredConnections();
   // Retrieve the value of the ever-increasing counters of new connection insertion, indexed by in/out and public/private nature.
   // Those counters are updated as new connections are reported by the system.
@@ -163,13 +299,131 @@ class ConnectionTracker {
   bool ShouldNormalizeConnection(const Connection* conn) const;
 
  private:
-  // NormalizeConnection transforms a connection into a normalized form.
-  Connection NormalizeConnectionNoLock(const Connection& conn) const;
-  IPNet NormalizeAddressNoLock(const Address& address, bool enable_external_ips) const;
+  // Networks and addresses used to filter and normalize connections. A published snapshot is never modified: updates
+  // build a new one, sharing the parts which did not change, and swap it in atomically. Readers load the current
+  // snapshot once per operation, without taking any tracker lock.
+  struct NetworkConfig {
+    // Incremented on every published change.
+    uint64_t version = 1;
+    std::shared_ptr<const FlatHashSet<Address>> known_public_ips = std::make_shared<FlatHashSet<Address>>();
+    std::shared_ptr<const NRadixTree> known_ip_networks = std::make_shared<NRadixTree>();
+    UnorderedMap<Address::Family, bool> known_private_networks_exists;
+    std::shared_ptr<const NRadixTree> ignored_networks = std::make_shared<NRadixTree>();
+    std::shared_ptr<const NRadixTree> non_aggregated_networks = std::make_shared<NRadixTree>();
+  };
+
+  std::shared_ptr<const NetworkConfig> Networks() const { return std::atomic_load(&networks_); }
+  // Publishes a copy of the current networks modified by `update`, unless it returns false because nothing changed.
+  void UpdateNetworks(const std::function<bool(NetworkConfig*)>& update);
+
+  // Where a connection is counted in Stats, if at all.
+  enum class StatsClass : uint8_t {
+    IGNORED,
+    INBOUND_PUBLIC,
+    INBOUND_PRIVATE,
+    OUTBOUND_PUBLIC,
+    OUTBOUND_PRIVATE,
+  };
+
+  // Memoized results of NormalizeAddressNoLock, valid for a single version of the configuration and networks.
+  struct NormalizationCache {
+    // Guards the fields below, held for a whole pass over a shard.
+    std::mutex mutex;
+    uint64_t config_version = 0;
+    uint64_t networks_version = 0;
+    // Normalized remote addresses, indexed by whether external IPs are enabled.
+    std::array<FlatHashMap<Address, IPNet>, 2> networks;
+    size_t hits = 0;
+    size_t misses = 0;
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    ConnMap conn_state;
+    // Connections which were inserted, closed or reopened since the last delta, with whether they were active then.
+    FlatHashMap<Connection, bool> changed_conns;
+    // Connections in conn_state, by container, with where they are counted in stored_connections.
+    FlatHashMap<ContainerIDInterner::Handle, FlatHashMap<Connection, StatsClass>> conns_by_container;
+    Stats stored_connections = {};
+    // Versions of the configuration and networks with which the connections were classified.
+    uint64_t stats_config_version = 0;
+    uint64_t stats_networks_version = 0;
+    // Connections evicted since ConsumeEvictedConnections was last called, by container.
+    FlatHashMap<ContainerIDInterner::Handle, uint64_t> evicted_conns;
+    ContainerEndpointMap endpoint_state;
+    // Listen endpoints in endpoint_state, by container.
+    FlatHashMap<ContainerIDInterner::Handle, FlatHashSet<ContainerEndpoint>> endpoints_by_container;
+    NormalizationCache normalization_cache;
+    Stats inserted_connections_counters = {};
+    LockTimeHistogram lock_wait;
+    LockTimeHistogram lock_hold;
+  };
+
+  // Locks a shard, recording the wait and hold times.
+  class ShardLock {
+   public:
+    explicit ShardLock(Shard* shard);
+    ~ShardLock();
+
+   private:
+    Shard* shard_;
+    uint64_t acquired_;
+  };
+
+  static size_t ShardOf(size_t hash) {
+    // Buckets of the shard maps are selected by the low bits of the hash.
+    return (static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ULL) >> (64 - kShardBits);
+  }
+  Shard& ShardFor(const Connection& conn) { return shards_[ShardOf(Hash(conn))]; }
+  Shard& ShardFor(const ContainerEndpoint& ep) { return shards_[ShardOf(Hash(ep))]; }
+
+  // Runs fn(shard_index) for each shard, on up to fetch_workers_ threads.
+  template <typename Fn>
+  void ForEachShard(const Fn& fn);
+
+  // Emplace a connection into the state ConnMap of its shard, or update its timestamp if the supplied timestamp is
+  // more recent than the stored one.
+  void EmplaceOrUpdateNoLock(Shard* shard, const Connection& conn, ConnStatus status);
+  // Same, without counting the update in CollectorStats. Returns true if the connection was inserted. The class of the
+  // connection is computed on insertion, unless given.
+  bool EmplaceOrUpdateStateNoLock(Shard* shard, const Connection& conn, ConnStatus status, std::optional<StatsClass> cls = std::nullopt);
+  // Erases a connection from the state of its shard.
+  static void EraseConnNoLock(Shard* shard, ConnMap::iterator it);
+  // Removes the connections erased in bulk from the state of a shard from its index, and from its statistics.
+  static void PruneConnsByContainerNoLock(Shard* shard);
+  // Indexes the listen endpoints of a shard by container, after endpoints were erased in bulk.
+  static void IndexEndpointsByContainerNoLock(Shard* shard);
+  // Evicts connections from the state of a shard if the given container, or the shard, holds more than its share of
+  // the connection limits.
+  void EnforceConnectionLimitsNoLock(Shard* shard, ContainerIDInterner::Handle container);
+  // Evicts count connections, among those of the given container if any, the least recently updated first, and
+  // the inactive ones before the active ones.
+  void EvictConnsNoLock(Shard* shard, std::optional<ContainerIDInterner::Handle> container, size_t count);
+  // Closes the connections and listen endpoints of a container in a shard, and returns the number of connections and
+  // of endpoints closed.
+  static std::pair<size_t, size_t> PurgeContainerNoLock(Shard* shard, ContainerIDInterner::Handle container, int64_t timestamp);
+  // Sweeps the container IDs, keeping those of the containers with entries in the state.
+  void SweepContainerIDs();
+
+  // Emplace a listen endpoint into the state ContainerEndpointMap of its shard, or update its timestamp if the
+  // supplied timestamp is more recent than the stored one.
+  void EmplaceOrUpdateNoLock(Shard* shard, const ContainerEndpoint& ep, ConnStatus status);
+
+  ConnMap FetchConnStateNoLock(ConnMap* state, bool normalize, bool clear_inactive, const NetworkConfig& networks, NormalizationCache* cache) const;
+  AdvertisedEndpointMap FetchEndpointStateNoLock(ContainerEndpointMap* state, bool normalize, bool clear_inactive) const;
+
+  // NormalizeConnection transforms a connection into a normalized form. Remote addresses are normalized through the
+  // given cache, whose lock is held by the caller.
+  Connection NormalizeConnectionNoLock(const Connection& conn, const NetworkConfig& networks, NormalizationCache* cache) const;
+  IPNet NormalizeAddressNoLock(const Address& address, bool enable_external_ips, const NetworkConfig& networks) const;
+  IPNet NormalizeAddressNoLock(const Address& address, bool enable_external_ips, const NetworkConfig& networks, NormalizationCache* cache) const;
+  bool ShouldNormalizeConnection(const Connection* conn, const NetworkConfig& networks) const;
+  // Adds the hits and misses of a cache to the statistics, and resets them.
+  static void FlushNormalizationStats(NormalizationCache* cache);
 
   // Returns true if any connection filters are found.
-  inline bool HasConnectionFilters() const {
-    return !ignored_l4proto_port_pairs_.empty() || !ignored_networks_.IsEmpty();
+  inline bool HasConnectionFilters(const NetworkConfig& networks) const {
+    return !ignored_l4proto_port_pairs_.empty() || !networks.ignored_networks->IsEmpty();
   }
 
   // Determine if a protocol port combination from a connection or endpoint should be ignored
@@ -180,14 +434,14 @@ class ConnectionTracker {
   // NormalizeContainerEndpoint transforms a container endpoint into a normalized form.
   inline ContainerEndpoint NormalizeContainerEndpoint(const ContainerEndpoint& cep) const {
     const auto& ep = cep.endpoint();
-    return ContainerEndpoint(cep.container(), Endpoint(Address(ep.address().family()), ep.port()), cep.l4proto(), cep.originator());
+    return ContainerEndpoint(cep.container_handle(), Endpoint(Address(ep.address().family()), ep.port()), cep.l4proto(), cep.originator());
   }
 
   // Determine if a connection should be ignored
-  inline bool ShouldFetchConnection(const Connection& conn) const {
+  inline bool ShouldFetchConnection(const Connection& conn, const NetworkConfig& networks) const {
     return !IsIgnoredL4ProtoPortPair(L4ProtoPortPair(conn.l4proto(), conn.local().port())) &&
            !IsIgnoredL4ProtoPortPair(L4ProtoPortPair(conn.l4proto(), conn.remote().port())) &&
-           ignored_networks_.Find(conn.remote().address()).IsNull();
+           networks.ignored_networks->Find(conn.remote().address()).IsNull();
   }
 
   // Determine if a container endpoint should be ignored
@@ -195,33 +449,76 @@ class ConnectionTracker {
     return !IsIgnoredL4ProtoPortPair(L4ProtoPortPair(cep.l4proto(), cep.endpoint().port()));
   }
 
-  inline void IncrementConnectionStats(Connection conn, ConnectionTracker::Stats& stats) const;
-
-  std::mutex mutex_;
-  ConnMap conn_state_;
-  ContainerEndpointMap endpoint_state_;
+  StatsClass ClassifyConnection(const Connection& conn, const NetworkConfig& networks) const;
+  // Returns the counter of the given class, or null if not counted.
+  static unsigned int* StatsCounter(Stats* stats, StatsClass cls);
+
+  friend class ConnectionBatch;
+  // Merges the content of a batch into the state, one shard at a time. The
+  // caller holds the batch lock, not the tracker ones.
+  void MergeBatch(std::vector<ConnMap>* batch, size_t num_updates);
+  void FlushBatches();
+
+  std::mutex batches_mutex_;
+  std::vector<std::unique_ptr<ConnectionBatch>> batches_;
+
+  std::array<Shard, kNumShards> shards_;
+  size_t fetch_workers_ = 1;
+
+  // A normalized connection, as known to FetchConnDelta.
+  struct ReportedConn {
+    // Number of active connections in the state normalized to this one.
+    uint32_t active = 0;
+    // Merged status of the connections normalized to this one which were closed since the last delta.
+    bool has_closed = false;
+    ConnStatus closed;
+    // Whether this connection is part of the reported state, and its status there.
+    bool reported = false;
+    ConnStatus last;
+    // Whether this connection is to be visited by the ongoing delta.
+    bool pending = false;
+  };
 
-  UnorderedSet<Address> known_public_ips_;
-  NRadixTree known_ip_networks_;
+  // Guards the state below, only used by FetchConnDelta.
+  std::mutex reported_mutex_;
+  FlatHashMap<Connection, ReportedConn> reported_conns_;
+  // Reported connections with no active connection left, e.g. closed and in afterglow, by the time at which they are
+  // to be visited again.
+  TimerWheel<Connection> closing_conns_;
+  // Configuration with which reported_conns_ was computed.
+  uint64_t reported_config_version_ = 0;
+  uint64_t reported_networks_version_ = 0;
+  ExternalIPsConfig reported_external_ips_config_;
+  bool reported_afterglow_ = false;
+  int64_t reported_afterglow_period_micros_ = 0;
+
+  // Guards the configuration below. Updating and fetching the state only
+  // needs shared ownership.
+  std::shared_mutex config_mutex_;
+  // Incremented on every change of the configuration below.
+  uint64_t config_version_ = 1;
   ExternalIPsConfig external_ips_config_;
-  UnorderedMap<Address::Family, bool> known_private_networks_exists_;
   UnorderedSet<L4ProtoPortPair> ignored_l4proto_port_pairs_;
-  NRadixTree ignored_networks_;
-  NRadixTree non_aggregated_networks_;
-
-  Stats inserted_connections_counters_ = {};
+  // Connection limits of each shard, 0 if unlimited.
+  size_t max_conns_per_container_per_shard_ = 0;
+  size_t max_conns_per_shard_ = 0;
+
+  // Only accessed through std::atomic_load and std::atomic_store.
+  std::shared_ptr<const NetworkConfig> networks_ = std::make_shared<NetworkConfig>();
+  // Serializes the updates of networks_, which readers never take.
+  std::mutex networks_update_mutex_;
 };
 
 /* static */
-template <typename T>
-void ConnectionTracker::UpdateOldState(UnorderedMap<T, ConnStatus>* old_state, const UnorderedMap<T, ConnStatus>& new_state, int64_t time_micros, int64_t afterglow_period_micros) {
+template <typename M>
+void ConnectionTracker::UpdateOldState(M* old_state, const M& new_state, int64_t time_micros, int64_t afterglow_period_micros) {
   // Remove connections that are older than the afterglow period and add unexpired new connections to the old state
   for (auto it = old_state->begin(); it != old_state->end();) {
     auto& old_conn = *it;
     if (old_conn.second.IsInAfterglowPeriod(time_micros, afterglow_period_micros)) {
       ++it;
     } else {
-      it = old_state->erase(it);
+      old_state->erase(it++);
     }
   }
 
@@ -234,8 +531,8 @@ void ConnectionTracker::UpdateOldState(UnorderedMap<T, ConnStatus>* old_state, c
   }
 }
 
-template <typename T, typename E>
-void ConnectionTracker::ComputeDelta(const UnorderedMap<T, ConnStatus, E>& new_state, UnorderedMap<T, ConnStatus, E>* old_state) {
+template <typename M>
+void ConnectionTracker::ComputeDelta(const M& new_state, M* old_state) {
   // Insert all objects from the new state, if anything changed about them.
   for (const auto& conn : new_state) {
     auto insert_res = old_state->insert(conn);
@@ -272,7 +569,7 @@ void ConnectionTracker::ComputeDelta(const UnorderedMap<T, ConnStatus, E>& new_s
       old_conn.second.SetActive(false);
       ++it;
     } else {
-      it = old_state->erase(it);
+      old_state->erase(it++);
     }
   }
 }
@@ -286,10 +583,10 @@ void ConnectionTracker::ComputeDelta(const UnorderedMap<T, ConnStatus, E>& new_s
 // the time at the previous scrape (time_at_last_scrape). These are used to determine
 // if the new connections were active within the afterglow period of the current scrape
 // and if the old_connection were active within the afterglow period of the previous scrape
-template <typename T>
-void ConnectionTracker::ComputeDeltaAfterglow(const UnorderedMap<T, ConnStatus>& new_state,
-                                              const UnorderedMap<T, ConnStatus>& old_state,
-                                              UnorderedMap<T, ConnStatus>& delta,
+template <typename M>
+void ConnectionTracker::ComputeDeltaAfterglow(const M& new_state,
+                                              const M& old_state,
+                                              M& delta,
                                               int64_t time_micros,
                                               int64_t time_at_last_scrape,
                                               int64_t afterglow_period_micros) {
@@ -318,10 +615,10 @@ void ConnectionTracker::ComputeDeltaAfterglow(const UnorderedMap<T, ConnStatus>&
 
 // See ComputeDeltaAfterglow
 // Handles the case when a connection appears in both the new and old states and afterglow is used
-template <typename T>
-inline void ConnectionTracker::ComputeDeltaForAConnectionInOldAndNewStates(const std::pair<const T, ConnStatus>& new_conn,
+template <typename M>
+inline void ConnectionTracker::ComputeDeltaForAConnectionInOldAndNewStates(const typename M::value_type& new_conn,
                                                                            const ConnStatus& old_conn_status,
-                                                                           UnorderedMap<T, ConnStatus>& delta,
+                                                                           M& delta,
                                                                            int64_t time_micros,
                                                                            int64_t time_at_last_scrape,
                                                                            int64_t afterglow_period_micros) {
@@ -359,9 +656,9 @@ inline std::pair<T, ConnStatus> ConnectionTracker::ChangeConnToActiveIfNeeded(co
 
 // See ComputeDeltaAfterglow
 // Handles the case when a connection appears in only the new state and afterglow is used
-template <typename T>
-inline void ConnectionTracker::ComputeDeltaForAConnectionInNewState(const std::pair<const T, ConnStatus>& new_conn,
-                                                                    UnorderedMap<T, ConnStatus>& delta,
+template <typename M>
+inline void ConnectionTracker::ComputeDeltaForAConnectionInNewState(const typename M::value_type& new_conn,
+                                                                    M& delta,
                                                                     int64_t time_micros,
                                                                     int64_t afterglow_period_micros) {
   auto& conn_key = new_conn.first;
@@ -374,10 +671,10 @@ inline void ConnectionTracker::ComputeDeltaForAConnectionInNewState(const std::p
 
 // If the connection is in the old_state, not in the new state, was active within the afterglow period of the previous scrape, and is now outside of the
 // afterglow period of the current state, it should be reported as being inactive.
-template <typename T>
-bool ConnectionTracker::CheckIfOldConnShouldBeInactiveInDelta(const T& conn_key,
+template <typename M>
+bool ConnectionTracker::CheckIfOldConnShouldBeInactiveInDelta(const typename M::key_type& conn_key,
                                                               const ConnStatus& conn_status,
-                                                              const UnorderedMap<T, ConnStatus>& new_state,
+                                                              const M& new_state,
                                                               int64_t time_micros,
                                                               int64_t time_at_last_scrape,
                                                               int64_t afterglow_period_micros) {
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include "ContainerIDInterner.h"
+#include "Containers.h"
+#include "Hash.h"
+#include "NetworkConnection.h"
+
+namespace collector {
+
+// Per socket cache of the connections resolved by the network signal
+// handler, so that repeated events on the same socket (send/recv) do not
+// rebuild the connection, and its container ID, every time.
+//
+// Entries are keyed by (pid, fd), as the fd table is shared by all the
+// threads of a process, and checked against a signature of the socket, made
+// of the raw socket tuple sinsp keeps for the fd. A reused fd therefore
+// misses, on top of the explicit invalidation on close and shutdown. The
+// entries of a process are dropped when it exits, before its pid can be
+// reused.
+//
+// Not thread-safe: it is meant to be used from the event loop only.
+class ConnectionCache {
+ public:
+  static constexpr size_t kSignatureSize = 48;
+  using Signature = std::array<uint8_t, kSignatureSize>;
+
+  struct Entry {
+    Signature signature{};
+    Connection conn;
+    // Timestamp of the last update of the connection tracker for this
+    // socket, in microseconds. Zero if it has never been updated.
+    int64_t last_update = 0;
+  };
+
+  static constexpr size_t kDefaultMaxSize = 65536;
+
+  explicit ConnectionCache(size_t max_size = kDefaultMaxSize) : max_size_(max_size) {}
+
+  // Returns the entry for the given socket, or null if there is none or it
+  // is stale.
+  Entry* Lookup(int64_t pid, int64_t fd, const Signature& signature) {
+    auto* fds = collector::Lookup(entries_, pid);
+    if (fds == nullptr) {
+      return nullptr;
+    }
+    auto* entry = collector::Lookup(*fds, fd);
+    if (entry == nullptr || entry->signature != signature) {
+      return nullptr;
+    }
+    // The container ID may have been released while the socket was idle.
+    if (!ContainerIDInterner::Instance().Valid(entry->conn.container_handle())) {
+      return nullptr;
+    }
+    return entry;
+  }
+
+  Entry& Insert(int64_t pid, int64_t fd, const Signature& signature, Connection conn) {
+    auto& fds = entries_[pid];
+    auto emplace_res = fds.try_emplace(fd);
+    if (emplace_res.second && ++size_ > max_size_) {
+      // Only reached if the exits of many processes were missed, in which
+      // case their entries are indistinguishable from live ones. Drop them
+      // all, live sockets are cached again on their next event.
+      entries_.clear();
+      size_ = 1;
+      emplace_res = entries_[pid].try_emplace(fd);
+    }
+
+    auto& entry = emplace_res.first->second;
+    entry.signature = signature;
+    entry.conn = std::move(conn);
+    entry.last_update = 0;
+    return entry;
+  }
+
+  void Invalidate(int64_t pid, int64_t fd) {
+    auto fds = entries_.find(pid);
+    if (fds == entries_.end()) {
+      return;
+    }
+    size_ -= fds->second.erase(fd);
+    if (fds->second.empty()) {
+      entries_.erase(fds);
+    }
+  }
+
+  // Drops the entries of an exited process.
+  void InvalidateProcess(int64_t pid) {
+    auto fds = entries_.find(pid);
+    if (fds == entries_.end()) {
+      return;
+    }
+    size_ -= fds->second.size();
+    entries_.erase(fds);
+  }
+
+  void Clear() {
+    entries_.clear();
+    size_ = 0;
+  }
+  size_t Size() const { return size_; }
+
+ private:
+  size_t max_size_;
+  size_t size_ = 0;
+  // Entries by pid, then fd.
+  UnorderedMap<int64_t, UnorderedMap<int64_t, Entry>> entries_;
+};
+
+}  // namespace collector
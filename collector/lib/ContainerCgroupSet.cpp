@@ -0,0 +1,46 @@
+#include "ContainerCgroupSet.h"
+
+namespace collector {
+
+namespace {
+
+constexpr size_t kContainerIDLength = 64;
+constexpr std::string_view kScopeSuffix = ".scope";
+
+bool IsLowerHex(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+bool IsSeparator(char c) {
+  return c == '/' || c == ':' || c == '-';
+}
+
+// Whether what follows the container ID matches `(\.scope)?(/.*)?`
+bool IsValidSuffix(std::string_view suffix) {
+  if (suffix.substr(0, kScopeSuffix.size()) == kScopeSuffix) {
+    suffix.remove_prefix(kScopeSuffix.size());
+  }
+  return suffix.empty() || suffix[0] == '/';
+}
+
+}  // namespace
+
+bool ContainerCgroupSet::MatchesContainerCgroup(std::string_view cgroup) {
+  if (cgroup.size() < kContainerIDLength + 1) {
+    return false;
+  }
+
+  // Number of consecutive lowercase hex characters starting at pos + 1,
+  // maintained while walking the path backwards.
+  size_t hex_run = 0;
+  for (size_t pos = cgroup.size() - 1; pos-- > 0;) {
+    hex_run = IsLowerHex(cgroup[pos + 1]) ? hex_run + 1 : 0;
+    if (hex_run >= kContainerIDLength && IsSeparator(cgroup[pos]) &&
+        IsValidSuffix(cgroup.substr(pos + 1 + kContainerIDLength))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace collector
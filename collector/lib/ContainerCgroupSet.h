@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "Containers.h"
+#include "Hash.h"
+
+namespace collector {
+
+// Tells container processes apart from host processes, replacing what used
+// to be a sinsp filter string evaluated on every event.
+//
+// A thread belongs to a container if it runs in a PID namespace other than
+// the host one (pid != vpid), or, for containers sharing the host PID
+// namespace (hostPID: true), if its memory cgroup is a container cgroup.
+// Container cgroups are recognized by their path ending with a 64 hex
+// character container ID, and the verdict is kept per cgroup, so each
+// cgroup path is only matched once, when the first thread of a container
+// is seen.
+//
+// Not thread-safe: it is meant to be used from the event loop only.
+class ContainerCgroupSet {
+ public:
+  static constexpr size_t kDefaultMaxSize = 8192;
+
+  explicit ContainerCgroupSet(size_t max_size = kDefaultMaxSize) : max_size_(max_size) {}
+
+  template <typename ThreadInfo>
+  bool IsContainerThread(const ThreadInfo& tinfo) {
+    if (tinfo.m_pid != tinfo.m_vpid) {
+      return true;
+    }
+
+    // The memory cgroup is used because on cgroups v2 with systemd, the
+    // memory controller is reliably delegated to the container's leaf
+    // cgroup (where the path contains the container ID), while cpuset is
+    // often only available at a higher level in the hierarchy.
+    for (const auto& [subsys, cgroup] : tinfo.cgroups()) {
+      if (subsys == "memory") {
+        return IsContainerCgroup(cgroup);
+      }
+    }
+    return false;
+  }
+
+  bool IsContainerCgroup(const std::string& cgroup) {
+    if (const auto* verdict = Lookup(verdicts_, cgroup)) {
+      return *verdict;
+    }
+
+    if (verdicts_.size() >= max_size_) {
+      // Cgroups of stopped containers are never seen again, so the set only
+      // fills up with stale entries. Start over, active cgroups will be
+      // matched again on their next event.
+      verdicts_.clear();
+    }
+
+    bool is_container = MatchesContainerCgroup(cgroup);
+    verdicts_.emplace(cgroup, is_container);
+    return is_container;
+  }
+
+  // Whether the path matches `.*[/:-][0-9a-f]{64}(\.scope)?(/.*)?`. The
+  // trailing components account for additional path components some
+  // runtimes append (e.g. podman adds /container).
+  static bool MatchesContainerCgroup(std::string_view cgroup);
+
+  void Clear() { verdicts_.clear(); }
+  size_t Size() const { return verdicts_.size(); }
+
+ private:
+  size_t max_size_;
+  // cgroup path -> whether it belongs to a container
+  UnorderedMap<std::string, bool> verdicts_;
+};
+
+}  // namespace collector
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Containers.h"
+#include "Hash.h"
+
+namespace collector {
+
+// Per thread cache of the container ID and the filtering verdict, used on
+// the event hot path to avoid walking the cgroups of a thread on every event.
+//
+// Entries are keyed by tid and tagged with a generation, built from the
+// clone and last exec timestamps of the thread, so a reused tid or an
+// execve is a miss even if the entry was not invalidated. sinsp only
+// refreshes the cgroups of a thread on clone and execve, and the caller is
+// expected to Invalidate() the entry of a thread on those events and on
+// its exit.
+//
+// Not thread-safe: it is meant to be used from the event loop only.
+class ContainerIDCache {
+ public:
+  struct Generation {
+    uint64_t clone_ts = 0;
+    uint64_t lastexec_ts = 0;
+
+    bool operator==(const Generation& other) const {
+      return clone_ts == other.clone_ts && lastexec_ts == other.lastexec_ts;
+    }
+    bool operator!=(const Generation& other) const { return !(*this == other); }
+  };
+
+  struct Entry {
+    Generation generation;
+    std::string container_id;
+    bool accepted = false;
+  };
+
+  static constexpr size_t kDefaultMaxSize = 32768;
+
+  explicit ContainerIDCache(size_t max_size = kDefaultMaxSize) : max_size_(max_size) {}
+
+  template <typename ThreadInfo>
+  static Generation GenerationOf(const ThreadInfo& tinfo) {
+    return {tinfo.m_clone_ts, tinfo.m_lastexec_ts};
+  }
+
+  // Returns the entry for the given thread, or null if there is none or it
+  // is stale.
+  const Entry* Lookup(int64_t tid, const Generation& generation) const {
+    const auto* entry = collector::Lookup(entries_, tid);
+    if (entry == nullptr || entry->generation != generation) {
+      return nullptr;
+    }
+    return entry;
+  }
+
+  const Entry& Insert(int64_t tid, const Generation& generation, std::string container_id, bool accepted) {
+    if (entries_.size() >= max_size_ && !Contains(entries_, tid)) {
+      // Entries of exited threads are removed on procexit, so reaching
+      // the limit means some exits were missed. Start over rather than
+      // paying for an eviction policy on the hot path.
+      entries_.clear();
+    }
+
+    auto& entry = entries_[tid];
+    entry.generation = generation;
+    entry.container_id = std::move(container_id);
+    entry.accepted = accepted;
+    return entry;
+  }
+
+  void Invalidate(int64_t tid) { entries_.erase(tid); }
+  void Clear() { entries_.clear(); }
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  size_t max_size_;
+  UnorderedMap<int64_t, Entry> entries_;
+};
+
+}  // namespace collector
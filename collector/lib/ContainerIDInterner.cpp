@@ -0,0 +1,151 @@
+#include "ContainerIDInterner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#include "Containers.h"
+#include "Logging.h"
+
+namespace collector {
+
+namespace {
+
+constexpr uint32_t kGenerations = uint32_t{1} << 12;
+
+}  // namespace
+
+ContainerIDInterner::ContainerIDInterner() {
+  static_assert(kMaxChunks * kChunkSize == size_t{1} << kSlotBits);
+  static_assert(size_t{kGenerations} << kSlotBits == size_t{1} << 32);
+  Intern("");
+}
+
+ContainerIDInterner::Handle ContainerIDInterner::Intern(std::string_view container_id) {
+  // Threads keep interning the IDs of the same few containers, so each of
+  // them first checks a small cache of the handles it got last, without
+  // taking the lock.
+  thread_local std::array<Handle, kCacheSize> cache = {};
+  Handle& cached = cache[absl::Hash<std::string_view>{}(container_id) % kCacheSize];
+  const auto* cached_id = Find(cached);
+  if (cached_id != nullptr && *cached_id == container_id && Touch(cached)) {
+    return cached;
+  }
+
+  {
+    std::shared_lock lock(mutex_);
+    auto it = handles_.find(container_id);
+    if (it != handles_.end()) {
+      // IDs are only released with the lock held exclusively.
+      Touch(it->second);
+      cached = it->second;
+      return cached;
+    }
+  }
+
+  std::unique_lock lock(mutex_);
+  auto it = handles_.find(container_id);
+  if (it != handles_.end()) {
+    Touch(it->second);
+    cached = it->second;
+    return cached;
+  }
+
+  size_t index;
+  if (!free_slots_.empty()) {
+    index = free_slots_.back();
+    free_slots_.pop_back();
+  } else if (used_slots_ < kMaxChunks * kChunkSize) {
+    index = used_slots_++;
+    if (index % kChunkSize == 0) {
+      chunks_[index / kChunkSize].store(new Slot[kChunkSize], std::memory_order_release);
+    }
+  } else {
+    CLOG_THROTTLED(ERROR, std::chrono::seconds(10))
+        << "Too many distinct container IDs (" << handles_.size() << "), ignoring container ID " << container_id;
+    return kEmpty;
+  }
+
+  Slot* slot = &chunks_[index / kChunkSize].load(std::memory_order_relaxed)[index % kChunkSize];
+  auto handle = static_cast<Handle>(slot->generation << kSlotBits | index);
+  const auto* stored = new std::string(container_id);
+  slot->id.store(stored, std::memory_order_release);
+  slot->state.store(MakeState(handle, epoch_.load(std::memory_order_relaxed)), std::memory_order_release);
+
+  handles_.emplace(*stored, handle);
+  cached = handle;
+  return handle;
+}
+
+bool ContainerIDInterner::Touch(Handle handle) {
+  auto* slot = SlotOf(handle);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  auto epoch = epoch_.load(std::memory_order_relaxed);
+  auto state = slot->state.load(std::memory_order_relaxed);
+  while (HandleOf(state) == handle) {
+    if (EpochOf(state) == epoch) {
+      return true;
+    }
+    // Fails if the slot was concurrently released, or touched.
+    if (slot->state.compare_exchange_weak(state, MakeState(handle, epoch), std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ContainerIDInterner::Sweep(const FlatHashSet<Handle>& live) {
+  std::unique_lock lock(mutex_);
+
+  auto epoch = epoch_.load(std::memory_order_relaxed) + 1;
+  epoch_.store(epoch, std::memory_order_relaxed);
+
+  // IDs released kGraceSweeps sweeps ago are no longer looked up.
+  retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                [epoch](const auto& retired) { return epoch - retired.first >= kGraceSweeps; }),
+                 retired_.end());
+
+  size_t released = 0;
+  // The empty ID, in the first slot, is never released.
+  for (size_t index = 1; index < used_slots_; index++) {
+    Slot* slot = &chunks_[index / kChunkSize].load(std::memory_order_relaxed)[index % kChunkSize];
+    auto state = slot->state.load(std::memory_order_relaxed);
+    auto handle = HandleOf(state);
+    if (handle == 0) {
+      continue;
+    }
+    if (Contains(live, handle)) {
+      Touch(handle);
+      continue;
+    }
+    if (epoch - EpochOf(state) < kGraceSweeps) {
+      continue;
+    }
+    if (!slot->state.compare_exchange_strong(state, MakeState(0, epoch), std::memory_order_acq_rel)) {
+      // Interned again in the meantime.
+      continue;
+    }
+
+    const auto* id = slot->id.load(std::memory_order_relaxed);
+    handles_.erase(*id);
+    retired_.emplace_back(epoch, id);
+    slot->generation = (slot->generation + 1) % kGenerations;
+    free_slots_.push_back(index);
+    released++;
+  }
+
+  if (released > 0) {
+    CLOG(DEBUG) << "Released " << released << " container IDs, " << handles_.size() << " left";
+  }
+  return released;
+}
+
+size_t ContainerIDInterner::Size() const {
+  std::shared_lock lock(mutex_);
+  return handles_.size();
+}
+
+}  // namespace collector
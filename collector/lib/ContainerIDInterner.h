@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+
+namespace collector {
+
+// ContainerIDInterner maps container IDs to 32-bit handles, so that
+// connections and endpoints store, hash and compare a handle instead of a
+// string.
+//
+// IDs are released by Sweep() once they were neither interned nor reported
+// live by its caller for kGraceSweeps sweeps. A handle is made of the slot
+// of its ID and a generation, bumped when the slot is released, so that a
+// stale handle never resolves to the ID of another container: looking it up
+// returns the empty string. Looking up the ID of a handle is lock-free, and
+// the returned string remains valid for kGraceSweeps sweeps after its
+// release.
+class ContainerIDInterner {
+ public:
+  using Handle = uint32_t;
+
+  // Handle of the empty ID, used for processes outside of containers. Also
+  // returned when there is no slot left.
+  static constexpr Handle kEmpty = 0;
+
+  // Number of sweeps an ID must remain unused for before it is released,
+  // and a released ID is kept for before it is freed.
+  static constexpr uint32_t kGraceSweeps = 3;
+
+  static ContainerIDInterner& Instance() {
+    // Never destroyed, as connections may be used until the very end.
+    static auto* instance = new ContainerIDInterner();
+    return *instance;
+  }
+
+  ContainerIDInterner(const ContainerIDInterner&) = delete;
+  ContainerIDInterner& operator=(const ContainerIDInterner&) = delete;
+
+  Handle Intern(std::string_view container_id);
+
+  const std::string& Lookup(Handle handle) const {
+    const auto* id = Find(handle);
+    return id != nullptr ? *id : empty_;
+  }
+
+  // Whether the handle was not released.
+  bool Valid(Handle handle) const { return Find(handle) != nullptr; }
+
+  // Releases the IDs which were neither interned nor in `live` during the
+  // last kGraceSweeps sweeps, including this one, and frees those released
+  // kGraceSweeps sweeps ago. Returns the number of IDs released.
+  size_t Sweep(const FlatHashSet<Handle>& live);
+
+  // Number of IDs currently interned.
+  size_t Size() const;
+
+ private:
+  static constexpr size_t kSlotBits = 20;
+  static constexpr size_t kChunkSize = 4096;
+  static constexpr size_t kMaxChunks = (size_t{1} << kSlotBits) / kChunkSize;
+  static constexpr size_t kCacheSize = 64;
+
+  struct Slot {
+    // Current handle of the slot in the high half, 0 once released, and the
+    // last sweep it was used in in the low half. Updated together so that
+    // a release does not race with a concurrent use.
+    std::atomic<uint64_t> state{0};
+    std::atomic<const std::string*> id{nullptr};
+    // Generation of the next handle of the slot. Guarded by mutex_.
+    uint32_t generation = 0;
+  };
+
+  static constexpr uint64_t MakeState(Handle handle, uint32_t epoch) {
+    return static_cast<uint64_t>(handle) << 32 | epoch;
+  }
+  static constexpr Handle HandleOf(uint64_t state) { return static_cast<Handle>(state >> 32); }
+  static constexpr uint32_t EpochOf(uint64_t state) { return static_cast<uint32_t>(state); }
+  static constexpr size_t SlotIndex(Handle handle) { return handle & ((size_t{1} << kSlotBits) - 1); }
+
+  ContainerIDInterner();
+
+  Slot* SlotOf(Handle handle) const {
+    auto index = SlotIndex(handle);
+    auto* chunk = chunks_[index / kChunkSize].load(std::memory_order_acquire);
+    return chunk != nullptr ? &chunk[index % kChunkSize] : nullptr;
+  }
+
+  const std::string* Find(Handle handle) const {
+    auto* slot = SlotOf(handle);
+    if (slot == nullptr || HandleOf(slot->state.load(std::memory_order_acquire)) != handle) {
+      return nullptr;
+    }
+    const auto* id = slot->id.load(std::memory_order_acquire);
+    // The slot may have been released and reused in the meantime.
+    if (HandleOf(slot->state.load(std::memory_order_acquire)) != handle) {
+      return nullptr;
+    }
+    return id;
+  }
+
+  // Records the use of a handle in the current sweep. Fails if the handle
+  // was released.
+  bool Touch(Handle handle);
+
+  mutable std::shared_mutex mutex_;
+  // Keys point to the IDs of the slots.
+  FlatHashMap<std::string_view, Handle> handles_;
+  // Number of slots ever used, and the released ones available for reuse.
+  size_t used_slots_ = 0;
+  std::vector<uint32_t> free_slots_;
+  // Released IDs, with the sweep they were released in.
+  std::vector<std::pair<uint32_t, std::unique_ptr<const std::string>>> retired_;
+  std::atomic<uint32_t> epoch_{0};
+  std::array<std::atomic<Slot*>, kMaxChunks> chunks_ = {};
+  const std::string empty_;
+};
+
+}  // namespace collector
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Containers.h"
+#include "Hash.h"
+
+namespace collector {
+
+// Number of live processes in each container, maintained by the event loop
+// from the process creation and exit events, so that telling whether a
+// container still runs anything does not require walking the thread table.
+//
+// Processes are counted once, by pid, whatever the number of events seen for
+// them. A process created while events were dropped is not counted until its
+// next execve, and one whose exit was missed is counted until its pid is
+// reused, so the counts are a hint which the periodic scrape corrects.
+//
+// Not thread-safe: it is meant to be used from the event loop only.
+class ContainerProcesses {
+ public:
+  // Records a process as running in the given container, moving it if it
+  // was counted in another one, e.g. because the exit of a previous process
+  // with the same pid was missed.
+  void Add(int64_t pid, const std::string& container_id) {
+    auto emplace_res = containers_by_pid_.emplace(pid, container_id);
+    if (!emplace_res.second) {
+      if (emplace_res.first->second == container_id) {
+        return;
+      }
+      Release(emplace_res.first->second);
+      emplace_res.first->second = container_id;
+    }
+    counts_[container_id]++;
+  }
+
+  // Forgets an exited process.
+  void Remove(int64_t pid) {
+    auto it = containers_by_pid_.find(pid);
+    if (it == containers_by_pid_.end()) {
+      return;
+    }
+    Release(it->second);
+    containers_by_pid_.erase(it);
+  }
+
+  // Number of processes counted in the container.
+  uint32_t Count(const std::string& container_id) const {
+    const auto* count = collector::Lookup(counts_, container_id);
+    return count ? *count : 0;
+  }
+
+  size_t Size() const { return containers_by_pid_.size(); }
+
+ private:
+  void Release(const std::string& container_id) {
+    auto count = counts_.find(container_id);
+    if (--count->second == 0) {
+      counts_.erase(count);
+    }
+  }
+
+  FlatHashMap<int64_t, std::string> containers_by_pid_;
+  FlatHashMap<std::string, uint32_t> counts_;
+};
+
+}  // namespace collector
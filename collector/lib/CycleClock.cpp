@@ -0,0 +1,31 @@
+#include "CycleClock.h"
+
+#include <thread>
+
+#include "Logging.h"
+
+namespace collector {
+
+std::atomic<double> CycleClock::ticks_per_micro_ = 1000.0;
+
+void CycleClock::Calibrate(std::chrono::milliseconds duration) {
+  auto start_time = std::chrono::steady_clock::now();
+  uint64_t start_ticks = Now();
+
+  std::this_thread::sleep_for(duration);
+
+  uint64_t end_ticks = Now();
+  auto end_time = std::chrono::steady_clock::now();
+
+  auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count();
+  if (elapsed_us <= 0 || end_ticks <= start_ticks) {
+    CLOG(WARNING) << "Failed to calibrate cycle clock, keeping " << TicksPerMicro() << " ticks per microsecond";
+    return;
+  }
+
+  double ticks_per_micro = static_cast<double>(end_ticks - start_ticks) / static_cast<double>(elapsed_us);
+  ticks_per_micro_.store(ticks_per_micro, std::memory_order_relaxed);
+  CLOG(DEBUG) << "Cycle clock calibrated: " << ticks_per_micro << " ticks per microsecond";
+}
+
+}  // namespace collector
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#  include <x86intrin.h>
+#endif
+
+namespace collector {
+
+// CycleClock is a cheap, monotonic tick counter meant for measuring short
+// durations on hot paths, where a clock_gettime() call per measurement is
+// too expensive.
+//
+// On x86_64 it reads the TSC, and on aarch64 the virtual counter. Both tick
+// at a constant rate on the platforms we support, which is measured once by
+// Calibrate() against the steady clock. On other architectures it falls back
+// to the steady clock itself, counting nanoseconds.
+class CycleClock {
+ public:
+  static inline uint64_t Now() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  // Measures the tick rate of Now(). Only needs to be called once, before
+  // converting ticks to time. Blocks for about the given duration.
+  static void Calibrate(std::chrono::milliseconds duration = std::chrono::milliseconds(20));
+
+  static double TicksPerMicro() { return ticks_per_micro_.load(std::memory_order_relaxed); }
+
+  static uint64_t ToMicros(uint64_t ticks) {
+    return static_cast<uint64_t>(static_cast<double>(ticks) / TicksPerMicro());
+  }
+
+ private:
+  // Defaults to the rate of the steady clock fallback.
+  static std::atomic<double> ticks_per_micro_;
+};
+
+}  // namespace collector
@@ -0,0 +1,36 @@
+#include "EventLane.h"
+
+#include <algorithm>
+#include <cctype>
+#include <ostream>
+
+namespace collector {
+
+std::ostream& operator<<(std::ostream& os, LanePolicy policy) {
+  switch (policy) {
+    case LanePolicy::DROP:
+      return os << "drop";
+    case LanePolicy::BLOCK:
+      return os << "block";
+  }
+  return os << "unknown";
+}
+
+bool ParseLanePolicy(const std::string& str, LanePolicy* policy) {
+  std::string lower(str);
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) -> char {
+    return static_cast<char>(std::tolower(c));
+  });
+
+  if (lower == "drop") {
+    *policy = LanePolicy::DROP;
+    return true;
+  }
+  if (lower == "block") {
+    *policy = LanePolicy::BLOCK;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace collector
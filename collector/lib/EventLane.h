@@ -0,0 +1,173 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "CollectorStats.h"
+#include "Logging.h"
+#include "SpscQueue.h"
+#include "StoppableThread.h"
+
+namespace collector {
+
+// What to do when a producer finds its lane full.
+enum class LanePolicy : uint8_t {
+  // Drop the new item right away. The producer never waits.
+  DROP = 0,
+  // Wait for the consumer to free a slot, up to a bounded amount of time,
+  // then drop the item. Once a wait has timed out, the lane drops without
+  // waiting until the consumer has drained it, so a stalled consumer costs
+  // the producer (i.e. the ring-buffer reader) a single wait, not one per
+  // item.
+  BLOCK,
+};
+
+std::ostream& operator<<(std::ostream& os, LanePolicy policy);
+bool ParseLanePolicy(const std::string& str, LanePolicy* policy);
+
+// A bounded single-producer/single-consumer lane, drained by a dedicated
+// worker thread which hands every item to the consumer callback.
+//
+// Queue depth, stalls (producer found the lane full) and drops are exported
+// through the given CollectorStats counters.
+template <typename T>
+class EventLane {
+ public:
+  using Consumer = std::function<void(T&)>;
+
+  struct Counters {
+    CollectorStats::CounterType depth;
+    CollectorStats::CounterType stalls;
+    CollectorStats::CounterType drops;
+  };
+
+  static constexpr auto kMaxBlockTime = std::chrono::milliseconds(10);
+
+  EventLane(std::string name, size_t capacity, LanePolicy policy, Counters counters, Consumer consumer)
+      : name_(std::move(name)), queue_(capacity), policy_(policy), counters_(counters), consumer_(std::move(consumer)) {}
+
+  EventLane(const EventLane&) = delete;
+  EventLane(EventLane&&) = delete;
+  EventLane& operator=(const EventLane&) = delete;
+  EventLane& operator=(EventLane&&) = delete;
+
+  ~EventLane() {
+    Stop();
+  }
+
+  bool Start() {
+    CLOG(INFO) << "Starting event lane " << name_ << " (capacity=" << queue_.Capacity() << ", policy=" << policy_ << ")";
+    return thread_.Start([this] { Run(); });
+  }
+
+  // Stops the worker after the items already queued have been consumed.
+  void Stop() {
+    if (thread_.running()) {
+      thread_.Stop();
+    }
+  }
+
+  // Must only be called from the producer thread. Returns false if the
+  // item was dropped.
+  bool Push(T&& item) {
+    if (congested_ && queue_.Empty()) {
+      congested_ = false;
+    }
+
+    if (queue_.TryPush(std::move(item))) {
+      return true;
+    }
+
+    COUNTER_INC(counters_.stalls);
+
+    if (policy_ == LanePolicy::BLOCK && !congested_) {
+      auto deadline = std::chrono::steady_clock::now() + kMaxBlockTime;
+      do {
+        std::this_thread::yield();
+        if (queue_.TryPush(std::move(item))) {
+          return true;
+        }
+      } while (std::chrono::steady_clock::now() < deadline);
+
+      congested_ = true;
+    }
+
+    COUNTER_INC(counters_.drops);
+    CLOG_THROTTLED(WARNING, std::chrono::seconds(30)) << "Event lane " << name_ << " is full, dropping events";
+    return false;
+  }
+
+  // Same as Push, but waits as long as it takes for the consumer to free a
+  // slot, whatever the policy of the lane, for items which must not be lost.
+  // Returns false if the item was dropped because the worker is not
+  // running.
+  bool PushWait(T&& item) {
+    while (!queue_.TryPush(std::move(item))) {
+      if (!thread_.running() || thread_.should_stop()) {
+        COUNTER_INC(counters_.drops);
+        return false;
+      }
+      COUNTER_INC(counters_.stalls);
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  size_t Depth() const { return queue_.Size(); }
+  const std::string& GetName() const { return name_; }
+
+ private:
+  // Number of items consumed between two updates of the depth gauge.
+  static constexpr size_t kDepthUpdateInterval = 256;
+
+  void Run() {
+    T item;
+    size_t consumed = 0;
+    auto idle_wait = std::chrono::microseconds(0);
+
+    while (!thread_.should_stop()) {
+      if (queue_.TryPop(&item)) {
+        consumer_(item);
+        idle_wait = std::chrono::microseconds(0);
+
+        if (++consumed % kDepthUpdateInterval == 0) {
+          COUNTER_SET(counters_.depth, queue_.Size());
+        }
+        continue;
+      }
+
+      COUNTER_SET(counters_.depth, 0);
+
+      // Back off progressively while idle, so an empty lane costs close to
+      // nothing, but a burst is picked up again quickly.
+      if (idle_wait < kMaxIdleWait) {
+        idle_wait += std::chrono::microseconds(10);
+      }
+      std::this_thread::sleep_for(idle_wait);
+    }
+
+    // Drain whatever is left, so nothing accepted into the lane is lost
+    // during a clean shutdown.
+    while (queue_.TryPop(&item)) {
+      consumer_(item);
+    }
+    COUNTER_SET(counters_.depth, 0);
+  }
+
+  static constexpr auto kMaxIdleWait = std::chrono::microseconds(500);
+
+  std::string name_;
+  SpscQueue<T> queue_;
+  LanePolicy policy_;
+  // Set when a blocking push timed out, cleared once the lane is empty.
+  // Only accessed from the producer thread.
+  bool congested_ = false;
+  Counters counters_;
+  Consumer consumer_;
+  StoppableThread thread_;
+};
+
+}  // namespace collector
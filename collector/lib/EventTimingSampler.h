@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+
+#include "CycleClock.h"
+
+namespace collector {
+
+// Accumulates per event type parse and process durations, measured with the
+// CycleClock on one out of every `sample_rate` events of each type.
+//
+// Totals are extrapolated from the sampled events, so they remain
+// comparable with timing every single event: dividing them by the number of
+// events of the same type still gives the average duration.
+//
+// Only the event loop thread is expected to call ShouldSample() and the Add
+// methods, while the totals can be read from any thread.
+template <size_t NumTypes>
+class EventTimingSampler {
+ public:
+  EventTimingSampler() {
+    Configure(1, std::bitset<NumTypes>());
+  }
+
+  // Event types not set in `enabled` are never timed.
+  void Configure(uint32_t sample_rate, const std::bitset<NumTypes>& enabled) {
+    sample_rate_ = sample_rate == 0 ? 1 : sample_rate;
+    enabled_ = enabled;
+    any_enabled_ = enabled.any();
+    // Always sample the first event of each type.
+    countdown_.fill(1);
+  }
+
+  // Whether the current event of the given type is to be timed. Must be
+  // called exactly once per event for the sampling to be accurate.
+  bool ShouldSample(size_t type) {
+    if (!enabled_[type]) {
+      return false;
+    }
+    if (--countdown_[type] != 0) {
+      return false;
+    }
+    countdown_[type] = sample_rate_;
+    return true;
+  }
+
+  void AddParse(size_t type, uint64_t ticks) { Add(&parse_ticks_[type], ticks); }
+  void AddProcess(size_t type, uint64_t ticks) { Add(&process_ticks_[type], ticks); }
+
+  uint64_t ParseMicros(size_t type) const { return Extrapolate(parse_ticks_[type]); }
+  uint64_t ProcessMicros(size_t type) const { return Extrapolate(process_ticks_[type]); }
+
+  uint32_t SampleRate() const { return sample_rate_; }
+  bool Enabled(size_t type) const { return enabled_[type]; }
+  // Whether any event type is timed at all. Cheap enough to check before
+  // the type of the next event is known.
+  bool AnyEnabled() const { return any_enabled_; }
+
+ private:
+  // Single writer, so there is no need for an atomic read-modify-write.
+  static void Add(std::atomic<uint64_t>* total, uint64_t ticks) {
+    total->store(total->load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+  }
+
+  uint64_t Extrapolate(const std::atomic<uint64_t>& ticks) const {
+    return CycleClock::ToMicros(ticks.load(std::memory_order_relaxed) * sample_rate_);
+  }
+
+  uint32_t sample_rate_;
+  std::bitset<NumTypes> enabled_;
+  bool any_enabled_;
+  std::array<uint32_t, NumTypes> countdown_;
+  std::array<std::atomic<uint64_t>, NumTypes> parse_ticks_ = {{}};
+  std::array<std::atomic<uint64_t>, NumTypes> process_ticks_ = {{}};
+};
+
+}  // namespace collector
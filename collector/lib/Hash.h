@@ -1,9 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+
 namespace collector {
 
 namespace internal {
@@ -74,6 +79,33 @@ size_t Hash(const std::array<T, N>& array) {
   return hash;
 }
 
+// MixWords multiplies two words into a 128-bit product and folds it, which spreads every input bit over all output
+// bits. This is the mixing function of wyhash.
+inline uint64_t MixWords(uint64_t a, uint64_t b) {
+  __uint128_t product = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+// HashWords computes a high-quality 64-bit hash of a fixed number of words, two at a time, in the style of wyhash.
+// Plain data keys (addresses, connections) should be hashed with it in one shot, rather than field by field with
+// HashAll, whose output varies in few bits for keys that differ in few bits.
+template <size_t N>
+uint64_t HashWords(const std::array<uint64_t, N>& words, uint64_t seed = 0) {
+  constexpr uint64_t kSecret0 = 0xa0761d6478bd642fULL;
+  constexpr uint64_t kSecret1 = 0xe7037ed1a0b428dbULL;
+  constexpr uint64_t kSecret2 = 0x8ebc6af09c88c6e3ULL;
+
+  uint64_t hash = seed ^ kSecret0;
+  size_t i = 0;
+  for (; i + 1 < N; i += 2) {
+    hash = MixWords(words[i] ^ kSecret1, words[i + 1] ^ hash);
+  }
+  if (i < N) {
+    hash = MixWords(words[i] ^ kSecret1, hash ^ kSecret2);
+  }
+  return MixWords(hash ^ kSecret2, (N * sizeof(uint64_t)) ^ kSecret1);
+}
+
 // Hasher is a function object that hashes values by calling the free function Hash(value), in an ADL-enabled fashion.
 struct Hasher {
   template <typename T>
@@ -99,4 +131,24 @@ using UnorderedSet = std::unordered_set<E, Hasher>;
 template <typename K, typename V, typename E = std::equal_to<K>>
 using UnorderedMap = std::unordered_map<K, V, Hasher, E>;
 
+// FlatHasher is a Hasher whose output is well spread over all bits, as needed by open-addressing tables. SwissTables
+// use the 7 lowest bits of the hash as a fingerprint and the others to probe, while Hash() values are mostly combined
+// integers which vary in few bits.
+struct FlatHasher {
+  template <typename T>
+  size_t operator()(const T& val) const {
+    return MixWords(Hasher()(val), 0x9e3779b97f4a7c15ULL);
+  }
+};
+
+// FlatHashSet and FlatHashMap are open-addressing (SwissTable) containers, storing elements inline in a single array
+// probed a group of control bytes at a time. They are faster and smaller than UnorderedSet and UnorderedMap for small
+// elements, but do not provide pointer stability: inserting may move all elements, and invalidates iterators. Erasing
+// does not move other elements, so erasing while iterating is done with `erase(it++)`.
+template <typename E>
+using FlatHashSet = absl::flat_hash_set<E, FlatHasher>;
+
+template <typename K, typename V, typename E = std::equal_to<K>>
+using FlatHashMap = absl::flat_hash_map<K, V, FlatHasher, E>;
+
 }  // namespace collector
@@ -29,10 +29,14 @@ class IKernelDriver {
    * using g_syscall_table.
    */
   std::unordered_set<ppm_sc_code> GetSyscallList(const CollectorConfig& config) {
+    return GetSyscallList(config.Syscalls());
+  }
+
+  static std::unordered_set<ppm_sc_code> GetSyscallList(const std::vector<std::string>& syscalls) {
     std::unordered_set<ppm_sc_code> ppm_sc;
     const EventNames& event_names = EventNames::GetInstance();
 
-    for (const auto& syscall_str : config.Syscalls()) {
+    for (const auto& syscall_str : syscalls) {
       for (ppm_event_code event_id : event_names.GetEventIDs(syscall_str)) {
         uint16_t syscall_id = event_names.GetEventSyscallID(event_id);
         if (!syscall_id) {
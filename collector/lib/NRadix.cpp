@@ -1,38 +1,86 @@
-/* Based on src/core/ngx_radix_tree.c from NGINX
- *
- * Copyright (C) 2002-2021 Igor Sysoev
- * Copyright (C) 2011-2021 Nginx, Inc.
- * All rights reserved.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- *
- * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
- * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
- * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
- * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
- * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
- * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
- * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
- * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
- * SUCH DAMAGE.
- */
-
 #include "NRadix.h"
 
+#include <algorithm>
+
 #include "Utility.h"
 
 namespace collector {
 
-bool NRadixTree::Insert(const IPNet& network) const {
+namespace {
+
+inline uint64_t SlotMask(uint32_t slot) {
+  // All the bits up to and including `slot`. For slot 63 the shift wraps to 0, yielding all ones.
+  return (2ULL << slot) - 1;
+}
+
+}  // namespace
+
+NRadixTree::NRadixTree(const std::vector<IPNet>& networks) {
+  for (const auto& network : networks) {
+    auto inserted = this->Insert(network);
+    if (!inserted) {
+      CLOG(ERROR) << "Failed to insert CIDR " << network << " in network tree";
+    }
+  }
+  // Trees built from a list are usually published right away; pay for the lookup structure now rather
+  // than in the first Find.
+  EnsureBuilt();
+}
+
+NRadixTree::NRadixTree(const NRadixTree& other) {
+  std::lock_guard<std::mutex> lock(other.build_mutex_);
+  ipv4_networks_ = other.ipv4_networks_;
+  ipv6_networks_ = other.ipv6_networks_;
+  ipv4_table_ = other.ipv4_table_;
+  ipv6_table_ = other.ipv6_table_;
+  dirty_.store(other.dirty_.load());
+}
+
+NRadixTree& NRadixTree::operator=(const NRadixTree& other) {
+  if (this == &other) {
+    return *this;
+  }
+  std::scoped_lock lock(build_mutex_, other.build_mutex_);
+  ipv4_networks_ = other.ipv4_networks_;
+  ipv6_networks_ = other.ipv6_networks_;
+  ipv4_table_ = other.ipv4_table_;
+  ipv6_table_ = other.ipv6_table_;
+  dirty_.store(other.dirty_.load());
+  return *this;
+}
+
+NRadixTree::Key NRadixTree::MakeKey(const Address& address, uint32_t bits) {
+  const uint64_t* data = address.u64_data();
+  Key key;
+  key.hi = ntohll(data[0]);
+  key.lo = ntohll(data[1]);
+  key.bits = bits;
+
+  if (bits < 64) {
+    key.hi &= bits == 0 ? 0 : ~(~0ULL >> bits);
+    key.lo = 0;
+  } else if (bits < 128) {
+    key.lo &= ~(~0ULL >> (bits - 64));
+  }
+  return key;
+}
+
+uint32_t NRadixTree::Chunk(const Key& key, uint32_t pos, uint32_t len) {
+  // Bits past the end of the address read as 0, which is consistent with how keys are masked.
+  uint64_t word;
+  if (pos == 0) {
+    word = key.hi;
+  } else if (pos < 64) {
+    word = (key.hi << pos) | (key.lo >> (64 - pos));
+  } else if (pos < 128) {
+    word = key.lo << (pos - 64);
+  } else {
+    word = 0;
+  }
+  return static_cast<uint32_t>(word >> (64 - len));
+}
+
+bool NRadixTree::Insert(const IPNet& network) {
   if (network.IsNull()) {
     CLOG(ERROR) << "Cannot handle null IP networks in network tree";
     return false;
@@ -43,212 +91,242 @@ bool NRadixTree::Insert(const IPNet& network) const {
     return false;
   }
 
-  const uint64_t* addr_p = network.address().u64_data();
-  const auto net_mask = network.net_mask_array();
-  const uint64_t* net_mask_p = net_mask.data();
-  uint64_t bit(0x8000000000000000ULL);
-
-  nRadixNode* node = this->root_;
-  nRadixNode* next = this->root_;
-
-  size_t i = 0;
-  // Traverse the tree for the bits that already exist in the tree.
-  while (bit & *net_mask_p) {
-    // If the bit is set, go right, otherwise left.
-    if (ntohll(*addr_p) & bit) {
-      next = node->right_;
-    } else {
-      next = node->left_;
-    }
+  auto& networks = network.family() == Address::Family::IPV4 ? ipv4_networks_ : ipv6_networks_;
+  auto inserted = networks.emplace(MakeKey(network.address(), network.bits()), network).second;
+  if (!inserted) {
+    CLOG(ERROR) << "CIDR " << network << " already exists";
+    return false;
+  }
 
-    if (!next) {
-      break;
-    }
+  dirty_.store(true, std::memory_order_relaxed);
+  return true;
+}
 
-    bit >>= 1;
-    node = next;
+void NRadixTree::EnsureBuilt() const {
+  if (!dirty_.load(std::memory_order_acquire)) {
+    return;
+  }
 
-    if (bit == 0) {
-      // We have walked 128 bits, stop.
-      if (++i >= Address::kU64MaxLen) {
-        break;
-      }
+  std::lock_guard<std::mutex> lock(build_mutex_);
+  if (!dirty_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  ipv4_table_.Build(ipv4_networks_);
+  ipv6_table_.Build(ipv6_networks_);
+  dirty_.store(false, std::memory_order_release);
+}
 
-      // Reset and move to lower part.
-      bit = 0x8000000000000000ULL;
-      if (network.bits() >= 64) {
-        addr_p++;
-        net_mask_p++;
-      }
-    }
+const NRadixTree::Table* NRadixTree::TableFor(Address::Family family) const {
+  switch (family) {
+    case Address::Family::IPV4:
+      return &ipv4_table_;
+    case Address::Family::IPV6:
+      return &ipv6_table_;
+    default:
+      return nullptr;
   }
+}
 
-  // We finished walking network bits of mask and a node already exist, try updating it with the value.
-  if (next) {
-    // Node already filled. Indicate that the new node was not actually inserted.
-    if (node->value_) {
-      CLOG(ERROR) << "CIDR " << network << " already exists";
-      return false;
+void NRadixTree::FillSlots(const std::vector<Key>& keys, size_t begin, size_t end, uint32_t pos, uint32_t stride, uint32_t def, std::vector<uint32_t>* slots) {
+  slots->assign(1U << stride, def);
+  // Keys are sorted so that a network always comes before the networks it contains, hence longer
+  // prefixes overwrite the slots of the shorter ones covering them.
+  for (size_t i = begin; i < end; i++) {
+    const Key& key = keys[i];
+    if (key.bits <= pos || key.bits > pos + stride) {
+      continue;
     }
-    node->value_ = new IPNet(network);
-    return true;
+    uint32_t first = Chunk(key, pos, stride);
+    uint32_t count = 1U << (pos + stride - key.bits);
+    std::fill_n(slots->begin() + first, count, static_cast<uint32_t>(i + 1));
   }
+}
 
-  // There still are bits to be walked, so go ahead and add them to the tree.
-  while (bit & *net_mask_p) {
-    next = new nRadixNode();
+void NRadixTree::Table::Build(const std::map<Key, IPNet>& networks) {
+  top.clear();
+  nodes.clear();
+  leaves.clear();
+  prefixes.clear();
+  parents.clear();
 
-    if (ntohll(*addr_p) & bit) {
-      node->right_ = next;
-    } else {
-      node->left_ = next;
-    }
-
-    bit >>= 1;
-    node = next;
+  if (networks.empty()) {
+    return;
+  }
 
-    if (bit == 0) {
-      // We have walked all 128 bits, stop.
-      if (++i >= Address::kU64MaxLen) {
+  std::vector<Key> keys;
+  keys.reserve(networks.size());
+  prefixes.reserve(networks.size());
+  parents.reserve(networks.size());
+
+  // The map order puts every network right before the networks it contains, so the chain of
+  // containing networks of the current one is always the top of a stack.
+  std::vector<uint32_t> containing;
+  for (const auto& [key, network] : networks) {
+    while (!containing.empty()) {
+      const Key& outer = keys[containing.back()];
+      Key masked = MakeKey(network.address(), outer.bits);
+      if (masked.hi == outer.hi && masked.lo == outer.lo) {
         break;
       }
-
-      bit = 0x8000000000000000ULL;
-      if (network.bits() >= 64) {
-        addr_p++;
-        net_mask_p++;
-      }
+      containing.pop_back();
     }
+    parents.push_back(containing.empty() ? 0 : containing.back() + 1);
+    containing.push_back(keys.size());
+    keys.push_back(key);
+    prefixes.push_back(network);
   }
 
-  node->value_ = new IPNet(network);
-  return true;
-}
-
-IPNet NRadixTree::Find(const IPNet& network) const {
-  if (network.IsNull()) {
-    return {};
-  }
+  FillSlots(keys, 0, keys.size(), 0, top_bits, 0, &top);
 
-  if (network.bits() == 0) {
-    CLOG(ERROR) << "Cannot handle CIDR " << network << " with /0, in network tree";
-    return {};
-  }
-
-  const uint64_t* addr_p = network.address().u64_data();
-  const auto net_mask = network.net_mask_array();
-  const uint64_t* net_mask_p = net_mask.data();
-  uint64_t bit(0x8000000000000000ULL);
-
-  IPNet ret;
-  nRadixNode* node = this->root_;
+  // Networks longer than the top-level stride continue into nodes, grouped by top-level slot.
   size_t i = 0;
-  while (node) {
-    if (node->value_) {
-      ret = *node->value_;
+  while (i < keys.size()) {
+    if (keys[i].bits <= top_bits) {
+      i++;
+      continue;
     }
-
-    if (ntohll(*addr_p) & bit) {
-      node = node->right_;
-    } else {
-      node = node->left_;
+    uint32_t slot = Chunk(keys[i], 0, top_bits);
+    size_t end = i + 1;
+    while (end < keys.size() && Chunk(keys[end], 0, top_bits) == slot) {
+      end++;
     }
+    auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+    BuildNode(keys, i, end, top_bits, top[slot], index);
+    top[slot] = kNodeFlag | index;
+    i = end;
+  }
+}
 
-    // All network bits are traversed. If a supernet was found along the way, `ret` holds it,
-    // else there does not exist any supernet containing the search network/address.
-    if (!(*net_mask_p & bit)) {
-      break;
+void NRadixTree::Table::BuildNode(const std::vector<Key>& keys, size_t begin, size_t end, uint32_t pos, uint32_t def, uint32_t index) {
+  std::vector<uint32_t> slots;
+  FillSlots(keys, begin, end, pos, kStride, def, &slots);
+
+  struct ChildRange {
+    uint32_t slot;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<ChildRange> children;
+  for (size_t i = begin; i < end; i++) {
+    if (keys[i].bits <= pos + kStride) {
+      continue;
     }
+    uint32_t slot = Chunk(keys[i], pos, kStride);
+    if (!children.empty() && children.back().slot == slot) {
+      children.back().end = i + 1;
+    } else {
+      children.push_back({slot, i, i + 1});
+    }
+  }
 
-    bit >>= 1;
-
-    if (bit == 0) {
-      // We have walked 128 bits, stop.
-      if (++i >= Address::kU64MaxLen) {
-        if (node && node->value_) {
-          ret = *node->value_;
-        }
-        break;
-      }
+  Node node;
+  for (const auto& child : children) {
+    node.vector |= 1ULL << child.slot;
+  }
 
-      bit = 0x8000000000000000ULL;
-      if (network.bits() >= 64) {
-        addr_p++;
-        net_mask_p++;
-      }
+  node.base0 = static_cast<uint32_t>(leaves.size());
+  bool first_leaf = true;
+  for (uint32_t slot = 0; slot < (1U << kStride); slot++) {
+    if (node.vector & (1ULL << slot)) {
+      continue;
+    }
+    if (first_leaf || slots[slot] != leaves.back()) {
+      node.leafvec |= 1ULL << slot;
+      leaves.push_back(slots[slot]);
+      first_leaf = false;
     }
   }
 
-  return (network.family() == ret.family()) ? ret : IPNet();
-}
+  // Children of a node are contiguous so that they can be addressed by popcount from base1.
+  node.base1 = static_cast<uint32_t>(nodes.size());
+  nodes[index] = node;
+  nodes.resize(nodes.size() + children.size());
 
-IPNet NRadixTree::Find(const Address& addr) const {
-  return Find(IPNet(addr));
+  for (size_t i = 0; i < children.size(); i++) {
+    const auto& child = children[i];
+    BuildNode(keys, child.begin, child.end, pos + kStride, slots[child.slot], node.base1 + i);
+  }
 }
 
-void getAll(nRadixNode* node, std::vector<IPNet>& ret) {
-  if (!node) {
-    return;
+uint32_t NRadixTree::Table::Lookup(const Key& key) const {
+  if (top.empty()) {
+    return 0;
   }
 
-  if (node->value_) {
-    ret.push_back(*node->value_);
+  uint32_t entry = top[Chunk(key, 0, top_bits)];
+  if (!(entry & kNodeFlag)) {
+    return entry;
   }
 
-  getAll(node->left_, ret);
-  getAll(node->right_, ret);
+  const Node* node = &nodes[entry & ~kNodeFlag];
+  uint32_t pos = top_bits;
+  while (true) {
+    uint32_t slot = Chunk(key, pos, kStride);
+    uint64_t mask = SlotMask(slot);
+    if (!(node->vector & (1ULL << slot))) {
+      return leaves[node->base0 + __builtin_popcountll(node->leafvec & mask) - 1];
+    }
+    node = &nodes[node->base1 + __builtin_popcountll(node->vector & mask) - 1];
+    pos += kStride;
+  }
 }
 
-std::vector<IPNet> NRadixTree::GetAll() const {
-  std::vector<IPNet> ret;
-  getAll(this->root_, ret);
-  return ret;
+const IPNet* NRadixTree::Table::FindSupernet(const Key& key, uint32_t bits) const {
+  // All the stored networks containing an address form a chain; walk it up from the longest one until
+  // the prefix is short enough to contain the whole queried network.
+  uint32_t match = Lookup(key);
+  while (match && prefixes[match - 1].bits() > bits) {
+    match = parents[match - 1];
+  }
+  return match ? &prefixes[match - 1] : nullptr;
 }
 
-// Check if any subnet in n2's (sub-)tree is fully contained by a subnet in n1's (sub-)tree.
-bool isAnyIPNetSubsetUtil(Address::Family family, const nRadixNode* n1, const nRadixNode* n2,
-                          const IPNet* containing_net, const IPNet* contained_net) {
-  // If we have found networks from both trees belonging to same family, we have the answer.
-  if (containing_net && contained_net) {
-    if (family == Address::Family::UNKNOWN) {
-      if (containing_net->family() == contained_net->family()) {
-        return true;
-      }
-    } else {
-      if (containing_net->family() == family && contained_net->family() == family) {
-        return true;
-      }
-    }
+IPNet NRadixTree::Find(const IPNet& network) const {
+  if (network.IsNull()) {
+    return {};
   }
 
-  // There are no more networks down the path in second tree, so stop.
-  if (!n2) {
-    return false;
+  if (network.bits() == 0) {
+    CLOG(ERROR) << "Cannot handle CIDR " << network << " with /0, in network tree";
+    return {};
   }
 
-  if (n1 && n1->value_) {
-    containing_net = n1->value_;
+  const Table* table = TableFor(network.family());
+  if (!table) {
+    return {};
   }
 
-  if (n2->value_) {
-    contained_net = n2->value_;
+  EnsureBuilt();
+  const IPNet* match = table->FindSupernet(MakeKey(network.address(), 128), network.bits());
+  return match ? *match : IPNet();
+}
+
+IPNet NRadixTree::Find(const Address& addr) const {
+  const Table* table = TableFor(addr.family());
+  if (!table) {
+    return {};
   }
 
-  // If we find a network in first tree, that means it contains
-  // some subnet in network in n2 subtree. However, former may
-  // belong to IPv4 and later may belong to IPv6. Hence, continue
-  // finding the smaller network down the path.
+  EnsureBuilt();
+  uint32_t match = table->Lookup(MakeKey(addr, 128));
+  return match ? table->prefixes[match - 1] : IPNet();
+}
 
-  if (n1) {
-    return isAnyIPNetSubsetUtil(family, n1->left_, n2->left_, containing_net, contained_net) ||
-           isAnyIPNetSubsetUtil(family, n1->right_, n2->right_, containing_net, contained_net);
+std::vector<IPNet> NRadixTree::GetAll() const {
+  std::vector<IPNet> ret;
+  ret.reserve(ipv4_networks_.size() + ipv6_networks_.size());
+  for (const auto& [key, network] : ipv4_networks_) {
+    ret.push_back(network);
   }
-  return isAnyIPNetSubsetUtil(family, nullptr, n2->left_, containing_net, contained_net) ||
-         isAnyIPNetSubsetUtil(family, nullptr, n2->right_, containing_net, contained_net);
+  for (const auto& [key, network] : ipv6_networks_) {
+    ret.push_back(network);
+  }
+  return ret;
 }
 
 bool NRadixTree::IsEmpty() const {
-  return root_->left_ == nullptr && root_->right_ == nullptr && root_->value_ == nullptr;
+  return ipv4_networks_.empty() && ipv6_networks_.empty();
 }
 
 bool NRadixTree::IsAnyIPNetSubset(const NRadixTree& other) const {
@@ -256,7 +334,21 @@ bool NRadixTree::IsAnyIPNetSubset(const NRadixTree& other) const {
 }
 
 bool NRadixTree::IsAnyIPNetSubset(Address::Family family, const NRadixTree& other) const {
-  return isAnyIPNetSubsetUtil(family, root_, other.root_, nullptr, nullptr);
+  EnsureBuilt();
+
+  auto any_contained = [](const Table& table, const std::map<Key, IPNet>& networks) {
+    for (const auto& [key, network] : networks) {
+      if (table.FindSupernet(key, key.bits)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  if (family != Address::Family::IPV6 && any_contained(ipv4_table_, other.ipv4_networks_)) {
+    return true;
+  }
+  return family != Address::Family::IPV4 && any_contained(ipv6_table_, other.ipv6_networks_);
 }
 
 }  // namespace collector
@@ -1,34 +1,10 @@
-/* Based on src/core/ngx_radix_tree.h from NGINX
- *
- * Copyright (C) 2002-2021 Igor Sysoev
- * Copyright (C) 2011-2021 Nginx, Inc.
- * All rights reserved.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions
- * are met:
- * 1. Redistributions of source code must retain the above copyright
- *    notice, this list of conditions and the following disclaimer.
- * 2. Redistributions in binary form must reproduce the above copyright
- *    notice, this list of conditions and the following disclaimer in the
- *    documentation and/or other materials provided with the distribution.
- *
- * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
- * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
- * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
- * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
- * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
- * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
- * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
- * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
- * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
- * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
- * SUCH DAMAGE.
- */
-
 #pragma once
 
+#include <atomic>
+#include <map>
 #include <mutex>
+#include <tuple>
+#include <vector>
 
 #include "Logging.h"
 #include "NetworkConnection.h"
@@ -36,80 +12,33 @@
 
 namespace collector {
 
-struct nRadixNode {
-  nRadixNode() : value_(nullptr), left_(nullptr), right_(nullptr) {}
-  explicit nRadixNode(const IPNet& value) : value_(new IPNet(value)), left_(nullptr), right_(nullptr) {}
-
-  nRadixNode(const nRadixNode& other) : value_(nullptr), left_(nullptr), right_(nullptr) {
-    if (other.value_) {
-      value_ = new IPNet(*other.value_);
-    }
-    if (other.left_) {
-      left_ = new nRadixNode(*other.left_);
-    }
-    if (other.right_) {
-      right_ = new nRadixNode(*other.right_);
-    }
-  }
-
-  nRadixNode& operator=(const nRadixNode& other) {
-    if (this == &other) {
-      return *this;
-    }
-    auto* new_node = new nRadixNode(other);
-    std::swap(*new_node, *this);
-    delete new_node;
-    return *this;
-  }
-
-  ~nRadixNode() {
-    delete left_;
-    delete right_;
-    delete value_;
-  }
-
-  const IPNet* value_;
-  nRadixNode* left_;
-  nRadixNode* right_;
-};
-
+// NRadixTree stores IP networks and answers longest-prefix-match queries.
+//
+// Networks are kept per address family in an ordered map, which is the source of truth for insertions,
+// duplicate detection and enumeration. Lookups are served from a compressed multibit trie in the style
+// of Poptrie: a direct-pointing array indexed by the first 16 (IPv4) or 12 (IPv6) address bits, followed by
+// 6-bit stride nodes stored contiguously in a single array. Each node holds a bitmap of the slots that
+// continue into a child node and a bitmap marking where runs of identical leaves start; children and
+// leaves are then addressed by popcount from per-node base offsets, so a lookup touches at most one cache
+// line per level and never chases individually allocated nodes.
+//
+// The lookup structure is rebuilt lazily by the first Find after an insertion.
 class NRadixTree {
  public:
-  NRadixTree() : root_(new nRadixNode()) {}
-  explicit NRadixTree(const std::vector<IPNet>& networks) : root_(new nRadixNode()) {
-    for (const auto& network : networks) {
-      auto inserted = this->Insert(network);
-      if (!inserted) {
-        CLOG(ERROR) << "Failed to insert CIDR " << network << " in network tree";
-      }
-    }
-  }
-
-  NRadixTree(const NRadixTree& other) : root_(new nRadixNode(*other.root_)) {}
+  NRadixTree() = default;
+  explicit NRadixTree(const std::vector<IPNet>& networks);
 
-  ~NRadixTree() {
-    // This calls the node destructor which in turn cleans up all the nodes.
-    delete root_;
-  }
-
-  NRadixTree& operator=(const NRadixTree& other) {
-    if (this == &other) {
-      return *this;
-    }
-    delete root_;
-    // This calls the node copy constructor which in turn copies all the nodes.
-    root_ = new nRadixNode(*other.root_);
-    return *this;
-  }
+  NRadixTree(const NRadixTree& other);
+  NRadixTree& operator=(const NRadixTree& other);
 
   // Inserts a network into radix tree. If the network already exists, insertion is skipped.
   // This function does not guarantee thread safety.
-  bool Insert(const IPNet& network) const;
+  bool Insert(const IPNet& network);
   // Returns the smallest subnet larger than or equal to the queried network.
-  // This function does not guarantee thread safety.
+  // Concurrent calls are safe as long as no insertion happens at the same time.
   IPNet Find(const IPNet& network) const;
   // Returns the smallest subnet larger than or equal to the queried address.
-  // This function does not guarantee thread safety.
+  // Concurrent calls are safe as long as no insertion happens at the same time.
   IPNet Find(const Address& addr) const;
   // Returns a vector of all the stored networks.
   std::vector<IPNet> GetAll() const;
@@ -120,7 +49,65 @@ class NRadixTree {
   // Determines whether any network in `other` is fully contained by any network in this tree, for a given family.
   bool IsAnyIPNetSubset(Address::Family family, const NRadixTree& other) const;
 
-  nRadixNode* root_;
+ private:
+  // Address bits in host order, left-aligned on 128 bits, with everything past the prefix length cleared.
+  struct Key {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+    uint32_t bits = 0;
+
+    bool operator<(const Key& other) const {
+      return std::tie(hi, lo, bits) < std::tie(other.hi, other.lo, other.bits);
+    }
+  };
+
+  struct Node {
+    uint64_t vector = 0;   // Slots continuing into a child node.
+    uint64_t leafvec = 0;  // Leaf slots starting a new run of leaves.
+    uint32_t base0 = 0;    // Index of the first leaf in `leaves`.
+    uint32_t base1 = 0;    // Index of the first child in `nodes`.
+  };
+
+  struct Table {
+    explicit Table(uint32_t top_bits) : top_bits(top_bits) {}
+
+    void Build(const std::map<Key, IPNet>& networks);
+    void BuildNode(const std::vector<Key>& keys, size_t begin, size_t end, uint32_t pos, uint32_t def, uint32_t index);
+    // Returns 1 + the index in `prefixes` of the longest prefix matching `key`, or 0 if none does.
+    uint32_t Lookup(const Key& key) const;
+    // Finds the longest stored network containing `key` with a prefix length of at most `bits`.
+    const IPNet* FindSupernet(const Key& key, uint32_t bits) const;
+
+    uint32_t top_bits;
+    // Top-level entries, either a leaf value or kNodeFlag | node index.
+    std::vector<uint32_t> top;
+    std::vector<Node> nodes;
+    // Leaf values: 1 + index in `prefixes`, or 0 if no prefix covers the slot.
+    std::vector<uint32_t> leaves;
+    std::vector<IPNet> prefixes;
+    // For each prefix, 1 + the index of the longest prefix strictly containing it, or 0.
+    std::vector<uint32_t> parents;
+  };
+
+  static constexpr uint32_t kIPv4TopBits = 16;
+  static constexpr uint32_t kIPv6TopBits = 12;
+  static constexpr uint32_t kStride = 6;
+  static constexpr uint32_t kNodeFlag = 0x80000000U;
+
+  static Key MakeKey(const Address& address, uint32_t bits);
+  static uint32_t Chunk(const Key& key, uint32_t pos, uint32_t len);
+  static void FillSlots(const std::vector<Key>& keys, size_t begin, size_t end, uint32_t pos, uint32_t stride, uint32_t def, std::vector<uint32_t>* slots);
+
+  const Table* TableFor(Address::Family family) const;
+  void EnsureBuilt() const;
+
+  std::map<Key, IPNet> ipv4_networks_;
+  std::map<Key, IPNet> ipv6_networks_;
+
+  mutable Table ipv4_table_{kIPv4TopBits};
+  mutable Table ipv6_table_{kIPv6TopBits};
+  mutable std::mutex build_mutex_;
+  mutable std::atomic<bool> dirty_{false};
 };
 
 }  // namespace collector
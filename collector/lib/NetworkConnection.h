@@ -12,8 +12,12 @@
 #include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "ContainerIDInterner.h"
 #include "Hash.h"
 #include "Process.h"
 
@@ -73,7 +77,7 @@ class Address {
 
   const uint64_t* u64_data() const { return data_.data(); }
 
-  size_t Hash() const { return HashAll(data_, family_); }
+  size_t Hash() const { return HashWords(data_, static_cast<uint64_t>(family_)); }
 
   bool operator==(const Address& other) const {
     return family_ == other.family_ && data_ == other.data_;
@@ -344,13 +348,85 @@ std::ostream& operator<<(std::ostream& os, L4Proto l4proto);
 using L4ProtoPortPair = ::std::pair<L4Proto, uint16_t>;
 size_t Hash(const L4ProtoPortPair& pp);
 
-class ContainerEndpoint {
+// PackedEndpoint stores an Endpoint in 24 bytes, for use in keys that are stored in large numbers. The network mask
+// is not stored, but recomputed when needed, which is only the case for endpoints that are networks (and not
+// addresses), i.e., the result of normalization.
+class PackedEndpoint {
  public:
-  ContainerEndpoint(std::string container, const Endpoint& endpoint, L4Proto l4proto, std::shared_ptr<IProcess> originator)
-      : container_(std::move(container)), endpoint_(endpoint), l4proto_(l4proto), originator_(originator) {}
+  PackedEndpoint() : address_({0, 0}), port_(0), family_(Address::Family::UNKNOWN), bits_(0), is_addr_(false) {}
+  explicit PackedEndpoint(const Endpoint& endpoint)
+      : address_(endpoint.network().address().array()),
+        port_(endpoint.port()),
+        family_(endpoint.network().family()),
+        bits_(static_cast<uint8_t>(endpoint.network().bits())),
+        is_addr_(endpoint.network().IsAddress()) {}
+
+  Endpoint Unpack() const {
+    return Endpoint(IPNet(Address(family_, address_), bits_, is_addr_), port_);
+  }
+
+  uint16_t port() const { return port_; }
+
+  // KeyWords returns the words that equal endpoints have in common, to be hashed with HashWords: the network mask,
+  // the prefix length and the port. The mask is used for addresses too, as an address equals the network of the same
+  // length covering only that address.
+  std::array<uint64_t, Address::kU64MaxLen + 1> KeyWords() const {
+    auto mask = Mask();
+    return {mask[0], mask[1], static_cast<uint64_t>(port_) | static_cast<uint64_t>(bits_) << 16};
+  }
+
+  size_t Hash() const { return HashWords(KeyWords()); }
+
+  bool operator==(const PackedEndpoint& other) const {
+    if (port_ != other.port_ || bits_ != other.bits_) {
+      return false;
+    }
+    if (is_addr_) {
+      return family_ == other.family_ && address_ == other.address_;
+    }
+    return Mask() == other.Mask();
+  }
+
+  bool operator!=(const PackedEndpoint& other) const {
+    return !(*this == other);
+  }
 
-  const std::string& container() const { return container_; }
-  const Endpoint& endpoint() const { return endpoint_; }
+ private:
+  // Same as IPNet::mask_array().
+  std::array<uint64_t, Address::kU64MaxLen> Mask() const {
+    std::array<uint64_t, Address::kU64MaxLen> mask = {0, 0};
+    size_t i = 0;
+    size_t bits_left = bits_;
+    for (; bits_left >= 64; bits_left -= 64, i++) {
+      mask[i] = address_[i];
+    }
+    if (bits_left > 0) {
+      mask[i] = ntohll(address_[i]) & ~(~static_cast<uint64_t>(0) >> bits_left);
+    }
+    return mask;
+  }
+
+  std::array<uint64_t, Address::kU64MaxLen> address_;
+  uint16_t port_;
+  Address::Family family_;
+  uint8_t bits_;
+  bool is_addr_;
+};
+
+class ContainerEndpoint {
+ public:
+  ContainerEndpoint(std::string_view container, const Endpoint& endpoint, L4Proto l4proto, std::shared_ptr<IProcess> originator)
+      : ContainerEndpoint(ContainerIDInterner::Instance().Intern(container), endpoint, l4proto, std::move(originator)) {}
+  // Takes an already interned container ID, e.g. the one of another endpoint.
+  ContainerEndpoint(ContainerIDInterner::Handle container, const Endpoint& endpoint, L4Proto l4proto, std::shared_ptr<IProcess> originator)
+      : container_(container), endpoint_(endpoint), l4proto_(l4proto), originator_(std::move(originator)) {
+    auto words = endpoint_.KeyWords();
+    hash_ = HashWords(words, static_cast<uint64_t>(container_) << 8 | static_cast<uint64_t>(l4proto_));
+  }
+
+  const std::string& container() const { return ContainerIDInterner::Instance().Lookup(container_); }
+  ContainerIDInterner::Handle container_handle() const { return container_; }
+  Endpoint endpoint() const { return endpoint_.Unpack(); }
   const L4Proto l4proto() const { return l4proto_; }
   const std::shared_ptr<IProcess> originator() const { return originator_; }
 
@@ -366,26 +442,37 @@ class ContainerEndpoint {
     return !(*this == other);
   }
 
-  size_t Hash() const { return HashAll(container_, endpoint_, l4proto_); }
+  // The originator is not part of the hash, so that AdvertisedEndpointEquality can compare originators loosely.
+  size_t Hash() const { return hash_; }
 
  private:
-  std::string container_;
-  Endpoint endpoint_;
+  uint64_t hash_;
+  ContainerIDInterner::Handle container_;
+  PackedEndpoint endpoint_;
   L4Proto l4proto_;
   std::shared_ptr<IProcess> originator_;
 };
 
 std::ostream& operator<<(std::ostream& os, const ContainerEndpoint& container_endpoint);
 
+// Connection is the key of the connection tracker and notifier maps, of which there can be millions. It is therefore
+// kept small (64 bytes) and trivially copyable: the container ID is interned, endpoints are packed, and the hash is
+// cached. Accessors convert back to the full representation.
 class Connection {
  public:
-  Connection() : flags_(0) {}
-  Connection(std::string container, const Endpoint& local, const Endpoint& remote, L4Proto l4proto, bool is_server)
-      : container_(std::move(container)), local_(local), remote_(remote), flags_((static_cast<uint8_t>(l4proto) << 1) | ((is_server) ? 1 : 0)) {}
-
-  const std::string& container() const { return container_; }
-  const Endpoint& local() const { return local_; }
-  const Endpoint& remote() const { return remote_; }
+  Connection() : container_(ContainerIDInterner::kEmpty), flags_(0) { hash_ = ComputeHash(); }
+  Connection(std::string_view container, const Endpoint& local, const Endpoint& remote, L4Proto l4proto, bool is_server)
+      : Connection(ContainerIDInterner::Instance().Intern(container), local, remote, l4proto, is_server) {}
+  // Takes an already interned container ID, e.g. the one of another connection.
+  Connection(ContainerIDInterner::Handle container, const Endpoint& local, const Endpoint& remote, L4Proto l4proto, bool is_server)
+      : local_(local), remote_(remote), container_(container), flags_((static_cast<uint8_t>(l4proto) << 1) | ((is_server) ? 1 : 0)) {
+    hash_ = ComputeHash();
+  }
+
+  const std::string& container() const { return ContainerIDInterner::Instance().Lookup(container_); }
+  ContainerIDInterner::Handle container_handle() const { return container_; }
+  Endpoint local() const { return local_.Unpack(); }
+  Endpoint remote() const { return remote_.Unpack(); }
   bool is_server() const { return (flags_ & 0x1) != 0; }
   L4Proto l4proto() const { return static_cast<L4Proto>(flags_ >> 1); }
 
@@ -397,15 +484,27 @@ class Connection {
     return !(*this == other);
   }
 
-  size_t Hash() const { return HashAll(container_, local_, remote_, flags_); }
+  // The hash is computed once, when the connection is created, and reused by every map the connection goes through.
+  size_t Hash() const { return hash_; }
 
  private:
-  std::string container_;
-  Endpoint local_;
-  Endpoint remote_;
+  uint64_t ComputeHash() const {
+    auto local = local_.KeyWords();
+    auto remote = remote_.KeyWords();
+    return HashWords(std::array<uint64_t, 8>{local[0], local[1], local[2], remote[0], remote[1], remote[2],
+                                             static_cast<uint64_t>(container_) << 8 | flags_, 0});
+  }
+
+  uint64_t hash_;
+  PackedEndpoint local_;
+  PackedEndpoint remote_;
+  ContainerIDInterner::Handle container_;
   uint8_t flags_;
 };
 
+static_assert(std::is_trivially_copyable_v<Connection>);
+static_assert(sizeof(Connection) == 64);
+
 std::ostream& operator<<(std::ostream& os, const Connection& conn);
 
 // Checks if the given connection is relevant (i.e., it is a connection with a remote address that is
@@ -0,0 +1,30 @@
+#include "NetworkExclusions.h"
+
+#include "Logging.h"
+
+namespace collector {
+
+void NetworkExclusions::SetContainers(const std::vector<std::string>& container_ids) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto rules = std::make_shared<Rules>();
+  size_t kept = 0;
+  for (const auto& container_id : container_ids) {
+    auto it = rules_->by_container_.find(container_id);
+    if (it != rules_->by_container_.end()) {
+      kept += rules->by_container_.emplace(container_id, it->second).second;
+    } else {
+      rules->by_container_.emplace(container_id, std::make_shared<RuleStats>());
+    }
+  }
+
+  if (kept == rules_->by_container_.size() && kept == rules->by_container_.size()) {
+    return;
+  }
+
+  rules_ = std::move(rules);
+  version_.fetch_add(1, std::memory_order_release);
+  CLOG(INFO) << "Excluding network activity of " << rules_->by_container_.size() << " containers";
+}
+
+}  // namespace collector
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+namespace collector {
+
+// Containers whose network activity is not processed, as set by the
+// runtime configuration. Events of excluded containers are dropped by the
+// event loop before reaching the network signal handler, and their
+// processes are skipped when scraping /proc for connections.
+//
+// Rules are published as immutable snapshots, which readers keep for as
+// long as they need them. Counters of what each rule skipped are carried
+// over to the next snapshot as long as the rule is still present.
+class NetworkExclusions {
+ public:
+  struct RuleStats {
+    std::atomic<uint64_t> events = 0;
+    std::atomic<uint64_t> scraped_processes = 0;
+  };
+
+  class Rules {
+   public:
+    // Stats of the rule excluding the given container, or null if it is
+    // not excluded.
+    RuleStats* Match(const std::string& container_id) const {
+      if (by_container_.empty()) {
+        return nullptr;
+      }
+      auto it = by_container_.find(container_id);
+      return it == by_container_.end() ? nullptr : it->second.get();
+    }
+
+    bool empty() const { return by_container_.empty(); }
+
+    const UnorderedMap<std::string, std::shared_ptr<RuleStats>>& ByContainer() const { return by_container_; }
+
+   private:
+    friend class NetworkExclusions;
+
+    UnorderedMap<std::string, std::shared_ptr<RuleStats>> by_container_;
+  };
+
+  NetworkExclusions() : rules_(std::make_shared<Rules>()) {}
+
+  // Replaces the rules with the given (short) container IDs.
+  void SetContainers(const std::vector<std::string>& container_ids);
+
+  std::shared_ptr<const Rules> Get() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rules_;
+  }
+
+  // Bumped by SetContainers(). The event loop compares it with the version
+  // of the rules it holds, and only calls Get(), which locks, when they
+  // differ.
+  uint64_t Version() const { return version_.load(std::memory_order_acquire); }
+
+ private:
+  mutable std::mutex mutex_;
+  std::shared_ptr<const Rules> rules_;
+  std::atomic<uint64_t> version_ = 0;
+};
+
+}  // namespace collector
@@ -1,9 +1,11 @@
 #include "NetworkSignalHandler.h"
 
+#include <cstring>
 #include <optional>
 
 #include <libsinsp/sinsp.h>
 
+#include "CollectorStats.h"
 #include "EventMap.h"
 #include "Utility.h"
 #include "system-inspector/EventExtractor.h"
@@ -16,6 +18,7 @@ enum class Modifier : uint8_t {
   INVALID = 0,
   ADD,
   REMOVE,
+  EXIT,
 };
 
 EventMap<Modifier> modifiers = {
@@ -26,6 +29,7 @@ EventMap<Modifier> modifiers = {
         {"accept<", Modifier::ADD},
         {"accept4<", Modifier::ADD},
         {"getsockopt<", Modifier::ADD},
+        {"procexit>", Modifier::EXIT},
         {"sendto<", Modifier::ADD},
         {"sendto>", Modifier::ADD},
         {"sendmsg<", Modifier::ADD},
@@ -41,6 +45,29 @@ EventMap<Modifier> modifiers = {
     Modifier::INVALID,
 };
 
+// The raw socket tuple sinsp keeps for the fd, along with its type,
+// protocol and role. Two sockets with the same signature resolve to the same
+// connection.
+ConnectionCache::Signature SocketSignature(const sinsp_fdinfo& fd_info) {
+  static_assert(sizeof(fd_info.m_sockinfo.m_ipv6info) <= ConnectionCache::kSignatureSize - 4);
+
+  ConnectionCache::Signature signature{};
+  signature[0] = static_cast<uint8_t>(fd_info.m_type);
+  signature[1] = static_cast<uint8_t>(fd_info.get_l4proto());
+  signature[2] = fd_info.is_role_server() ? 1 : (fd_info.is_role_client() ? 2 : 0);
+  switch (fd_info.m_type) {
+    case SCAP_FD_IPV4_SOCK:
+      std::memcpy(&signature[4], &fd_info.m_sockinfo.m_ipv4info, sizeof(fd_info.m_sockinfo.m_ipv4info));
+      break;
+    case SCAP_FD_IPV6_SOCK:
+      std::memcpy(&signature[4], &fd_info.m_sockinfo.m_ipv6info, sizeof(fd_info.m_sockinfo.m_ipv6info));
+      break;
+    default:
+      break;
+  }
+  return signature;
+}
+
 }  // namespace
 
 NetworkSignalHandler::NetworkSignalHandler(sinsp* inspector, std::shared_ptr<ConnectionTracker> conn_tracker, system_inspector::Stats* stats)
@@ -70,10 +97,14 @@ NetworkSignalHandler::~NetworkSignalHandler() = default;
 std::optional<Connection> NetworkSignalHandler::GetConnection(sinsp_evt* evt) {
   auto* fd_info = evt->get_fd_info();
 
-  if (!fd_info) {
+  if (!fd_info || !IsSuccessfulSocketEvent(evt, *fd_info)) {
     return std::nullopt;
   }
 
+  return ResolveConnection(evt, *fd_info);
+}
+
+bool NetworkSignalHandler::IsSuccessfulSocketEvent(sinsp_evt* evt, const sinsp_fdinfo& fd_info) {
   // With collect_connection_status_ set, we can prevent reporting of asynchronous
   // connections which fail. This check is only relevant for connection
   // establishment events (connect, accept, getsockopt). For send/recv events,
@@ -98,11 +129,11 @@ std::optional<Connection> NetworkSignalHandler::GetConnection(sinsp_evt* evt) {
       case PPME_SOCKET_RECVMMSG_X:
         break;
       default:
-        if (fd_info->is_socket_failed()) {
-          return std::nullopt;
+        if (fd_info.is_socket_failed()) {
+          return false;
         }
-        if (fd_info->is_socket_pending()) {
-          return std::nullopt;
+        if (fd_info.is_socket_pending()) {
+          return false;
         }
         break;
     }
@@ -111,16 +142,19 @@ std::optional<Connection> NetworkSignalHandler::GetConnection(sinsp_evt* evt) {
   auto res = event_extractor_->get_event_rawres(evt);
   if (!res.has_value() || res.value() < 0) {
     // ignore unsuccessful events for now.
-    return std::nullopt;
+    return false;
   }
+  return true;
+}
 
-  bool is_server = fd_info->is_role_server();
-  if (!is_server && !fd_info->is_role_client()) {
+std::optional<Connection> NetworkSignalHandler::ResolveConnection(sinsp_evt* evt, const sinsp_fdinfo& fd_info) {
+  bool is_server = fd_info.is_role_server();
+  if (!is_server && !fd_info.is_role_client()) {
     return std::nullopt;
   }
 
   L4Proto l4proto;
-  switch (fd_info->get_l4proto()) {
+  switch (fd_info.get_l4proto()) {
     case SCAP_L4_TCP:
       l4proto = L4Proto::TCP;
       break;
@@ -132,15 +166,15 @@ std::optional<Connection> NetworkSignalHandler::GetConnection(sinsp_evt* evt) {
   }
 
   Endpoint client, server;
-  switch (fd_info->m_type) {
+  switch (fd_info.m_type) {
     case SCAP_FD_IPV4_SOCK: {
-      const auto& ipv4_fields = fd_info->m_sockinfo.m_ipv4info.m_fields;
+      const auto& ipv4_fields = fd_info.m_sockinfo.m_ipv4info.m_fields;
       client = Endpoint(Address(ipv4_fields.m_sip), ipv4_fields.m_sport);
       server = Endpoint(Address(ipv4_fields.m_dip), ipv4_fields.m_dport);
       break;
     }
     case SCAP_FD_IPV6_SOCK: {
-      const auto& ipv6_fields = fd_info->m_sockinfo.m_ipv6info.m_fields;
+      const auto& ipv6_fields = fd_info.m_sockinfo.m_ipv6info.m_fields;
       client = Endpoint(Address(ipv6_fields.m_sip.m_b), ipv6_fields.m_sport);
       server = Endpoint(Address(ipv6_fields.m_dip.m_b), ipv6_fields.m_dport);
       break;
@@ -160,21 +194,195 @@ std::optional<Connection> NetworkSignalHandler::GetConnection(sinsp_evt* evt) {
   return {Connection(container_id, *local, *remote, l4proto, is_server)};
 }
 
+std::string NetworkSignalHandler::GetContainerID(sinsp_evt* evt) {
+  const auto* tinfo = evt->get_thread_info();
+  if (container_id_cache_ && tinfo) {
+    const auto* entry = container_id_cache_->Lookup(tinfo->m_tid, ContainerIDCache::GenerationOf(*tinfo));
+    if (entry) {
+      ++(stats_->nContainerIDCacheHits);
+      return entry->container_id;
+    }
+    ++(stats_->nContainerIDCacheMisses);
+  }
+
+  return collector::GetContainerID(evt);
+}
+
 SignalHandler::Result NetworkSignalHandler::HandleSignal(sinsp_evt* evt) {
-  auto modifier = modifiers[evt->get_type()];
+  return DispatchSignal(evt, GetEventKind(evt->get_type()));
+}
+
+uint8_t NetworkSignalHandler::GetEventKind(uint16_t event_type) {
+  return static_cast<uint8_t>(modifiers[event_type]);
+}
+
+SignalHandler::Result NetworkSignalHandler::DispatchSignal(sinsp_evt* evt, uint8_t kind) {
+  auto modifier = static_cast<Modifier>(kind);
   if (modifier == Modifier::INVALID) {
     return SignalHandler::IGNORED;
   }
 
+  if (modifier == Modifier::EXIT) {
+    return HandleProcessExit(evt);
+  }
+
+  if (connection_cache_) {
+    return DispatchCachedSignal(evt, modifier == Modifier::ADD);
+  }
+
   auto result = GetConnection(evt);
   if (!result.has_value() || !IsRelevantConnection(*result)) {
     return SignalHandler::IGNORED;
   }
 
-  conn_tracker_->UpdateConnection(*result, evt->get_ts() / 1000UL, modifier == Modifier::ADD);
+  return UpdateConnection(std::move(*result), evt->get_ts() / 1000UL, modifier == Modifier::ADD);
+}
+
+SignalHandler::Result NetworkSignalHandler::DispatchCachedSignal(sinsp_evt* evt, bool added) {
+  auto* fd_info = evt->get_fd_info();
+  const auto* tinfo = evt->get_thread_info();
+  if (!fd_info || !tinfo) {
+    return SignalHandler::IGNORED;
+  }
+
+  int64_t fd = evt->get_fd_num();
+  bool successful = IsSuccessfulSocketEvent(evt, *fd_info);
+  if (!added) {
+    // The fd is released (or at least done with) whatever the outcome.
+    ConnectionCache::Entry* entry = nullptr;
+    if (successful) {
+      entry = connection_cache_->Lookup(tinfo->m_pid, fd, SocketSignature(*fd_info));
+    }
+    std::optional<Connection> conn;
+    if (entry) {
+      COUNTER_INC(CollectorStats::net_conn_cache_hits);
+      conn = std::move(entry->conn);
+    } else if (successful) {
+      COUNTER_INC(CollectorStats::net_conn_cache_misses);
+      conn = ResolveConnection(evt, *fd_info);
+    }
+    connection_cache_->Invalidate(tinfo->m_pid, fd);
+
+    if (!conn.has_value() || !IsRelevantConnection(*conn)) {
+      return SignalHandler::IGNORED;
+    }
+    return UpdateConnection(std::move(*conn), evt->get_ts() / 1000UL, false);
+  }
+
+  if (!successful) {
+    return SignalHandler::IGNORED;
+  }
+
+  auto signature = SocketSignature(*fd_info);
+  auto* entry = connection_cache_->Lookup(tinfo->m_pid, fd, signature);
+  if (entry) {
+    COUNTER_INC(CollectorStats::net_conn_cache_hits);
+  } else {
+    COUNTER_INC(CollectorStats::net_conn_cache_misses);
+    auto conn = ResolveConnection(evt, *fd_info);
+    if (!conn.has_value() || !IsRelevantConnection(*conn)) {
+      return SignalHandler::IGNORED;
+    }
+    entry = &connection_cache_->Insert(tinfo->m_pid, fd, signature, std::move(*conn));
+  }
+
+  int64_t timestamp = evt->get_ts() / 1000UL;
+  if (entry->last_update != 0 && timestamp >= entry->last_update &&
+      timestamp - entry->last_update < refresh_window_us_) {
+    // The tracker already knows this connection is active.
+    COUNTER_INC(CollectorStats::net_conn_updates_skipped);
+    return SignalHandler::PROCESSED;
+  }
+  entry->last_update = timestamp;
+
+  return UpdateConnection(entry->conn, timestamp, true);
+}
+
+SignalHandler::Result NetworkSignalHandler::UpdateConnection(Connection conn, int64_t timestamp, bool added) {
+  if (lane_) {
+    // The event itself is only valid until the next call to sinsp, so the
+    // connection has been fully extracted at this point and only the
+    // tracker update is deferred.
+    if (!lane_->Push({std::move(conn), timestamp, added})) {
+      return SignalHandler::ERROR;
+    }
+    return SignalHandler::PROCESSED;
+  }
+
+  ApplyConnectionUpdate(conn, timestamp, added);
+  return SignalHandler::PROCESSED;
+}
+
+SignalHandler::Result NetworkSignalHandler::HandleProcessExit(sinsp_evt* evt) {
+  const auto* tinfo = evt->get_thread_info();
+  // A process, and its fd table, exits with its main thread.
+  if (!tinfo || !tinfo->is_main_thread()) {
+    return SignalHandler::IGNORED;
+  }
+
+  if (connection_cache_) {
+    connection_cache_->InvalidateProcess(tinfo->m_pid);
+  }
+  if (!purge_on_exit_ || !container_processes_) {
+    return SignalHandler::IGNORED;
+  }
+
+  // The event loop already forgot the exiting process.
+  auto container_id = GetContainerID(evt);
+  if (container_id.empty() || container_processes_->Count(container_id) > 0) {
+    return SignalHandler::IGNORED;
+  }
+  auto container = ContainerIDInterner::Instance().Intern(container_id);
+
+  int64_t timestamp = evt->get_ts() / 1000UL;
+  if (lane_) {
+    // Ordered after the updates of the container still in the lane.
+    if (!lane_->Push({Connection(), timestamp, false, container})) {
+      return SignalHandler::ERROR;
+    }
+    return SignalHandler::PROCESSED;
+  }
+
+  conn_tracker_->PurgeContainer(container, timestamp);
   return SignalHandler::PROCESSED;
 }
 
+void NetworkSignalHandler::ApplyConnectionUpdate(const Connection& conn, int64_t timestamp, bool added) {
+  if (conn_batch_) {
+    conn_batch_->Add(conn, timestamp, added);
+  } else {
+    conn_tracker_->UpdateConnection(conn, timestamp, added);
+  }
+}
+
+void NetworkSignalHandler::EnableBatching(size_t max_size, std::chrono::milliseconds max_delay) {
+  conn_batch_ = conn_tracker_->CreateBatch(max_size, std::chrono::duration_cast<std::chrono::microseconds>(max_delay).count());
+}
+
+void NetworkSignalHandler::EnableConnectionCache(std::chrono::milliseconds refresh_window) {
+  connection_cache_ = std::make_unique<ConnectionCache>();
+  refresh_window_us_ = std::chrono::duration_cast<std::chrono::microseconds>(refresh_window).count();
+}
+
+void NetworkSignalHandler::EnablePipeline(size_t lane_size, LanePolicy policy) {
+  lane_ = std::make_unique<EventLane<ConnectionUpdate>>(
+      "network",
+      lane_size,
+      policy,
+      EventLane<ConnectionUpdate>::Counters{
+          CollectorStats::pipeline_network_lane_depth,
+          CollectorStats::pipeline_network_lane_stalls,
+          CollectorStats::pipeline_network_lane_drops,
+      },
+      [this](ConnectionUpdate& update) {
+        if (update.purged_container) {
+          conn_tracker_->PurgeContainer(*update.purged_container, update.timestamp);
+        } else {
+          ApplyConnectionUpdate(update.conn, update.timestamp, update.added);
+        }
+      });
+}
+
 std::vector<std::string> NetworkSignalHandler::GetRelevantEvents() {
   std::vector<std::string> base_events = {
       "close<",
@@ -184,6 +392,10 @@ std::vector<std::string> NetworkSignalHandler::GetRelevantEvents() {
       "accept4<",
       "getsockopt<"};
 
+  if (purge_on_exit_ || connection_cache_) {
+    base_events.push_back("procexit>");
+  }
+
   if (track_send_recv_) {
     // disable clang-format here because it will massively
     // indent the initializer list.
@@ -209,7 +421,17 @@ std::vector<std::string> NetworkSignalHandler::GetRelevantEvents() {
   return base_events;
 }
 
+bool NetworkSignalHandler::Start() {
+  if (lane_) {
+    return lane_->Start();
+  }
+  return true;
+}
+
 bool NetworkSignalHandler::Stop() {
+  if (lane_) {
+    lane_->Stop();
+  }
   event_extractor_->ClearWrappers();
   return true;
 }
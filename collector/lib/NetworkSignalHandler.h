@@ -1,15 +1,21 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <optional>
 
 #include "ConnTracker.h"
+#include "ConnectionCache.h"
+#include "ContainerIDCache.h"
+#include "ContainerProcesses.h"
+#include "EventLane.h"
 #include "SignalHandler.h"
 #include "system-inspector/SystemInspector.h"
 
 // forward declarations
 class sinsp;
 class sinsp_evt;
+class sinsp_fdinfo;
 
 namespace collector {
 namespace system_inspector {
@@ -23,21 +29,75 @@ class NetworkSignalHandler final : public SignalHandler {
 
   std::string GetName() override { return "NetworkSignalHandler"; }
   Result HandleSignal(sinsp_evt* evt) override;
+  Result DispatchSignal(sinsp_evt* evt, uint8_t kind) override;
+  uint8_t GetEventKind(uint16_t event_type) override;
   std::vector<std::string> GetRelevantEvents() override;
+  bool Start() override;
   bool Stop() override;
 
   void SetCollectConnectionStatus(bool collect_connection_status) { collect_connection_status_ = collect_connection_status; }
   void SetTrackSendRecv(bool track_send_recv) { track_send_recv_ = track_send_recv; }
 
+  // Resolve container IDs from the cache populated by the event loop while
+  // filtering events, instead of walking the cgroups of the thread again.
+  void SetContainerIDCache(std::shared_ptr<const ContainerIDCache> cache) { container_id_cache_ = std::move(cache); }
+
+  // Cache the connection of each socket, so that it is not resolved again
+  // on every send/recv. Activity on a socket less than refresh_window after
+  // the last update of the connection tracker for it is not reported again.
+  void EnableConnectionCache(std::chrono::milliseconds refresh_window);
+
+  // Merge connection updates into the tracker in batches of up to
+  // max_size connections, or max_delay worth of events.
+  void EnableBatching(size_t max_size, std::chrono::milliseconds max_delay);
+
+  // Close all the connections and listen endpoints of a container in the
+  // tracker once its last process exits, as counted by the event loop.
+  void EnablePurgeOnExit(std::shared_ptr<const ContainerProcesses> processes) {
+    purge_on_exit_ = true;
+    container_processes_ = std::move(processes);
+  }
+
+  // Hand connection updates over to a worker thread through a bounded lane,
+  // so that contention on the connection tracker does not hold back the
+  // thread consuming sinsp events. Must be called before Start().
+  void EnablePipeline(size_t lane_size, LanePolicy policy);
+
  private:
+  struct ConnectionUpdate {
+    Connection conn;
+    int64_t timestamp = 0;
+    bool added = false;
+    // If set, all the connections of this container are closed instead.
+    std::optional<ContainerIDInterner::Handle> purged_container;
+  };
+
   std::optional<Connection> GetConnection(sinsp_evt* evt);
+  bool IsSuccessfulSocketEvent(sinsp_evt* evt, const sinsp_fdinfo& fd_info);
+  std::optional<Connection> ResolveConnection(sinsp_evt* evt, const sinsp_fdinfo& fd_info);
+  Result DispatchCachedSignal(sinsp_evt* evt, bool added);
+  Result UpdateConnection(Connection conn, int64_t timestamp, bool added);
+  void ApplyConnectionUpdate(const Connection& conn, int64_t timestamp, bool added);
+  Result HandleProcessExit(sinsp_evt* evt);
+  std::string GetContainerID(sinsp_evt* evt);
 
   std::unique_ptr<system_inspector::EventExtractor> event_extractor_;
   std::shared_ptr<ConnectionTracker> conn_tracker_;
+  // Owned by conn_tracker_, null unless batching is enabled.
+  ConnectionBatch* conn_batch_ = nullptr;
+  std::shared_ptr<const ContainerIDCache> container_id_cache_;
   system_inspector::Stats* stats_;
 
   bool collect_connection_status_;
   bool track_send_recv_;
+
+  std::unique_ptr<EventLane<ConnectionUpdate>> lane_;
+
+  std::unique_ptr<ConnectionCache> connection_cache_;
+  int64_t refresh_window_us_ = 0;
+
+  bool purge_on_exit_ = false;
+  std::shared_ptr<const ContainerProcesses> container_processes_;
 };
 
 }  // namespace collector
@@ -96,7 +96,7 @@ void NetworkStatusNotifier::ReceiveIPNetworks(const sensor::IPNetworkList& netwo
     CLOG(WARNING) << "IPv4 network field has incorrect length (" << ipv4_networks_size << "). Ignoring IPv4 networks...";
   } else {
     std::vector<IPNet> ipv4_networks = readNetworks(networks.ipv4_networks(), Address::Family::IPV4);
-    known_ip_networks[Address::Family::IPV4] = ipv4_networks;
+    known_ip_networks[Address::Family::IPV4] = std::move(ipv4_networks);
   }
 
   auto ipv6_networks_size = networks.ipv6_networks().size();
@@ -104,7 +104,7 @@ void NetworkStatusNotifier::ReceiveIPNetworks(const sensor::IPNetworkList& netwo
     CLOG(WARNING) << "IPv6 network field has incorrect length (" << ipv6_networks_size << "). Ignoring IPv6 networks...";
   } else {
     std::vector<IPNet> ipv6_networks = readNetworks(networks.ipv6_networks(), Address::Family::IPV6);
-    known_ip_networks[Address::Family::IPV6] = ipv6_networks;
+    known_ip_networks[Address::Family::IPV6] = std::move(ipv6_networks);
   }
   conn_tracker_->UpdateKnownIPNetworks(std::move(known_ip_networks));
 }
@@ -193,6 +193,13 @@ void NetworkStatusNotifier::ReportConnectionStats() {
     connections_rate_counter_last_ = stats_new_counter;
     connections_last_report_time_ = now;
   }
+
+  if (lock_stats_reporter_) {
+    lock_stats_reporter_->Update();
+  }
+  if (eviction_stats_reporter_) {
+    eviction_stats_reporter_->Update();
+  }
 }
 
 bool NetworkStatusNotifier::UpdateAllConnsAndEndpoints() {
@@ -211,6 +218,10 @@ bool NetworkStatusNotifier::UpdateAllConnsAndEndpoints() {
     }
   }
   WITH_TIMER(CollectorStats::net_scrape_update) {
+    // Containers without any process left are closed as a whole.
+    if (const auto* containers = conn_scraper_->ScrapedContainers()) {
+      conn_tracker_->PurgeContainersExcept(*containers, ts);
+    }
     conn_tracker_->Update(all_conns, all_listen_endpoints, ts);
   }
 
@@ -220,13 +231,12 @@ bool NetworkStatusNotifier::UpdateAllConnsAndEndpoints() {
 void NetworkStatusNotifier::RunSingle(IDuplexClientWriter<sensor::NetworkConnectionInfoMessage>* writer) {
   WaitUntilWriterStarted(writer, 10);
 
-  ConnMap old_conn_state;
+  // Everything is new to the receiving end of this stream.
+  conn_tracker_->ResetConnDelta();
   AdvertisedEndpointMap old_cep_state;
   auto next_scrape = std::chrono::system_clock::now();
   int64_t time_at_last_scrape = NowMicros();
 
-  ExternalIPsConfig prevEnableExternalIPs = config_.GetExternalIPsConf();
-
   while (writer->Sleep(next_scrape)) {
     CLOG(TRACE) << "Starting network status notification";
     next_scrape = std::chrono::system_clock::now() + std::chrono::seconds(config_.ScrapeInterval());
@@ -240,36 +250,21 @@ void NetworkStatusNotifier::RunSingle(IDuplexClientWriter<sensor::NetworkConnect
 
     int64_t time_micros = NowMicros();
     const sensor::NetworkConnectionInfoMessage* msg;
-    ConnMap new_conn_state, delta_conn;
+    ConnMap delta_conn;
     AdvertisedEndpointMap new_cep_state;
-    ExternalIPsConfig externalIPsConfig = config_.GetExternalIPsConf();
 
     WITH_TIMER(CollectorStats::net_fetch_state) {
-      conn_tracker_->SetExternalIPsConfig(externalIPsConfig);
+      conn_tracker_->SetExternalIPsConfig(config_.GetExternalIPsConf());
 
-      new_conn_state = conn_tracker_->FetchConnState(true, true);
-      if (config_.EnableAfterglow()) {
-        ConnectionTracker::ComputeDeltaAfterglow(new_conn_state, old_conn_state, delta_conn, time_micros, time_at_last_scrape, config_.AfterglowPeriod());
-
-        conn_tracker_->CloseConnectionsOnExternalIPsConfigChange(prevEnableExternalIPs, &old_conn_state, &delta_conn);
-        prevEnableExternalIPs = externalIPsConfig;
-
-      } else {
-        ConnectionTracker::ComputeDelta(new_conn_state, &old_conn_state);
-      }
+      // The tracker keeps the reported connections, and only visits those which changed.
+      delta_conn = conn_tracker_->FetchConnDelta(time_micros, time_at_last_scrape, config_.EnableAfterglow(), config_.AfterglowPeriod());
 
       new_cep_state = conn_tracker_->FetchEndpointState(true, true);
       ConnectionTracker::ComputeDelta(new_cep_state, &old_cep_state);
     }
 
     WITH_TIMER(CollectorStats::net_create_message) {
-      if (config_.EnableAfterglow()) {
-        msg = CreateInfoMessage(delta_conn, old_cep_state);
-        ConnectionTracker::UpdateOldState(&old_conn_state, new_conn_state, time_micros, config_.AfterglowPeriod());
-      } else {
-        msg = CreateInfoMessage(old_conn_state, old_cep_state);
-        old_conn_state = std::move(new_conn_state);
-      }
+      msg = CreateInfoMessage(delta_conn, old_cep_state);
       old_cep_state = std::move(new_cep_state);
       time_at_last_scrape = time_micros;
     }
@@ -7,6 +7,8 @@
 
 #include "CollectorConfig.h"
 #include "CollectorConnectionStats.h"
+#include "CollectorEvictionStats.h"
+#include "CollectorLockStats.h"
 #include "ConnTracker.h"
 #include "NetworkConnectionInfoServiceComm.h"
 #include "ProcfsScraper.h"
@@ -39,6 +41,12 @@ class NetworkStatusNotifier : protected ProtoAllocator<sensor::NetworkConnection
                                      config.GetConnectionStatsQuantiles(),
                                      config.GetConnectionStatsError()}};
     }
+    if (config_.ConnTrackerLockMetrics()) {
+      lock_stats_reporter_.emplace(registry, conn_tracker_.get());
+    }
+    if (registry != nullptr) {
+      eviction_stats_reporter_.emplace(registry, conn_tracker_.get());
+    }
   }
 
   void Start();
@@ -102,6 +110,8 @@ class NetworkStatusNotifier : protected ProtoAllocator<sensor::NetworkConnection
   std::optional<CollectorConnectionStats<float>> connections_rate_reporter_;
   std::chrono::steady_clock::time_point connections_last_report_time_;     // time delta between the current reporting and the previous (rate computation)
   std::optional<ConnectionTracker::Stats> connections_rate_counter_last_;  // previous counter values (rate computation)
+  std::optional<CollectorLockStats> lock_stats_reporter_;
+  std::optional<CollectorEvictionStats> eviction_stats_reporter_;
 };
 
 }  // namespace collector
@@ -27,16 +27,26 @@ std::string compute_process_key(const ::storage::ProcessSignal& s) {
 
 bool ProcessSignalHandler::Start() {
   client_->Start();
+  if (lane_) {
+    return lane_->Start();
+  }
   return true;
 }
 
 bool ProcessSignalHandler::Stop() {
+  if (lane_) {
+    lane_->Stop();
+  }
   client_->Stop();
   rate_limiter_.ResetRateLimitCache();
   return true;
 }
 
 SignalHandler::Result ProcessSignalHandler::HandleSignal(sinsp_evt* evt) {
+  if (lane_ && needs_refresh_.exchange(false)) {
+    return NEEDS_REFRESH;
+  }
+
   const auto* signal_msg = formatter_.ToProtoMessage(evt);
 
   if (!signal_msg) {
@@ -53,14 +63,7 @@ SignalHandler::Result ProcessSignalHandler::HandleSignal(sinsp_evt* evt) {
     return IGNORED;
   }
 
-  auto result = client_->PushSignals(*signal_msg);
-  if (result == SignalHandler::PROCESSED) {
-    ++(stats_->nProcessSent);
-  } else if (result == SignalHandler::ERROR) {
-    ++(stats_->nProcessSendFailures);
-  }
-
-  return result;
+  return SendSignal(*signal_msg, false);
 }
 
 SignalHandler::Result ProcessSignalHandler::HandleExistingProcess(sinsp_threadinfo* tinfo) {
@@ -75,7 +78,27 @@ SignalHandler::Result ProcessSignalHandler::HandleExistingProcess(sinsp_threadin
     return IGNORED;
   }
 
-  auto result = client_->PushSignals(*signal_msg);
+  // Dropping an existing process would abort the resend of the process
+  // state, so wait for the lane instead.
+  return SendSignal(*signal_msg, true);
+}
+
+SignalHandler::Result ProcessSignalHandler::SendSignal(const SignalStreamMessage& msg, bool wait) {
+  if (!lane_) {
+    return PushSignal(msg);
+  }
+
+  // The formatter reuses its message, so the lane gets its own copy.
+  bool pushed = wait ? lane_->PushWait(SignalStreamMessage(msg)) : lane_->Push(SignalStreamMessage(msg));
+  if (!pushed) {
+    ++(stats_->nProcessSendFailures);
+    return ERROR;
+  }
+  return PROCESSED;
+}
+
+SignalHandler::Result ProcessSignalHandler::PushSignal(const SignalStreamMessage& msg) {
+  auto result = client_->PushSignals(msg);
   if (result == SignalHandler::PROCESSED) {
     ++(stats_->nProcessSent);
   } else if (result == SignalHandler::ERROR) {
@@ -85,6 +108,27 @@ SignalHandler::Result ProcessSignalHandler::HandleExistingProcess(sinsp_threadin
   return result;
 }
 
+void ProcessSignalHandler::EnablePipeline(size_t lane_size, LanePolicy policy) {
+  lane_ = std::make_unique<EventLane<SignalStreamMessage>>(
+      "process",
+      lane_size,
+      policy,
+      EventLane<SignalStreamMessage>::Counters{
+          CollectorStats::pipeline_process_lane_depth,
+          CollectorStats::pipeline_process_lane_stalls,
+          CollectorStats::pipeline_process_lane_drops,
+      },
+      [this](SignalStreamMessage& msg) {
+        if (PushSignal(msg) == NEEDS_REFRESH) {
+          // The stream has just been (re)established. Let the event loop
+          // know it has to resend the existing processes, and do not lose
+          // the current signal in the meantime.
+          needs_refresh_.store(true);
+          PushSignal(msg);
+        }
+      });
+}
+
 std::vector<std::string> ProcessSignalHandler::GetRelevantEvents() {
   return {"execve<"};
 }
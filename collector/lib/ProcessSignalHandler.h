@@ -1,10 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 
 #include <grpcpp/channel.h>
 
 #include "CollectorConfig.h"
+#include "EventLane.h"
 #include "ProcessSignalFormatter.h"
 #include "RateLimit.h"
 #include "SignalHandler.h"
@@ -42,13 +44,30 @@ class ProcessSignalHandler : public SignalHandler {
   std::string GetName() override { return "ProcessSignalHandler"; }
   std::vector<std::string> GetRelevantEvents() override;
 
+  // Hand formatted signals over to a worker thread through a bounded lane,
+  // so that a slow or blocked gRPC stream does not hold back the thread
+  // consuming sinsp events. Must be called before Start().
+  void EnablePipeline(size_t lane_size, LanePolicy policy);
+
  private:
+  using SignalStreamMessage = ISignalServiceClient::SignalStreamMessage;
+
+  // Sends a signal, through the lane if enabled, waiting for room in it if
+  // `wait` is set instead of dropping the signal.
+  Result SendSignal(const SignalStreamMessage& msg, bool wait);
+  Result PushSignal(const SignalStreamMessage& msg);
+
   ISignalServiceClient* client_;
   ProcessSignalFormatter formatter_;
   system_inspector::Stats* stats_;
   RateLimitCache rate_limiter_;
 
   const CollectorConfig& config_;
+
+  std::unique_ptr<EventLane<SignalStreamMessage>> lane_;
+  // Set by the lane worker when the signal stream was (re)established and
+  // the existing processes have to be sent again.
+  std::atomic<bool> needs_refresh_{false};
 };
 
 }  // namespace collector
@@ -2,13 +2,16 @@
 
 #include <cctype>
 #include <cinttypes>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
+#include <mutex>
 #include <string_view>
 
 #include <netinet/tcp.h>
 
+#include "CgroupResolver.h"
 #include "CollectorStats.h"
 #include "Containers.h"
 #include "FileSystem.h"
@@ -23,23 +26,6 @@ namespace {
 
 // String parsing helper functions
 
-// rep_find applies find n times, always advancing past the found character in each subsequent application.
-std::string_view::size_type rep_find(int n, std::string_view str, char c) {
-  if (n <= 0) {
-    return std::string_view::npos;
-  }
-
-  std::string_view::size_type pos = 0;
-  while (--n > 0) {
-    pos = str.find(c, pos);
-    if (pos == std::string_view::npos) {
-      return std::string_view::npos;
-    }
-    pos++;
-  }
-  return str.find(c, pos);
-}
-
 // nextfield advances to the next field in a space-delimited string.
 const char* nextfield(const char* p, const char* endp) {
   while (p < endp && *p && !std::isspace(*p)) {
@@ -164,33 +150,7 @@ std::optional<char> ReadProcessState(int dirfd) {
 // GetContainerID retrieves the container ID of the process represented by dirfd. The container ID is extracted from
 // the cgroup.
 std::optional<std::string> GetContainerID(int dirfd) {
-  FileHandle cgroups_file(FDHandle(openat(dirfd, "cgroup", O_RDONLY)), "r");
-  if (!cgroups_file.valid()) {
-    return {};
-  }
-
-  thread_local char* linebuf;
-  thread_local size_t linebuf_cap;
-
-  ssize_t line_len;
-  while ((line_len = getline(&linebuf, &linebuf_cap, cgroups_file.get())) != -1) {
-    if (!line_len) {
-      continue;
-    }
-    if (linebuf[line_len - 1] == '\n') {
-      line_len--;
-    }
-
-    std::string_view line(linebuf, line_len);
-    auto short_container_id = ExtractContainerID(line);
-    if (!short_container_id) {
-      continue;
-    }
-
-    return std::make_optional(std::string(*short_container_id));
-  }
-
-  return {};
+  return CgroupResolver::ResolveProcess(dirfd);
 }
 
 // Functions for parsing `net/tcp[6]` files
@@ -480,93 +440,211 @@ void ResolveSocketInodes(const SocketsByContainer& sockets_by_container, const C
   }
 }
 
-// ReadContainerConnections reads all container connection info from the given `/proc`-like directory. All connections
-// from non-container processes are ignored.
-// process_store, when provided, is used to to link the originator process of a ContainerEndpoint.
-bool ReadContainerConnections(const char* proc_path, ProcessStore* process_store,
-                              std::vector<Connection>* connections, std::vector<ContainerEndpoint>* listen_endpoints) {
-  DirHandle procdir = opendir(proc_path);
-  if (!procdir.valid()) {
-    COUNTER_INC(CollectorStats::procfs_could_not_open_proc_dir);
-    CLOG_THROTTLED(ERROR, std::chrono::seconds(10)) << "Could not open " << proc_path << ": " << StrError();
-    return false;
+// NetnsClaims makes sure that the connections of each network namespace are read by a single worker of a scrape.
+// The worker reading a namespace holds its claim until it is done. If the read fails because the process went away,
+// the claim is released, and the next process found in that namespace, by any worker, reads it instead.
+class NetnsClaims {
+ public:
+  enum class Claim {
+    ACQUIRED,  // The caller reads the namespace, then calls Release.
+    DONE,      // The namespace has already been read.
+  };
+
+  // Acquire claims the given namespace, waiting for any other worker currently reading it.
+  Claim Acquire(ino_t netns) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      auto emplace_res = states_.emplace(netns, State::READING);
+      if (emplace_res.second) {
+        return Claim::ACQUIRED;
+      }
+      if (emplace_res.first->second == State::DONE) {
+        return Claim::DONE;
+      }
+      released_.wait(lock);
+    }
   }
 
+  // Release ends the read of an acquired namespace. If it was not successful, the namespace can be acquired again.
+  void Release(ino_t netns, bool done) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (done) {
+        states_[netns] = State::DONE;
+      } else {
+        states_.erase(netns);
+      }
+    }
+    released_.notify_all();
+  }
+
+ private:
+  enum class State {
+    READING,
+    DONE,
+  };
+
+  std::mutex mutex_;
+  std::condition_variable released_;
+  UnorderedMap<ino_t, State> states_;
+};
+
+// ProcScan holds what a single worker read from the processes it scanned.
+struct ProcScan {
   ConnsByNS conns_by_ns;
   SocketsByContainer sockets_by_container_and_ns;
+};
 
-  // Read all the information from proc.
-  while (auto curr = procdir.read()) {
-    if (!std::isdigit(curr->d_name[0])) {
-      continue;  // only look for <pid> entries
-    }
-    long long pid = strtoll(curr->d_name, 0, 10);
+// ScanProcess reads the sockets of the process with the given `/proc` entry name into scan, and the connections of its
+// network namespace if no worker has read them yet.
+void ScanProcess(const DirHandle& procdir, const char* name, const NetworkExclusions::Rules* network_exclusions,
+                 bool read_listen_endpoints, NetnsClaims* netns_claims, ProcScan* scan) {
+  long long pid = strtoll(name, 0, 10);
 
-    FDHandle dirfd = procdir.openat(curr->d_name, O_RDONLY);
-    if (!dirfd.valid()) {
-      COUNTER_INC(CollectorStats::procfs_could_not_open_pid_dir);
-      CLOG(DEBUG) << "Could not open process directory " << curr->d_name << ": " << StrError();
-      continue;
+  FDHandle dirfd = procdir.openat(name, O_RDONLY);
+  if (!dirfd.valid()) {
+    COUNTER_INC(CollectorStats::procfs_could_not_open_pid_dir);
+    CLOG(DEBUG) << "Could not open process directory " << name << ": " << StrError();
+    return;
+  }
+
+  auto process_state = ReadProcessState(dirfd);
+  if (process_state && *process_state == 'Z') {
+    COUNTER_INC(CollectorStats::procfs_zombie_process);
+    return;
+  }
+
+  auto container_id = GetContainerID(dirfd);
+  if (!container_id) {
+    return;
+  }
+
+  if (network_exclusions) {
+    if (auto* rule = network_exclusions->Match(*container_id)) {
+      rule->scraped_processes.fetch_add(1, std::memory_order_relaxed);
+      return;
     }
+  }
 
-    auto process_state = ReadProcessState(dirfd);
-    if (process_state && *process_state == 'Z') {
-      COUNTER_INC(CollectorStats::procfs_zombie_process);
-      continue;
+  uint64_t netns_inode;
+  if (!GetNetworkNamespace(dirfd, &netns_inode)) {
+    COUNTER_INC(CollectorStats::procfs_could_not_get_network_namespace);
+    CLOG(TRACE) << "Could not determine network namespace: " << StrError();
+    if (process_state) {
+      CLOG(TRACE) << "Process state: " << *process_state;
     }
+    return;
+  }
 
-    auto container_id = GetContainerID(dirfd);
-    if (!container_id) {
-      continue;
+  auto& container_ns_sockets = scan->sockets_by_container_and_ns[*container_id][netns_inode];
+  bool no_sockets = container_ns_sockets.empty();
+
+  if (!GetSocketINodes(dirfd, pid, &container_ns_sockets)) {
+    COUNTER_INC(CollectorStats::procfs_could_not_get_socket_inodes);
+    CLOG(TRACE) << "Could not obtain socket inodes: " << StrError();
+    if (process_state) {
+      CLOG(TRACE) << "Process state: " << *process_state;
     }
+    return;
+  }
 
-    uint64_t netns_inode;
-    if (!GetNetworkNamespace(dirfd, &netns_inode)) {
-      COUNTER_INC(CollectorStats::procfs_could_not_get_network_namespace);
-      CLOG(TRACE) << "Could not determine network namespace: " << StrError();
-      if (process_state) {
-        CLOG(TRACE) << "Process state: " << *process_state;
-      }
-      continue;
+  if (!no_sockets || container_ns_sockets.empty() || Contains(scan->conns_by_ns, netns_inode)) {
+    return;
+  }
+
+  // These are the first sockets for this (container, netns) pair. Make sure we actually have the information about
+  // connections in this network namespace.
+  if (netns_claims->Acquire(netns_inode) == NetnsClaims::Claim::DONE) {
+    return;
+  }
+
+  auto emplace_res = scan->conns_by_ns.emplace(netns_inode, NSNetworkData());
+  auto& ns_network_data = emplace_res.first->second;
+
+  if (!GetConnections(dirfd, &ns_network_data.connections, read_listen_endpoints ? &ns_network_data.listen_endpoints : nullptr)) {
+    // If there was an error reading connections, that could be due to a number of reasons.
+    // We need to differentiate persistent errors (e.g., expected net/tcp6 file not found)
+    // from spurious/race condition errors caused by the process disappearing while reading
+    // the directory. To determine if the latter is the root cause, we reattempt to read the
+    // network namespace inode; if that succeeds, we assume that the process is still alive
+    // and any errors encountered are persistent.
+    uint64_t netns_inode2;
+    if (!GetNetworkNamespace(dirfd, &netns_inode2) || netns_inode2 != netns_inode) {
+      scan->conns_by_ns.erase(emplace_res.first);
+      netns_claims->Release(netns_inode, false);
+      return;
     }
+  }
+  netns_claims->Release(netns_inode, true);
+}
 
-    auto& container_ns_sockets = sockets_by_container_and_ns[*container_id][netns_inode];
-    bool no_sockets = container_ns_sockets.empty();
+// MergeScans moves the results of all the workers into the first one.
+void MergeScans(std::vector<ProcScan>* scans) {
+  auto& merged = scans->front();
+  for (size_t i = 1; i < scans->size(); i++) {
+    auto& scan = (*scans)[i];
 
-    if (!GetSocketINodes(dirfd, pid, &container_ns_sockets)) {
-      COUNTER_INC(CollectorStats::procfs_could_not_get_socket_inodes);
-      CLOG(TRACE) << "Could not obtain socket inodes: " << StrError();
-      if (process_state) {
-        CLOG(TRACE) << "Process state: " << *process_state;
-      }
-      continue;
+    // Each network namespace was read by a single worker.
+    for (auto& entry : scan.conns_by_ns) {
+      merged.conns_by_ns.emplace(entry.first, std::move(entry.second));
     }
 
-    if (no_sockets && !container_ns_sockets.empty()) {
-      // These are the first sockets for this (container, netns) pair. Make sure we actually have the information about
-      // connections in this network namespace.
-      auto emplace_res = conns_by_ns.emplace(netns_inode, NSNetworkData());
-      if (emplace_res.second) {
-        auto& ns_network_data = emplace_res.first->second;
-
-        if (!GetConnections(dirfd, &ns_network_data.connections, listen_endpoints ? &ns_network_data.listen_endpoints : nullptr)) {
-          // If there was an error reading connections, that could be due to a number of reasons.
-          // We need to differentiate persistent errors (e.g., expected net/tcp6 file not found)
-          // from spurious/race condition errors caused by the process disappearing while reading
-          // the directory. To determine if the latter is the root cause, we reattempt to read the
-          // network namespace inode; if that succeeds, we assume that the process is still alive
-          // and any errors encountered are persistent.
-          uint64_t netns_inode2;
-          if (!GetNetworkNamespace(dirfd, &netns_inode2) || netns_inode2 != netns_inode) {
-            conns_by_ns.erase(emplace_res.first);
-            continue;
-          }
+    for (auto& container_sockets : scan.sockets_by_container_and_ns) {
+      auto& merged_container_sockets = merged.sockets_by_container_and_ns[container_sockets.first];
+      for (auto& netns_sockets : container_sockets.second) {
+        auto& merged_sockets = merged_container_sockets[netns_sockets.first];
+        if (merged_sockets.empty()) {
+          merged_sockets = std::move(netns_sockets.second);
+        } else {
+          merged_sockets.insert(netns_sockets.second.begin(), netns_sockets.second.end());
         }
       }
     }
   }
+}
+
+// ReadContainerConnections reads all container connection info from the given `/proc`-like directory. All connections
+// from non-container processes are ignored.
+// process_store, when provided, is used to to link the originator process of a ContainerEndpoint.
+// network_exclusions, when provided, lists containers whose processes are skipped.
+// containers, when provided, receives the containers with at least one process read.
+// Processes are read by up to `workers` threads, including the calling one.
+bool ReadContainerConnections(const char* proc_path, ProcessStore* process_store,
+                              const NetworkExclusions::Rules* network_exclusions,
+                              std::vector<Connection>* connections, std::vector<ContainerEndpoint>* listen_endpoints,
+                              UnorderedSet<std::string>* containers, size_t workers) {
+  DirHandle procdir = opendir(proc_path);
+  if (!procdir.valid()) {
+    COUNTER_INC(CollectorStats::procfs_could_not_open_proc_dir);
+    CLOG_THROTTLED(ERROR, std::chrono::seconds(10)) << "Could not open " << proc_path << ": " << StrError();
+    return false;
+  }
+
+  // Only <pid> entries are listed, the processes themselves are read by the workers.
+  std::vector<std::string> pids;
+  while (auto curr = procdir.read()) {
+    if (std::isdigit(curr->d_name[0])) {
+      pids.emplace_back(curr->d_name);
+    }
+  }
 
-  ResolveSocketInodes(sockets_by_container_and_ns, conns_by_ns, process_store, connections, listen_endpoints);
+  workers = std::max<size_t>(std::min(workers, pids.size()), 1);
+  std::vector<ProcScan> scans(workers);
+  NetnsClaims netns_claims;
+  ParallelFor(workers, pids.size(), [&](size_t worker, size_t i) {
+    ScanProcess(procdir, pids[i].c_str(), network_exclusions, listen_endpoints != nullptr, &netns_claims, &scans[worker]);
+  });
+
+  MergeScans(&scans);
+  const auto& scan = scans.front();
+
+  ResolveSocketInodes(scan.sockets_by_container_and_ns, scan.conns_by_ns, process_store, connections, listen_endpoints);
+  if (containers) {
+    containers->clear();
+    for (const auto& entry : scan.sockets_by_container_and_ns) {
+      containers->insert(entry.first);
+    }
+  }
   return true;
 }
 
@@ -628,14 +706,7 @@ bool ReadProcessCmdline(const char* process_id, int dirfd, std::string& exe, std
 }  // namespace
 
 std::optional<std::string_view> ExtractContainerID(std::string_view cgroup_line) {
-  auto start = rep_find(2, cgroup_line, ':');
-  if (start == std::string_view::npos) {
-    return {};
-  }
-
-  std::string_view cgroup_path = cgroup_line.substr(start + 1);
-
-  return ExtractContainerIDFromCgroup(cgroup_path);
+  return CgroupResolver::ExtractContainerIDFromLine(cgroup_line);
 }
 
 std::optional<char> ExtractProcessState(std::string_view line) {
@@ -655,7 +726,16 @@ std::optional<char> ExtractProcessState(std::string_view line) {
 }
 
 bool ConnScraper::Scrape(std::vector<Connection>* connections, std::vector<ContainerEndpoint>* listen_endpoints) {
-  return ReadContainerConnections(proc_path_.c_str(), process_store_.get(), connections, listen_endpoints);
+  std::shared_ptr<const NetworkExclusions::Rules> network_exclusions;
+  if (network_exclusions_) {
+    network_exclusions = network_exclusions_->Get();
+  }
+  if (!ReadContainerConnections(proc_path_.c_str(), process_store_.get(), network_exclusions.get(), connections, listen_endpoints, &scraped_containers_, workers_)) {
+    scraped_containers_valid_ = false;
+    return false;
+  }
+  scraped_containers_valid_ = true;
+  return true;
 }
 
 bool ProcessScraper::Scrape(uint64_t pid, ProcessInfo& process_info) {
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include <string>
 #include <vector>
 
 #include "CollectorConfig.h"
+#include "Hash.h"
 #include "NetworkConnection.h"
+#include "NetworkExclusions.h"
 
 namespace collector {
 
@@ -14,6 +17,8 @@ namespace collector {
 class IConnScraper {
  public:
   virtual bool Scrape(std::vector<Connection>* connections, std::vector<ContainerEndpoint>* listen_endpoints) = 0;
+  // Returns the containers with at least one process found by the last successful scrape, or null if unknown.
+  virtual const UnorderedSet<std::string>* ScrapedContainers() const { return nullptr; }
   virtual ~IConnScraper() {}
 };
 
@@ -22,7 +27,7 @@ class ConnScraper : public IConnScraper {
  public:
   explicit ConnScraper(std::string_view proc_path) : proc_path_(proc_path) {}
   explicit ConnScraper(const CollectorConfig& config, system_inspector::Service* system_inspector)
-      : proc_path_(config.HostProc()) {
+      : proc_path_(config.HostProc()), network_exclusions_(&config.GetNetworkExclusions()), workers_(config.ProcfsScrapeWorkers()) {
     if (config.IsProcessesListeningOnPortsEnabled()) {
       process_store_ = std::make_unique<ProcessStore>(system_inspector);
     }
@@ -30,10 +35,23 @@ class ConnScraper : public IConnScraper {
 
   // Scrape returns a snapshot of all active network connections in the given vector.
   bool Scrape(std::vector<Connection>* connections, std::vector<ContainerEndpoint>* listen_endpoints) override;
+  const UnorderedSet<std::string>* ScrapedContainers() const override {
+    return scraped_containers_valid_ ? &scraped_containers_ : nullptr;
+  }
+
+  // Sets the number of threads reading processes in parallel on each scrape.
+  void SetWorkers(size_t workers) { workers_ = std::max<size_t>(workers, 1); }
 
  private:
   std::filesystem::path proc_path_;
   std::unique_ptr<ProcessStore> process_store_;
+  // Processes of excluded containers are skipped, if set.
+  const NetworkExclusions* network_exclusions_ = nullptr;
+  // Processes are partitioned across this many threads, including the
+  // scraping one, each reading any network namespace not read yet.
+  size_t workers_ = 1;
+  UnorderedSet<std::string> scraped_containers_;
+  bool scraped_containers_valid_ = false;
 };
 
 class ProcessScraper {
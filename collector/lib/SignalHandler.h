@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -35,6 +36,17 @@ class SignalHandler {
   virtual bool Start() { return true; }
   virtual bool Stop() { return true; }
   virtual Result HandleSignal(sinsp_evt* evt) = 0;
+  // Called by the event loop with the kind resolved by GetEventKind() for
+  // the type of the event, so that handlers do not have to look it up
+  // again for every event.
+  virtual Result DispatchSignal(sinsp_evt* evt, uint8_t kind) {
+    return HandleSignal(evt);
+  }
+  // Handler specific classification of an event type, resolved once per
+  // event type when the event loop builds its dispatch table.
+  virtual uint8_t GetEventKind(uint16_t event_type) {
+    return 0;
+  }
   virtual Result HandleExistingProcess(sinsp_threadinfo* tinfo) {
     return IGNORED;
   }
@@ -6,6 +6,7 @@
 #include "Logging.h"
 #include "ProtoUtil.h"
 #include "Utility.h"
+#include "system-inspector/SystemInspector.h"
 
 namespace collector {
 
@@ -19,27 +20,34 @@ bool SignalServiceClient::EstablishGRPCStreamSingle() {
 
   CLOG(INFO) << "Trying to establish GRPC stream for signals ...";
 
+  writer_ = OpenStream();
+  if (!writer_) {
+    return !thread_.should_stop();
+  }
+  CLOG(INFO) << "Successfully established GRPC stream for signals.";
+
+  first_write_ = true;
+  stream_active_.store(true, std::memory_order_release);
+  return true;
+}
+
+std::unique_ptr<IDuplexClientWriter<SignalServiceClient::SignalStreamMessage>> SignalServiceClient::OpenStream() {
   if (!WaitForChannelReady(channel_, [this]() { return thread_.should_stop(); })) {
-    return false;
+    return nullptr;
   }
   if (thread_.should_stop()) {
-    return false;
+    return nullptr;
   }
 
   // stream writer
   context_ = std::make_unique<grpc::ClientContext>();
-  writer_ = DuplexClient::CreateWithReadsIgnored(&SignalService::Stub::AsyncPushSignals, channel_, context_.get());
-  if (!writer_->WaitUntilStarted(std::chrono::seconds(30))) {
+  auto writer = DuplexClient::CreateWithReadsIgnored(&SignalService::Stub::AsyncPushSignals, channel_, context_.get());
+  if (!writer->WaitUntilStarted(std::chrono::seconds(30))) {
     CLOG(ERROR) << "Signal stream not ready after 30 seconds. Retrying ...";
-    CLOG(ERROR) << "Error message: " << writer_->FinishNow().error_message();
-    writer_.reset();
-    return true;
+    CLOG(ERROR) << "Error message: " << writer->FinishNow().error_message();
+    return nullptr;
   }
-  CLOG(INFO) << "Successfully established GRPC stream for signals.";
-
-  first_write_ = true;
-  stream_active_.store(true, std::memory_order_release);
-  return true;
+  return writer;
 }
 
 void SignalServiceClient::EstablishGRPCStream() {
@@ -49,15 +57,33 @@ void SignalServiceClient::EstablishGRPCStream() {
 
 void SignalServiceClient::Start() {
   thread_.Start([this] { EstablishGRPCStream(); });
+  if (async_send_) {
+    writer_thread_.Start([this] { WriteQueuedSignals(); });
+  }
 }
 
 void SignalServiceClient::Stop() {
   stream_interrupted_.notify_one();
   thread_.Stop();
-  context_->TryCancel();
+  // The writer thread writes out what is still queued before exiting. Its
+  // writes are bounded by kAsyncWriteTimeout, so a stalled stream cannot
+  // hold it back.
+  if (writer_thread_.running()) {
+    writer_thread_.Stop();
+  }
+  if (context_) {
+    context_->TryCancel();
+  }
   context_.reset();
 }
 
+void SignalServiceClient::EnableAsyncSend(size_t queue_size, bool drop_oldest, system_inspector::Stats* stats) {
+  async_send_ = true;
+  queue_size_ = queue_size;
+  drop_oldest_ = drop_oldest;
+  stats_ = stats;
+}
+
 SignalHandler::Result SignalServiceClient::PushSignals(const SignalStreamMessage& msg) {
   if (!stream_active_.load(std::memory_order_acquire)) {
     CLOG_THROTTLED(ERROR, std::chrono::seconds(10))
@@ -70,22 +96,112 @@ SignalHandler::Result SignalServiceClient::PushSignals(const SignalStreamMessage
     return SignalHandler::NEEDS_REFRESH;
   }
 
-  if (!writer_->Write(msg)) {
+  if (async_send_) {
+    return EnqueueSignal(msg);
+  }
+
+  return WriteSignal(msg, grpc_duplex_impl::ToDeadline(grpc_duplex_impl::time_point::max())) ? SignalHandler::PROCESSED : SignalHandler::ERROR;
+}
+
+bool SignalServiceClient::WriteSignal(const SignalStreamMessage& msg, const gpr_timespec& deadline) {
+  if (!stream_active_.load(std::memory_order_acquire)) {
+    return false;
+  }
+
+  if (!writer_->Write(msg, deadline)) {
     auto status = writer_->FinishNow();
     if (!status.ok()) {
       CLOG(ERROR) << "GRPC writes failed: " << status.error_message();
     }
     writer_.reset();
 
-    stream_active_.store(false, std::memory_order_release);
+    {
+      // Signals queued for the broken stream must not be written to the next
+      // one, ahead of the refresh requested by its first write.
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      if (!queue_.empty()) {
+        stats_->nGRPCSendFailures += queue_.size();
+        queue_.clear();
+        stats_->nSignalQueueDepth = 0;
+      }
+      stream_active_.store(false, std::memory_order_release);
+    }
     CLOG(ERROR) << "GRPC stream interrupted";
     stream_interrupted_.notify_one();
-    return SignalHandler::ERROR;
+    return false;
+  }
+
+  return true;
+}
+
+SignalHandler::Result SignalServiceClient::EnqueueSignal(const SignalStreamMessage& msg) {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    // Checked under the queue lock, as a failed write clears the queue
+    // when marking the stream inactive.
+    if (!stream_active_.load(std::memory_order_acquire)) {
+      return SignalHandler::ERROR;
+    }
+
+    if (queue_.size() >= queue_size_) {
+      if (!drop_oldest_) {
+        ++(stats_->nSignalQueueDroppedNewest);
+        CLOG_THROTTLED(WARNING, std::chrono::seconds(30)) << "Signal queue is full, dropping new signals";
+        return SignalHandler::ERROR;
+      }
+
+      queue_.pop_front();
+      ++(stats_->nSignalQueueDroppedOldest);
+      CLOG_THROTTLED(WARNING, std::chrono::seconds(30)) << "Signal queue is full, dropping oldest signals";
+    }
+
+    queue_.push_back(msg);
+    stats_->nSignalQueueDepth = queue_.size();
   }
 
+  queue_cond_.notify_one();
   return SignalHandler::PROCESSED;
 }
 
+void SignalServiceClient::WriteQueuedSignals() {
+  std::deque<SignalStreamMessage> batch;
+
+  while (!writer_thread_.should_stop()) {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      // Bounded wait, as StoppableThread::Stop() does not notify this
+      // condition variable.
+      queue_cond_.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+        return !queue_.empty() || writer_thread_.should_stop();
+      });
+      batch.swap(queue_);
+      stats_->nSignalQueueDepth = 0;
+    }
+
+    WriteBatch(&batch);
+  }
+
+  // Write out what was queued before Stop() was called.
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    batch.swap(queue_);
+    stats_->nSignalQueueDepth = 0;
+  }
+  WriteBatch(&batch);
+}
+
+void SignalServiceClient::WriteBatch(std::deque<SignalStreamMessage>* batch) {
+  // Coalesce everything queued so far into back-to-back writes, without
+  // going back to the queue lock in between.
+  for (auto it = batch->begin(); it != batch->end(); it++) {
+    if (!WriteSignal(*it, grpc_duplex_impl::ToDeadline(kAsyncWriteTimeout))) {
+      stats_->nGRPCSendFailures += std::distance(it, batch->end());
+      break;
+    }
+  }
+  batch->clear();
+}
+
 SignalHandler::Result StdoutSignalServiceClient::PushSignals(const SignalStreamMessage& msg) {
   LogProtobufMessage(msg);
   return SignalHandler::PROCESSED;
@@ -3,6 +3,7 @@
 // SIGNAL_SERVICE_CLIENT.h
 // This class defines our GRPC client abstraction
 
+#include <deque>
 #include <mutex>
 
 #include <grpc/grpc.h>
@@ -18,6 +19,10 @@
 
 namespace collector {
 
+namespace system_inspector {
+struct Stats;
+}
+
 class ISignalServiceClient {
  public:
   using SignalStreamMessage = sensor::SignalStreamMessage;
@@ -34,18 +39,41 @@ class SignalServiceClient : public ISignalServiceClient {
   using SignalService = sensor::SignalService;
   using SignalStreamMessage = sensor::SignalStreamMessage;
 
+  // Bounds each write of the asynchronous send path. A write which does not
+  // complete in time fails the stream, which is then re-established.
+  static constexpr auto kAsyncWriteTimeout = std::chrono::seconds(10);
+
   explicit SignalServiceClient(std::shared_ptr<grpc::Channel> channel)
       : channel_(std::move(channel)), stream_active_(false) {}
+  virtual ~SignalServiceClient() = default;
 
   void Start();
   void Stop();
 
   SignalHandler::Result PushSignals(const SignalStreamMessage& msg);
 
+  // Queue signals in PushSignals and write them to the stream from a
+  // dedicated thread, so that a slow stream does not block the caller.
+  // When the queue is full, either the oldest queued signal or the new one
+  // is dropped. Signals still queued on Stop() are written before it returns.
+  // Must be called before Start().
+  void EnableAsyncSend(size_t queue_size, bool drop_oldest, system_inspector::Stats* stats);
+
+ protected:
+  // Waits for the channel and opens a new signal stream. Returns nullptr if
+  // the stream could not be started, or the client is stopping.
+  // Overridden in tests.
+  virtual std::unique_ptr<IDuplexClientWriter<SignalStreamMessage>> OpenStream();
+
  private:
   void EstablishGRPCStream();
   bool EstablishGRPCStreamSingle();
 
+  bool WriteSignal(const SignalStreamMessage& msg, const gpr_timespec& deadline);
+  SignalHandler::Result EnqueueSignal(const SignalStreamMessage& msg);
+  void WriteQueuedSignals();
+  void WriteBatch(std::deque<SignalStreamMessage>* batch);
+
   std::shared_ptr<grpc::Channel> channel_;
 
   StoppableThread thread_;
@@ -57,6 +85,16 @@ class SignalServiceClient : public ISignalServiceClient {
   std::unique_ptr<IDuplexClientWriter<SignalStreamMessage>> writer_;
 
   bool first_write_;
+
+  // Asynchronous send path
+  bool async_send_ = false;
+  size_t queue_size_ = 0;
+  bool drop_oldest_ = true;
+  system_inspector::Stats* stats_ = nullptr;
+  StoppableThread writer_thread_;
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cond_;
+  std::deque<SignalStreamMessage> queue_;
 };
 
 class StdoutSignalServiceClient : public ISignalServiceClient {
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace collector {
+
+// Bounded, lock-free, single-producer/single-consumer ring buffer.
+//
+// Exactly one thread may call TryPush and exactly one (possibly different)
+// thread may call TryPop. Size() can be called from any thread and gives an
+// approximate value. The capacity is rounded up to the next power of two so
+// that indices can be wrapped with a mask.
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : capacity_(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity)),
+        mask_(capacity_ - 1),
+        slots_(std::make_unique<T[]>(capacity_)) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue(SpscQueue&&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+  SpscQueue& operator=(SpscQueue&&) = delete;
+
+  // Returns false, leaving value untouched, if the queue is full.
+  bool TryPush(T&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == capacity_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == capacity_) {
+        return false;
+      }
+    }
+
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool TryPop(T* out) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+
+    *out = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t Size() const {
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+
+  bool Empty() const { return Size() == 0; }
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  static size_t RoundUpToPowerOfTwo(size_t v) {
+    size_t p = 1;
+    while (p < v) {
+      p <<= 1;
+    }
+    return p;
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+
+  // Consumer-owned index, plus the producer's cached copy of it. Kept on
+  // separate cache lines to avoid false sharing between the two threads.
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+};
+
+}  // namespace collector
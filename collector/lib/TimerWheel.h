@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+
+namespace collector {
+
+// Hierarchical timer wheel, firing keys once their deadline has passed.
+//
+// Deadlines are in microseconds, and rounded to ticks of tick_micros to
+// select a slot: the first level has a slot per tick, and each level above
+// a slot per 64 slots of the level below. Timers are moved down a level when
+// the wheel reaches their slot, so that advancing the wheel only touches the
+// timers that are due, plus those moved down, at most once per level.
+//
+// A key has at most one deadline: scheduling it again replaces the previous
+// one. Replaced and cancelled timers are dropped lazily, when the wheel
+// reaches their slot.
+//
+// Not thread-safe.
+template <typename K>
+class TimerWheel {
+ public:
+  static constexpr int64_t kDefaultTickMicros = 1 << 20;
+
+  explicit TimerWheel(int64_t tick_micros = kDefaultTickMicros) : tick_micros_(tick_micros) {}
+
+  void Schedule(const K& key, int64_t deadline_micros) {
+    auto [it, inserted] = deadlines_.emplace(key, deadline_micros);
+    if (!inserted) {
+      if (it->second == deadline_micros) {
+        return;
+      }
+      it->second = deadline_micros;
+    }
+    Place(Timer{key, deadline_micros});
+  }
+
+  // Returns true if the key had a deadline.
+  bool Cancel(const K& key) { return deadlines_.erase(key) > 0; }
+
+  // Calls fn(key) for each key whose deadline is at or before now_micros,
+  // and forgets them. fn must not modify the wheel.
+  template <typename Fn>
+  void Advance(int64_t now_micros, const Fn& fn) {
+    int64_t target = Tick(now_micros);
+
+    if (deadlines_.empty()) {
+      // Drops the replaced and cancelled timers left.
+      Clear();
+      current_tick_ = std::max(current_tick_, target);
+      return;
+    }
+
+    if (target - current_tick_ >= kHorizon) {
+      // All timers are visited anyway.
+      std::vector<Timer> timers;
+      for (auto& level : slots_) {
+        for (auto& slot : level) {
+          for (auto& timer : slot) {
+            timers.push_back(std::move(timer));
+          }
+          slot.clear();
+        }
+      }
+      current_tick_ = target;
+      for (auto& timer : timers) {
+        Expire(std::move(timer), now_micros, fn);
+      }
+    }
+
+    while (current_tick_ < target && !deadlines_.empty()) {
+      current_tick_++;
+      for (int level = 1; level < kLevels && (current_tick_ & ((int64_t{1} << (kSlotBits * level)) - 1)) == 0; level++) {
+        std::vector<Timer> timers = std::move(slots_[level][SlotOf(current_tick_, level)]);
+        slots_[level][SlotOf(current_tick_, level)].clear();
+        for (auto& timer : timers) {
+          if (IsScheduled(timer)) {
+            Place(std::move(timer));
+          }
+        }
+      }
+
+      std::vector<Timer> timers = std::move(slots_[0][SlotOf(current_tick_, 0)]);
+      slots_[0][SlotOf(current_tick_, 0)].clear();
+      for (auto& timer : timers) {
+        Expire(std::move(timer), now_micros, fn);
+      }
+    }
+    current_tick_ = std::max(current_tick_, target);
+
+    // Timers of the current tick, or moved down to it, whose deadline may be later in the tick.
+    std::vector<Timer> due = std::move(due_);
+    due_.clear();
+    for (auto& timer : due) {
+      Expire(std::move(timer), now_micros, fn);
+    }
+  }
+
+  // Calls fn(key) for each key with a deadline, and forgets them.
+  template <typename Fn>
+  void Drain(const Fn& fn) {
+    for (const auto& [key, deadline] : deadlines_) {
+      fn(key);
+    }
+    Clear();
+  }
+
+  void Clear() {
+    deadlines_.clear();
+    for (auto& level : slots_) {
+      for (auto& slot : level) {
+        slot.clear();
+      }
+    }
+    due_.clear();
+  }
+
+  size_t size() const { return deadlines_.size(); }
+  bool empty() const { return deadlines_.empty(); }
+
+ private:
+  static constexpr int kSlotBits = 6;
+  static constexpr int kSlots = 1 << kSlotBits;
+  static constexpr int kLevels = 4;
+  // Number of ticks covered by the wheel.
+  static constexpr int64_t kHorizon = int64_t{1} << (kSlotBits * kLevels);
+
+  struct Timer {
+    K key;
+    int64_t deadline;
+  };
+
+  int64_t Tick(int64_t micros) const { return micros < 0 ? 0 : micros / tick_micros_; }
+
+  static size_t SlotOf(int64_t tick, int level) { return (tick >> (kSlotBits * level)) & (kSlots - 1); }
+
+  bool IsScheduled(const Timer& timer) const {
+    auto it = deadlines_.find(timer.key);
+    return it != deadlines_.end() && it->second == timer.deadline;
+  }
+
+  void Place(Timer timer) {
+    int64_t tick = Tick(timer.deadline);
+    if (tick <= current_tick_) {
+      due_.push_back(std::move(timer));
+      return;
+    }
+
+    // Level L holds the timers due within 64^(L+1) ticks, in the slot of their tick. They are moved down when the
+    // wheel enters the slot, which happens before the tick.
+    int level = (63 - __builtin_clzll(static_cast<uint64_t>(tick - current_tick_))) / kSlotBits;
+    if (level >= kLevels) {
+      // Beyond the horizon: placed again when the wheel gets there.
+      level = kLevels - 1;
+      tick = current_tick_ + kHorizon - 1;
+    }
+    slots_[level][SlotOf(tick, level)].push_back(std::move(timer));
+  }
+
+  template <typename Fn>
+  void Expire(Timer timer, int64_t now_micros, const Fn& fn) {
+    if (!IsScheduled(timer)) {
+      return;
+    }
+    if (timer.deadline > now_micros) {
+      Place(std::move(timer));
+      return;
+    }
+    deadlines_.erase(timer.key);
+    fn(timer.key);
+  }
+
+  int64_t tick_micros_;
+  int64_t current_tick_ = 0;
+  FlatHashMap<K, int64_t> deadlines_;
+  std::array<std::array<std::vector<Timer>, kSlots>, kLevels> slots_;
+  std::vector<Timer> due_;
+};
+
+}  // namespace collector
@@ -15,12 +15,18 @@ extern "C" {
 #include <uuid/uuid.h>
 }
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <thread>
+
 #include <utf8_validity.h>
 
 #include <libsinsp/sinsp.h>
 
 #include <google/protobuf/util/json_util.h>
 
+#include "CgroupResolver.h"
 #include "HostInfo.h"
 #include "Logging.h"
 #include "Utility.h"
@@ -195,50 +201,8 @@ void TryUnlink(const char* path) {
   }
 }
 
-const static unsigned int CONTAINER_ID_LENGTH = 64;
-const static unsigned int SHORT_CONTAINER_ID_LENGTH = 12;
-
-// IsContainerID returns whether the given string view represents a container ID.
-bool IsContainerID(std::string_view str) {
-  if (str.size() != CONTAINER_ID_LENGTH) {
-    return false;
-  }
-
-  return std::all_of(str.begin(), str.end(), [](char c) -> bool {
-    return std::isxdigit(c) != 0;
-  });
-}
-
 std::optional<std::string_view> ExtractContainerIDFromCgroup(std::string_view cgroup) {
-  if (cgroup.size() < CONTAINER_ID_LENGTH + 1) {
-    return {};
-  }
-
-  auto scope = cgroup.rfind(".scope");
-  if (scope != std::string_view::npos) {
-    cgroup.remove_suffix(cgroup.length() - scope);
-    if (cgroup.size() < CONTAINER_ID_LENGTH + 1) {
-      return {};
-    }
-  }
-
-  auto container_id_part = cgroup.substr(cgroup.size() - (CONTAINER_ID_LENGTH + 1));
-  if (container_id_part[0] != '/' && container_id_part[0] != '-' && container_id_part[0] != ':') {
-    return {};
-  }
-
-  cgroup.remove_suffix(CONTAINER_ID_LENGTH + 1);
-  // conmon runs as its own container, we ignore it.
-  if (cgroup.find("-conmon", cgroup.size() - StrLen("-conmon")) != std::string_view::npos) {
-    return {};
-  }
-
-  container_id_part.remove_prefix(1);
-
-  if (!IsContainerID(container_id_part)) {
-    return {};
-  }
-  return std::make_optional(container_id_part.substr(0, SHORT_CONTAINER_ID_LENGTH));
+  return CgroupResolver::ExtractContainerID(cgroup);
 }
 
 std::optional<std::string> SanitizedUTF8(std::string_view str) {
@@ -276,4 +240,49 @@ void LogProtobufMessage(const google::protobuf::Message& msg) {
     CLOG(DEBUG) << "MessageToJsonString failed: " << status;
   }
 }
+
+std::optional<double> GetCPUQuota(const std::filesystem::path& cgroup_root) {
+  // cgroup v2: "<quota> <period>", or "max <period>" when unlimited.
+  std::ifstream cpu_max(cgroup_root / "cpu.max");
+  if (cpu_max) {
+    std::string quota;
+    long long period = 0;
+    if (!(cpu_max >> quota >> period) || quota == "max" || period <= 0) {
+      return {};
+    }
+    char* endp;
+    long long quota_us = std::strtoll(quota.c_str(), &endp, 10);
+    if (*endp != '\0' || quota_us <= 0) {
+      return {};
+    }
+    return static_cast<double>(quota_us) / period;
+  }
+
+  // cgroup v1: a quota of -1 means unlimited. The cpu controller is often
+  // co-mounted with cpuacct, in which case "cpu" may be missing or only be
+  // a symlink.
+  for (const char* controller : {"cpu", "cpu,cpuacct", "cpuacct,cpu"}) {
+    std::ifstream cfs_quota(cgroup_root / controller / "cpu.cfs_quota_us");
+    if (!cfs_quota) {
+      continue;
+    }
+    std::ifstream cfs_period(cgroup_root / controller / "cpu.cfs_period_us");
+    long long quota_us = -1;
+    long long period = 0;
+    if (!(cfs_quota >> quota_us) || !(cfs_period >> period) || quota_us <= 0 || period <= 0) {
+      return {};
+    }
+    return static_cast<double>(quota_us) / period;
+  }
+  return {};
+}
+
+unsigned int AvailableCPUs(const std::filesystem::path& cgroup_root) {
+  unsigned int cpus = std::max(std::thread::hardware_concurrency(), 1U);
+  if (auto quota = GetCPUQuota(cgroup_root)) {
+    cpus = std::min(cpus, static_cast<unsigned int>(std::ceil(*quota)));
+  }
+  return std::max(cpus, 1U);
+}
+
 }  // namespace collector
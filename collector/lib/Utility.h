@@ -1,6 +1,8 @@
 #pragma once
 #define _UTILITY_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <filesystem>
 #include <iostream>
@@ -8,7 +10,9 @@
 #include <optional>
 #include <sstream>
 #include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include <google/protobuf/message.h>
 
@@ -115,4 +119,37 @@ std::optional<std::string_view> ExtractContainerIDFromCgroup(std::string_view cg
 std::optional<std::string> SanitizedUTF8(std::string_view str);
 
 void LogProtobufMessage(const google::protobuf::Message& msg);
+
+// Returns the CPU quota of the cgroup mounted at cgroup_root, in CPUs, read from cpu.max (cgroup v2) or from
+// cpu.cfs_quota_us and cpu.cfs_period_us of the cpu controller (cgroup v1), mounted as cpu or co-mounted as
+// cpu,cpuacct. Returns nullopt when no quota is set.
+std::optional<double> GetCPUQuota(const std::filesystem::path& cgroup_root = "/sys/fs/cgroup");
+
+// Returns the number of CPUs the collector can keep busy: the online CPUs, capped by the CPU quota of its cgroup,
+// rounded up. Always at least 1.
+unsigned int AvailableCPUs(const std::filesystem::path& cgroup_root = "/sys/fs/cgroup");
+
+// Calls fn(worker, i) for each i in [0, n), spreading the calls over up to `workers` threads, the calling one
+// included, with worker being the index of the thread in [0, workers). The other threads are started and joined on
+// every call, so it is meant for periodic bulk work (e.g. fetching the connections, scraping /proc), not hot paths.
+template <typename Fn>
+void ParallelFor(size_t workers, size_t n, const Fn& fn) {
+  workers = std::max<size_t>(std::min(workers, n), 1);
+  std::atomic<size_t> next = 0;
+  auto work = [&](size_t worker) {
+    for (size_t i = next++; i < n; i = next++) {
+      fn(worker, i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t worker = 1; worker < workers; worker++) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 }  // namespace collector
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "SignalHandler.h"
+#include "ppm_events_public.h"
+
+namespace collector::system_inspector {
+
+// Flat, per event type list of the signal handlers interested in it, along
+// with the kind each handler resolved for that event type (see
+// SignalHandler::GetEventKind).
+//
+// Entries for all event types are stored contiguously, so looking up the
+// handlers of an event is a single indexed load. The table is immutable:
+// changes to the set of handlers are applied by building a new one.
+class DispatchTable {
+ public:
+  struct Entry {
+    SignalHandler* handler;
+    uint8_t kind;
+  };
+
+  // A range of entries, in the order handlers were given to Build().
+  class Range {
+   public:
+    Range(const Entry* begin, const Entry* end) : begin_(begin), end_(end) {}
+
+    const Entry* begin() const { return begin_; }
+    const Entry* end() const { return end_; }
+    bool empty() const { return begin_ == end_; }
+    size_t size() const { return end_ - begin_; }
+
+   private:
+    const Entry* begin_;
+    const Entry* end_;
+  };
+
+  using HandlerEvents = std::pair<SignalHandler*, std::bitset<PPM_EVENT_MAX>>;
+
+  DispatchTable() { offsets_.fill(0); }
+
+  static DispatchTable Build(const std::vector<HandlerEvents>& handlers) {
+    DispatchTable table;
+    for (uint16_t type = 0; type < PPM_EVENT_MAX; type++) {
+      table.offsets_[type] = table.entries_.size();
+      for (const auto& [handler, events] : handlers) {
+        if (events[type]) {
+          table.entries_.push_back({handler, handler->GetEventKind(type)});
+        }
+      }
+    }
+    table.offsets_[PPM_EVENT_MAX] = table.entries_.size();
+    return table;
+  }
+
+  // The caller guarantees type < PPM_EVENT_MAX, which holds for the type of
+  // any event coming from sinsp.
+  Range Get(uint16_t type) const {
+    return {entries_.data() + offsets_[type], entries_.data() + offsets_[type + 1]};
+  }
+
+ private:
+  std::array<uint32_t, PPM_EVENT_MAX + 1> offsets_;
+  std::vector<Entry> entries_;
+};
+
+}  // namespace collector::system_inspector
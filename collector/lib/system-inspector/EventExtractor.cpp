@@ -1,5 +1,7 @@
 #include "EventExtractor.h"
 
+#include <cstring>
+
 namespace collector::system_inspector {
 
 void EventExtractor::Init(sinsp* inspector) {
@@ -20,4 +22,111 @@ void EventExtractor::ClearWrappers() {
   wrappers_.clear();
 }
 
+int8_t EventExtractor::ResParamIndex(sinsp_evt* event) {
+  uint16_t type = event->get_type();
+  if (type >= res_param_index_.size()) {
+    return kParamNone;
+  }
+
+  int8_t& index = res_param_index_[type];
+  if (index != kParamUnresolved) {
+    return index;
+  }
+
+  // The filter check looks up the "res" parameter by name, or the "fd"
+  // parameter of exit events creating a file descriptor.
+  index = kParamNone;
+  const ppm_event_info* info = event->get_info();
+  if (info == nullptr || PPME_IS_ENTER(type)) {
+    return index;
+  }
+  for (uint32_t i = 0; i < info->nparams; i++) {
+    if (std::strcmp(info->params[i].name, "res") == 0) {
+      index = static_cast<int8_t>(i);
+      return index;
+    }
+  }
+  if (info->flags & EF_CREATES_FD) {
+    for (uint32_t i = 0; i < info->nparams; i++) {
+      if (std::strcmp(info->params[i].name, "fd") == 0) {
+        index = static_cast<int8_t>(i);
+        return index;
+      }
+    }
+  }
+  return index;
+}
+
+bool EventExtractor::DecodeRawRes(sinsp_evt* event, std::optional<int64_t>* res) {
+  int8_t index = ResParamIndex(event);
+  if (index < 0 || static_cast<uint32_t>(index) >= event->get_num_params()) {
+    return false;
+  }
+
+  const sinsp_evt_param* param = event->get_param(index);
+  if (param == nullptr || param->m_len != sizeof(int64_t)) {
+    return false;
+  }
+
+  int64_t val;
+  std::memcpy(&val, param->m_val, sizeof(val));
+  *res = val;
+  return true;
+}
+
+bool EventExtractor::DecodeClientPort(sinsp_evt* event, std::optional<uint16_t>* port) {
+  const sinsp_fdinfo* fd_info = event->get_fd_info();
+  if (fd_info == nullptr || fd_info->is_role_none()) {
+    return false;
+  }
+
+  switch (fd_info->m_type) {
+    case SCAP_FD_IPV4_SOCK:
+      *port = fd_info->m_sockinfo.m_ipv4info.m_fields.m_sport;
+      return true;
+    case SCAP_FD_IPV6_SOCK:
+      *port = fd_info->m_sockinfo.m_ipv6info.m_fields.m_sport;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool EventExtractor::DecodeServerPort(sinsp_evt* event, std::optional<uint16_t>* port) {
+  const sinsp_fdinfo* fd_info = event->get_fd_info();
+  if (fd_info == nullptr || fd_info->is_role_none()) {
+    return false;
+  }
+
+  switch (fd_info->m_type) {
+    case SCAP_FD_IPV4_SOCK:
+      *port = fd_info->m_sockinfo.m_ipv4info.m_fields.m_dport;
+      return true;
+    case SCAP_FD_IPV6_SOCK:
+      *port = fd_info->m_sockinfo.m_ipv6info.m_fields.m_dport;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool EventExtractor::DecodeProcArgs(sinsp_evt* event, const char** args) {
+  const sinsp_threadinfo* tinfo = event->get_thread_info();
+  if (tinfo == nullptr) {
+    return false;
+  }
+
+  // Same format as the filter check: arguments separated by single spaces.
+  // The buffer is reused, so its capacity is kept from one event to the next.
+  proc_args_.clear();
+  for (size_t i = 0; i < tinfo->m_args.size(); i++) {
+    if (i > 0) {
+      proc_args_ += ' ';
+    }
+    proc_args_ += tinfo->m_args[i];
+  }
+  *args = proc_args_.c_str();
+  return true;
+}
+
 }  // namespace collector::system_inspector
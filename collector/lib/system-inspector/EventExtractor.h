@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
 #include <cassert>
+#include <cstring>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -12,6 +15,11 @@
 namespace collector::system_inspector {
 
 // This class allows extracting a predefined set of system_inspector event fields in an efficient manner.
+//
+// Most fields go through a sinsp filter check. The few fields read for every
+// network and execve event are instead decoded directly from the event
+// parameters, thread info or fd info, and only fall back to the filter check
+// when the direct decoding does not apply.
 class EventExtractor {
  public:
   void Init(sinsp* inspector);
@@ -60,9 +68,8 @@ class EventExtractor {
 
 // When using FIELD_RAW_SAFE, type needs to be trivially copyable so we
 // can move it to a properly aligned variable.
-#define FIELD_RAW_SAFE(id, fieldname, type)                                                                \
- public:                                                                                                   \
-  const std::optional<type> get_##id(sinsp_evt* event) {                                                   \
+#define FIELD_RAW_SAFE_ACCESSOR(accessor, id, fieldname, type)                                             \
+  const std::optional<type> accessor(sinsp_evt* event) {                                                   \
     static_assert(std::is_trivially_copyable_v<type>,                                                      \
                   "Attempted to create FIELD_RAW_SAFE on non trivial type");                               \
     assert(filter_check_##id##_.filter_check && "filter check not initialized for " fieldname);            \
@@ -78,22 +85,57 @@ class EventExtractor {
     type val;                                                                                              \
     std::memcpy(&val, buf, sizeof(type));                                                                  \
     return {val};                                                                                          \
-  }                                                                                                        \
-                                                                                                           \
- private:                                                                                                  \
+  }
+
+#define FIELD_RAW_SAFE(id, fieldname, type)              \
+ public:                                                 \
+  FIELD_RAW_SAFE_ACCESSOR(get_##id, id, fieldname, type) \
+                                                         \
+ private:                                                \
   DECLARE_FILTER_CHECK(id, fieldname)
 
-#define FIELD_CSTR(id, fieldname)                                                               \
- public:                                                                                        \
-  const char* get_##id(sinsp_evt* event) {                                                      \
+#define FIELD_CSTR_ACCESSOR(accessor, id, fieldname)                                            \
+  const char* accessor(sinsp_evt* event) {                                                      \
     assert(filter_check_##id##_.filter_check && "filter check not initialized for " fieldname); \
     uint32_t len;                                                                               \
     auto buf = filter_check_##id##_->extract_single(event, &len);                               \
     if (!buf) return nullptr;                                                                   \
     return reinterpret_cast<const char*>(buf);                                                  \
-  }                                                                                             \
-                                                                                                \
- private:                                                                                       \
+  }
+
+#define FIELD_CSTR(id, fieldname)              \
+ public:                                       \
+  FIELD_CSTR_ACCESSOR(get_##id, id, fieldname) \
+                                               \
+ private:                                      \
+  DECLARE_FILTER_CHECK(id, fieldname)
+
+// Direct flavours of FIELD_RAW_SAFE and FIELD_CSTR. get_<id>() first calls
+// the decoder(event, &value) member, which returns false when it cannot
+// decode the field for this event, in which case the filter check is used.
+// The filter check alone remains available via extract_<id>().
+#define FIELD_DIRECT_SAFE(id, decoder, fieldname, type)      \
+ public:                                                     \
+  const std::optional<type> get_##id(sinsp_evt* event) {     \
+    std::optional<type> val;                                 \
+    if (decoder(event, &val)) return val;                    \
+    return extract_##id(event);                              \
+  }                                                          \
+  FIELD_RAW_SAFE_ACCESSOR(extract_##id, id, fieldname, type) \
+                                                             \
+ private:                                                    \
+  DECLARE_FILTER_CHECK(id, fieldname)
+
+#define FIELD_DIRECT_CSTR(id, decoder, fieldname)  \
+ public:                                           \
+  const char* get_##id(sinsp_evt* event) {         \
+    const char* val = nullptr;                     \
+    if (decoder(event, &val)) return val;          \
+    return extract_##id(event);                    \
+  }                                                \
+  FIELD_CSTR_ACCESSOR(extract_##id, id, fieldname) \
+                                                   \
+ private:                                          \
   DECLARE_FILTER_CHECK(id, fieldname)
 
 #define EVT_ARG(name) FIELD_CSTR(evt_arg_##name, "evt.arg." #name)
@@ -128,6 +170,8 @@ class EventExtractor {
   //   const char*.
   // - FIELD_RAW(id, fieldname, type): exposes the system inspector field <fieldname> via get_<id>(), returning a const <type>*.
   // - FIELD_RAW_SAFE(id, fieldname, type): exposes the system inspector field <fieldname> via get_<id>(), returning a std::optional<type>.
+  // - FIELD_DIRECT_SAFE(id, decoder, fieldname, type), FIELD_DIRECT_CSTR(id, decoder, fieldname): same as
+  //   FIELD_RAW_SAFE and FIELD_CSTR, decoding the field with the given member function when possible.
   // - EVT_ARG(argname): shorthand for FIELD_CSTR(evt_arg_<argname>, "evt.arg.<argname>")
   // - EVT_ARG_RAW(argname, type): shorthand for FIELD_RAW(evt_arg_<argname>, "evt.rawarg.<argname>", <type>)
   //
@@ -140,18 +184,44 @@ class EventExtractor {
   TINFO_FIELD(pid);
   TINFO_FIELD_RAW(uid, m_uid, uint32_t);
   TINFO_FIELD_RAW(gid, m_gid, uint32_t);
-  FIELD_CSTR(proc_args, "proc.args");
+  FIELD_DIRECT_CSTR(proc_args, DecodeProcArgs, "proc.args");
 
   // General event information
-  FIELD_RAW_SAFE(event_rawres, "evt.rawres", int64_t);
+  FIELD_DIRECT_SAFE(event_rawres, DecodeRawRes, "evt.rawres", int64_t);
 
   // File/network related
-  FIELD_RAW_SAFE(client_port, "fd.cport", uint16_t);
-  FIELD_RAW_SAFE(server_port, "fd.sport", uint16_t);
+  FIELD_DIRECT_SAFE(client_port, DecodeClientPort, "fd.cport", uint16_t);
+  FIELD_DIRECT_SAFE(server_port, DecodeServerPort, "fd.sport", uint16_t);
+
+ private:
+  // Index of the return value parameter of each event type, resolved from
+  // the event table the first time an event of that type is decoded.
+  static constexpr int8_t kParamUnresolved = -2;
+  static constexpr int8_t kParamNone = -1;
+
+  int8_t ResParamIndex(sinsp_evt* event);
+
+  bool DecodeRawRes(sinsp_evt* event, std::optional<int64_t>* res);
+  bool DecodeClientPort(sinsp_evt* event, std::optional<uint16_t>* port);
+  bool DecodeServerPort(sinsp_evt* event, std::optional<uint16_t>* port);
+  bool DecodeProcArgs(sinsp_evt* event, const char** args);
+
+  std::array<int8_t, PPM_EVENT_MAX> res_param_index_ = MakeUnresolvedIndex();
+  std::string proc_args_;
+
+  static std::array<int8_t, PPM_EVENT_MAX> MakeUnresolvedIndex() {
+    std::array<int8_t, PPM_EVENT_MAX> index;
+    index.fill(kParamUnresolved);
+    return index;
+  }
 
 #undef TINFO_FIELD
 #undef FIELD_RAW
+#undef FIELD_RAW_SAFE_ACCESSOR
 #undef FIELD_CSTR
+#undef FIELD_CSTR_ACCESSOR
+#undef FIELD_DIRECT_SAFE
+#undef FIELD_DIRECT_CSTR
 #undef EVT_ARG
 #undef EVT_ARG_RAW
 #undef DECLARE_FILTER_CHECK
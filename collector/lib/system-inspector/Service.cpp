@@ -1,5 +1,6 @@
 #include "Service.h"
 
+#include <algorithm>
 #include <cap-ng.h>
 #include <memory>
 #include <thread>
@@ -14,6 +15,7 @@
 #include "CollectionMethod.h"
 #include "CollectorException.h"
 #include "CollectorStats.h"
+#include "CycleClock.h"
 #include "EventExtractor.h"
 #include "EventNames.h"
 #include "HostInfo.h"
@@ -32,11 +34,15 @@ namespace collector::system_inspector {
 Service::~Service() = default;
 
 Service::Service(const CollectorConfig& config)
-    : inspector_(std::make_unique<sinsp>(true)),
+    : config_(config),
+      inspector_(std::make_unique<sinsp>(true)),
       default_formatter_(std::make_unique<sinsp_evt_formatter>(
           inspector_.get(),
           DEFAULT_OUTPUT_STR,
-          EventExtractor::FilterList())) {
+          EventExtractor::FilterList())),
+      container_id_cache_(std::make_shared<ContainerIDCache>(config.GetSinspThreadCacheSize())),
+      network_exclusions_(config.GetNetworkExclusions().Get()),
+      network_exclusions_version_(config.GetNetworkExclusions().Version()) {
   // Setup the inspector.
   // peeking into arguments has a big overhead, so we prevent it from happening
   inspector_->set_snaplen(0);
@@ -58,35 +64,9 @@ Service::Service(const CollectorConfig& config)
     inspector_->get_parser()->set_track_connection_status(true);
   }
 
-  // Filter out host processes to avoid flooding Sensor with events it
-  // cannot associate with a container. The filter has two clauses:
-  //
-  //   1. pid != vpid — In a PID namespace (the common container case),
-  //      the kernel PID differs from the virtual PID visible inside the
-  //      container. The val() transformer makes the parser treat
-  //      proc.vpid as a field reference instead of a literal string.
-  //
-  //   2. cgroup regex — Catches containers that share the host PID
-  //      namespace (hostPID: true), where pid == vpid despite the
-  //      process running inside a container. Container runtimes always
-  //      place container processes in a cgroup whose path ends with the
-  //      64-hex-character container ID, so matching that pattern
-  //      identifies containerised processes regardless of PID namespace
-  //      configuration. This mirrors the cgroup-based container ID
-  //      extraction in ExtractContainerIDFromCgroup().
-  //
-  //      The memory cgroup is used because on cgroups v2 with systemd,
-  //      the memory controller is reliably delegated to the container's
-  //      leaf cgroup (where the path contains the container ID), while
-  //      cpuset is often only available at a higher level in the
-  //      hierarchy. The trailing (/.*) accounts for additional path
-  //      components some runtimes append (e.g. podman adds /container).
-  //
-  // The 'or' short-circuits: the regex only evaluates for events where
-  // the PID check fails, so the performance cost is negligible.
-  inspector_->set_filter(
-      "proc.pid != val(proc.vpid)"
-      " or thread.cgroup.memory regex \".*[/:-][0-9a-f]{64}(\\\\.scope)?(/.*)?\"");
+  if (config.ConnTrackerPurgeOnExit()) {
+    container_processes_ = std::make_shared<ContainerProcesses>();
+  }
 
   // The self-check handlers should only operate during start up,
   // so they are added to the handler list first, so they have access
@@ -96,14 +76,33 @@ Service::Service(const CollectorConfig& config)
   AddSignalHandler(std::make_unique<SelfCheckNetworkHandler>(inspector_.get()));
 
   if (config.grpc_channel) {
-    signal_client_ = std::make_unique<SignalServiceClient>(config.grpc_channel);
+    auto signal_client = std::make_unique<SignalServiceClient>(config.grpc_channel);
+    if (config.EnableAsyncSignalSend()) {
+      signal_client->EnableAsyncSend(config.SignalQueueSize(), config.SignalQueueDropOldest(), &userspace_stats_);
+    }
+    signal_client_ = std::move(signal_client);
   } else {
     signal_client_ = std::make_unique<StdoutSignalServiceClient>();
   }
-  AddSignalHandler(std::make_unique<ProcessSignalHandler>(inspector_.get(),
-                                                          signal_client_.get(),
-                                                          &userspace_stats_,
-                                                          config));
+  auto process_signal_handler = std::make_unique<ProcessSignalHandler>(inspector_.get(),
+                                                                      signal_client_.get(),
+                                                                      &userspace_stats_,
+                                                                      config);
+  if (config.EnableEventPipeline()) {
+    process_signal_handler->EnablePipeline(config.EventPipelineLaneSize(), config.EventPipelineLanePolicy());
+  }
+  AddSignalHandler(std::move(process_signal_handler));
+
+  ConfigureEventTiming(config);
+
+  // sinsp refreshes the cgroups of a thread on these events, so its cached
+  // container has to be resolved again.
+  const EventNames& event_names = EventNames::GetInstance();
+  for (const auto* name : {"clone<", "fork<", "vfork<", "clone3<", "execve<", "execveat<"}) {
+    for (ppm_event_code event_id : event_names.GetEventIDs(name)) {
+      thread_update_events_.set(event_id);
+    }
+  }
 
   if (signal_handlers_.size() == 2) {
     // self-check handlers do not count towards this check, because they
@@ -112,6 +111,34 @@ Service::Service(const CollectorConfig& config)
   }
 }
 
+void Service::ConfigureEventTiming(const CollectorConfig& config) {
+  // Timings are only exported as part of the detailed metrics, there is no
+  // point measuring them otherwise.
+  if (!config.EnableDetailedMetrics()) {
+    return;
+  }
+
+  std::bitset<PPM_EVENT_MAX> timed_events;
+  timed_events.set();
+
+  const EventNames& event_names = EventNames::GetInstance();
+  for (const auto& name : config.EventTimingExcluded()) {
+    try {
+      for (ppm_event_code event_id : event_names.GetEventIDs(name)) {
+        timed_events.reset(event_id);
+      }
+    } catch (const CollectorException& e) {
+      CLOG(ERROR) << "Cannot exclude event from timing: " << e.what();
+    }
+  }
+
+  CycleClock::Calibrate();
+  event_timing_.Configure(config.EventTimingSampleRate(), timed_events);
+
+  CLOG(INFO) << "Timing 1 out of " << event_timing_.SampleRate() << " events for "
+             << timed_events.count() << " event types";
+}
+
 bool Service::InitKernel(const CollectorConfig& config) {
   KernelDriverCOREEBPF driver;
   if (!driver.Setup(config, *inspector_)) {
@@ -126,7 +153,10 @@ sinsp_evt* Service::GetNext() {
   std::lock_guard<std::mutex> lock(libsinsp_mutex_);
   sinsp_evt* event = nullptr;
 
-  auto parse_start = NowMicros();
+  time_current_event_ = false;
+  // The type of the event is only known once it has been parsed, so the
+  // clock is read ahead of parsing whenever some event type is timed.
+  uint64_t parse_start = event_timing_.AnyEnabled() ? CycleClock::Now() : 0;
   auto res = inspector_->next(&event);
   if (res != SCAP_SUCCESS || event == nullptr) {
     return nullptr;
@@ -160,10 +190,37 @@ sinsp_evt* Service::GetNext() {
     return nullptr;
   }
 
-  userspace_stats_.event_parse_micros[event->get_type()] += (NowMicros() - parse_start);
+  if (event_timing_.ShouldSample(event->get_type())) {
+    event_timing_.AddParse(event->get_type(), CycleClock::Now() - parse_start);
+    time_current_event_ = true;
+  }
   ++userspace_stats_.nUserspaceEvents[event->get_type()];
 
-  if (!FilterEvent(event)) {
+  if (thread_update_events_[event->get_type()]) {
+    container_id_cache_->Invalidate(event->get_tid());
+  }
+
+  const auto* container = ResolveContainer(event);
+  bool accepted = container != nullptr && container->accepted;
+  if (container_processes_) {
+    TrackContainerProcess(event, container);
+  }
+
+  if (accepted && network_events_[event->get_type()]) {
+    // Dropped here rather than in the network signal handler, so that
+    // excluded containers do not pay for dispatching either.
+    if (auto* rule = network_exclusions_->Match(container->container_id)) {
+      rule->events.fetch_add(1, std::memory_order_relaxed);
+      accepted = false;
+    }
+  }
+
+  if (event->get_type() == PPME_PROCEXIT_1_E) {
+    // Done after filtering, so the exiting thread is not re-added.
+    container_id_cache_->Invalidate(event->get_tid());
+  }
+
+  if (!accepted) {
     return nullptr;
   }
   ++userspace_stats_.nFilteredEvents[event->get_type()];
@@ -171,10 +228,64 @@ sinsp_evt* Service::GetNext() {
   return event;
 }
 
-bool Service::FilterEvent(sinsp_evt* event) {
+const ContainerIDCache::Entry* Service::ResolveContainer(sinsp_evt* event) {
+  const auto* tinfo = event->get_thread_info();
+  if (tinfo == nullptr) {
+    return nullptr;
+  }
+
+  auto generation = ContainerIDCache::GenerationOf(*tinfo);
+  if (const auto* entry = container_id_cache_->Lookup(tinfo->m_tid, generation)) {
+    ++userspace_stats_.nContainerIDCacheHits;
+    return entry;
+  }
+  ++userspace_stats_.nContainerIDCacheMisses;
+
+  // Filter out host processes to avoid flooding Sensor with events it
+  // cannot associate with a container.
+  std::string container_id;
+  bool accepted = false;
+  if (container_cgroups_.IsContainerThread(*tinfo)) {
+    container_id = GetContainerID(*tinfo);
+    accepted = FilterEvent(*tinfo, container_id);
+  }
+  return &container_id_cache_->Insert(tinfo->m_tid, generation, std::move(container_id), accepted);
+}
+
+void Service::TrackContainerProcess(sinsp_evt* event, const ContainerIDCache::Entry* container) {
+  bool exited = event->get_type() == PPME_PROCEXIT_1_E;
+  if (!exited && !thread_update_events_[event->get_type()]) {
+    return;
+  }
+  // Processes are identified by their main thread. For clone and fork,
+  // this is the event of the child, the parent is already counted.
   const auto* tinfo = event->get_thread_info();
+  if (tinfo == nullptr || !tinfo->is_main_thread()) {
+    return;
+  }
 
-  return FilterEvent(tinfo);
+  if (exited) {
+    container_processes_->Remove(tinfo->m_pid);
+  } else if (container != nullptr && !container->container_id.empty()) {
+    container_processes_->Add(tinfo->m_pid, container->container_id);
+  }
+}
+
+void Service::LoadContainerProcesses() {
+  auto threads = inspector_->m_thread_manager->get_threads();
+  if (!threads) {
+    return;
+  }
+  threads->loop([this](sinsp_threadinfo& tinfo) {
+    if (tinfo.is_main_thread()) {
+      auto container_id = GetContainerID(tinfo);
+      if (!container_id.empty()) {
+        container_processes_->Add(tinfo.m_pid, container_id);
+      }
+    }
+    return true;
+  });
+  CLOG(DEBUG) << "Found " << container_processes_->Size() << " processes in containers";
 }
 
 bool Service::FilterEvent(const sinsp_threadinfo* tinfo) {
@@ -182,18 +293,22 @@ bool Service::FilterEvent(const sinsp_threadinfo* tinfo) {
     return false;
   }
 
-  // Exclude host processes that leak through the sinsp filter.
-  // The sinsp filter uses a cgroup regex to catch containers in
-  // the host PID namespace, but this can also match container
+  return FilterEvent(*tinfo, GetContainerID(*tinfo));
+}
+
+bool Service::FilterEvent(const sinsp_threadinfo& tinfo, const std::string& container_id) {
+  // Exclude host processes that leak through the container cgroup
+  // check. It catches containers in the host PID namespace by their
+  // cgroup path, but this can also match container
   // runtime helpers (crun, runc, conmon, podman) that run on the
   // host within cgroup paths containing container IDs. Checking
   // GetContainerID catches all such cases without maintaining a
   // list of runtime helper names.
-  if (GetContainerID(*tinfo).empty()) {
+  if (container_id.empty()) {
     return false;
   }
 
-  std::string_view exepath_sv{tinfo->m_exepath};
+  std::string_view exepath_sv{tinfo.m_exepath};
   auto marker = exepath_sv.rfind(':');
   if (marker != std::string_view::npos) {
     exepath_sv.remove_prefix(marker + 1);
@@ -215,6 +330,10 @@ void Service::Start() {
     }
   }
 
+  if (container_processes_) {
+    LoadContainerProcesses();
+  }
+
   inspector_->start_capture();
 
   // trigger the self check process only once capture has started,
@@ -253,36 +372,49 @@ void Service::Run(const std::atomic<ControlValue>& control) {
   while (control.load(std::memory_order_relaxed) == ControlValue::RUN) {
     ServePendingProcessRequests();
 
+    if (config_.SyscallsVersion() != syscalls_version_) {
+      UpdateCapturedSyscalls();
+    }
+
+    auto& network_exclusions = config_.GetNetworkExclusions();
+    if (network_exclusions.Version() != network_exclusions_version_) {
+      network_exclusions_version_ = network_exclusions.Version();
+      network_exclusions_ = network_exclusions.Get();
+    }
+
     sinsp_evt* evt = GetNext();
     if (!evt) {
       continue;
     }
 
-    auto process_start = NowMicros();
-    for (auto it = signal_handlers_.begin(); it != signal_handlers_.end(); it++) {
-      auto& signal_handler = *it;
-      if (!signal_handler.ShouldHandle(evt)) {
-        continue;
-      }
-      LogUnreasonableEventTime(process_start, evt);
-      auto result = signal_handler.handler->HandleSignal(evt);
+    bool timed = time_current_event_;
+    uint64_t process_start = timed ? CycleClock::Now() : 0;
+    auto handlers = dispatch_table_.Get(evt->get_type());
+    if (!handlers.empty()) {
+      // The coarse clock is plenty for detecting unreasonable timestamps.
+      LogUnreasonableEventTime(NowMicrosCoarse(), evt);
+    }
+    for (const auto& entry : handlers) {
+      auto result = entry.handler->DispatchSignal(evt, entry.kind);
       if (result == SignalHandler::NEEDS_REFRESH) {
-        if (!SendExistingProcesses(signal_handler.handler.get())) {
+        if (!SendExistingProcesses(entry.handler)) {
           continue;
         }
-        result = signal_handler.handler->HandleSignal(evt);
+        result = entry.handler->DispatchSignal(evt, entry.kind);
       } else if (result == SignalHandler::FINISHED) {
         // This signal handler has finished processing events,
         // so remove it from the signal handler list.
         //
-        // We don't need to update the iterator post-deletion
-        // because we also stop iteration at this point.
-        signal_handlers_.erase(it);
+        // This replaces the dispatch table we are iterating over,
+        // so we also stop iteration at this point.
+        RemoveSignalHandler(entry.handler);
         break;
       }
     }
 
-    userspace_stats_.event_process_micros[evt->get_type()] += (NowMicros() - process_start);
+    if (timed) {
+      event_timing_.AddProcess(evt->get_type(), CycleClock::Now() - process_start);
+    }
   }
 }
 
@@ -356,6 +488,10 @@ bool Service::GetStats(system_inspector::Stats* stats) const {
   userspace_stats = inspector_->get_sinsp_stats_v2();
 
   *stats = userspace_stats_;
+  for (int i = 0; i < PPM_EVENT_MAX; i++) {
+    stats->event_parse_micros[i] = event_timing_.ParseMicros(i);
+    stats->event_process_micros[i] = event_timing_.ProcessMicros(i);
+  }
   stats->nEvents = kernel_stats.n_evts;
   stats->nDrops = kernel_stats.n_drops;
   stats->nDropsBuffer = kernel_stats.n_drops_buffer;
@@ -379,12 +515,92 @@ void Service::AddSignalHandler(std::unique_ptr<SignalHandler> signal_handler) {
     for (const auto& event_name : relevant_events) {
       for (ppm_event_code event_id : event_names.GetEventIDs(event_name)) {
         event_filter.set(event_id);
-        global_event_filter_.set(event_id);
+        handler_events_.set(event_id);
       }
     }
   }
 
   signal_handlers_.emplace_back(std::move(signal_handler), event_filter);
+  RebuildDispatchTable();
+}
+
+void Service::AddNetworkSignalHandler(std::unique_ptr<SignalHandler> signal_handler) {
+  const EventNames& event_names = EventNames::GetInstance();
+  for (const auto& event_name : signal_handler->GetRelevantEvents()) {
+    for (ppm_event_code event_id : event_names.GetEventIDs(event_name)) {
+      network_events_.set(event_id);
+    }
+  }
+
+  AddSignalHandler(std::move(signal_handler));
+}
+
+void Service::RemoveSignalHandler(SignalHandler* signal_handler) {
+  auto it = std::find_if(signal_handlers_.begin(), signal_handlers_.end(), [&](const SignalHandlerEntry& entry) {
+    return entry.handler.get() == signal_handler;
+  });
+  if (it == signal_handlers_.end()) {
+    return;
+  }
+  signal_handlers_.erase(it);
+  RebuildDispatchTable();
+}
+
+void Service::RebuildDispatchTable() {
+  global_event_filter_ = handler_events_ & ~disabled_events_;
+
+  std::vector<DispatchTable::HandlerEvents> handlers;
+  handlers.reserve(signal_handlers_.size());
+  for (const auto& entry : signal_handlers_) {
+    handlers.emplace_back(entry.handler.get(), entry.event_filter & ~disabled_events_);
+  }
+  // Swapped in as a whole, so the event loop never sees a partially
+  // updated table.
+  dispatch_table_ = DispatchTable::Build(handlers);
+}
+
+void Service::UpdateCapturedSyscalls() {
+  syscalls_version_ = config_.SyscallsVersion();
+  auto disabled = config_.DisabledSyscalls();
+
+  std::vector<std::string> enabled;
+  for (const auto& syscall : config_.Syscalls()) {
+    if (std::find(disabled.begin(), disabled.end(), syscall) == disabled.end()) {
+      enabled.push_back(syscall);
+    }
+  }
+
+  std::bitset<PPM_EVENT_MAX> disabled_events;
+  const EventNames& event_names = EventNames::GetInstance();
+  for (const auto& syscall : disabled) {
+    try {
+      for (ppm_event_code event_id : event_names.GetEventIDs(syscall)) {
+        disabled_events.set(event_id);
+      }
+    } catch (const CollectorException& e) {
+      CLOG(ERROR) << "Cannot disable syscall: " << e.what();
+    }
+  }
+
+  // Only toggle syscalls captured at startup: handlers picked their events
+  // then, so there would be no one to handle anything else.
+  auto captured = IKernelDriver::GetSyscallList(config_.Syscalls());
+  auto wanted = IKernelDriver::GetSyscallList(enabled);
+  {
+    std::lock_guard<std::mutex> lock(libsinsp_mutex_);
+    if (!inspector_) {
+      return;
+    }
+    for (ppm_sc_code ppm_sc : captured) {
+      inspector_->mark_ppm_sc_of_interest(ppm_sc, wanted.count(ppm_sc) != 0);
+    }
+  }
+
+  disabled_events_ = disabled_events;
+  RebuildDispatchTable();
+
+  CLOG(INFO) << "Capturing " << enabled.size() << " out of " << config_.Syscalls().size()
+             << " syscalls, " << disabled.size() << " disabled at runtime";
 }
 
 void Service::GetProcessInformation(uint64_t pid, ProcessInfoCallbackRef callback) {
@@ -409,8 +625,4 @@ void Service::ServePendingProcessRequests() {
   }
 }
 
-bool Service::SignalHandlerEntry::ShouldHandle(sinsp_evt* evt) const {
-  return event_filter[evt->get_type()];
-}
-
 }  // namespace collector::system_inspector
@@ -8,7 +8,13 @@
 #include <gtest/gtest_prod.h>
 
 #include "ConnTracker.h"
+#include "ContainerCgroupSet.h"
+#include "ContainerIDCache.h"
+#include "ContainerProcesses.h"
 #include "Control.h"
+#include "DispatchTable.h"
+#include "EventTimingSampler.h"
+#include "NetworkExclusions.h"
 #include "SignalHandler.h"
 #include "SignalServiceClient.h"
 #include "SystemInspector.h"
@@ -46,6 +52,17 @@ class Service : public SystemInspector {
   Stats* GetUserspaceStats() { return &userspace_stats_; }
 
   void AddSignalHandler(std::unique_ptr<SignalHandler> signal_handler);
+  // Same as AddSignalHandler, with the events of the handler being dropped
+  // for containers excluded from network processing.
+  void AddNetworkSignalHandler(std::unique_ptr<SignalHandler> signal_handler);
+
+  // Container IDs of the threads seen by the event loop. Only to be used
+  // from the event loop thread, i.e. from signal handlers.
+  std::shared_ptr<const ContainerIDCache> GetContainerIDCache() const { return container_id_cache_; }
+  // Live processes of each container, only maintained when purging the
+  // connections of exited containers is enabled, null otherwise. Same
+  // threading rules as the container ID cache.
+  std::shared_ptr<const ContainerProcesses> GetContainerProcesses() const { return container_processes_; }
 
  private:
   FRIEND_TEST(SystemInspectorServiceTest, FilterEvent);
@@ -56,23 +73,60 @@ class Service : public SystemInspector {
 
     SignalHandlerEntry(std::unique_ptr<SignalHandler> handler, std::bitset<PPM_EVENT_MAX> event_filter)
         : handler(std::move(handler)), event_filter(event_filter) {}
-
-    bool ShouldHandle(sinsp_evt* evt) const;
   };
 
   sinsp_evt* GetNext();
-  static bool FilterEvent(sinsp_evt* event);
+  // Goes through the container ID cache. Null if the event has no thread
+  // info, otherwise the returned entry is valid until the next event.
+  const ContainerIDCache::Entry* ResolveContainer(sinsp_evt* event);
+  // Counts the process of the event in its container on process creation
+  // and execve, and forgets it when it exits.
+  void TrackContainerProcess(sinsp_evt* event, const ContainerIDCache::Entry* container);
+  // Counts the processes in the thread table, which sinsp loads on open.
+  void LoadContainerProcesses();
   static bool FilterEvent(const sinsp_threadinfo* tinfo);
+  static bool FilterEvent(const sinsp_threadinfo& tinfo, const std::string& container_id);
 
   bool SendExistingProcesses(SignalHandler* handler);
+  void RemoveSignalHandler(SignalHandler* signal_handler);
+  void RebuildDispatchTable();
+
+  void ConfigureEventTiming(const CollectorConfig& config);
+  // Applies the syscalls disabled through the runtime configuration to the
+  // live driver, the global event filter and the dispatch table.
+  void UpdateCapturedSyscalls();
 
+  const CollectorConfig& config_;
   mutable std::mutex libsinsp_mutex_;
   std::unique_ptr<sinsp> inspector_;
   std::unique_ptr<sinsp_evt_formatter> default_formatter_;
   std::unique_ptr<ISignalServiceClient> signal_client_;
   std::vector<SignalHandlerEntry> signal_handlers_;
+  // Built from signal_handlers_, only modified from the event loop thread
+  // (or before it starts).
+  DispatchTable dispatch_table_;
   Stats userspace_stats_;
+  // Events relevant to any signal handler, and the subset of those which is
+  // not disabled at runtime.
+  std::bitset<PPM_EVENT_MAX> handler_events_;
   std::bitset<PPM_EVENT_MAX> global_event_filter_;
+  // Events of the syscalls disabled at runtime, as of syscalls_version_.
+  std::bitset<PPM_EVENT_MAX> disabled_events_;
+  uint64_t syscalls_version_ = 0;
+  std::shared_ptr<ContainerIDCache> container_id_cache_;
+  // Events after which the container of the thread is resolved again.
+  std::bitset<PPM_EVENT_MAX> thread_update_events_;
+  std::shared_ptr<ContainerProcesses> container_processes_;
+  ContainerCgroupSet container_cgroups_;
+  // Events of network signal handlers, and the containers for which they
+  // are dropped, as of network_exclusions_version_.
+  std::bitset<PPM_EVENT_MAX> network_events_;
+  std::shared_ptr<const NetworkExclusions::Rules> network_exclusions_;
+  uint64_t network_exclusions_version_ = 0;
+
+  EventTimingSampler<PPM_EVENT_MAX> event_timing_;
+  // Whether the event last returned by GetNext() is being timed.
+  bool time_current_event_ = false;
 
   mutable std::mutex running_mutex_;
   bool running_ = false;
@@ -24,6 +24,8 @@ struct Stats {
   volatile uint64_t nGRPCSendFailures = 0;                  // number of signals that were not sent on GRPC
   volatile uint64_t nThreadCacheSize = 0;                   // number of thread-info entries stored in the cache
   volatile uint64_t nDropsThreadCache = 0;                  // the number of drops due to full thread cache
+  volatile uint64_t nContainerIDCacheHits = 0;              // container ID lookups served by the per thread cache
+  volatile uint64_t nContainerIDCacheMisses = 0;            // container ID lookups which had to walk the thread cgroups
 
   // process related metrics
   volatile uint64_t nProcessSent = 0;                       // number of process signals sent
@@ -32,6 +34,11 @@ struct Stats {
   volatile uint64_t nProcessResolutionFailuresByTinfo = 0;  // number of process signals failed to resolve by tinfo*
   volatile uint64_t nProcessRateLimitCount = 0;             // number of process signals rate limited
 
+  // asynchronous signal sending metrics
+  volatile uint64_t nSignalQueueDepth = 0;          // number of signals waiting to be written to the stream
+  volatile uint64_t nSignalQueueDroppedOldest = 0;  // number of queued signals dropped to make room for new ones
+  volatile uint64_t nSignalQueueDroppedNewest = 0;  // number of new signals dropped because the queue was full
+
   // Timing metrics
   volatile uint64_t event_parse_micros[PPM_EVENT_MAX] = {0};    // total microseconds spent parsing event type (correlates w/ nUserspaceEvents)
   volatile uint64_t event_process_micros[PPM_EVENT_MAX] = {0};  // total microseconds spent processing event type (correlates w/ nFilteredevents)
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace collector {
+
+// Wall time taken by fn, as a count of Unit. Use a floating point Unit,
+// e.g. std::chrono::duration<double, std::milli>, to keep the fraction.
+template <typename Unit = std::chrono::microseconds, typename Fn>
+typename Unit::rep TimeIt(Fn&& fn) {
+  auto start = std::chrono::steady_clock::now();
+  std::forward<Fn>(fn)();
+  return std::chrono::duration_cast<Unit>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One line of benchmark results, printed when it goes out of scope, with a
+// prefix which makes it stand out of the test output:
+//
+//   BenchmarkLine() << "lookup: " << TimeIt([&] { ... }) << "us";
+class BenchmarkLine {
+ public:
+  BenchmarkLine() { line_ << "[ BENCHMARK] "; }
+  ~BenchmarkLine() { std::cout << line_.str() << std::endl; }
+
+  BenchmarkLine(const BenchmarkLine&) = delete;
+  BenchmarkLine& operator=(const BenchmarkLine&) = delete;
+
+  template <typename T>
+  BenchmarkLine& operator<<(const T& value) {
+    line_ << value;
+    return *this;
+  }
+
+ private:
+  std::ostringstream line_;
+};
+
+}  // namespace collector
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BenchmarkUtil.h"
+#include "CgroupResolver.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+const std::string_view kCgroupPaths[] = {
+    "/mesos/3b1cf944-1d97-40a6-ac73-b156ac2f2bfe/kubepods/besteffort/pod8e18d5f1-1421-42b7-8151-fb1c3be4bd4d/e73c55f3e7f5b6a9cfc32a89bf13e44d348bcc4fa7b079f804d61fb1532ddbe5",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4",
+    "/kubepods/burstable/pod7cd3dba6-e475-11e9-8f99-42010a8a00d2/2bc55a8cae1704a733ba5d785d146bbed9610483380507cbf00c96b32bb637e1",
+    "/kubepods.slice/kubepods-burstable.slice/kubepods-burstable-podce705797_e47e_11e9_bd71_42010a000002.slice/docker-6525e65814a99d431b6978e8f8c895013176c6c58173b56639d4b020c14e6022.scope",
+    "/machine.slice/libpod-e9cf81e3b1d172752567c8fe6ac48c1c751b9237ab47bf55cbfd5a971a4a9519.scope/container",
+    "/kubepods-burstable-podbd12dd3393227d950605a2444b13c27a.slice:cri-containerd:d52db56a9c80d536a91354c0951c061187ca46249e64865a12703003d8f42366",
+    "/machine.slice/libpod-conmon-b6ce30d02945df4bbf8e8b7193b2c56ebb3cd10227dd7e59d7f7cdc2cfa2a307.scope",
+    "/kubepods/burstable/pod7cd3dba6-e475-11e9-8f99-42010a8a00d2/2bc55a8cae1704a733ba5d785d146bbed9610483380507cbf00c96b32bbXYZ",
+    "/user.slice/user-1000.slice/session-2.scope",
+    "/",
+};
+
+// The scalar implementation CgroupResolver replaces, kept as a reference for
+// equivalence and as a benchmark baseline.
+std::optional<std::string_view> ReferenceExtractContainerID(std::string_view cgroup) {
+  constexpr size_t kIDLength = 64;
+  if (cgroup.size() < kIDLength + 1) {
+    return {};
+  }
+
+  auto scope = cgroup.rfind(".scope");
+  if (scope != std::string_view::npos) {
+    cgroup.remove_suffix(cgroup.length() - scope);
+    if (cgroup.size() < kIDLength + 1) {
+      return {};
+    }
+  }
+
+  auto container_id_part = cgroup.substr(cgroup.size() - (kIDLength + 1));
+  if (container_id_part[0] != '/' && container_id_part[0] != '-' && container_id_part[0] != ':') {
+    return {};
+  }
+
+  cgroup.remove_suffix(kIDLength + 1);
+  if (cgroup.find("-conmon", cgroup.size() - 7) != std::string_view::npos) {
+    return {};
+  }
+
+  container_id_part.remove_prefix(1);
+  if (container_id_part.size() != kIDLength ||
+      !std::all_of(container_id_part.begin(), container_id_part.end(), [](char c) { return std::isxdigit(c) != 0; })) {
+    return {};
+  }
+  return container_id_part.substr(0, 12);
+}
+
+TEST(CgroupResolverTest, MatchesReference) {
+  for (auto path : kCgroupPaths) {
+    EXPECT_EQ(CgroupResolver::ExtractContainerID(path), ReferenceExtractContainerID(path)) << path;
+  }
+}
+
+TEST(CgroupResolverTest, IsContainerID) {
+  std::string id(64, 'a');
+  EXPECT_TRUE(CgroupResolver::IsContainerID(id));
+  EXPECT_FALSE(CgroupResolver::IsContainerID(id.substr(1)));
+
+  // Every position is checked, and anything but hex digits is rejected.
+  const char invalid[] = {'g', 'G', '/', ':', '@', '`', '\0', '\x80', '\xe0', '\xff'};
+  for (size_t i = 0; i < id.size(); i++) {
+    for (char c : invalid) {
+      std::string bad = id;
+      bad[i] = c;
+      EXPECT_FALSE(CgroupResolver::IsContainerID(bad)) << "position " << i << " char " << static_cast<int>(c);
+    }
+  }
+
+  EXPECT_TRUE(CgroupResolver::IsContainerID("0123456789abcdefABCDEF0123456789abcdefABCDEF0123456789abcdef0123"));
+}
+
+TEST(CgroupResolverTest, ExtractContainerIDFromFile) {
+  std::string content =
+      "12:pids:/\n"
+      "11:freezer:/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4\n"
+      "0::/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4\n";
+  EXPECT_EQ(CgroupResolver::ExtractContainerIDFromFile(content), "951e643e3c24");
+
+  // No trailing newline
+  EXPECT_EQ(CgroupResolver::ExtractContainerIDFromFile("0::/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4"), "951e643e3c24");
+
+  EXPECT_EQ(CgroupResolver::ExtractContainerIDFromFile("0::/init.scope\n"), std::nullopt);
+  EXPECT_EQ(CgroupResolver::ExtractContainerIDFromFile(""), std::nullopt);
+}
+
+TEST(CgroupResolverTest, ResolveProcess) {
+  char dir_template[] = "/tmp/cgroup_resolver_test.XXXXXX";
+  ASSERT_NE(mkdtemp(dir_template), nullptr);
+  std::string dir(dir_template);
+  std::string path = dir + "/cgroup";
+
+  {
+    std::ofstream file(path);
+    file << "0::/kubepods/burstable/pod7cd3dba6-e475-11e9-8f99-42010a8a00d2/2bc55a8cae1704a733ba5d785d146bbed9610483380507cbf00c96b32bb637e1\n";
+  }
+
+  int dirfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_GE(dirfd, 0);
+
+  EXPECT_EQ(CgroupResolver::ResolveProcess(dirfd), "2bc55a8cae17");
+
+  {
+    std::ofstream file(path);
+    file << "0::/init.scope\n";
+  }
+  EXPECT_EQ(CgroupResolver::ResolveProcess(dirfd), std::nullopt);
+
+  unlink(path.c_str());
+  EXPECT_EQ(CgroupResolver::ResolveProcess(dirfd), std::nullopt);
+
+  close(dirfd);
+  rmdir(dir.c_str());
+}
+
+TEST(CgroupResolverTest, DISABLED_Benchmark) {
+  constexpr int kIterations = 200000;
+  size_t found = 0;
+
+  auto reference_us = TimeIt([&] {
+    for (int i = 0; i < kIterations; i++) {
+      for (auto path : kCgroupPaths) {
+        found += ReferenceExtractContainerID(path).has_value();
+      }
+    }
+  });
+  auto resolver_us = TimeIt([&] {
+    for (int i = 0; i < kIterations; i++) {
+      for (auto path : kCgroupPaths) {
+        found += CgroupResolver::ExtractContainerID(path).has_value();
+      }
+    }
+  });
+
+  EXPECT_EQ(found, 2 * kIterations * 6);
+
+  BenchmarkLine() << "reference: " << reference_us << "us, resolver: " << resolver_us << "us";
+}
+
+}  // namespace
+}  // namespace collector
@@ -457,4 +457,118 @@ TEST(CollectorConfigTest, TestMaxConnectionsPerMinute) {
   }
 }
 
+TEST(CollectorConfigTest, TestDisabledSyscalls) {
+  CollectorConfig config;
+  ConfigLoader loader(config);
+  auto version = config.SyscallsVersion();
+
+  YAML::Node yamlNode = YAML::Load(R"(
+                  syscalls:
+                    disabled:
+                      - sendto
+                      - recvfrom
+               )");
+  ASSERT_EQ(loader.LoadConfiguration(yamlNode), ConfigLoader::SUCCESS);
+  EXPECT_EQ(config.DisabledSyscalls(), (std::vector<std::string>{"sendto", "recvfrom"}));
+  EXPECT_NE(config.SyscallsVersion(), version);
+
+  // Reloading the same set does not bump the version.
+  version = config.SyscallsVersion();
+  ASSERT_EQ(loader.LoadConfiguration(yamlNode), ConfigLoader::SUCCESS);
+  EXPECT_EQ(config.SyscallsVersion(), version);
+
+  // Removing the section enables them again.
+  ASSERT_EQ(loader.LoadConfiguration(YAML::Load(R"(
+                  networking:
+                    maxConnectionsPerMinute: 1234
+               )")),
+            ConfigLoader::SUCCESS);
+  EXPECT_TRUE(config.DisabledSyscalls().empty());
+  EXPECT_NE(config.SyscallsVersion(), version);
+
+  ASSERT_EQ(loader.LoadConfiguration(yamlNode), ConfigLoader::SUCCESS);
+  version = config.SyscallsVersion();
+  config.ResetRuntimeConfig();
+  EXPECT_TRUE(config.DisabledSyscalls().empty());
+  EXPECT_NE(config.SyscallsVersion(), version);
+}
+
+TEST(CollectorConfigTest, TestDisabledSyscallsInvalid) {
+  std::vector<std::string> tests = {
+      R"(
+                  syscalls: sendto
+               )",
+      R"(
+                  syscalls:
+                    disabled: sendto
+               )",
+      R"(
+                  syscalls:
+                    disabled:
+                      - notasyscall
+               )",
+      R"(
+                  syscalls:
+                    disabled:
+                      - procexit
+               )",
+  };
+
+  for (const auto& yamlStr : tests) {
+    CollectorConfig config;
+    EXPECT_EQ(ConfigLoader(config).LoadConfiguration(YAML::Load(yamlStr)), ConfigLoader::PARSE_ERROR) << "Input: " << yamlStr;
+    EXPECT_TRUE(config.DisabledSyscalls().empty());
+    EXPECT_FALSE(config.GetRuntimeConfig().has_value());
+  }
+}
+
+TEST(CollectorConfigTest, TestNetworkExclusions) {
+  CollectorConfig config;
+  ConfigLoader loader(config);
+
+  ASSERT_EQ(loader.LoadConfiguration(YAML::Load(R"(
+                  networkExclusions:
+                    containerIds:
+                      - 0123456789ab
+                      - e73c55f3e7f5b6a9cfc32a89bf13e44d348bcc4fa7b079f804d61fb1532ddbe5
+               )")),
+            ConfigLoader::SUCCESS);
+
+  auto rules = config.GetNetworkExclusions().Get();
+  EXPECT_EQ(rules->ByContainer().size(), 2);
+  EXPECT_NE(rules->Match("0123456789ab"), nullptr);
+  EXPECT_NE(rules->Match("e73c55f3e7f5"), nullptr);
+
+  config.ResetRuntimeConfig();
+  EXPECT_TRUE(config.GetNetworkExclusions().Get()->empty());
+}
+
+TEST(CollectorConfigTest, TestNetworkExclusionsInvalid) {
+  std::vector<std::string> tests = {
+      R"(
+                  networkExclusions: 0123456789ab
+               )",
+      R"(
+                  networkExclusions:
+                    containerIds: 0123456789ab
+               )",
+      R"(
+                  networkExclusions:
+                    containerIds:
+                      - not-a-container
+               )",
+      R"(
+                  networkExclusions:
+                    containerIds:
+                      - 0123456789AB
+               )",
+  };
+
+  for (const auto& yamlStr : tests) {
+    CollectorConfig config;
+    EXPECT_EQ(ConfigLoader(config).LoadConfiguration(YAML::Load(yamlStr)), ConfigLoader::PARSE_ERROR) << "Input: " << yamlStr;
+    EXPECT_TRUE(config.GetNetworkExclusions().Get()->empty());
+  }
+}
+
 }  // namespace collector
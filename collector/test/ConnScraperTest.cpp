@@ -1,5 +1,14 @@
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <string_view>
 
+#include <stdlib.h>
+
+#include "BenchmarkUtil.h"
+#include "Containers.h"
+#include "ProcfsScraper.h"
 #include "ProcfsScraper_internal.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -8,6 +17,126 @@ namespace collector {
 
 namespace {
 
+// ProcFixture writes a synthetic `/proc` directory. Each of its network namespaces is shared by the processes of two
+// containers, like a pod, which hold the sockets of the established connections of the namespace between them. The
+// first process of each namespace also holds a listen socket. A process outside of any container is added as pid 1.
+class ProcFixture {
+ public:
+  ProcFixture(int num_netns, int procs_per_netns, int conns_per_netns) {
+    char dir_template[] = "/tmp/conn_scraper_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+      return;
+    }
+    path_ = dir_template;
+
+    WriteProcess(1, "0::/init.scope\n", 0, {});
+
+    int pid = 2;
+    for (int ns = 0; ns < num_netns; ns++) {
+      WriteNetns(ns, conns_per_netns);
+
+      std::vector<std::vector<ino_t>> sockets(procs_per_netns);
+      sockets[0].push_back(SocketInode(ns, kListenSocket));
+      for (int i = 0; i < conns_per_netns; i++) {
+        sockets[i % procs_per_netns].push_back(SocketInode(ns, i));
+      }
+
+      for (int p = 0; p < procs_per_netns; p++) {
+        char cgroup[128];
+        snprintf(cgroup, sizeof(cgroup), "0::/kubepods/besteffort/pod%d/%012x%052x\n", ns, 2 * ns + p % 2, 0);
+        WriteProcess(pid++, cgroup, ns, sockets[p]);
+      }
+    }
+  }
+
+  ~ProcFixture() {
+    if (!path_.empty()) {
+      std::filesystem::remove_all(path_);
+    }
+  }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  static constexpr int kListenSocket = 9999;
+
+  static ino_t SocketInode(int ns, int socket) { return 1000000 + 10000 * ns + socket; }
+
+  // Formats an IPv4 address the way net/tcp does, as the hexadecimal value of the address in host byte order.
+  static unsigned int Addr(int a, int b, int c, int d) { return a | b << 8 | c << 16 | static_cast<unsigned int>(d) << 24; }
+
+  void WriteNetns(int ns, int conns_per_netns) {
+    auto dir = std::filesystem::path(path_) / "netns" / std::to_string(ns);
+    std::filesystem::create_directories(dir);
+
+    unsigned int local = Addr(10, 0, ns / 256, ns % 256);
+    char line[256];
+    std::ofstream tcp(dir / "tcp");
+    tcp << "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n";
+    snprintf(line, sizeof(line), "%4d: %08X:%04X %08X:%04X 0A 00000000:00000000 00:00000000 00000000     0        0 %lu 1 0000000000000000 100 0 0 10 0\n",
+             0, local, 8080, 0, 0, static_cast<unsigned long>(SocketInode(ns, kListenSocket)));
+    tcp << line;
+    for (int i = 0; i < conns_per_netns; i++) {
+      unsigned int remote = Addr(10, 128, i / 256 % 256, i % 256);
+      snprintf(line, sizeof(line), "%4d: %08X:%04X %08X:%04X 01 00000000:00000000 00:00000000 00000000     0        0 %lu 1 0000000000000000 100 0 0 10 0\n",
+               i + 1, local, 8080, remote, 40000 + i % 20000, static_cast<unsigned long>(SocketInode(ns, i)));
+      tcp << line;
+    }
+
+    std::ofstream tcp6(dir / "tcp6");
+    tcp6 << "  sl  local_address                         remote_address                        st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n";
+  }
+
+  void WriteProcess(int pid, const char* cgroup, int ns, const std::vector<ino_t>& sockets) {
+    auto dir = std::filesystem::path(path_) / std::to_string(pid);
+    std::filesystem::create_directories(dir / "fd");
+    std::filesystem::create_directories(dir / "ns");
+
+    std::ofstream(dir / "stat") << pid << " (proc) S 1 " << pid << " " << pid << " 0 -1 4194560 0 0 0 0 0 0 0 0 20 0 1 0\n";
+    std::ofstream(dir / "cgroup") << cgroup;
+    std::filesystem::create_symlink("net:[" + std::to_string(4026532000 + ns) + "]", dir / "ns" / "net");
+    std::filesystem::create_directory_symlink("../netns/" + std::to_string(ns), dir / "net");
+
+    std::filesystem::create_symlink("/dev/null", dir / "fd" / "0");
+    int fd = 3;
+    for (ino_t inode : sockets) {
+      std::filesystem::create_symlink("socket:[" + std::to_string(inode) + "]", dir / "fd" / std::to_string(fd++));
+    }
+  }
+
+  std::string path_;
+};
+
+struct ScrapeResult {
+  UnorderedSet<Connection> connections;
+  UnorderedSet<ContainerEndpoint> listen_endpoints;
+  UnorderedSet<std::string> containers;
+};
+
+ScrapeResult Scrape(const std::string& proc_path, size_t workers) {
+  ConnScraper scraper(proc_path);
+  scraper.SetWorkers(workers);
+
+  std::vector<Connection> connections;
+  std::vector<ContainerEndpoint> listen_endpoints;
+  EXPECT_TRUE(scraper.Scrape(&connections, &listen_endpoints));
+
+  ScrapeResult result;
+  result.connections.insert(connections.begin(), connections.end());
+  result.listen_endpoints.insert(listen_endpoints.begin(), listen_endpoints.end());
+  EXPECT_EQ(result.connections.size(), connections.size());
+  if (const auto* containers = scraper.ScrapedContainers()) {
+    result.containers = *containers;
+  }
+  return result;
+}
+
+int64_t ProcessCPUTimeMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
 TEST(ConnScraperTest, TestExtractContainerID) {
   struct TestCase {
     std::string_view input, expected_output;
@@ -67,6 +196,66 @@ TEST(ConnScraperTest, TestProcStateExtract) {
   EXPECT_EQ(*state, 'R');
 }
 
+TEST(ConnScraperTest, TestScrape) {
+  ProcFixture fixture(3, 4, 10);
+  ASSERT_FALSE(fixture.path().empty());
+
+  auto result = Scrape(fixture.path(), 1);
+  EXPECT_EQ(result.connections.size(), 30);
+  EXPECT_EQ(result.listen_endpoints.size(), 3);
+  EXPECT_EQ(result.containers.size(), 6);
+
+  Endpoint local(Address(10, 0, 0, 1), 8080);
+  Endpoint remote(Address(10, 128, 0, 2), 40002);
+  EXPECT_TRUE(Contains(result.connections, Connection("000000000002", local, remote, L4Proto::TCP, true)));
+  EXPECT_TRUE(Contains(result.connections, Connection("000000000003", local, Endpoint(Address(10, 128, 0, 1), 40001), L4Proto::TCP, true)));
+}
+
+TEST(ConnScraperTest, TestParallelScrapeMatchesSerial) {
+  ProcFixture fixture(20, 6, 50);
+  ASSERT_FALSE(fixture.path().empty());
+
+  auto serial = Scrape(fixture.path(), 1);
+  EXPECT_EQ(serial.connections.size(), 20 * 50);
+  EXPECT_EQ(serial.listen_endpoints.size(), 20);
+  EXPECT_EQ(serial.containers.size(), 40);
+
+  for (size_t workers : {2, 4, 16, 1000}) {
+    auto parallel = Scrape(fixture.path(), workers);
+    EXPECT_TRUE(parallel.connections == serial.connections) << workers << " workers";
+    EXPECT_TRUE(parallel.listen_endpoints == serial.listen_endpoints) << workers << " workers";
+    EXPECT_TRUE(parallel.containers == serial.containers) << workers << " workers";
+  }
+}
+
+// Compares the wall time and CPU time of scraping a large `/proc` with different numbers of workers. The fixture lives
+// on a regular filesystem, so reading net/tcp is cheaper than on procfs, where the kernel formats it on each read.
+TEST(ConnScraperTest, DISABLED_BenchmarkParallelScrape) {
+  constexpr int kNetns = 1000;
+  constexpr int kProcsPerNetns = 10;
+  constexpr int kConnsPerNetns = 200;
+
+  ProcFixture fixture(kNetns, kProcsPerNetns, kConnsPerNetns);
+  ASSERT_FALSE(fixture.path().empty());
+
+  for (size_t workers : {1, 2, 4, 8}) {
+    ConnScraper scraper(fixture.path());
+    scraper.SetWorkers(workers);
+    std::vector<Connection> connections;
+    std::vector<ContainerEndpoint> listen_endpoints;
+
+    bool scraped = false;
+    int64_t cpu_start = ProcessCPUTimeMicros();
+    auto wall_us = TimeIt([&] { scraped = scraper.Scrape(&connections, &listen_endpoints); });
+    int64_t cpu_us = ProcessCPUTimeMicros() - cpu_start;
+
+    ASSERT_TRUE(scraped);
+    EXPECT_EQ(connections.size(), kNetns * kConnsPerNetns);
+    BenchmarkLine() << "Scraped " << kNetns * kProcsPerNetns << " processes with " << workers << " workers: "
+                    << wall_us << "us wall time, " << cpu_us << "us CPU time";
+  }
+}
+
 }  // namespace
 
 }  // namespace collector
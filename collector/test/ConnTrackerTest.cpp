@@ -20,8 +20,19 @@ You should have received a copy of the GNU General Public License along with thi
 * do not wish to do so, delete this exception statement from your
 * version. */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 
+#include <malloc.h>
+
+#include "BenchmarkUtil.h"
+#include "CollectorStats.h"
 #include "ConnTracker.h"
 #include "TimeUtil.h"
 #include "gmock/gmock.h"
@@ -35,6 +46,16 @@ using CT = ConnectionTracker;
 using ::testing::IsEmpty;
 using ::testing::UnorderedElementsAre;
 
+// Bytes in use on the heap, reported by the memory benchmarks. mallinfo2()
+// is glibc-only, other C libraries report 0.
+int64_t HeapBytes() {
+#if defined(__GLIBC__)
+  return static_cast<int64_t>(mallinfo2().uordblks);
+#else
+  return 0;
+#endif
+}
+
 TEST(ConnTrackerTest, TestAddRemove) {
   Endpoint a(Address(192, 168, 0, 1), 80);
   Endpoint b(Address(192, 168, 1, 10), 9999);
@@ -1279,13 +1300,10 @@ TEST(ConnTrackerTest, TestUpdateOldStateBenchmark) {
   ConnMap old_state, new_state;
 
   CreateFakeState(old_state, num_endpoints, num_connections, time_micros1);
-  auto t1 = std::chrono::steady_clock::now();
-  CT::UpdateOldState(&old_state, new_state, time_micros2, afterglow_period_micros);
-  auto t2 = std::chrono::steady_clock::now();
-  std::chrono::duration<double, std::milli> dur = t2 - t1;
-  std::cout << "old_state.size()= " << old_state.size() << std::endl;
-  std::cout << "new_state.size()= " << new_state.size() << std::endl;
-  std::cout << "Time taken by UpdateOldState= " << dur.count() << " ms\n";
+  auto dur = TimeIt<std::chrono::duration<double, std::milli>>([&] { CT::UpdateOldState(&old_state, new_state, time_micros2, afterglow_period_micros); });
+  BenchmarkLine() << "old_state.size()= " << old_state.size();
+  BenchmarkLine() << "new_state.size()= " << new_state.size();
+  BenchmarkLine() << "Time taken by UpdateOldState= " << dur << " ms";
 }
 
 TEST(ConnTrackerTest, TestUpdateOldStateBenchmark2) {
@@ -1297,13 +1315,10 @@ TEST(ConnTrackerTest, TestUpdateOldStateBenchmark2) {
   ConnMap old_state, new_state;
 
   CreateFakeState(new_state, num_endpoints, num_connections, time_micros1);
-  auto t1 = std::chrono::steady_clock::now();
-  CT::UpdateOldState(&old_state, new_state, time_micros2, afterglow_period_micros);
-  auto t2 = std::chrono::steady_clock::now();
-  std::chrono::duration<double, std::milli> dur = t2 - t1;
-  std::cout << "old_state.size()= " << old_state.size() << std::endl;
-  std::cout << "new_state.size()= " << new_state.size() << std::endl;
-  std::cout << "Time taken by UpdateOldState= " << dur.count() << " ms\n";
+  auto dur = TimeIt<std::chrono::duration<double, std::milli>>([&] { CT::UpdateOldState(&old_state, new_state, time_micros2, afterglow_period_micros); });
+  BenchmarkLine() << "old_state.size()= " << old_state.size();
+  BenchmarkLine() << "new_state.size()= " << new_state.size();
+  BenchmarkLine() << "Time taken by UpdateOldState= " << dur << " ms";
 }
 
 TEST(ConnTrackerTest, TestComputeDeltaAfterglowBenchmark) {
@@ -1315,13 +1330,10 @@ TEST(ConnTrackerTest, TestComputeDeltaAfterglowBenchmark) {
   ConnMap new_state, old_state, delta;
 
   CreateFakeState(new_state, num_endpoints, num_connections, time_at_last_scrape);
-  auto t1 = std::chrono::steady_clock::now();
-  CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, afterglow_period_micros);
-  auto t2 = std::chrono::steady_clock::now();
-  std::chrono::duration<double, std::milli> dur = t2 - t1;
-  std::cout << "old_state.size()= " << old_state.size() << std::endl;
-  std::cout << "new_state.size()= " << new_state.size() << std::endl;
-  std::cout << "Time taken by ComputeDeltaAfterglow= " << dur.count() << " ms\n";
+  auto dur = TimeIt<std::chrono::duration<double, std::milli>>([&] { CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, afterglow_period_micros); });
+  BenchmarkLine() << "old_state.size()= " << old_state.size();
+  BenchmarkLine() << "new_state.size()= " << new_state.size();
+  BenchmarkLine() << "Time taken by ComputeDeltaAfterglow= " << dur << " ms";
 }
 
 TEST(ConnTrackerTest, TestComputeDeltaAfterglowBenchmark2) {
@@ -1334,13 +1346,10 @@ TEST(ConnTrackerTest, TestComputeDeltaAfterglowBenchmark2) {
 
   CreateFakeState(new_state, num_endpoints, num_connections, time_micros);
   CreateFakeState(new_state, num_endpoints, num_connections, time_at_last_scrape);
-  auto t1 = std::chrono::steady_clock::now();
-  CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, afterglow_period_micros);
-  auto t2 = std::chrono::steady_clock::now();
-  std::chrono::duration<double, std::milli> dur = t2 - t1;
-  std::cout << "old_state.size()= " << old_state.size() << std::endl;
-  std::cout << "new_state.size()= " << new_state.size() << std::endl;
-  std::cout << "Time taken by ComputeDeltaAfterglow= " << dur.count() << " ms\n";
+  auto dur = TimeIt<std::chrono::duration<double, std::milli>>([&] { CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, afterglow_period_micros); });
+  BenchmarkLine() << "old_state.size()= " << old_state.size();
+  BenchmarkLine() << "new_state.size()= " << new_state.size();
+  BenchmarkLine() << "Time taken by ComputeDeltaAfterglow= " << dur << " ms";
 }
 
 class FakeProcess : public IProcess {
@@ -1651,6 +1660,96 @@ TEST(ConnTrackerTest, TestConnectionStats) {
   EXPECT_EQ(stats.outbound.public_, 4);
 }
 
+// Compares the maintained connection stats with the stored connections, through all the ways to insert and remove them.
+TEST(ConnTrackerTest, TestConnectionStatsMatchStoredConnections) {
+  std::mt19937 rng(17);
+  auto random_conn = [&rng]() {
+    Address remote = rng() % 2 ? Address(35, 0, 0, rng() % 64) : Address(10, 0, 0, rng() % 64);
+    return Connection(rng() % 2 ? "aaa" : "bbb", Endpoint(Address(10, 1, 0, 1), 7 + rng() % 4), Endpoint(remote, 7 + rng() % 4),
+                      L4Proto::TCP, rng() % 2);
+  };
+  auto expected_stats = [](const ConnMap& state) {
+    ConnectionTracker::Stats stats = {};
+    for (const auto& [conn, status] : state) {
+      auto& direction = conn.is_server() ? stats.inbound : stats.outbound;
+      (conn.remote().address().IsPublic() ? direction.public_ : direction.private_)++;
+    }
+    return stats;
+  };
+
+  ConnectionTracker tracker;
+  tracker.SetConnectionLimits(CT::kNumShards * 8, 0);
+  ConnectionBatch* batch = tracker.CreateBatch(16, 1000000);
+  int64_t now = 1000;
+  for (int round = 0; round < 200; round++) {
+    now += 1000;
+    switch (rng() % 8) {
+      case 0: {
+        std::vector<Connection> scraped;
+        for (int i = 0; i < 20; i++) {
+          scraped.push_back(random_conn());
+        }
+        tracker.Update(scraped, {}, now);
+        break;
+      }
+      case 1:
+        tracker.FetchConnDelta(now, now - 1000, true, 5000);
+        break;
+      case 2:
+        tracker.FetchConnState(false, true);
+        break;
+      case 3:
+        tracker.PurgeContainer(ContainerIDInterner::Instance().Intern(rng() % 2 ? "aaa" : "bbb"), now);
+        break;
+      case 4:
+        // Ignored connections are not counted.
+        if (rng() % 2) {
+          tracker.UpdateIgnoredL4ProtoPortPairs({{L4Proto::TCP, 9}});
+        } else {
+          tracker.UpdateIgnoredL4ProtoPortPairs({});
+        }
+        break;
+      case 5:
+        for (int i = 0; i < 20; i++) {
+          batch->Add(random_conn(), now + i, rng() % 2);
+        }
+        break;
+      default:
+        for (int i = 0; i < 20; i++) {
+          tracker.UpdateConnection(random_conn(), now + i, rng() % 2);
+        }
+    }
+
+    // Only fetches the connections which are not ignored, without changing the state. Pending batches are merged
+    // first.
+    auto expected = expected_stats(tracker.FetchConnState(false, false));
+    auto stats = tracker.GetConnectionStats_StoredConnections();
+    ASSERT_EQ(stats.inbound.public_, expected.inbound.public_) << "round " << round;
+    ASSERT_EQ(stats.inbound.private_, expected.inbound.private_) << "round " << round;
+    ASSERT_EQ(stats.outbound.public_, expected.outbound.public_) << "round " << round;
+    ASSERT_EQ(stats.outbound.private_, expected.outbound.private_) << "round " << round;
+  }
+}
+
+TEST(ConnTrackerTest, DISABLED_BenchmarkConnectionStats) {
+  constexpr int kConnections = 500000;
+
+  ConnectionTracker tracker;
+  for (int i = 0; i < kConnections; i++) {
+    tracker.AddConnection(Connection("xyz", Endpoint(Address(10, 0, 0, 1), 40000),
+                                     Endpoint(Address(i % 2 ? 35 : 10, i >> 16, (i >> 8) & 0xff, i & 0xff), 80), L4Proto::TCP, false),
+                          1000);
+  }
+
+  // The first call classifies all connections, as the configuration changed since they were inserted.
+  for (int i = 0; i < 3; i++) {
+    ConnectionTracker::Stats stats;
+    auto elapsed = TimeIt([&] { stats = tracker.GetConnectionStats_StoredConnections(); });
+    BenchmarkLine() << "call " << i << ": " << elapsed << "us";
+    EXPECT_EQ(stats.outbound.public_ + stats.outbound.private_, kConnections);
+  }
+}
+
 TEST(ConnTrackerTest, TestExternalIPsConfigChangeEnableEgress) {
   Endpoint ingress_local(IPNet(Address()), 80);
   Endpoint ingress_remote(Address(223, 42, 0, 1), 0);
@@ -1846,6 +1945,938 @@ TEST(ConnTrackerTest, TestShouldNormalizeConnectionFalse) {
   EXPECT_FALSE(tracker.ShouldNormalizeConnection(&conn));
 }
 
+TEST(ConnTrackerTest, TestBatchMatchesUpdates) {
+  Endpoint a(Address(192, 168, 0, 1), 80);
+  Endpoint b(Address(35, 127, 0, 15), 9999);
+  Endpoint c(Address(10, 1, 1, 8), 54321);
+
+  Connection conn1("xyz", a, b, L4Proto::TCP, true);
+  Connection conn2("xyz", a, c, L4Proto::TCP, true);
+  Connection conn3("zyx", c, a, L4Proto::UDP, false);
+
+  struct Update {
+    const Connection& conn;
+    int64_t timestamp;
+    bool added;
+  };
+  std::vector<Update> updates = {
+      {conn1, 1000, true},
+      {conn2, 1000, true},
+      {conn1, 1010, false},
+      {conn1, 1005, true},
+      {conn3, 1020, true},
+      {conn2, 1000, false},
+      {conn3, 1030, false},
+  };
+
+  ConnectionTracker expected_tracker;
+  ConnectionTracker batched_tracker;
+  // Never merged on its own, only on fetch.
+  ConnectionBatch* batch = batched_tracker.CreateBatch(100, 1000000);
+
+  expected_tracker.AddConnection(conn2, 900);
+  batched_tracker.AddConnection(conn2, 900);
+  for (const auto& update : updates) {
+    expected_tracker.UpdateConnection(update.conn, update.timestamp, update.added);
+    batch->Add(update.conn, update.timestamp, update.added);
+  }
+
+  EXPECT_EQ(batched_tracker.FetchConnState(), expected_tracker.FetchConnState());
+
+  auto expected_stats = expected_tracker.GetConnectionStats_NewConnectionCounters();
+  auto batched_stats = batched_tracker.GetConnectionStats_NewConnectionCounters();
+  EXPECT_EQ(batched_stats.inbound.public_, expected_stats.inbound.public_);
+  EXPECT_EQ(batched_stats.inbound.private_, expected_stats.inbound.private_);
+  EXPECT_EQ(batched_stats.outbound.public_, expected_stats.outbound.public_);
+  EXPECT_EQ(batched_stats.outbound.private_, expected_stats.outbound.private_);
+
+  EXPECT_EQ(batched_tracker.FetchConnState(), expected_tracker.FetchConnState());
+}
+
+TEST(ConnTrackerTest, TestBatchThresholds) {
+  Endpoint a(Address(192, 168, 0, 1), 80);
+  Connection conn1("xyz", a, Endpoint(Address(10, 0, 0, 1), 1), L4Proto::TCP, true);
+  Connection conn2("xyz", a, Endpoint(Address(10, 0, 0, 2), 1), L4Proto::TCP, true);
+  Connection conn3("xyz", a, Endpoint(Address(10, 0, 0, 3), 1), L4Proto::TCP, true);
+
+  ConnectionTracker tracker;
+  ConnectionBatch* batch = tracker.CreateBatch(2, 100);
+
+  // Repeated updates of a connection are coalesced.
+  batch->Add(conn1, 1000, true);
+  batch->Add(conn1, 1001, true);
+  EXPECT_EQ(tracker.GetConnectionStats_StoredConnections().inbound.private_, 0);
+
+  // Size threshold
+  batch->Add(conn2, 1002, true);
+  EXPECT_EQ(tracker.GetConnectionStats_StoredConnections().inbound.private_, 2);
+
+  // Delay threshold
+  batch->Add(conn3, 1010, true);
+  EXPECT_EQ(tracker.GetConnectionStats_StoredConnections().inbound.private_, 2);
+  batch->Add(conn3, 1110, false);
+  EXPECT_EQ(tracker.GetConnectionStats_StoredConnections().inbound.private_, 3);
+
+  EXPECT_THAT(tracker.FetchConnState(), UnorderedElementsAre(
+                                            std::make_pair(conn1, ConnStatus(1001, true)),
+                                            std::make_pair(conn2, ConnStatus(1002, true)),
+                                            std::make_pair(conn3, ConnStatus(1110, false))));
+}
+
+// Compares ingesting connection events one by one and through a batch, while
+// another thread keeps fetching the state, like the network status notifier.
+TEST(ConnTrackerTest, DISABLED_BenchmarkBatchIngestion) {
+  constexpr int kConnections = 1000;
+  constexpr int kEvents = 1000000;
+  constexpr int kBurstSize = 16;
+
+  std::vector<Connection> conns;
+  for (int i = 0; i < kConnections; i++) {
+    conns.emplace_back("0123456789ab", Endpoint(Address(10, 0, i / 256, i % 256), 8080),
+                       Endpoint(Address(10, 1, i / 256, i % 256), 40000 + i), L4Proto::TCP, true);
+  }
+
+  auto run = [&](bool batched) {
+    ConnectionTracker tracker;
+    ConnectionBatch* batch = tracker.CreateBatch(256, 100000);
+    std::atomic<bool> done = false;
+    std::thread fetcher([&]() {
+      while (!done) {
+        tracker.FetchConnState(true, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+
+    auto elapsed = TimeIt<std::chrono::milliseconds>([&] {
+      for (int i = 0; i < kEvents; i++) {
+        // Bursts of send/recv events on the same connection.
+        const auto& conn = conns[(i / kBurstSize) % kConnections];
+        if (batched) {
+          batch->Add(conn, i, true);
+        } else {
+          tracker.UpdateConnection(conn, i, true);
+        }
+      }
+    });
+
+    done = true;
+    fetcher.join();
+    EXPECT_EQ(tracker.FetchConnState().size(), kConnections);
+    return elapsed;
+  };
+
+  auto per_event = run(false);
+  auto batched = run(true);
+  BenchmarkLine() << "per event: " << per_event << "ms, batched: " << batched << "ms";
+}
+
+TEST(ConnTrackerTest, TestNormalizedFetchMergesShards) {
+  Endpoint server(Address(192, 168, 0, 1), 80);
+  ConnectionTracker tracker;
+
+  // Only differ by the client port, so they end up in different shards but
+  // are normalized to the same connection.
+  std::vector<Connection> conns;
+  for (uint16_t port = 40000; port < 40100; port++) {
+    conns.emplace_back("xyz", server, Endpoint(Address(10, 0, 0, 1), port), L4Proto::TCP, true);
+    tracker.AddConnection(conns.back(), 1000 + port);
+  }
+
+  Connection normalized("xyz", Endpoint(IPNet(Address()), 80), Endpoint(IPNet(Address(10, 0, 0, 1), 0, true), 0), L4Proto::TCP, true);
+  EXPECT_THAT(tracker.FetchConnState(true), UnorderedElementsAre(std::make_pair(normalized, ConnStatus(41099, true))));
+
+  for (const auto& conn : conns) {
+    tracker.RemoveConnection(conn, 50000);
+  }
+  EXPECT_THAT(tracker.FetchConnState(true), UnorderedElementsAre(std::make_pair(normalized, ConnStatus(50000, false))));
+  EXPECT_THAT(tracker.FetchConnState(true), IsEmpty());
+}
+
+TEST(ConnTrackerTest, TestParallelFetchMatchesSequential) {
+  ConnectionTracker sequential;
+  ConnectionTracker parallel;
+  parallel.SetFetchWorkers(4);
+
+  for (int i = 0; i < 1000; i++) {
+    Connection conn("xyz", Endpoint(Address(10, 0, i / 256, i % 256), 80), Endpoint(Address(35, 1, i / 256, i % 256), 40000 + i), L4Proto::TCP, i % 3 == 0);
+    ContainerEndpoint ep("xyz", Endpoint(Address(10, 0, i / 256, i % 256), 80 + i % 5), L4Proto::TCP, nullptr);
+    for (auto* tracker : {&sequential, &parallel}) {
+      tracker->UpdateConnection(conn, 1000 + i, i % 7 != 0);
+      tracker->Update({}, {ep}, 1000 + i);
+    }
+  }
+
+  EXPECT_EQ(parallel.FetchConnState(true, false), sequential.FetchConnState(true, false));
+  EXPECT_EQ(parallel.FetchConnState(false, true), sequential.FetchConnState(false, true));
+  EXPECT_EQ(parallel.FetchConnState(false, true), sequential.FetchConnState(false, true));
+  EXPECT_EQ(parallel.FetchEndpointState(true, true), sequential.FetchEndpointState(true, true));
+  EXPECT_EQ(parallel.FetchEndpointState(false, true), sequential.FetchEndpointState(false, true));
+}
+
+TEST(ConnTrackerTest, TestShardLockTimes) {
+  ConnectionTracker tracker;
+  Connection conn("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(Address(10, 0, 0, 2), 40000), L4Proto::TCP, true);
+
+  for (int i = 0; i < 10; i++) {
+    tracker.AddConnection(conn, 1000 + i);
+  }
+
+  uint64_t waits = 0;
+  uint64_t holds = 0;
+  for (size_t shard = 0; shard < ConnectionTracker::kNumShards; shard++) {
+    for (size_t bucket = 0; bucket < LockTimeHistogram::kNumBuckets; bucket++) {
+      waits += tracker.ShardLockWaitTimes(shard).Count(bucket);
+      holds += tracker.ShardLockHoldTimes(shard).Count(bucket);
+    }
+  }
+  EXPECT_EQ(waits, 10);
+  EXPECT_EQ(holds, 10);
+
+  LockTimeHistogram histogram;
+  histogram.Record(0);
+  histogram.Record(1);
+  histogram.Record(3);
+  histogram.Record(1 << 20);
+  EXPECT_EQ(histogram.Count(0), 1);
+  EXPECT_EQ(histogram.Count(1), 1);
+  EXPECT_EQ(histogram.Count(2), 1);
+  EXPECT_EQ(histogram.Count(LockTimeHistogram::kNumBuckets - 1), 1);
+  EXPECT_EQ(histogram.SumMicros(), 4 + (1 << 20));
+  EXPECT_EQ(LockTimeHistogram::BucketBoundaries().size(), LockTimeHistogram::kNumBuckets - 1);
+}
+
+// Measures how long connection updates are blocked while another thread
+// fetches a large state, as the network status notifier does.
+TEST(ConnTrackerTest, DISABLED_BenchmarkUpdateLatencyDuringFetch) {
+  constexpr int kConnections = 200000;
+
+  ConnectionTracker tracker;
+  tracker.SetFetchWorkers(2);
+  std::vector<Connection> conns;
+  for (int i = 0; i < kConnections; i++) {
+    conns.emplace_back("0123456789ab", Endpoint(Address(10, 0, 0, 1), 8080),
+                       Endpoint(Address(10, i >> 16, (i >> 8) & 0xff, i & 0xff), 40000), L4Proto::TCP, true);
+    tracker.AddConnection(conns.back(), i);
+  }
+
+  std::atomic<bool> done = false;
+  int64_t fetch_ms = 0;
+  std::thread fetcher([&]() {
+    auto elapsed = TimeIt<std::chrono::milliseconds>([&] {
+      for (int i = 0; i < 5; i++) {
+        tracker.FetchConnState(true, false);
+      }
+    });
+    fetch_ms = elapsed / 5;
+    done = true;
+  });
+
+  int64_t max_latency_us = 0;
+  int updates = 0;
+  for (int64_t ts = kConnections; !done; ts++, updates++) {
+    auto latency = TimeIt([&] { tracker.UpdateConnection(conns[ts % kConnections], ts, true); });
+    max_latency_us = std::max<int64_t>(max_latency_us, latency);
+  }
+  fetcher.join();
+
+  BenchmarkLine() << "fetch: " << fetch_ms << "ms, " << updates << " updates during fetch, max update latency " << max_latency_us << "us";
+}
+
+// Tracks the memory allocated by the containers using it.
+size_t allocated_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    allocated_bytes += n * sizeof(T);
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) {
+    allocated_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  bool operator==(const CountingAllocator&) const { return true; }
+  bool operator!=(const CountingAllocator&) const { return false; }
+};
+
+// Measures the memory per connection and the time to compute a delta with
+// afterglow, for the node based and flat maps.
+void BenchmarkConnMaps(int num_connections) {
+  using Allocator = CountingAllocator<std::pair<const Connection, ConnStatus>>;
+  using NodeConnMap = std::unordered_map<Connection, ConnStatus, Hasher, std::equal_to<Connection>, Allocator>;
+  using FlatConnMap = absl::flat_hash_map<Connection, ConnStatus, FlatHasher, std::equal_to<Connection>, Allocator>;
+
+  int64_t afterglow_period = 20000000;
+  int64_t time_at_last_scrape = 1000000000;
+  int64_t time_micros = time_at_last_scrape + 30000000;
+
+  auto run = [&](auto old_state, const char* name) {
+    using Map = decltype(old_state);
+    Map new_state, delta;
+
+    allocated_bytes = 0;
+    for (int i = 0; i < num_connections; i++) {
+      Connection conn("0123456789ab", Endpoint(Address(10, 0, 0, 1), 8080),
+                      Endpoint(Address(10, i >> 16, (i >> 8) & 0xff, i & 0xff), 40000), L4Proto::TCP, true);
+      old_state.emplace(conn, ConnStatus(time_at_last_scrape, true));
+    }
+    size_t bytes_per_entry = allocated_bytes / num_connections;
+
+    // A tenth of the connections were closed, and as many opened.
+    for (int i = num_connections / 10; i < num_connections + num_connections / 10; i++) {
+      Connection conn("0123456789ab", Endpoint(Address(10, 0, 0, 1), 8080),
+                      Endpoint(Address(10, i >> 16, (i >> 8) & 0xff, i & 0xff), 40000), L4Proto::TCP, true);
+      new_state.emplace(conn, ConnStatus(time_micros, true));
+    }
+
+    auto elapsed = TimeIt<std::chrono::milliseconds>([&] {
+      CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, afterglow_period);
+    });
+    EXPECT_EQ(delta.size(), num_connections / 10 * 2);
+
+    BenchmarkLine() << num_connections << " connections, " << name << ": " << bytes_per_entry << " bytes per entry, delta " << elapsed << "ms";
+  };
+
+  run(NodeConnMap(), "unordered_map");
+  run(FlatConnMap(), "flat_hash_map");
+}
+
+// Reported statuses of a delta, keyed by their string representation for readable failures.
+std::map<std::string, ConnStatus> ReportedDelta(const ConnMap& delta) {
+  std::map<std::string, ConnStatus> reported;
+  for (const auto& [conn, status] : delta) {
+    reported.emplace(Str(conn), status);
+  }
+  return reported;
+}
+
+// Feeds the same random events and scrapes to two trackers, and checks that the deltas fetched incrementally match
+// those computed from full snapshots, as the network status notifier used to do.
+void TestFetchConnDeltaMatchesSnapshots(bool afterglow) {
+  constexpr int64_t kScrapeInterval = 30000000;
+  constexpr int64_t kAfterglowPeriod = 70000000;
+
+  std::vector<Connection> pool;
+  for (int i = 0; i < 40; i++) {
+    // Servers, some of them with public peers which are normalized together.
+    Address remote = i % 3 == 0 ? Address(35, 127, 0, i) : Address(10, 1, 0, i);
+    pool.emplace_back("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(remote, 40000 + i), L4Proto::TCP, true);
+    // Clients with ephemeral ports, normalized together.
+    pool.emplace_back(i % 2 ? "xyz" : "zyx", Endpoint(Address(10, 0, 0, 2), 40000 + i), Endpoint(Address(35, 127, 1, i % 4), 443), L4Proto::TCP, false);
+  }
+
+  std::mt19937 rng(42);
+  ConnectionTracker snapshot_tracker, incremental_tracker;
+  ConnMap old_state;
+  ExternalIPsConfig prev_config;
+  int64_t time_at_last_scrape = 1000000000;
+
+  for (int round = 0; round < 60; round++) {
+    int64_t time_micros = time_at_last_scrape + kScrapeInterval;
+
+    ExternalIPsConfig config(round >= 40 ? ExternalIPsConfig::Direction::BOTH : ExternalIPsConfig::Direction::NONE);
+    if (round == 20) {
+      UnorderedMap<Address::Family, std::vector<IPNet>> known_networks = {{Address::Family::IPV4, {IPNet(Address(35, 127, 0, 0), 24)}}};
+      snapshot_tracker.UpdateKnownIPNetworks(UnorderedMap<Address::Family, std::vector<IPNet>>(known_networks));
+      incremental_tracker.UpdateKnownIPNetworks(std::move(known_networks));
+    }
+
+    // Few changes in most rounds, and none in some, so that connections go through afterglow.
+    int num_events = round % 5 == 4 ? 0 : rng() % 8;
+    for (int i = 0; i < num_events; i++) {
+      const auto& conn = pool[rng() % pool.size()];
+      int64_t timestamp = time_at_last_scrape + 1 + rng() % (kScrapeInterval - 1);
+      bool added = rng() % 2;
+      snapshot_tracker.UpdateConnection(conn, timestamp, added);
+      incremental_tracker.UpdateConnection(conn, timestamp, added);
+    }
+    if (round % 7 == 3) {
+      std::vector<Connection> scraped;
+      for (const auto& conn : pool) {
+        if (rng() % 2) {
+          scraped.push_back(conn);
+        }
+      }
+      snapshot_tracker.Update(scraped, {}, time_micros - 1);
+      incremental_tracker.Update(scraped, {}, time_micros - 1);
+    }
+
+    snapshot_tracker.SetExternalIPsConfig(config);
+    incremental_tracker.SetExternalIPsConfig(config);
+
+    ConnMap new_state = snapshot_tracker.FetchConnState(true, true);
+    ConnMap delta;
+    if (afterglow) {
+      CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, kAfterglowPeriod);
+      snapshot_tracker.CloseConnectionsOnExternalIPsConfigChange(prev_config, &old_state, &delta);
+      CT::UpdateOldState(&old_state, new_state, time_micros, kAfterglowPeriod);
+    } else {
+      CT::ComputeDelta(new_state, &old_state);
+      delta = std::move(old_state);
+      old_state = std::move(new_state);
+    }
+    prev_config = config;
+
+    auto expected = ReportedDelta(delta);
+    auto actual = ReportedDelta(incremental_tracker.FetchConnDelta(time_micros, time_at_last_scrape, afterglow, kAfterglowPeriod));
+    ASSERT_EQ(actual.size(), expected.size()) << "round " << round;
+    for (const auto& [conn, status] : expected) {
+      auto it = actual.find(conn);
+      ASSERT_NE(it, actual.end()) << "round " << round << ": " << conn;
+      EXPECT_EQ(it->second.IsActive(), status.IsActive()) << "round " << round << ": " << conn;
+      if (status.IsActive()) {
+        // The time at which active connections were last seen is not reported.
+        continue;
+      }
+      // Active connections which disappear from the state, because they are normalized differently, are closed at
+      // the time of the delta instead of the time they were last seen.
+      EXPECT_GE(it->second.LastActiveTime(), status.LastActiveTime()) << "round " << round << ": " << conn;
+      EXPECT_LE(it->second.LastActiveTime(), time_micros) << "round " << round << ": " << conn;
+    }
+
+    time_at_last_scrape = time_micros;
+  }
+}
+
+TEST(ConnTrackerTest, TestFetchConnDeltaMatchesSnapshots) {
+  TestFetchConnDeltaMatchesSnapshots(false);
+}
+
+TEST(ConnTrackerTest, TestFetchConnDeltaMatchesSnapshotsAfterglow) {
+  TestFetchConnDeltaMatchesSnapshots(true);
+}
+
+TEST(ConnTrackerTest, TestFetchConnDeltaReset) {
+  Endpoint a(Address(192, 168, 0, 1), 80);
+  Connection conn1("xyz", a, Endpoint(Address(10, 0, 0, 1), 1), L4Proto::TCP, true);
+  Connection conn2("xyz", a, Endpoint(Address(10, 0, 0, 2), 1), L4Proto::TCP, true);
+  Connection conn1_normalized("xyz", Endpoint(IPNet(Address()), 80), Endpoint(IPNet(Address(10, 0, 0, 1), 0, true), 0), L4Proto::TCP, true);
+  Connection conn2_normalized("xyz", Endpoint(IPNet(Address()), 80), Endpoint(IPNet(Address(10, 0, 0, 2), 0, true), 0), L4Proto::TCP, true);
+
+  ConnectionTracker tracker;
+  tracker.AddConnection(conn1, 1000);
+  tracker.AddConnection(conn2, 1000);
+
+  EXPECT_THAT(tracker.FetchConnDelta(2000, 1000, false, 0), UnorderedElementsAre(
+                                                                 std::make_pair(conn1_normalized, ConnStatus(2000, true)),
+                                                                 std::make_pair(conn2_normalized, ConnStatus(2000, true))));
+  EXPECT_THAT(tracker.FetchConnDelta(3000, 2000, false, 0), IsEmpty());
+
+  tracker.RemoveConnection(conn2, 3500);
+  EXPECT_THAT(tracker.FetchConnDelta(4000, 3000, false, 0), UnorderedElementsAre(std::make_pair(conn2_normalized, ConnStatus(3500, false))));
+
+  // Reported again to a new consumer.
+  tracker.ResetConnDelta();
+  EXPECT_THAT(tracker.FetchConnDelta(5000, 4000, false, 0), UnorderedElementsAre(std::make_pair(conn1_normalized, ConnStatus(5000, true))));
+}
+
+// Compares the time and retained memory of computing deltas from full snapshots and incrementally, with 1% of the
+// connections closed and as many opened every scrape.
+TEST(ConnTrackerTest, DISABLED_BenchmarkFetchConnDelta) {
+  constexpr int kConnections = 100000;
+  constexpr int kChurn = kConnections / 100;
+  constexpr int kRounds = 10;
+  constexpr int64_t kScrapeInterval = 30000000;
+  constexpr int64_t kAfterglowPeriod = 300000000;
+
+  auto make_conn = [](int i) {
+    return Connection("0123456789ab", Endpoint(Address(10, 0, 0, 1), 8080),
+                      Endpoint(Address(10, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff), 40000), L4Proto::TCP, true);
+  };
+
+  auto run = [&](bool incremental) {
+    ConnectionTracker tracker;
+    int64_t time_at_last_scrape = 1000000000;
+    for (int i = 0; i < kConnections; i++) {
+      tracker.AddConnection(make_conn(i), time_at_last_scrape);
+    }
+
+    int64_t heap_before = HeapBytes();
+    ConnMap old_state;
+    int64_t total_us = 0;
+    size_t total_delta = 0;
+    for (int round = 0; round <= kRounds; round++) {
+      int64_t time_micros = time_at_last_scrape + kScrapeInterval;
+      if (round > 0) {
+        int first = (round - 1) * kChurn;
+        for (int i = first; i < first + kChurn; i++) {
+          tracker.RemoveConnection(make_conn(i), time_micros - 1);
+          tracker.AddConnection(make_conn(kConnections + i), time_micros - 1);
+        }
+      }
+
+      ConnMap delta;
+      auto elapsed = TimeIt([&] {
+        if (incremental) {
+          delta = tracker.FetchConnDelta(time_micros, time_at_last_scrape, true, kAfterglowPeriod);
+        } else {
+          ConnMap new_state = tracker.FetchConnState(true, true);
+          CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, kAfterglowPeriod);
+          CT::UpdateOldState(&old_state, new_state, time_micros, kAfterglowPeriod);
+        }
+      });
+
+      // The first round reports everything, and is not counted.
+      if (round > 0) {
+        total_us += elapsed;
+        total_delta += delta.size();
+        EXPECT_EQ(delta.size(), kChurn);
+      }
+      time_at_last_scrape = time_micros;
+    }
+
+    BenchmarkLine() << (incremental ? "incremental" : "snapshots") << ": " << total_us / kRounds << "us per scrape, "
+                    << total_delta / kRounds << " changes, " << (HeapBytes() - heap_before) / kConnections
+                    << " bytes retained per connection";
+  };
+
+  run(false);
+  run(true);
+}
+
+TEST(ConnTrackerTest, TestNormalizationFollowsConfigChanges) {
+  Connection conn("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(Address(35, 127, 0, 15), 40000), L4Proto::TCP, true);
+  auto fetched_remote = [&conn](ConnectionTracker* tracker) {
+    auto state = tracker->FetchConnState(true, false);
+    EXPECT_EQ(state.size(), 1);
+    return state.empty() ? Endpoint() : state.begin()->first.remote();
+  };
+
+  ConnectionTracker tracker;
+  tracker.AddConnection(conn, 1000);
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(255, 255, 255, 255), 0, true), 0));
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(255, 255, 255, 255), 0, true), 0));
+
+  tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, {IPNet(Address(35, 127, 0, 0), 16)}}});
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(35, 127, 0, 0), 16), 0));
+
+  tracker.UpdateKnownPublicIPs({Address(35, 127, 0, 15)});
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(35, 127, 0, 15), 16, true), 0));
+
+  tracker.UpdateKnownPublicIPs({});
+  tracker.UpdateNonAggregatedNetworks({IPNet(Address(35, 127, 0, 0), 24)});
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(35, 127, 0, 15), 0, true), 0));
+
+  tracker.UpdateKnownIPNetworks({});
+  tracker.UpdateNonAggregatedNetworks({});
+  tracker.SetExternalIPsConfig(ExternalIPsConfig(ExternalIPsConfig::Direction::INGRESS));
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(35, 127, 0, 15), 32), 0));
+
+  tracker.SetExternalIPsConfig(ExternalIPsConfig(ExternalIPsConfig::Direction::NONE));
+  EXPECT_EQ(fetched_remote(&tracker), Endpoint(IPNet(Address(255, 255, 255, 255), 0, true), 0));
+}
+
+TEST(ConnTrackerTest, TestResendingSameNetworksKeepsNormalization) {
+  std::vector<IPNet> known_networks = {IPNet(Address(35, 127, 0, 0), 16), IPNet(Address(35, 128, 0, 0), 16)};
+  ConnectionTracker tracker;
+  tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, known_networks}});
+  tracker.UpdateKnownPublicIPs({Address(35, 127, 0, 15), Address(35, 128, 0, 15)});
+  tracker.UpdateIgnoredNetworks({IPNet(Address(169, 254, 0, 0), 16)});
+  for (int i = 0; i < 100; i++) {
+    tracker.AddConnection(Connection("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(Address(35, 127 + i % 2, 1, i), 40000),
+                                     L4Proto::TCP, true),
+                          1000);
+  }
+
+  auto& stats = CollectorStats::GetOrCreate();
+  auto fetch_misses = [&stats, &tracker]() {
+    int64_t misses = stats.GetCounter(CollectorStats::net_normalize_cache_misses);
+    tracker.FetchConnState(true, false);
+    return stats.GetCounter(CollectorStats::net_normalize_cache_misses) - misses;
+  };
+  EXPECT_EQ(fetch_misses(), 100);
+  EXPECT_EQ(fetch_misses(), 0);
+
+  // The same content, in another order, does not invalidate the normalized addresses.
+  std::reverse(known_networks.begin(), known_networks.end());
+  tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, known_networks}});
+  tracker.UpdateKnownPublicIPs({Address(35, 128, 0, 15), Address(35, 127, 0, 15)});
+  tracker.UpdateIgnoredNetworks({IPNet(Address(169, 254, 0, 0), 16)});
+  tracker.UpdateNonAggregatedNetworks({});
+  EXPECT_EQ(fetch_misses(), 0);
+
+  known_networks.pop_back();
+  tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, known_networks}});
+  EXPECT_EQ(fetch_misses(), 100);
+  auto state = tracker.FetchConnState(true, false);
+  EXPECT_EQ(state.size(), 2);
+  EXPECT_NE(state.find(Connection("xyz", Endpoint(IPNet(Address()), 80), Endpoint(IPNet(Address(35, 128, 0, 0), 16), 0), L4Proto::TCP, true)),
+            state.end());
+  EXPECT_NE(state.find(Connection("xyz", Endpoint(IPNet(Address()), 80), Endpoint(IPNet(Address(255, 255, 255, 255), 0, true), 0), L4Proto::TCP, true)),
+            state.end());
+}
+
+// Measures the longest time taken by a connection update while another thread keeps replacing thousands of known
+// networks, as Sensor does.
+TEST(ConnTrackerTest, DISABLED_BenchmarkIngestionDuringNetworkUpdates) {
+  constexpr int kNetworks = 10000;
+  constexpr int kEvents = 200000;
+
+  std::array<std::vector<IPNet>, 2> network_lists;
+  for (int i = 0; i < kNetworks; i++) {
+    network_lists[0].emplace_back(Address(35, i >> 8, i & 0xff, 0), 24);
+    network_lists[1].emplace_back(Address(36, i >> 8, i & 0xff, 0), 24);
+  }
+
+  ConnectionTracker tracker;
+  std::atomic<bool> done = false;
+  int updates = 0;
+  std::thread updater([&]() {
+    while (!done) {
+      tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, network_lists[updates++ % 2]}});
+    }
+  });
+
+  int64_t max_us = 0;
+  for (int i = 0; i < kEvents; i++) {
+    Connection conn("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(Address(35, i >> 16 & 0xff, i >> 8 & 0xff, i & 0xff), 40000),
+                    L4Proto::TCP, true);
+    auto elapsed = TimeIt([&] { tracker.UpdateConnection(conn, i, true); });
+    max_us = std::max<int64_t>(max_us, elapsed);
+  }
+
+  done = true;
+  updater.join();
+  EXPECT_EQ(tracker.FetchConnState().size(), kEvents);
+  BenchmarkLine() << updates << " network updates, longest connection update: " << max_us << "us";
+}
+
+// Measures fetching a normalized state with many known networks, when remote addresses are first seen, and when
+// they were normalized by a previous fetch.
+TEST(ConnTrackerTest, DISABLED_BenchmarkNormalizationCache) {
+  constexpr int kConnections = 100000;
+  constexpr int kRemotes = 10000;
+
+  std::vector<IPNet> known_networks;
+  for (int i = 0; i < 4096; i++) {
+    known_networks.emplace_back(Address(35, i >> 4, (i & 0xf) << 4, 0), 20);
+  }
+  UnorderedSet<Address> known_public_ips;
+  for (int i = 0; i < 1000; i++) {
+    known_public_ips.insert(Address(35, 1, i >> 8, i & 0xff));
+  }
+
+  ConnectionTracker tracker;
+  tracker.UpdateKnownIPNetworks({{Address::Family::IPV4, known_networks}});
+  tracker.UpdateKnownPublicIPs(std::move(known_public_ips));
+  for (int i = 0; i < kConnections; i++) {
+    int remote = i % kRemotes;
+    tracker.AddConnection(Connection("xyz", Endpoint(Address(10, 0, 0, 2), 40000 + i / kRemotes),
+                                     Endpoint(Address(35, remote >> 8 & 0xff, remote & 0xff, 1), 443), L4Proto::TCP, false),
+                          1000);
+  }
+
+  auto& stats = CollectorStats::GetOrCreate();
+  for (const char* fetch : {"cold", "warm"}) {
+    int64_t hits = stats.GetCounter(CollectorStats::net_normalize_cache_hits);
+    int64_t misses = stats.GetCounter(CollectorStats::net_normalize_cache_misses);
+
+    ConnMap state;
+    auto elapsed = TimeIt([&] { state = tracker.FetchConnState(true, false); });
+
+    hits = stats.GetCounter(CollectorStats::net_normalize_cache_hits) - hits;
+    misses = stats.GetCounter(CollectorStats::net_normalize_cache_misses) - misses;
+    EXPECT_EQ(hits + misses, kConnections);
+    BenchmarkLine() << fetch << " fetch: " << elapsed << "us, " << state.size() << " normalized connections, hit rate "
+                    << 100 * hits / (hits + misses) << "%";
+  }
+}
+
+// Compares the time of computing deltas with afterglow from full snapshots and incrementally, for 1M connections of
+// which 10% are closed over 10 scrapes, and whose afterglow then ends over the next 10 scrapes.
+TEST(ConnTrackerTest, DISABLED_BenchmarkAfterglowExpiry) {
+  constexpr int kConnections = 1000000;
+  constexpr int kRounds = 10;
+  constexpr int kPerRound = kConnections / 10 / kRounds;
+  constexpr int64_t kScrapeInterval = 30000000;
+  constexpr int64_t kAfterglowPeriod = kRounds * kScrapeInterval;
+
+  auto make_conn = [](int i) {
+    return Connection("0123456789ab", Endpoint(Address(10, 0, 0, 1), 8080),
+                      Endpoint(Address(10, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff), 40000), L4Proto::TCP, true);
+  };
+
+  std::array<std::vector<size_t>, 2> delta_sizes;
+  for (bool incremental : {false, true}) {
+    ConnectionTracker tracker;
+    int64_t time_at_last_scrape = 1000000000;
+    for (int i = 0; i < kConnections; i++) {
+      tracker.AddConnection(make_conn(i), time_at_last_scrape);
+    }
+
+    ConnMap old_state;
+    int64_t closing_us = 0, expiring_us = 0;
+    for (int round = 0; round <= 2 * kRounds; round++) {
+      int64_t time_micros = time_at_last_scrape + kScrapeInterval;
+      if (round > 0 && round <= kRounds) {
+        for (int i = (round - 1) * kPerRound; i < round * kPerRound; i++) {
+          tracker.RemoveConnection(make_conn(i), time_micros - 1);
+        }
+      }
+
+      ConnMap delta;
+      auto elapsed = TimeIt([&] {
+        if (incremental) {
+          delta = tracker.FetchConnDelta(time_micros, time_at_last_scrape, true, kAfterglowPeriod);
+        } else {
+          ConnMap new_state = tracker.FetchConnState(true, true);
+          CT::ComputeDeltaAfterglow(new_state, old_state, delta, time_micros, time_at_last_scrape, kAfterglowPeriod);
+          CT::UpdateOldState(&old_state, new_state, time_micros, kAfterglowPeriod);
+        }
+      });
+
+      if (round > kRounds) {
+        expiring_us += elapsed;
+      } else if (round > 0) {
+        closing_us += elapsed;
+      }
+      delta_sizes[incremental].push_back(delta.size());
+      time_at_last_scrape = time_micros;
+    }
+
+    BenchmarkLine() << (incremental ? "incremental" : "snapshots") << ": " << closing_us / kRounds / 1000
+                    << "ms per scrape closing connections, " << expiring_us / kRounds / 1000
+                    << "ms per scrape ending afterglows";
+  }
+  EXPECT_EQ(delta_sizes[0], delta_sizes[1]);
+}
+
+TEST(ConnTrackerTest, TestConnectionLimitPerContainer) {
+  constexpr size_t kLimit = 8 * CT::kNumShards;
+  auto make_conn = [](const char* container, int i) {
+    return Connection(container, Endpoint(Address(10, 0, 0, 1), 40000), Endpoint(Address(35, 0, i >> 8, i & 0xff), 80), L4Proto::UDP, false);
+  };
+
+  ConnectionTracker tracker;
+  tracker.SetConnectionLimits(kLimit, 0);
+  for (int i = 0; i < 5; i++) {
+    tracker.AddConnection(make_conn("quiet", i), 1000);
+  }
+  for (int i = 0; i < 10000; i++) {
+    tracker.AddConnection(make_conn("scanner", i), 1000 + i);
+  }
+
+  size_t quiet = 0, scanner = 0;
+  for (const auto& [conn, status] : tracker.FetchConnState(false, false)) {
+    (conn.container() == "quiet" ? quiet : scanner)++;
+  }
+  EXPECT_EQ(quiet, 5);
+  EXPECT_LE(scanner, kLimit);
+  EXPECT_GT(scanner, kLimit / 2);
+
+  auto evicted = tracker.ConsumeEvictedConnections();
+  EXPECT_THAT(evicted, UnorderedElementsAre(std::make_pair("scanner", 10000 - scanner)));
+  EXPECT_THAT(tracker.ConsumeEvictedConnections(), IsEmpty());
+}
+
+TEST(ConnTrackerTest, TestConnectionLimitTotal) {
+  constexpr size_t kLimit = 8 * CT::kNumShards;
+
+  ConnectionTracker tracker;
+  tracker.SetConnectionLimits(0, kLimit);
+  size_t evicted_expected = 0;
+  for (int i = 0; i < 1000; i++) {
+    tracker.AddConnection(Connection("container" + std::to_string(i % 100), Endpoint(Address(10, 0, 0, 1), 40000 + i),
+                                     Endpoint(Address(10, 0, 0, 2), 80), L4Proto::TCP, false),
+                          1000 + i);
+    evicted_expected++;
+  }
+
+  size_t stored = tracker.FetchConnState(false, false).size();
+  EXPECT_LE(stored, kLimit);
+  uint64_t evicted = 0;
+  for (const auto& [container, count] : tracker.ConsumeEvictedConnections()) {
+    evicted += count;
+  }
+  EXPECT_EQ(stored + evicted, evicted_expected);
+}
+
+// Inactive connections are evicted first, then the least recently updated ones.
+TEST(ConnTrackerTest, TestConnectionEvictionOrder) {
+  constexpr size_t kLimit = 4 * CT::kNumShards;
+  auto make_conn = [](int i) {
+    return Connection("xyz", Endpoint(Address(10, 0, 0, 1), 40000), Endpoint(Address(10, 1, i >> 8, i & 0xff), 80), L4Proto::TCP, false);
+  };
+
+  ConnectionTracker tracker;
+  tracker.SetConnectionLimits(kLimit, 0);
+  // Active connections, then closed ones, which are more recent but go first.
+  for (int i = 0; i < 1000; i++) {
+    tracker.AddConnection(make_conn(i), 1000 + i);
+  }
+  for (int i = 1000; i < 2000; i++) {
+    tracker.RemoveConnection(make_conn(i), 1000 + i);
+  }
+
+  // In each shard, the remaining connections are the most recent active ones.
+  std::array<std::vector<int64_t>, CT::kNumShards> active_by_shard;
+  for (int i = 0; i < 1000; i++) {
+    active_by_shard[CT::ShardIndex(make_conn(i))].push_back(1000 + i);
+  }
+  std::array<std::vector<int64_t>, CT::kNumShards> remaining_by_shard;
+  for (const auto& [conn, status] : tracker.FetchConnState(false, false)) {
+    EXPECT_TRUE(status.IsActive()) << conn;
+    remaining_by_shard[CT::ShardIndex(conn)].push_back(status.LastActiveTime());
+  }
+  for (size_t i = 0; i < CT::kNumShards; i++) {
+    auto& remaining = remaining_by_shard[i];
+    auto& active = active_by_shard[i];
+    ASSERT_LE(remaining.size(), kLimit / CT::kNumShards);
+    ASSERT_FALSE(remaining.empty());
+    std::sort(remaining.begin(), remaining.end());
+    EXPECT_TRUE(std::equal(remaining.begin(), remaining.end(), active.end() - remaining.size())) << "shard " << i;
+  }
+}
+
+TEST(ConnTrackerTest, TestEvictedConnectionsAreReportedClosed) {
+  auto make_conn = [](int i) {
+    return Connection("xyz", Endpoint(Address(10, 0, 0, 1), 80), Endpoint(Address(10, 1, 0, i), 40000), L4Proto::TCP, true);
+  };
+
+  ConnectionTracker tracker;
+  for (int i = 0; i < 100; i++) {
+    tracker.AddConnection(make_conn(i), 1000);
+  }
+  EXPECT_EQ(tracker.FetchConnDelta(2000, 1000, false, 0).size(), 100);
+
+  tracker.SetConnectionLimits(CT::kNumShards, 0);
+  tracker.AddConnection(make_conn(100), 2500);
+
+  auto delta = tracker.FetchConnDelta(3000, 2000, false, 0);
+  size_t stored = tracker.FetchConnState(false, false).size();
+  size_t closed = 0;
+  for (const auto& [conn, status] : delta) {
+    closed += !status.IsActive();
+  }
+  EXPECT_EQ(closed, 101 - stored);
+}
+
+// Stores as many connections as possible from a single container, as a scan would, with and without limits.
+TEST(ConnTrackerTest, DISABLED_BenchmarkConnectionLimits) {
+  constexpr int kConnections = 300000;
+
+  for (size_t limit : {0, 16384}) {
+    int64_t heap_before = HeapBytes();
+    auto tracker = std::make_unique<ConnectionTracker>();
+    tracker->SetConnectionLimits(limit, 0);
+
+    auto elapsed = TimeIt<std::chrono::milliseconds>([&] {
+      for (int i = 0; i < kConnections; i++) {
+        tracker->AddConnection(Connection("scanner", Endpoint(Address(10, 0, 0, 1), 40000),
+                                          Endpoint(Address(35, i >> 16, (i >> 8) & 0xff, i & 0xff), 53), L4Proto::UDP, false),
+                               1000 + i);
+      }
+    });
+
+    int64_t heap = HeapBytes() - heap_before;
+    size_t stored = tracker->FetchConnState(false, false).size();
+    BenchmarkLine() << "limit " << limit << ": " << elapsed << "ms, " << stored << " connections stored, " << heap / 1024
+                    << "KiB";
+    if (limit > 0) {
+      EXPECT_LE(stored, limit);
+    }
+  }
+}
+
+TEST(ConnTrackerTest, TestPurgeContainer) {
+  auto make_conn = [](const char* container, int port) {
+    return Connection(container, Endpoint(Address(10, 0, 0, 1), port), Endpoint(Address(10, 1, 0, 1), 40000), L4Proto::TCP, true);
+  };
+  ContainerEndpoint aaa_endpoint("aaa", Endpoint(Address(10, 0, 0, 1), 80), L4Proto::TCP, nullptr);
+  ContainerEndpoint bbb_endpoint("bbb", Endpoint(Address(10, 0, 0, 2), 80), L4Proto::TCP, nullptr);
+
+  ConnectionTracker tracker;
+  tracker.AddConnection(make_conn("aaa", 80), 1000);
+  tracker.AddConnection(make_conn("aaa", 81), 1000);
+  tracker.AddConnection(make_conn("aaa", 82), 1000);
+  tracker.RemoveConnection(make_conn("aaa", 82), 1500);
+  tracker.AddConnection(make_conn("bbb", 80), 1000);
+  tracker.EmplaceOrUpdateNoLock(aaa_endpoint, ConnStatus(1000, true));
+  tracker.EmplaceOrUpdateNoLock(bbb_endpoint, ConnStatus(1000, true));
+  EXPECT_EQ(tracker.FetchConnDelta(2000, 1000, false, 0).size(), 4);
+
+  auto aaa = ContainerIDInterner::Instance().Intern("aaa");
+  EXPECT_EQ(tracker.PurgeContainer(aaa, 2500), 3);
+  // Already closed.
+  EXPECT_EQ(tracker.PurgeContainer(aaa, 2600), 0);
+
+  auto delta = tracker.FetchConnDelta(3000, 2000, false, 0);
+  EXPECT_EQ(delta.size(), 2);
+  for (const auto& [conn, status] : delta) {
+    EXPECT_EQ(conn.container(), "aaa");
+    EXPECT_EQ(status, ConnStatus(2500, false));
+  }
+  EXPECT_THAT(tracker.FetchConnState(false, false), UnorderedElementsAre(std::make_pair(make_conn("bbb", 80), ConnStatus(1000, true))));
+
+  EXPECT_THAT(tracker.FetchEndpointState(false, true),
+              UnorderedElementsAre(std::make_pair(aaa_endpoint, ConnStatus(2500, false)), std::make_pair(bbb_endpoint, ConnStatus(1000, true))));
+  EXPECT_THAT(tracker.FetchEndpointState(false, true), UnorderedElementsAre(std::make_pair(bbb_endpoint, ConnStatus(1000, true))));
+}
+
+TEST(ConnTrackerTest, TestPurgeContainersExcept) {
+  auto make_conn = [](const char* container, int port) {
+    return Connection(container, Endpoint(Address(10, 0, 0, 1), 40000), Endpoint(Address(10, 1, 0, 1), port), L4Proto::TCP, false);
+  };
+
+  ConnectionTracker tracker;
+  for (const char* container : {"aaa", "bbb", "ccc"}) {
+    for (int port = 1; port <= 50; port++) {
+      tracker.AddConnection(make_conn(container, port), 1000);
+    }
+  }
+
+  EXPECT_EQ(tracker.PurgeContainersExcept({"bbb", "ddd"}, 2000), 100);
+  for (const auto& [conn, status] : tracker.FetchConnState(false, false)) {
+    EXPECT_EQ(status.IsActive(), conn.container() == "bbb") << conn;
+  }
+
+  // Containers seen again after being purged are tracked as usual.
+  tracker.AddConnection(make_conn("aaa", 1), 3000);
+  EXPECT_EQ(tracker.FetchConnState(false, true).size(), 150);
+  EXPECT_EQ(tracker.FetchConnState(false, false).size(), 51);
+  EXPECT_EQ(tracker.PurgeContainersExcept({"bbb"}, 4000), 1);
+}
+
+TEST(ConnTrackerTest, TestPurgeContainersExceptReleasesContainerIDs) {
+  auto& interner = ContainerIDInterner::Instance();
+  Connection gone("gone", Endpoint(Address(10, 0, 0, 1), 40000), Endpoint(Address(10, 1, 0, 1), 80), L4Proto::TCP, false);
+  Connection kept("kept", Endpoint(Address(10, 0, 0, 1), 40001), Endpoint(Address(10, 1, 0, 1), 80), L4Proto::TCP, false);
+
+  ConnectionTracker tracker;
+  tracker.AddConnection(gone, 1000);
+  tracker.AddConnection(kept, 1000);
+
+  // The ID remains as long as the container has connections, even closed.
+  for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps; i++) {
+    tracker.PurgeContainersExcept({"kept"}, 2000);
+  }
+  EXPECT_EQ(gone.container(), "gone");
+
+  EXPECT_THAT(tracker.FetchConnState(false, true), UnorderedElementsAre(std::make_pair(gone, ConnStatus(2000, false)), std::make_pair(kept, ConnStatus(1000, true))));
+  for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps; i++) {
+    tracker.PurgeContainersExcept({"kept"}, 3000);
+  }
+  EXPECT_FALSE(interner.Valid(gone.container_handle()));
+  EXPECT_EQ(kept.container(), "kept");
+}
+
+TEST(ConnTrackerTest, DISABLED_BenchmarkConnMaps) {
+  BenchmarkConnMaps(100000);
+}
+
+// Takes several GBs of memory, run with --gtest_also_run_disabled_tests.
+TEST(ConnTrackerTest, DISABLED_BenchmarkLargeConnMaps) {
+  BenchmarkConnMaps(1000000);
+  BenchmarkConnMaps(5000000);
+}
+
 }  // namespace
 
 }  // namespace collector
@@ -0,0 +1,89 @@
+#include "ConnectionCache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+Connection MakeConnection(const std::string& container, uint16_t port) {
+  return Connection(container, Endpoint(Address(10, 0, 0, 1), port), Endpoint(Address(10, 0, 0, 2), 80), L4Proto::TCP, false);
+}
+
+ConnectionCache::Signature MakeSignature(uint8_t seed) {
+  ConnectionCache::Signature signature{};
+  signature.fill(seed);
+  return signature;
+}
+
+TEST(ConnectionCacheTest, HitAndMiss) {
+  ConnectionCache cache;
+  auto signature = MakeSignature(1);
+
+  EXPECT_EQ(cache.Lookup(42, 3, signature), nullptr);
+
+  auto& inserted = cache.Insert(42, 3, signature, MakeConnection("container", 1234));
+  EXPECT_EQ(inserted.last_update, 0);
+  inserted.last_update = 5000;
+
+  auto* entry = cache.Lookup(42, 3, signature);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->conn, MakeConnection("container", 1234));
+  EXPECT_EQ(entry->last_update, 5000);
+
+  // Other fd, other process
+  EXPECT_EQ(cache.Lookup(42, 4, signature), nullptr);
+  EXPECT_EQ(cache.Lookup(43, 3, signature), nullptr);
+}
+
+TEST(ConnectionCacheTest, FdReuse) {
+  ConnectionCache cache;
+  cache.Insert(42, 3, MakeSignature(1), MakeConnection("container", 1234));
+
+  // Same fd number, different socket
+  EXPECT_EQ(cache.Lookup(42, 3, MakeSignature(2)), nullptr);
+
+  // Replacing the entry resets the last update.
+  cache.Lookup(42, 3, MakeSignature(1))->last_update = 5000;
+  auto& entry = cache.Insert(42, 3, MakeSignature(2), MakeConnection("container", 4321));
+  EXPECT_EQ(entry.last_update, 0);
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_EQ(cache.Lookup(42, 3, MakeSignature(1)), nullptr);
+}
+
+TEST(ConnectionCacheTest, InvalidateProcess) {
+  ConnectionCache cache;
+  cache.Insert(42, 3, MakeSignature(1), MakeConnection("container", 1234));
+  cache.Insert(42, 4, MakeSignature(1), MakeConnection("container", 1235));
+  cache.Insert(43, 3, MakeSignature(1), MakeConnection("container", 1236));
+
+  cache.InvalidateProcess(42);
+  EXPECT_EQ(cache.Lookup(42, 3, MakeSignature(1)), nullptr);
+  EXPECT_EQ(cache.Lookup(42, 4, MakeSignature(1)), nullptr);
+  EXPECT_NE(cache.Lookup(43, 3, MakeSignature(1)), nullptr);
+  EXPECT_EQ(cache.Size(), 1);
+}
+
+TEST(ConnectionCacheTest, Invalidate) {
+  ConnectionCache cache;
+  cache.Insert(42, 3, MakeSignature(1), MakeConnection("container", 1234));
+  cache.Insert(42, 4, MakeSignature(1), MakeConnection("container", 1235));
+
+  cache.Invalidate(42, 3);
+  EXPECT_EQ(cache.Lookup(42, 3, MakeSignature(1)), nullptr);
+  EXPECT_NE(cache.Lookup(42, 4, MakeSignature(1)), nullptr);
+  EXPECT_EQ(cache.Size(), 1);
+}
+
+TEST(ConnectionCacheTest, MaxSize) {
+  ConnectionCache cache(2);
+  cache.Insert(1, 3, MakeSignature(1), MakeConnection("container", 1));
+  cache.Insert(2, 3, MakeSignature(1), MakeConnection("container", 2));
+  EXPECT_EQ(cache.Size(), 2);
+
+  cache.Insert(3, 3, MakeSignature(1), MakeConnection("container", 3));
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_NE(cache.Lookup(3, 3, MakeSignature(1)), nullptr);
+}
+
+}  // namespace
+}  // namespace collector
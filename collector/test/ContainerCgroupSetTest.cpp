@@ -0,0 +1,130 @@
+#include <chrono>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BenchmarkUtil.h"
+#include "ContainerCgroupSet.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+// The cgroup part of the sinsp filter string ContainerCgroupSet replaces.
+const std::regex kContainerCgroupRegex(".*[/:-][0-9a-f]{64}(\\.scope)?(/.*)?");
+
+const std::vector<std::string> kCgroups = {
+    "/kubepods/burstable/pod7cd3dba6-e475-11e9-8f99-42010a8a00d2/2bc55a8cae1704a733ba5d785d146bbed9610483380507cbf00c96b32bb637e1",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4",
+    "/kubepods.slice/kubepods-burstable.slice/kubepods-burstable-podce705797_e47e_11e9_bd71_42010a000002.slice/docker-6525e65814a99d431b6978e8f8c895013176c6c58173b56639d4b020c14e6022.scope",
+    "/machine.slice/libpod-e9cf81e3b1d172752567c8fe6ac48c1c751b9237ab47bf55cbfd5a971a4a9519.scope/container",
+    "/kubepods-burstable-podbd12dd3393227d950605a2444b13c27a.slice:cri-containerd:d52db56a9c80d536a91354c0951c061187ca46249e64865a12703003d8f42366",
+    "/machine.slice/libpod-conmon-b6ce30d02945df4bbf8e8b7193b2c56ebb3cd10227dd7e59d7f7cdc2cfa2a307.scope",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4/nested/path",
+    // Uppercase, too long, too short and missing separator
+    "/docker/951E643E3C241B225B6284EF2B79A37C13FC64CBF65B5D46BDA95FCB98FE63A4",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a40",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a",
+    "x951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4",
+    "/docker/951e643e3c241b225b6284ef2b79a37c13fc64cbf65b5d46bda95fcb98fe63a4.scopes",
+    "/system.slice/containerd.service",
+    "/user.slice/user-1000.slice/session-2.scope",
+    "/init.scope",
+    "/",
+    "",
+};
+
+struct FakeThreadInfo {
+  using cgroups_t = std::vector<std::pair<std::string, std::string>>;
+
+  int64_t m_pid = 0;
+  int64_t m_vpid = 0;
+  cgroups_t m_cgroups;
+
+  const cgroups_t& cgroups() const { return m_cgroups; }
+};
+
+TEST(ContainerCgroupSetTest, MatchesRegex) {
+  for (const auto& cgroup : kCgroups) {
+    EXPECT_EQ(ContainerCgroupSet::MatchesContainerCgroup(cgroup), std::regex_match(cgroup, kContainerCgroupRegex))
+        << cgroup;
+  }
+}
+
+TEST(ContainerCgroupSetTest, IsContainerThread) {
+  ContainerCgroupSet set;
+
+  FakeThreadInfo namespaced{1234, 1, {}};
+  EXPECT_TRUE(set.IsContainerThread(namespaced));
+
+  FakeThreadInfo host_pid{1234, 1234, {{"cpu", "/"}, {"memory", kCgroups[0]}}};
+  EXPECT_TRUE(set.IsContainerThread(host_pid));
+
+  FakeThreadInfo host{1234, 1234, {{"cpu", kCgroups[0]}, {"memory", "/system.slice/containerd.service"}}};
+  EXPECT_FALSE(set.IsContainerThread(host));
+
+  FakeThreadInfo no_cgroups{1234, 1234, {}};
+  EXPECT_FALSE(set.IsContainerThread(no_cgroups));
+
+  EXPECT_EQ(set.Size(), 2);
+}
+
+TEST(ContainerCgroupSetTest, MaxSize) {
+  ContainerCgroupSet set(4);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_FALSE(set.IsContainerCgroup("/cgroup" + std::to_string(i)));
+  }
+  EXPECT_EQ(set.Size(), 4);
+
+  // Known cgroups do not trigger the limit.
+  EXPECT_FALSE(set.IsContainerCgroup("/cgroup0"));
+  EXPECT_EQ(set.Size(), 4);
+
+  EXPECT_TRUE(set.IsContainerCgroup(kCgroups[0]));
+  EXPECT_EQ(set.Size(), 1);
+}
+
+// Per event cost of the filter for threads in the host PID namespace, which
+// is the case where the sinsp filter string had to evaluate the regex.
+TEST(ContainerCgroupSetTest, DISABLED_Benchmark) {
+  constexpr int kIterations = 20000;
+
+  std::vector<FakeThreadInfo> threads;
+  for (const auto& cgroup : kCgroups) {
+    threads.push_back({1234, 1234, {{"cpu", "/"}, {"memory", cgroup}}});
+  }
+
+  size_t regex_accepted = 0;
+  auto regex_ns = TimeIt<std::chrono::nanoseconds>([&] {
+    for (int i = 0; i < kIterations; i++) {
+      for (const auto& tinfo : threads) {
+        for (const auto& [subsys, cgroup] : tinfo.cgroups()) {
+          if (subsys == "memory") {
+            regex_accepted += std::regex_match(cgroup, kContainerCgroupRegex);
+          }
+        }
+      }
+    }
+  });
+
+  ContainerCgroupSet set;
+  size_t set_accepted = 0;
+  auto cgroup_set_ns = TimeIt<std::chrono::nanoseconds>([&] {
+    for (int i = 0; i < kIterations; i++) {
+      for (const auto& tinfo : threads) {
+        set_accepted += set.IsContainerThread(tinfo);
+      }
+    }
+  });
+
+  EXPECT_EQ(regex_accepted, set_accepted);
+
+  size_t events = kIterations * threads.size();
+  BenchmarkLine() << "regex: " << regex_ns / events << "ns/event, "
+                  << "container cgroup set: " << cgroup_set_ns / events << "ns/event";
+}
+
+}  // namespace
+}  // namespace collector
@@ -0,0 +1,97 @@
+#include <string>
+
+#include "ContainerIDCache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+// Mimics the sinsp_threadinfo fields used to build a generation.
+struct FakeThreadInfo {
+  int64_t m_tid = 0;
+  uint64_t m_clone_ts = 0;
+  uint64_t m_lastexec_ts = 0;
+};
+
+TEST(ContainerIDCacheTest, HitAndMiss) {
+  ContainerIDCache cache;
+  FakeThreadInfo tinfo;
+  tinfo.m_tid = 42;
+  tinfo.m_clone_ts = 1000;
+
+  auto generation = ContainerIDCache::GenerationOf(tinfo);
+  EXPECT_EQ(cache.Lookup(tinfo.m_tid, generation), nullptr);
+
+  cache.Insert(tinfo.m_tid, generation, "0123456789ab", true);
+  const auto* entry = cache.Lookup(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->container_id, "0123456789ab");
+  EXPECT_TRUE(entry->accepted);
+
+  EXPECT_EQ(cache.Lookup(43, generation), nullptr);
+}
+
+TEST(ContainerIDCacheTest, InvalidatedByExec) {
+  ContainerIDCache cache;
+  FakeThreadInfo tinfo;
+  tinfo.m_tid = 42;
+  tinfo.m_clone_ts = 1000;
+
+  cache.Insert(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo), "", false);
+
+  tinfo.m_lastexec_ts = 2000;
+  EXPECT_EQ(cache.Lookup(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo)), nullptr);
+
+  cache.Insert(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo), "0123456789ab", true);
+  const auto* entry = cache.Lookup(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo));
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(entry->container_id, "0123456789ab");
+  EXPECT_EQ(cache.Size(), 1);
+}
+
+TEST(ContainerIDCacheTest, InvalidatedByTidReuse) {
+  ContainerIDCache cache;
+  FakeThreadInfo tinfo;
+  tinfo.m_tid = 42;
+  tinfo.m_clone_ts = 1000;
+
+  cache.Insert(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo), "0123456789ab", true);
+
+  FakeThreadInfo reused;
+  reused.m_tid = 42;
+  reused.m_clone_ts = 5000;
+  EXPECT_EQ(cache.Lookup(reused.m_tid, ContainerIDCache::GenerationOf(reused)), nullptr);
+}
+
+TEST(ContainerIDCacheTest, Invalidate) {
+  ContainerIDCache cache;
+  FakeThreadInfo tinfo;
+  tinfo.m_tid = 42;
+
+  cache.Insert(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo), "0123456789ab", true);
+  cache.Invalidate(tinfo.m_tid);
+  EXPECT_EQ(cache.Lookup(tinfo.m_tid, ContainerIDCache::GenerationOf(tinfo)), nullptr);
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(ContainerIDCacheTest, MaxSize) {
+  ContainerIDCache cache(4);
+  ContainerIDCache::Generation generation;
+
+  for (int64_t tid = 0; tid < 4; tid++) {
+    cache.Insert(tid, generation, "", false);
+  }
+  EXPECT_EQ(cache.Size(), 4);
+
+  // Updating an existing entry does not trigger the limit.
+  cache.Insert(3, generation, "0123456789ab", true);
+  EXPECT_EQ(cache.Size(), 4);
+
+  cache.Insert(4, generation, "", false);
+  EXPECT_EQ(cache.Size(), 1);
+  EXPECT_NE(cache.Lookup(4, generation), nullptr);
+}
+
+}  // namespace
+}  // namespace collector
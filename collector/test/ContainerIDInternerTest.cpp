@@ -0,0 +1,176 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ContainerIDInterner.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+TEST(ContainerIDInternerTest, EmptyID) {
+  auto& interner = ContainerIDInterner::Instance();
+  EXPECT_EQ(interner.Intern(""), ContainerIDInterner::kEmpty);
+  EXPECT_EQ(interner.Lookup(ContainerIDInterner::kEmpty), "");
+}
+
+TEST(ContainerIDInternerTest, InternAndLookup) {
+  auto& interner = ContainerIDInterner::Instance();
+  auto a = interner.Intern("0123456789ab");
+  auto b = interner.Intern("ba9876543210");
+  EXPECT_NE(a, b);
+  EXPECT_NE(a, ContainerIDInterner::kEmpty);
+
+  std::string id = "0123456789ab";
+  EXPECT_EQ(interner.Intern(id), a);
+  EXPECT_EQ(interner.Lookup(a), "0123456789ab");
+  EXPECT_EQ(interner.Lookup(b), "ba9876543210");
+}
+
+TEST(ContainerIDInternerTest, LookupIsStable) {
+  auto& interner = ContainerIDInterner::Instance();
+  auto handle = interner.Intern("stable");
+  const std::string* stored = &interner.Lookup(handle);
+
+  // Spans several chunks.
+  for (int i = 0; i < 10000; i++) {
+    interner.Intern("container-" + std::to_string(i));
+  }
+
+  EXPECT_EQ(&interner.Lookup(handle), stored);
+  EXPECT_EQ(*stored, "stable");
+  EXPECT_EQ(interner.Lookup(interner.Intern("container-9999")), "container-9999");
+}
+
+TEST(ContainerIDInternerTest, Concurrent) {
+  auto& interner = ContainerIDInterner::Instance();
+  constexpr int kNumThreads = 4;
+  constexpr int kNumIDs = 5000;
+
+  std::vector<std::vector<ContainerIDInterner::Handle>> handles(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kNumIDs; i++) {
+        auto handle = interner.Intern("concurrent-" + std::to_string(i));
+        EXPECT_EQ(interner.Lookup(handle), "concurrent-" + std::to_string(i));
+        handles[t].push_back(handle);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 1; t < kNumThreads; t++) {
+    EXPECT_EQ(handles[t], handles[0]);
+  }
+}
+
+TEST(ContainerIDInternerTest, SweepReleasesUnused) {
+  auto& interner = ContainerIDInterner::Instance();
+  auto unused = interner.Intern("unused");
+  auto live = interner.Intern("live");
+
+  for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps - 1; i++) {
+    interner.Sweep({live});
+    EXPECT_EQ(interner.Lookup(unused), "unused");
+  }
+
+  // The string of a released ID remains valid for a while.
+  const std::string* stored = &interner.Lookup(unused);
+  interner.Sweep({live});
+  EXPECT_FALSE(interner.Valid(unused));
+  EXPECT_EQ(interner.Lookup(unused), "");
+  EXPECT_EQ(*stored, "unused");
+  EXPECT_TRUE(interner.Valid(live));
+  EXPECT_EQ(interner.Lookup(live), "live");
+
+  // A released slot is reused with another handle.
+  auto reused = interner.Intern("unused");
+  EXPECT_NE(reused, unused);
+  EXPECT_EQ(interner.Lookup(reused), "unused");
+  EXPECT_FALSE(interner.Valid(unused));
+}
+
+TEST(ContainerIDInternerTest, SweepKeepsInterned) {
+  auto& interner = ContainerIDInterner::Instance();
+  auto handle = interner.Intern("interned");
+
+  for (uint32_t i = 0; i < 2 * ContainerIDInterner::kGraceSweeps; i++) {
+    interner.Sweep({});
+    EXPECT_EQ(interner.Intern("interned"), handle);
+  }
+  EXPECT_EQ(interner.Lookup(handle), "interned");
+}
+
+TEST(ContainerIDInternerTest, SweepKeepsEmptyID) {
+  auto& interner = ContainerIDInterner::Instance();
+  for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps; i++) {
+    interner.Sweep({});
+  }
+  EXPECT_TRUE(interner.Valid(ContainerIDInterner::kEmpty));
+  EXPECT_EQ(interner.Intern(""), ContainerIDInterner::kEmpty);
+}
+
+TEST(ContainerIDInternerTest, SweepBoundsSize) {
+  auto& interner = ContainerIDInterner::Instance();
+  for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps; i++) {
+    interner.Sweep({});
+  }
+  size_t size = interner.Size();
+
+  // Containers keep coming and going, each reusing the slots of those gone.
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 1000; i++) {
+      interner.Intern("churn-" + std::to_string(round) + "-" + std::to_string(i));
+    }
+    for (uint32_t i = 0; i < ContainerIDInterner::kGraceSweeps; i++) {
+      interner.Sweep({});
+    }
+    EXPECT_EQ(interner.Size(), size);
+  }
+}
+
+TEST(ContainerIDInternerTest, ConcurrentSweep) {
+  auto& interner = ContainerIDInterner::Instance();
+  constexpr int kNumThreads = 4;
+  constexpr int kNumIDs = 100;
+
+  std::atomic<bool> done = false;
+  std::thread sweeper([&]() {
+    // Sweeps are spaced out, as released IDs are only kept for a few of
+    // them.
+    while (!done) {
+      interner.Sweep({});
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&]() {
+      for (int n = 0; n < 100; n++) {
+        for (int i = 0; i < kNumIDs; i++) {
+          auto id = "swept-" + std::to_string(i);
+          auto handle = interner.Intern(id);
+          // The handle may be released right away, but never refers to
+          // another ID.
+          auto found = interner.Lookup(handle);
+          EXPECT_TRUE(found == id || found.empty()) << found;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  done = true;
+  sweeper.join();
+}
+
+}  // namespace
+}  // namespace collector
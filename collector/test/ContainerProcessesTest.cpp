@@ -0,0 +1,46 @@
+#include "ContainerProcesses.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+TEST(ContainerProcessesTest, AddAndRemove) {
+  ContainerProcesses processes;
+  EXPECT_EQ(processes.Count("0123456789ab"), 0);
+
+  processes.Add(1, "0123456789ab");
+  processes.Add(2, "0123456789ab");
+  processes.Add(3, "ba9876543210");
+  EXPECT_EQ(processes.Count("0123456789ab"), 2);
+  EXPECT_EQ(processes.Count("ba9876543210"), 1);
+
+  // Seen again, e.g. on execve.
+  processes.Add(1, "0123456789ab");
+  EXPECT_EQ(processes.Count("0123456789ab"), 2);
+  EXPECT_EQ(processes.Size(), 3);
+
+  processes.Remove(1);
+  EXPECT_EQ(processes.Count("0123456789ab"), 1);
+  processes.Remove(2);
+  EXPECT_EQ(processes.Count("0123456789ab"), 0);
+  EXPECT_EQ(processes.Count("ba9876543210"), 1);
+
+  // Unknown pid
+  processes.Remove(42);
+  EXPECT_EQ(processes.Size(), 1);
+}
+
+TEST(ContainerProcessesTest, PidReuse) {
+  ContainerProcesses processes;
+  processes.Add(1, "0123456789ab");
+
+  // The exit of the previous process was missed.
+  processes.Add(1, "ba9876543210");
+  EXPECT_EQ(processes.Count("0123456789ab"), 0);
+  EXPECT_EQ(processes.Count("ba9876543210"), 1);
+  EXPECT_EQ(processes.Size(), 1);
+}
+
+}  // namespace
+}  // namespace collector
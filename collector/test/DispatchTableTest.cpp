@@ -0,0 +1,87 @@
+#include <bitset>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "system-inspector/DispatchTable.h"
+
+namespace collector::system_inspector {
+namespace {
+
+class FakeHandler : public SignalHandler {
+ public:
+  explicit FakeHandler(uint8_t kind_offset = 0) : kind_offset_(kind_offset) {}
+
+  std::string GetName() override { return "FakeHandler"; }
+  Result HandleSignal(sinsp_evt* evt) override { return PROCESSED; }
+  std::vector<std::string> GetRelevantEvents() override { return {}; }
+
+  uint8_t GetEventKind(uint16_t event_type) override {
+    return static_cast<uint8_t>(event_type + kind_offset_);
+  }
+
+ private:
+  uint8_t kind_offset_;
+};
+
+TEST(DispatchTableTest, Empty) {
+  DispatchTable table;
+  for (uint16_t type = 0; type < PPM_EVENT_MAX; type++) {
+    EXPECT_TRUE(table.Get(type).empty());
+  }
+
+  table = DispatchTable::Build({});
+  for (uint16_t type = 0; type < PPM_EVENT_MAX; type++) {
+    EXPECT_TRUE(table.Get(type).empty());
+  }
+}
+
+TEST(DispatchTableTest, Build) {
+  FakeHandler all;
+  FakeHandler some(100);
+
+  std::bitset<PPM_EVENT_MAX> some_events;
+  some_events.set(3);
+  some_events.set(PPM_EVENT_MAX - 1);
+
+  auto table = DispatchTable::Build({
+      {&some, some_events},
+      {&all, std::bitset<PPM_EVENT_MAX>().set()},
+  });
+
+  for (uint16_t type = 0; type < PPM_EVENT_MAX; type++) {
+    auto entries = table.Get(type);
+    if (some_events[type]) {
+      ASSERT_EQ(entries.size(), 2);
+      // Handlers keep the order they were given in.
+      EXPECT_EQ(entries.begin()[0].handler, &some);
+      EXPECT_EQ(entries.begin()[0].kind, static_cast<uint8_t>(type + 100));
+      EXPECT_EQ(entries.begin()[1].handler, &all);
+      EXPECT_EQ(entries.begin()[1].kind, static_cast<uint8_t>(type));
+    } else {
+      ASSERT_EQ(entries.size(), 1);
+      EXPECT_EQ(entries.begin()->handler, &all);
+      EXPECT_EQ(entries.begin()->kind, static_cast<uint8_t>(type));
+    }
+  }
+}
+
+TEST(DispatchTableTest, Rebuild) {
+  FakeHandler first;
+  FakeHandler second;
+  std::bitset<PPM_EVENT_MAX> events;
+  events.set(7);
+
+  auto table = DispatchTable::Build({{&first, events}, {&second, events}});
+  EXPECT_EQ(table.Get(7).size(), 2);
+
+  table = DispatchTable::Build({{&second, events}});
+  ASSERT_EQ(table.Get(7).size(), 1);
+  EXPECT_EQ(table.Get(7).begin()->handler, &second);
+  EXPECT_TRUE(table.Get(6).empty());
+  EXPECT_TRUE(table.Get(8).empty());
+}
+
+}  // namespace
+}  // namespace collector::system_inspector
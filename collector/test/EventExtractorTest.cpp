@@ -0,0 +1,121 @@
+// clang-format off
+#include "libsinsp/sinsp.h"
+// clang-format on
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BenchmarkUtil.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "system-inspector/EventExtractor.h"
+
+namespace collector::system_inspector {
+namespace {
+
+// A close exit event, whose single parameter is the return value.
+class CloseExitEvent {
+ public:
+  explicit CloseExitEvent(int64_t res) : buffer_(sizeof(scap_evt) + sizeof(uint16_t) + sizeof(int64_t)) {
+    auto* header = reinterpret_cast<scap_evt*>(buffer_.data());
+    header->ts = 1;
+    header->tid = 3;
+    header->len = buffer_.size();
+    header->type = PPME_SYSCALL_CLOSE_X;
+    header->nparams = 1;
+
+    uint16_t param_len = sizeof(int64_t);
+    std::memcpy(&buffer_[sizeof(scap_evt)], &param_len, sizeof(param_len));
+    std::memcpy(&buffer_[sizeof(scap_evt) + sizeof(param_len)], &res, sizeof(res));
+  }
+
+  uint8_t* data() { return buffer_.data(); }
+
+ private:
+  std::vector<uint8_t> buffer_;
+};
+
+class EventExtractorTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    inspector_ = std::make_unique<sinsp>();
+    extractor_.Init(inspector_.get());
+
+    tinfo_ = inspector_->get_threadinfo_factory().create();
+    tinfo_->m_pid = 3;
+    tinfo_->m_tid = 3;
+    tinfo_->set_args(std::vector<std::string>{"-c", "sleep 1000", "--verbose"});
+  }
+
+  void TearDown() override { extractor_.ClearWrappers(); }
+
+  void InitEvent(CloseExitEvent* scap_event) {
+    evt_.init(scap_event->data(), 0);
+    evt_.set_tinfo(tinfo_.get());
+  }
+
+  std::unique_ptr<sinsp> inspector_;
+  EventExtractor extractor_;
+  std::unique_ptr<sinsp_threadinfo> tinfo_;
+  sinsp_evt evt_;
+};
+
+TEST_F(EventExtractorTest, RawResMatchesFilterCheck) {
+  for (int64_t res : {0L, 42L, -2L}) {
+    CloseExitEvent scap_event(res);
+    InitEvent(&scap_event);
+
+    auto direct = extractor_.get_event_rawres(&evt_);
+    ASSERT_TRUE(direct.has_value());
+    EXPECT_EQ(*direct, res);
+    EXPECT_EQ(direct, extractor_.extract_event_rawres(&evt_));
+  }
+}
+
+TEST_F(EventExtractorTest, ProcArgsMatchesFilterCheck) {
+  CloseExitEvent scap_event(0);
+  InitEvent(&scap_event);
+
+  const char* direct = extractor_.get_proc_args(&evt_);
+  ASSERT_NE(direct, nullptr);
+  EXPECT_STREQ(direct, "-c sleep 1000 --verbose");
+
+  std::string direct_copy = direct;
+  const char* extracted = extractor_.extract_proc_args(&evt_);
+  ASSERT_NE(extracted, nullptr);
+  EXPECT_EQ(direct_copy, extracted);
+
+  tinfo_->set_args(std::vector<std::string>{});
+  EXPECT_STREQ(extractor_.get_proc_args(&evt_), "");
+}
+
+TEST_F(EventExtractorTest, DISABLED_BenchmarkFieldExtraction) {
+  constexpr int kIterations = 1'000'000;
+  CloseExitEvent scap_event(42);
+  InitEvent(&scap_event);
+
+  auto measure = [&](auto extract) {
+    int64_t total = 0;
+    auto elapsed_ns = TimeIt<std::chrono::nanoseconds>([&] {
+      for (int i = 0; i < kIterations; i++) {
+        total += extract();
+      }
+    });
+    EXPECT_NE(total, 0);
+    return elapsed_ns / kIterations;
+  };
+
+  auto rawres_filter_check = measure([&] { return extractor_.extract_event_rawres(&evt_).value_or(0); });
+  auto rawres_direct = measure([&] { return extractor_.get_event_rawres(&evt_).value_or(0); });
+  auto args_filter_check = measure([&] { return static_cast<int64_t>(std::strlen(extractor_.extract_proc_args(&evt_))); });
+  auto args_direct = measure([&] { return static_cast<int64_t>(std::strlen(extractor_.get_proc_args(&evt_))); });
+
+  BenchmarkLine() << "evt.rawres: filter check " << rawres_filter_check << "ns, direct " << rawres_direct << "ns per event";
+  BenchmarkLine() << "proc.args: filter check " << args_filter_check << "ns, direct " << args_direct << "ns per event";
+}
+
+}  // namespace
+}  // namespace collector::system_inspector
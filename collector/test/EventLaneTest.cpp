@@ -0,0 +1,203 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CollectorStats.h"
+#include "EventLane.h"
+#include "SpscQueue.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+const EventLane<int>::Counters kCounters{
+    CollectorStats::pipeline_network_lane_depth,
+    CollectorStats::pipeline_network_lane_stalls,
+    CollectorStats::pipeline_network_lane_drops,
+};
+
+TEST(SpscQueueTest, PushPop) {
+  SpscQueue<int> queue(3);
+  EXPECT_EQ(queue.Capacity(), 4);
+  EXPECT_TRUE(queue.Empty());
+
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.TryPush(int(i)));
+  }
+  EXPECT_FALSE(queue.TryPush(42));
+  EXPECT_EQ(queue.Size(), 4);
+
+  int value = -1;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(SpscQueueTest, ConcurrentOrdering) {
+  constexpr int kItems = 100'000;
+  SpscQueue<int> queue(1024);
+
+  std::thread producer([&queue]() {
+    for (int i = 0; i < kItems; i++) {
+      while (!queue.TryPush(int(i))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int expected = 0;
+  int value;
+  while (expected < kItems) {
+    if (queue.TryPop(&value)) {
+      ASSERT_EQ(value, expected);
+      expected++;
+    }
+  }
+
+  producer.join();
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(EventLaneTest, ParsePolicy) {
+  LanePolicy policy = LanePolicy::DROP;
+  EXPECT_TRUE(ParseLanePolicy("Block", &policy));
+  EXPECT_EQ(policy, LanePolicy::BLOCK);
+  EXPECT_TRUE(ParseLanePolicy("drop", &policy));
+  EXPECT_EQ(policy, LanePolicy::DROP);
+  EXPECT_FALSE(ParseLanePolicy("whatever", &policy));
+  EXPECT_EQ(policy, LanePolicy::DROP);
+}
+
+TEST(EventLaneTest, ConsumesInOrder) {
+  std::vector<int> consumed;
+  EventLane<int> lane("test", 16, LanePolicy::BLOCK, kCounters, [&consumed](int& item) {
+    consumed.push_back(item);
+  });
+
+  ASSERT_TRUE(lane.Start());
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(lane.Push(int(i)));
+  }
+  // Stop drains the items still queued.
+  lane.Stop();
+
+  ASSERT_EQ(consumed.size(), 1000);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(consumed[i], i);
+  }
+}
+
+TEST(EventLaneTest, DropWhenFull) {
+  CollectorStats::Reset();
+
+  std::mutex blocker;
+  std::atomic<int> consumed = 0;
+  EventLane<int> lane("test", 4, LanePolicy::DROP, kCounters, [&](int&) {
+    std::lock_guard<std::mutex> lock(blocker);
+    consumed++;
+  });
+
+  {
+    // Hold the consumer, so the lane fills up.
+    std::lock_guard<std::mutex> lock(blocker);
+    ASSERT_TRUE(lane.Start());
+
+    int accepted = 0;
+    for (int i = 0; i < 10; i++) {
+      if (lane.Push(int(i))) {
+        accepted++;
+      }
+    }
+
+    // At most one item is held by the consumer, the rest must fit the lane.
+    EXPECT_LE(accepted, 5);
+    EXPECT_GE(accepted, 4);
+
+    auto& stats = CollectorStats::GetOrCreate();
+    EXPECT_EQ(stats.GetCounter(kCounters.drops), 10 - accepted);
+    EXPECT_EQ(stats.GetCounter(kCounters.stalls), 10 - accepted);
+  }
+
+  lane.Stop();
+  EXPECT_EQ(consumed, 10 - CollectorStats::GetOrCreate().GetCounter(kCounters.drops));
+}
+
+TEST(EventLaneTest, BlockWaitsOnceWhileStalled) {
+  CollectorStats::Reset();
+
+  std::mutex blocker;
+  std::atomic<int> consumed = 0;
+  EventLane<int> lane("test", 4, LanePolicy::BLOCK, kCounters, [&](int&) {
+    std::lock_guard<std::mutex> lock(blocker);
+    consumed++;
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(blocker);
+    ASSERT_TRUE(lane.Start());
+
+    auto start = std::chrono::steady_clock::now();
+    int accepted = 0;
+    for (int i = 0; i < 100; i++) {
+      if (lane.Push(int(i))) {
+        accepted++;
+      }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_LE(accepted, 5);
+    // Only the first push to the full lane waits, the others are dropped
+    // right away.
+    EXPECT_LT(elapsed, 20 * EventLane<int>::kMaxBlockTime);
+    EXPECT_EQ(CollectorStats::GetOrCreate().GetCounter(kCounters.drops), 100 - accepted);
+  }
+
+  // Once the consumer has caught up, pushes are accepted again.
+  while (lane.Depth() > 0) {
+    std::this_thread::yield();
+  }
+  EXPECT_TRUE(lane.Push(100));
+
+  lane.Stop();
+}
+
+TEST(EventLaneTest, PushWaitNeverDrops) {
+  CollectorStats::Reset();
+
+  std::vector<int> consumed;
+  EventLane<int> lane("test", 4, LanePolicy::DROP, kCounters, [&consumed](int& item) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    consumed.push_back(item);
+  });
+  ASSERT_TRUE(lane.Start());
+
+  std::vector<int> expected;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(lane.PushWait(int(i)));
+    expected.push_back(i);
+  }
+  lane.Stop();
+
+  EXPECT_EQ(consumed, expected);
+  EXPECT_EQ(CollectorStats::GetOrCreate().GetCounter(kCounters.drops), 0);
+}
+
+TEST(EventLaneTest, PushWaitFailsWithoutWorker) {
+  CollectorStats::Reset();
+
+  EventLane<int> lane("test", 4, LanePolicy::BLOCK, kCounters, [](int&) {});
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(lane.PushWait(int(i)));
+  }
+  EXPECT_FALSE(lane.PushWait(4));
+  EXPECT_EQ(CollectorStats::GetOrCreate().GetCounter(kCounters.drops), 1);
+}
+
+}  // namespace
+}  // namespace collector
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <thread>
+
+#include "CycleClock.h"
+#include "EventTimingSampler.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+TEST(CycleClockTest, Calibrate) {
+  CycleClock::Calibrate();
+  EXPECT_GT(CycleClock::TicksPerMicro(), 0.0);
+
+  auto start_time = std::chrono::steady_clock::now();
+  uint64_t start = CycleClock::Now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  uint64_t elapsed = CycleClock::ToMicros(CycleClock::Now() - start);
+  auto expected = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+
+  // Generous bounds, the test machine might be busy.
+  EXPECT_GT(elapsed, expected / 2);
+  EXPECT_LT(elapsed, expected * 2);
+}
+
+TEST(EventTimingSamplerTest, DisabledByDefault) {
+  EventTimingSampler<4> sampler;
+  EXPECT_FALSE(sampler.AnyEnabled());
+  for (int i = 0; i < 100; i++) {
+    EXPECT_FALSE(sampler.ShouldSample(0));
+  }
+  EXPECT_EQ(sampler.ParseMicros(0), 0);
+  EXPECT_EQ(sampler.ProcessMicros(0), 0);
+}
+
+TEST(EventTimingSamplerTest, SamplesOneOutOfN) {
+  EventTimingSampler<4> sampler;
+  std::bitset<4> enabled;
+  enabled.set(1);
+  enabled.set(2);
+  sampler.Configure(10, enabled);
+  EXPECT_TRUE(sampler.AnyEnabled());
+
+  int sampled[4] = {0};
+  for (int i = 0; i < 1000; i++) {
+    for (int type = 0; type < 4; type++) {
+      if (sampler.ShouldSample(type)) {
+        sampled[type]++;
+      }
+    }
+  }
+
+  EXPECT_EQ(sampled[0], 0);
+  EXPECT_EQ(sampled[1], 100);
+  EXPECT_EQ(sampled[2], 100);
+  EXPECT_EQ(sampled[3], 0);
+}
+
+TEST(EventTimingSamplerTest, FirstEventIsSampled) {
+  EventTimingSampler<2> sampler;
+  sampler.Configure(1000, std::bitset<2>().set());
+  EXPECT_TRUE(sampler.ShouldSample(0));
+  EXPECT_FALSE(sampler.ShouldSample(0));
+  EXPECT_TRUE(sampler.ShouldSample(1));
+}
+
+TEST(EventTimingSamplerTest, ExtrapolatesTotals) {
+  CycleClock::Calibrate();
+  uint64_t ticks_per_ms = static_cast<uint64_t>(CycleClock::TicksPerMicro() * 1000);
+
+  EventTimingSampler<2> sampler;
+  sampler.Configure(8, std::bitset<2>().set());
+
+  // 800 events costing 1ms each, of which 100 are timed.
+  for (int i = 0; i < 800; i++) {
+    if (sampler.ShouldSample(0)) {
+      sampler.AddParse(0, ticks_per_ms);
+      sampler.AddProcess(0, 2 * ticks_per_ms);
+    }
+  }
+
+  EXPECT_NEAR(sampler.ParseMicros(0), 800'000, 800);
+  EXPECT_NEAR(sampler.ProcessMicros(0), 1'600'000, 1600);
+  EXPECT_EQ(sampler.ParseMicros(1), 0);
+}
+
+}  // namespace
+}  // namespace collector
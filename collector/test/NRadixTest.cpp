@@ -1,5 +1,8 @@
+#include <chrono>
+#include <memory>
 #include <random>
 
+#include "BenchmarkUtil.h"
 #include "Containers.h"
 #include "NRadix.h"
 #include "gmock/gmock.h"
@@ -273,28 +276,84 @@ TEST(NRadixTest, TestIsAnyIPNetSubsetWithFamily) {
   EXPECT_FALSE(t2.IsAnyIPNetSubset(Address::Family::IPV6, t1));
 }
 
-std::pair<std::chrono::duration<double, std::milli>, std::chrono::duration<double, std::milli>> TestLookup(const NRadixTree& tree, const std::vector<IPNet>& networks, Address lookup_addr) {
-  auto t1 = std::chrono::steady_clock::now();
-  IPNet actual = tree.Find(lookup_addr);
-  auto t2 = std::chrono::steady_clock::now();
+IPNet LinearLookup(const std::vector<IPNet>& networks, const Address& addr) {
+  IPNet ret;
+  for (const auto& net : networks) {
+    if (net.Contains(addr) && (ret.IsNull() || net.bits() > ret.bits())) {
+      ret = net;
+    }
+  }
+  return ret;
+}
 
-  EXPECT_NE(IPNet(), actual);
-  std::chrono::duration<double, std::milli> tree_lookup_dur = t2 - t1;
-  actual = {};
+TEST(NRadixTest, TestFindMatchesLinearScan) {
+  std::default_random_engine gen(42);
+  std::uniform_int_distribution<uint32_t> ipv4_distr(0, 0xFFFFFFFF);
+  std::uniform_int_distribution<uint64_t> ipv6_distr(0, 0xFFFFFFFFFFFFFFFFULL);
+  std::uniform_int_distribution<size_t> ipv4_bits_distr(1, 32);
+  std::uniform_int_distribution<size_t> ipv6_bits_distr(1, 128);
+
+  // Networks are derived from a few roots so that many of them nest.
+  std::vector<IPNet> networks;
+  NRadixTree tree;
+  for (int i = 0; i < 500; i++) {
+    uint32_t ipv4 = ipv4_distr(gen) & (i % 3 ? 0xFF00FFFF : 0xFFFFFFFF);
+    IPNet ipv4_net(Address(htonl(ipv4)), ipv4_bits_distr(gen));
+    if (tree.Insert(ipv4_net)) {
+      networks.push_back(ipv4_net);
+    }
+    uint64_t ipv6_high = ipv6_distr(gen) & (i % 3 ? 0xFFFF0000FFFFFFFFULL : 0xFFFFFFFFFFFFFFFFULL);
+    IPNet ipv6_net(Address(htonll(ipv6_high), htonll(ipv6_distr(gen))), ipv6_bits_distr(gen));
+    if (tree.Insert(ipv6_net)) {
+      networks.push_back(ipv6_net);
+    }
+  }
+
+  std::vector<Address> addrs;
+  for (const auto& net : networks) {
+    addrs.push_back(net.address());
+  }
+  for (int i = 0; i < 500; i++) {
+    addrs.push_back(Address(htonl(ipv4_distr(gen))));
+    addrs.push_back(Address(htonll(ipv6_distr(gen)), htonll(ipv6_distr(gen))));
+  }
+  addrs.push_back(Address());
+
+  for (const auto& addr : addrs) {
+    EXPECT_EQ(LinearLookup(networks, addr), tree.Find(addr)) << addr;
+  }
 
-  t1 = std::chrono::steady_clock::now();
-  // This is the legacy lookup code.
-  for (const auto net : networks) {
-    if (net.Contains(lookup_addr)) {
-      actual = net;
-      break;
+  for (const auto& net : networks) {
+    IPNet expected;
+    for (const auto& other : networks) {
+      if (other.bits() <= net.bits() && other.Contains(net.address()) && (expected.IsNull() || other.bits() > expected.bits())) {
+        expected = other;
+      }
     }
+    EXPECT_EQ(expected, tree.Find(net)) << net;
   }
-  t2 = std::chrono::steady_clock::now();
+}
+
+using Millis = std::chrono::duration<double, std::milli>;
+
+// Times a lookup with the tree and a linear one, in milliseconds.
+std::pair<double, double> TestLookup(const NRadixTree& tree, const std::vector<IPNet>& networks, Address lookup_addr) {
+  IPNet actual;
+  auto tree_lookup_ms = TimeIt<Millis>([&] { actual = tree.Find(lookup_addr); });
+  EXPECT_NE(IPNet(), actual);
+  actual = {};
 
+  auto linear_lookup_ms = TimeIt<Millis>([&] {
+    // This is the legacy lookup code.
+    for (const auto net : networks) {
+      if (net.Contains(lookup_addr)) {
+        actual = net;
+        break;
+      }
+    }
+  });
   EXPECT_NE(IPNet(), actual);
-  std::chrono::duration<double, std::milli> linear_lookup_dur = t2 - t1;
-  return {tree_lookup_dur, linear_lookup_dur};
+  return {tree_lookup_ms, linear_lookup_ms};
 }
 
 TEST(NRadixTest, BenchMarkNetworkLookup) {
@@ -325,51 +384,93 @@ TEST(NRadixTest, BenchMarkNetworkLookup) {
   }
 
   // Benchmark tree creation.
-  auto t1 = std::chrono::steady_clock::now();
   NRadixTree tree;
-  for (const auto net : ipv4_network_set) {
-    tree.Insert(net);
-  }
-  for (const auto net : ipv6_network_set) {
-    tree.Insert(net);
-  }
-  auto t2 = std::chrono::steady_clock::now();
-  std::chrono::duration<double, std::milli> dur = t2 - t1;
-  std::cout << "Time to create tree with " << num_nets << " networks: " << dur.count() << "ms\n";
+  auto create_ms = TimeIt<Millis>([&] {
+    for (const auto net : ipv4_network_set) {
+      tree.Insert(net);
+    }
+    for (const auto net : ipv6_network_set) {
+      tree.Insert(net);
+    }
+  });
+  BenchmarkLine() << "Time to create tree with " << num_nets << " networks: " << create_ms << "ms";
 
   // This is from the legacy lookup code. The networks were sorted after receiving from Sensor.
   std::vector<IPNet> ipv4_nets(ipv4_network_set.begin(), ipv4_network_set.end());
-  t1 = std::chrono::steady_clock::now();
-  std::sort(ipv4_nets.begin(), ipv4_nets.end(), std::greater<IPNet>());
-  t2 = std::chrono::steady_clock::now();
-  dur = t2 - t1;
-  std::cout << "Time to sort " << num_ipv4_nets << " ipv4 networks: " << dur.count() << "ms\n";
+  auto sort_ms = TimeIt<Millis>([&] { std::sort(ipv4_nets.begin(), ipv4_nets.end(), std::greater<IPNet>()); });
+  BenchmarkLine() << "Time to sort " << num_ipv4_nets << " ipv4 networks: " << sort_ms << "ms";
 
   // This is from the legacy lookup code. The networks were sorted after receiving from Sensor.
   std::vector<IPNet> ipv6_nets(ipv6_network_set.begin(), ipv6_network_set.end());
-  t1 = std::chrono::steady_clock::now();
-  std::sort(ipv6_nets.begin(), ipv6_nets.end(), std::greater<IPNet>());
-  t2 = std::chrono::steady_clock::now();
-  dur = t2 - t1;
-  std::cout << "Time to sort " << num_ipv6_nets << " ipv6 networks: " << dur.count() << "ms\n";
+  sort_ms = TimeIt<Millis>([&] { std::sort(ipv6_nets.begin(), ipv6_nets.end(), std::greater<IPNet>()); });
+  BenchmarkLine() << "Time to sort " << num_ipv6_nets << " ipv6 networks: " << sort_ms << "ms";
 
   // Benchmark network lookups.
   // In legacy code, IPv4 and IPv6 networks were stored separately in respective family bucket.
   double aggr_dur_with_tree = 0, aggr_dur_without_tree = 0;
   for (const auto net : ipv4_network_set) {
     const auto durs = TestLookup(tree, ipv4_nets, net.address());
-    aggr_dur_with_tree += durs.first.count();
-    aggr_dur_without_tree += durs.second.count();
+    aggr_dur_with_tree += durs.first;
+    aggr_dur_without_tree += durs.second;
   }
 
   for (const auto net : ipv6_network_set) {
     const auto durs = TestLookup(tree, ipv6_nets, net.address());
-    aggr_dur_with_tree += durs.first.count();
-    aggr_dur_without_tree += durs.second.count();
+    aggr_dur_with_tree += durs.first;
+    aggr_dur_without_tree += durs.second;
+  }
+
+  BenchmarkLine() << "Avg time to lookup " << num_nets << " addresses with network radix tree (#networks:" << num_nets << "): " << (aggr_dur_with_tree / num_nets) << "ms";
+  BenchmarkLine() << "Avg time to lookup " << num_nets << " addresses without network radix tree (#networks:" << num_nets << "): " << (aggr_dur_without_tree / num_nets) << "ms";
+}
+
+void BenchmarkLookupWithNetworks(size_t num_nets) {
+  constexpr size_t kNumLookups = 1000000;
+
+  std::default_random_engine gen(num_nets);
+  std::uniform_int_distribution<uint32_t> ip_distr(0, 0xFFFFFFFF);
+  std::uniform_int_distribution<size_t> bits_distr(8, 32);
+
+  UnorderedSet<IPNet> network_set;
+  network_set.reserve(num_nets);
+  while (network_set.size() < num_nets) {
+    network_set.emplace(Address(htonl(ip_distr(gen))), bits_distr(gen));
+  }
+  std::vector<IPNet> networks(network_set.begin(), network_set.end());
+
+  // Half of the lookups hit a network, the other half are random addresses.
+  std::vector<Address> addrs;
+  addrs.reserve(kNumLookups);
+  for (size_t i = 0; i < kNumLookups; i++) {
+    addrs.push_back(i % 2 ? networks[i % num_nets].address() : Address(htonl(ip_distr(gen))));
   }
 
-  std::cout << "Avg time to lookup " << num_nets << " addresses with network radix tree (#networks:" << num_nets << "): " << (aggr_dur_with_tree / num_nets) << "ms\n";
-  std::cout << "Avg time to lookup " << num_nets << " addresses without network radix tree (#networks:" << num_nets << "): " << (aggr_dur_without_tree / num_nets) << "ms\n";
+  std::unique_ptr<NRadixTree> tree;
+  auto create_ms = TimeIt<Millis>([&] { tree = std::make_unique<NRadixTree>(networks); });
+  BenchmarkLine() << "Time to create tree with " << num_nets << " networks: " << create_ms << "ms";
+
+  size_t found = 0;
+  auto lookup_ns = TimeIt<std::chrono::duration<double, std::nano>>([&] {
+    for (const auto& addr : addrs) {
+      found += !tree->Find(addr).IsNull();
+    }
+  });
+
+  EXPECT_GE(found, kNumLookups / 2);
+
+  BenchmarkLine() << "Avg time to lookup an address among " << num_nets << " networks: " << (lookup_ns / kNumLookups) << "ns";
+}
+
+TEST(NRadixTest, DISABLED_BenchmarkLookup10Networks) {
+  BenchmarkLookupWithNetworks(10);
+}
+
+TEST(NRadixTest, DISABLED_BenchmarkLookup1kNetworks) {
+  BenchmarkLookupWithNetworks(1000);
+}
+
+TEST(NRadixTest, DISABLED_BenchmarkLookup100kNetworks) {
+  BenchmarkLookupWithNetworks(100000);
 }
 
 TEST(NRadixTest, IsEmpty) {
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <utility>
+#include <vector>
 
+#include "BenchmarkUtil.h"
 #include "NetworkConnection.h"
 #include "Utility.h"
 #include "gmock/gmock.h"
@@ -176,6 +181,232 @@ TEST(TestIPNet, TestIsCanonicalExternalIp) {
   }
 }
 
+TEST(TestConnection, TestPackedRoundTrip) {
+  Endpoint local(Address(10, 0, 0, 1), 8080);
+  Endpoint remote(IPNet(Address(192, 168, 1, 0), 24), 0);
+  Connection conn("0123456789ab", local, remote, L4Proto::TCP, true);
+
+  EXPECT_EQ(conn.container(), "0123456789ab");
+  EXPECT_EQ(conn.local(), local);
+  EXPECT_TRUE(conn.local().network().IsAddress());
+  EXPECT_EQ(conn.remote(), remote);
+  EXPECT_FALSE(conn.remote().network().IsAddress());
+  EXPECT_EQ(conn.remote().network().bits(), 24);
+  EXPECT_EQ(conn.l4proto(), L4Proto::TCP);
+  EXPECT_TRUE(conn.is_server());
+  EXPECT_EQ(Str(conn), Str(Connection("0123456789ab", local, remote, L4Proto::TCP, true)));
+
+  Connection no_container("", local, remote, L4Proto::UDP, false);
+  EXPECT_EQ(no_container.container_handle(), ContainerIDInterner::kEmpty);
+  EXPECT_EQ(no_container.container(), "");
+}
+
+TEST(TestConnection, TestPackedEquality) {
+  Endpoint local(Address(10, 0, 0, 1), 8080);
+
+  // Networks are equal if they have the same prefix, regardless of the host bits.
+  Connection a("0123456789ab", local, Endpoint(IPNet(Address(192, 168, 1, 0), 24), 0), L4Proto::TCP, false);
+  Connection b("0123456789ab", local, Endpoint(IPNet(Address(192, 168, 1, 7), 24), 0), L4Proto::TCP, false);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.Hash(), b.Hash());
+
+  Connection c("0123456789ab", local, Endpoint(IPNet(Address(192, 168, 2, 0), 24), 0), L4Proto::TCP, false);
+  EXPECT_NE(a, c);
+  Connection d("ba9876543210", local, Endpoint(IPNet(Address(192, 168, 1, 0), 24), 0), L4Proto::TCP, false);
+  EXPECT_NE(a, d);
+  Connection e("0123456789ab", local, Endpoint(IPNet(Address(192, 168, 1, 0), 24), 0), L4Proto::UDP, false);
+  EXPECT_NE(a, e);
+
+  ContainerEndpoint cep1("0123456789ab", local, L4Proto::TCP, nullptr);
+  ContainerEndpoint cep2(std::string("0123456789ab"), Endpoint(Address(10, 0, 0, 1), 8080), L4Proto::TCP, nullptr);
+  EXPECT_EQ(cep1, cep2);
+  EXPECT_EQ(cep1.Hash(), cep2.Hash());
+  EXPECT_EQ(cep1.endpoint(), local);
+  EXPECT_EQ(cep1.container(), "0123456789ab");
+
+  // Built from the interned container ID of another key.
+  Connection f(a.container_handle(), local, Endpoint(IPNet(Address(192, 168, 1, 0), 24), 0), L4Proto::TCP, false);
+  EXPECT_EQ(a, f);
+  EXPECT_EQ(a.Hash(), f.Hash());
+  ContainerEndpoint cep3(cep1.container_handle(), local, L4Proto::TCP, nullptr);
+  EXPECT_EQ(cep1, cep3);
+  EXPECT_EQ(cep1.Hash(), cep3.Hash());
+}
+
+// LegacyConnection has the layout Connection had before container IDs were interned and endpoints packed.
+class LegacyConnection {
+ public:
+  LegacyConnection(std::string container, const Endpoint& local, const Endpoint& remote, L4Proto l4proto, bool is_server)
+      : container_(std::move(container)), local_(local), remote_(remote), flags_((static_cast<uint8_t>(l4proto) << 1) | ((is_server) ? 1 : 0)) {}
+
+  bool operator==(const LegacyConnection& other) const {
+    return container_ == other.container_ && local_ == other.local_ && remote_ == other.remote_ && flags_ == other.flags_;
+  }
+
+  size_t Hash() const { return HashAll(container_, local_, remote_, flags_); }
+
+ private:
+  std::string container_;
+  Endpoint local_;
+  Endpoint remote_;
+  uint8_t flags_;
+};
+
+// Measures the size, the memory in a flat map, and the hash and equality cost of connection keys, compared to the
+// previous layout.
+TEST(TestConnection, DISABLED_BenchmarkKeyLayout) {
+  constexpr int kNumConnections = 1000000;
+  const std::string container_id = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+
+  auto run = [&](auto make, const char* name) {
+    using Key = decltype(make(0));
+    std::vector<Key> keys, copies;
+    keys.reserve(kNumConnections);
+    for (int i = 0; i < kNumConnections; i++) {
+      keys.push_back(make(i));
+    }
+    copies = keys;
+
+    FlatHashMap<Key, int> map;
+    for (const auto& key : keys) {
+      map.emplace(key, 0);
+    }
+    // Each slot holds an entry and a control byte; strings may also own a heap allocation.
+    size_t bytes_per_entry = map.capacity() * (sizeof(typename decltype(map)::value_type) + 1) / map.size();
+
+    size_t hash = 0;
+    auto hash_ns = TimeIt<std::chrono::nanoseconds>([&] {
+      for (const auto& key : keys) {
+        hash ^= key.Hash();
+      }
+    });
+
+    size_t equal = 0;
+    auto equal_ns = TimeIt<std::chrono::nanoseconds>([&] {
+      for (int i = 0; i < kNumConnections; i++) {
+        equal += keys[i] == copies[i];
+      }
+    });
+
+    size_t found = 0;
+    auto lookup_ns = TimeIt<std::chrono::nanoseconds>([&] {
+      for (const auto& key : copies) {
+        found += map.count(key);
+      }
+    });
+
+    EXPECT_EQ(map.size(), kNumConnections);
+    EXPECT_EQ(equal, kNumConnections);
+    EXPECT_EQ(found, kNumConnections);
+    BenchmarkLine() << name << ": " << sizeof(Key) << " bytes, " << bytes_per_entry << " bytes per map entry, hash "
+                    << hash_ns / kNumConnections << "ns, equality " << equal_ns / kNumConnections << "ns, lookup "
+                    << lookup_ns / kNumConnections << "ns (" << (hash & 1) << ")";
+  };
+
+  auto endpoints = [](int i) {
+    return std::make_pair(Endpoint(Address(10, 0, 0, 1), 8080),
+                          Endpoint(Address(10, i >> 16, (i >> 8) & 0xff, i & 0xff), 40000));
+  };
+  run([&](int i) {
+    auto [local, remote] = endpoints(i);
+    return LegacyConnection(container_id, local, remote, L4Proto::TCP, true);
+  },
+      "legacy");
+  run([&](int i) {
+    auto [local, remote] = endpoints(i);
+    return Connection(container_id, local, remote, L4Proto::TCP, true);
+  },
+      "packed");
+}
+
+// Client connections from many pods to a few services differ in few bits: the remote address and the ephemeral port.
+// Checks that their hashes do not collide, and are spread over both the low and the high bits, which are
+// respectively used as fingerprints and to probe by flat maps.
+TEST(TestConnection, HashCollisions) {
+  constexpr int kNumBuckets = 1 << 16;
+  std::vector<Connection> conns;
+  for (int pod = 0; pod < 32; pod++) {
+    for (int port = 32768; port < 61000; port++) {
+      conns.emplace_back("0123456789ab", Endpoint(Address(10, 128, 0, pod), port),
+                         Endpoint(Address(10, 96, 0, 10), 443), L4Proto::TCP, false);
+    }
+  }
+
+  UnorderedSet<uint64_t> hashes;
+  std::vector<int> low_buckets(kNumBuckets), high_buckets(kNumBuckets);
+  for (const auto& conn : conns) {
+    hashes.insert(conn.Hash());
+    low_buckets[conn.Hash() % kNumBuckets]++;
+    high_buckets[conn.Hash() >> 48]++;
+  }
+
+  EXPECT_EQ(hashes.size(), conns.size());
+
+  // With 900k keys in 65536 buckets, about 14 per bucket are expected. A uniform hash is very unlikely to exceed 40.
+  int max_low = *std::max_element(low_buckets.begin(), low_buckets.end());
+  int max_high = *std::max_element(high_buckets.begin(), high_buckets.end());
+  EXPECT_LT(max_low, 40);
+  EXPECT_LT(max_high, 40);
+  std::cout << conns.size() << " connections, max bucket load " << max_low << " (low bits), " << max_high
+            << " (high bits)" << std::endl;
+}
+
+// Compares the cost of hashing the words of a connection key in one shot, and field by field.
+TEST(TestConnection, DISABLED_BenchmarkHashWords) {
+  constexpr int kNumKeys = 10000000;
+  std::array<uint64_t, 8> words = {0x0a80000100000000ULL, 0, 8080, 0x0a60000a00000000ULL, 0, 443, 0x100, 0};
+
+  using Nanos = std::chrono::duration<double, std::nano>;
+  uint64_t hash = 0;
+  auto words_ns = TimeIt<Nanos>([&] {
+    for (int i = 0; i < kNumKeys; i++) {
+      words[2] = i;
+      hash ^= HashWords(words);
+    }
+  });
+  auto fields_ns = TimeIt<Nanos>([&] {
+    for (int i = 0; i < kNumKeys; i++) {
+      words[2] = i;
+      hash ^= HashAll(words[0], words[1], words[2], words[3], words[4], words[5], words[6], words[7]);
+    }
+  });
+
+  BenchmarkLine() << "HashWords: " << words_ns / kNumKeys << "ns, HashAll: " << fields_ns / kNumKeys << "ns ("
+                  << (hash & 1) << ")";
+}
+
+TEST(TestConnection, HashIsConsistentWithEquality) {
+  Endpoint local(Address(10, 0, 0, 1), 40000);
+  Connection a("0123456789ab", local, Endpoint(Address(10, 96, 0, 10), 443), L4Proto::TCP, false);
+  Connection b("0123456789ab", local, Endpoint(Address(10, 96, 0, 10), 443), L4Proto::TCP, false);
+  Connection c("0123456789ab", local, Endpoint(Address(10, 96, 0, 10), 443), L4Proto::TCP, true);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.Hash(), b.Hash());
+  EXPECT_NE(a, c);
+  EXPECT_NE(a.Hash(), c.Hash());
+
+  Connection copy = a;
+  EXPECT_EQ(copy, a);
+  EXPECT_EQ(copy.Hash(), a.Hash());
+  EXPECT_EQ(Connection().Hash(), Connection().Hash());
+
+  // An address and the network covering only that address are equal, so
+  // they must hash the same.
+  Connection host_net("0123456789ab", local, Endpoint(IPNet(Address(10, 96, 0, 10), 32), 443), L4Proto::TCP, false);
+  EXPECT_EQ(a, host_net);
+  EXPECT_EQ(host_net, a);
+  EXPECT_EQ(a.Hash(), host_net.Hash());
+
+  ContainerEndpoint addr_endpoint("0123456789ab", Endpoint(Address(10, 0, 0, 1), 80), L4Proto::TCP, nullptr);
+  ContainerEndpoint net_endpoint("0123456789ab", Endpoint(IPNet(Address(10, 0, 0, 1), 32), 80), L4Proto::TCP, nullptr);
+  EXPECT_EQ(addr_endpoint, net_endpoint);
+  EXPECT_EQ(addr_endpoint.Hash(), net_endpoint.Hash());
+
+  EXPECT_EQ(Address(10, 0, 0, 1).Hash(), Address(10, 0, 0, 1).Hash());
+  EXPECT_NE(Address(10, 0, 0, 1).Hash(), Address(10, 0, 0, 2).Hash());
+  EXPECT_NE(Address(Address::Family::IPV4).Hash(), Address(Address::Family::IPV6).Hash());
+}
+
 }  // namespace
 
 }  // namespace collector
@@ -0,0 +1,62 @@
+#include <string>
+#include <vector>
+
+#include "NetworkExclusions.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+TEST(NetworkExclusionsTest, Empty) {
+  NetworkExclusions exclusions;
+  auto rules = exclusions.Get();
+  ASSERT_NE(rules, nullptr);
+  EXPECT_TRUE(rules->empty());
+  EXPECT_EQ(rules->Match("0123456789ab"), nullptr);
+  EXPECT_EQ(exclusions.Version(), 0);
+}
+
+TEST(NetworkExclusionsTest, Match) {
+  NetworkExclusions exclusions;
+  exclusions.SetContainers({"0123456789ab", "ba9876543210"});
+  EXPECT_EQ(exclusions.Version(), 1);
+
+  auto rules = exclusions.Get();
+  EXPECT_FALSE(rules->empty());
+  EXPECT_NE(rules->Match("0123456789ab"), nullptr);
+  EXPECT_NE(rules->Match("ba9876543210"), nullptr);
+  EXPECT_EQ(rules->Match("aaaaaaaaaaaa"), nullptr);
+}
+
+TEST(NetworkExclusionsTest, StatsCarriedOver) {
+  NetworkExclusions exclusions;
+  exclusions.SetContainers({"0123456789ab", "ba9876543210"});
+
+  auto rules = exclusions.Get();
+  rules->Match("0123456789ab")->events += 10;
+  rules->Match("ba9876543210")->scraped_processes += 3;
+
+  // Same rules, in a different order: nothing changes.
+  exclusions.SetContainers({"ba9876543210", "0123456789ab"});
+  EXPECT_EQ(exclusions.Version(), 1);
+  EXPECT_EQ(exclusions.Get(), rules);
+
+  exclusions.SetContainers({"0123456789ab", "aaaaaaaaaaaa"});
+  EXPECT_EQ(exclusions.Version(), 2);
+
+  auto updated = exclusions.Get();
+  EXPECT_EQ(updated->Match("0123456789ab")->events, 10);
+  EXPECT_EQ(updated->Match("aaaaaaaaaaaa")->events, 0);
+  EXPECT_EQ(updated->Match("ba9876543210"), nullptr);
+
+  // The previous snapshot remains usable by its readers.
+  EXPECT_EQ(rules->Match("ba9876543210")->scraped_processes, 3);
+
+  exclusions.SetContainers({});
+  EXPECT_TRUE(exclusions.Get()->empty());
+  EXPECT_EQ(exclusions.Version(), 3);
+}
+
+}  // namespace
+}  // namespace collector
@@ -0,0 +1,277 @@
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DuplexGRPC.h"
+#include "SignalServiceClient.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "system-inspector/SystemInspector.h"
+
+namespace collector {
+
+namespace {
+
+using grpc_duplex_impl::Result;
+using grpc_duplex_impl::Status;
+using SignalStreamMessage = SignalServiceClient::SignalStreamMessage;
+using ::testing::ElementsAre;
+
+class MockDuplexClientWriter : public IDuplexClientWriter<SignalStreamMessage> {
+ public:
+  MOCK_METHOD(grpc_duplex_impl::Result, Write, (const SignalStreamMessage& obj, const gpr_timespec& deadline), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, WriteAsync, (const SignalStreamMessage& obj), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, WaitUntilStarted, (const gpr_timespec& deadline), (override));
+  MOCK_METHOD(bool, Sleep, (const gpr_timespec& deadline), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, WritesDoneAsync, (), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, WritesDone, (const gpr_timespec& deadline), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, FinishAsync, (), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, WaitUntilFinished, (const gpr_timespec& deadline), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, Finish, (grpc::Status * status, const gpr_timespec& deadline), (override));
+  MOCK_METHOD(grpc::Status, Finish, (const gpr_timespec& deadline), (override));
+  MOCK_METHOD(void, TryCancel, (), (override));
+  MOCK_METHOD(grpc_duplex_impl::Result, Shutdown, (), (override));
+};
+
+class MockSignalServiceClient : public SignalServiceClient {
+ public:
+  MockSignalServiceClient() : SignalServiceClient(nullptr) {}
+
+  MOCK_METHOD(std::unique_ptr<IDuplexClientWriter<SignalStreamMessage>>, OpenStream, (), (override));
+};
+
+/* Records the pids of the signals written to a mocked stream. */
+class WrittenSignals {
+ public:
+  void Add(uint32_t pid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pids_.push_back(pid);
+    cond_.notify_all();
+  }
+
+  bool WaitForCount(size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, std::chrono::seconds(5), [&]() { return pids_.size() >= count; });
+  }
+
+  std::vector<uint32_t> Get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pids_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<uint32_t> pids_;
+};
+
+/* A write which is held back until the test releases it. */
+class HeldWrite {
+ public:
+  HeldWrite() : released_(release_.get_future().share()) {}
+
+  void Hold() {
+    entered_.set_value();
+    released_.wait();
+  }
+
+  bool WaitUntilEntered() {
+    return entered_.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready;
+  }
+
+  void Release() { release_.set_value(); }
+
+ private:
+  std::promise<void> entered_;
+  std::promise<void> release_;
+  std::shared_future<void> released_;
+};
+
+SignalStreamMessage MakeSignal(uint32_t pid) {
+  SignalStreamMessage msg;
+  msg.mutable_signal()->mutable_process_signal()->set_pid(pid);
+  return msg;
+}
+
+template <typename Pred>
+bool WaitFor(Pred pred) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (pred()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+/* The first signal pushed to a new stream is not written, it only requests
+   a refresh. */
+bool WaitForStream(SignalServiceClient* client) {
+  return WaitFor([client]() {
+    return client->PushSignals(MakeSignal(0)) == SignalHandler::NEEDS_REFRESH;
+  });
+}
+
+/* Opens a stream recording written signals, holding back the write of the
+   signal with the given pid, if any. */
+std::unique_ptr<IDuplexClientWriter<SignalStreamMessage>> RecordingStream(WrittenSignals* written, uint32_t held_pid = 0, HeldWrite* held = nullptr) {
+  auto writer = std::make_unique<MockDuplexClientWriter>();
+  EXPECT_CALL(*writer, Write).WillRepeatedly([=](const SignalStreamMessage& msg, const gpr_timespec& deadline) -> Result {
+    auto pid = msg.signal().process_signal().pid();
+    if (held && pid == held_pid) {
+      held->Hold();
+    }
+    written->Add(pid);
+    return Result(Status::OK);
+  });
+  return writer;
+}
+
+TEST(SignalServiceClientTest, DropOldestWhenFull) {
+  system_inspector::Stats stats;
+  WrittenSignals written;
+  HeldWrite held;
+
+  MockSignalServiceClient client;
+  client.EnableAsyncSend(2, true, &stats);
+  EXPECT_CALL(client, OpenStream).WillOnce([&]() { return RecordingStream(&written, 1, &held); });
+
+  client.Start();
+  ASSERT_TRUE(WaitForStream(&client));
+
+  EXPECT_EQ(client.PushSignals(MakeSignal(1)), SignalHandler::PROCESSED);
+  ASSERT_TRUE(held.WaitUntilEntered());
+
+  // The writer thread is busy with 1, so 2 and 3 fill the queue and 4
+  // evicts 2.
+  for (uint32_t pid = 2; pid <= 4; pid++) {
+    EXPECT_EQ(client.PushSignals(MakeSignal(pid)), SignalHandler::PROCESSED);
+  }
+  EXPECT_EQ(static_cast<uint64_t>(stats.nSignalQueueDroppedOldest), 1);
+  EXPECT_EQ(static_cast<uint64_t>(stats.nSignalQueueDroppedNewest), 0);
+
+  held.Release();
+  ASSERT_TRUE(written.WaitForCount(3));
+  client.Stop();
+
+  EXPECT_THAT(written.Get(), ElementsAre(1, 3, 4));
+  EXPECT_EQ(static_cast<uint64_t>(stats.nGRPCSendFailures), 0);
+}
+
+TEST(SignalServiceClientTest, DropNewestWhenFull) {
+  system_inspector::Stats stats;
+  WrittenSignals written;
+  HeldWrite held;
+
+  MockSignalServiceClient client;
+  client.EnableAsyncSend(2, false, &stats);
+  EXPECT_CALL(client, OpenStream).WillOnce([&]() { return RecordingStream(&written, 1, &held); });
+
+  client.Start();
+  ASSERT_TRUE(WaitForStream(&client));
+
+  EXPECT_EQ(client.PushSignals(MakeSignal(1)), SignalHandler::PROCESSED);
+  ASSERT_TRUE(held.WaitUntilEntered());
+
+  EXPECT_EQ(client.PushSignals(MakeSignal(2)), SignalHandler::PROCESSED);
+  EXPECT_EQ(client.PushSignals(MakeSignal(3)), SignalHandler::PROCESSED);
+  EXPECT_EQ(client.PushSignals(MakeSignal(4)), SignalHandler::ERROR);
+  EXPECT_EQ(static_cast<uint64_t>(stats.nSignalQueueDroppedOldest), 0);
+  EXPECT_EQ(static_cast<uint64_t>(stats.nSignalQueueDroppedNewest), 1);
+
+  held.Release();
+  ASSERT_TRUE(written.WaitForCount(3));
+  client.Stop();
+
+  EXPECT_THAT(written.Get(), ElementsAre(1, 2, 3));
+}
+
+TEST(SignalServiceClientTest, StopWritesQueuedSignals) {
+  system_inspector::Stats stats;
+  WrittenSignals written;
+
+  MockSignalServiceClient client;
+  client.EnableAsyncSend(100, true, &stats);
+  EXPECT_CALL(client, OpenStream).WillOnce([&]() { return RecordingStream(&written); });
+
+  client.Start();
+  ASSERT_TRUE(WaitForStream(&client));
+
+  std::vector<uint32_t> expected;
+  for (uint32_t pid = 1; pid <= 50; pid++) {
+    EXPECT_EQ(client.PushSignals(MakeSignal(pid)), SignalHandler::PROCESSED);
+    expected.push_back(pid);
+  }
+  client.Stop();
+
+  EXPECT_EQ(written.Get(), expected);
+  EXPECT_EQ(static_cast<uint64_t>(stats.nSignalQueueDepth), 0);
+  EXPECT_EQ(static_cast<uint64_t>(stats.nGRPCSendFailures), 0);
+}
+
+TEST(SignalServiceClientTest, WriteFailureDiscardsQueuedSignals) {
+  system_inspector::Stats stats;
+  WrittenSignals written;
+  WrittenSignals written_after_reconnect;
+  HeldWrite held_first;
+  HeldWrite held_failing;
+
+  MockSignalServiceClient client;
+  client.EnableAsyncSend(100, true, &stats);
+  EXPECT_CALL(client, OpenStream)
+      .WillOnce([&]() -> std::unique_ptr<IDuplexClientWriter<SignalStreamMessage>> {
+        auto writer = std::make_unique<MockDuplexClientWriter>();
+        EXPECT_CALL(*writer, Write).WillRepeatedly([&](const SignalStreamMessage& msg, const gpr_timespec& deadline) -> Result {
+          auto pid = msg.signal().process_signal().pid();
+          if (pid == 1) {
+            held_first.Hold();
+          } else if (pid == 3) {
+            held_failing.Hold();
+            return Result(Status::ERROR);
+          }
+          written.Add(pid);
+          return Result(Status::OK);
+        });
+        return writer;
+      })
+      .WillOnce([&]() { return RecordingStream(&written_after_reconnect); });
+
+  client.Start();
+  ASSERT_TRUE(WaitForStream(&client));
+
+  // 2, 3 and 4 are queued while 1 is being written, and then written as a
+  // single batch, in which 3 fails.
+  EXPECT_EQ(client.PushSignals(MakeSignal(1)), SignalHandler::PROCESSED);
+  ASSERT_TRUE(held_first.WaitUntilEntered());
+  for (uint32_t pid = 2; pid <= 4; pid++) {
+    EXPECT_EQ(client.PushSignals(MakeSignal(pid)), SignalHandler::PROCESSED);
+  }
+  held_first.Release();
+
+  // 5 and 6 are queued while the failing write is in progress.
+  ASSERT_TRUE(held_failing.WaitUntilEntered());
+  EXPECT_EQ(client.PushSignals(MakeSignal(5)), SignalHandler::PROCESSED);
+  EXPECT_EQ(client.PushSignals(MakeSignal(6)), SignalHandler::PROCESSED);
+  held_failing.Release();
+
+  // 3 and 4 from the batch, 5 and 6 from the queue.
+  ASSERT_TRUE(WaitFor([&stats]() { return stats.nGRPCSendFailures == 4; }));
+
+  // Nothing queued for the broken stream reaches the new one.
+  ASSERT_TRUE(WaitForStream(&client));
+  EXPECT_EQ(client.PushSignals(MakeSignal(7)), SignalHandler::PROCESSED);
+  ASSERT_TRUE(written_after_reconnect.WaitForCount(1));
+  client.Stop();
+
+  EXPECT_THAT(written.Get(), ElementsAre(1, 2));
+  EXPECT_THAT(written_after_reconnect.Get(), ElementsAre(7));
+  EXPECT_EQ(static_cast<uint64_t>(stats.nGRPCSendFailures), 4);
+}
+
+}  // namespace
+
+}  // namespace collector
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "TimerWheel.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace collector {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+std::vector<int> Advance(TimerWheel<int>* wheel, int64_t now) {
+  std::vector<int> fired;
+  wheel->Advance(now, [&fired](int key) { fired.push_back(key); });
+  return fired;
+}
+
+TEST(TimerWheelTest, FiresAfterDeadline) {
+  TimerWheel<int> wheel(1000);
+  wheel.Schedule(1, 1500);
+  wheel.Schedule(2, 2500);
+  wheel.Schedule(3, 2999);
+
+  EXPECT_THAT(Advance(&wheel, 1499), IsEmpty());
+  EXPECT_THAT(Advance(&wheel, 1500), ElementsAre(1));
+  // Same tick as the deadline, but before it.
+  EXPECT_THAT(Advance(&wheel, 2400), IsEmpty());
+  EXPECT_THAT(Advance(&wheel, 2600), ElementsAre(2));
+  EXPECT_EQ(wheel.size(), 1);
+  EXPECT_THAT(Advance(&wheel, 10000), ElementsAre(3));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, PastDeadlines) {
+  TimerWheel<int> wheel(1000);
+  EXPECT_THAT(Advance(&wheel, 50000), IsEmpty());
+  wheel.Schedule(1, 10);
+  wheel.Schedule(2, 50000);
+  EXPECT_THAT(Advance(&wheel, 50000), UnorderedElementsAre(1, 2));
+}
+
+TEST(TimerWheelTest, RescheduleAndCancel) {
+  TimerWheel<int> wheel(1000);
+  wheel.Schedule(1, 5000);
+  wheel.Schedule(2, 5000);
+  wheel.Schedule(3, 5000);
+  wheel.Schedule(1, 500000);
+  wheel.Schedule(2, 3000);
+  EXPECT_TRUE(wheel.Cancel(3));
+  EXPECT_FALSE(wheel.Cancel(4));
+
+  EXPECT_THAT(Advance(&wheel, 4000), ElementsAre(2));
+  EXPECT_THAT(Advance(&wheel, 400000), IsEmpty());
+  EXPECT_THAT(Advance(&wheel, 500000), ElementsAre(1));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(TimerWheelTest, Drain) {
+  TimerWheel<int> wheel(1000);
+  wheel.Schedule(1, 5000);
+  wheel.Schedule(2, 5000000);
+
+  std::vector<int> drained;
+  wheel.Drain([&drained](int key) { drained.push_back(key); });
+  EXPECT_THAT(drained, UnorderedElementsAre(1, 2));
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_THAT(Advance(&wheel, 10000000), IsEmpty());
+}
+
+// Compares the wheel with a sorted map of deadlines, over all levels and beyond its horizon.
+TEST(TimerWheelTest, MatchesSortedDeadlines) {
+  constexpr int64_t kTick = 1000;
+  std::mt19937_64 rng(7);
+  std::uniform_int_distribution<int> key_dist(0, 999);
+
+  TimerWheel<int> wheel(kTick);
+  std::map<int, int64_t> deadlines;
+  int64_t now = 123456789;
+  Advance(&wheel, now);
+
+  for (int round = 0; round < 2000; round++) {
+    for (int i = 0; i < 20; i++) {
+      int key = key_dist(rng);
+      switch (rng() % 8) {
+        case 0:
+          wheel.Cancel(key);
+          deadlines.erase(key);
+          break;
+        default: {
+          // From the current tick to well beyond the horizon of 2^24 ticks.
+          int shift = rng() % 28;
+          int64_t deadline = now + static_cast<int64_t>(rng() % (kTick << shift));
+          wheel.Schedule(key, deadline);
+          deadlines[key] = deadline;
+        }
+      }
+    }
+
+    now += static_cast<int64_t>(rng() % (kTick << (rng() % 20)));
+    std::vector<int> expected;
+    for (auto it = deadlines.begin(); it != deadlines.end();) {
+      if (it->second <= now) {
+        expected.push_back(it->first);
+        it = deadlines.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    auto fired = Advance(&wheel, now);
+    std::sort(fired.begin(), fired.end());
+    ASSERT_EQ(fired, expected) << "round " << round;
+    ASSERT_EQ(wheel.size(), deadlines.size());
+  }
+}
+
+}  // namespace
+}  // namespace collector
@@ -1,3 +1,8 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
 #include <gmock/gmock-actions.h>
 #include <gmock/gmock-spec-builders.h>
 
@@ -150,4 +155,65 @@ TEST(SanitizeUTF8Test, TestSanitizeUTF8_Valid) {
   }
 }
 
+TEST(CPUQuotaTest, TestGetCPUQuota) {
+  char dir_template[] = "/tmp/cpu_quota_test.XXXXXX";
+  ASSERT_NE(mkdtemp(dir_template), nullptr);
+  std::filesystem::path dir(dir_template);
+
+  // No cgroup CPU files.
+  EXPECT_EQ(GetCPUQuota(dir), std::nullopt);
+
+  // cgroup v1
+  std::filesystem::create_directory(dir / "cpu");
+  std::ofstream(dir / "cpu" / "cpu.cfs_quota_us") << "-1\n";
+  std::ofstream(dir / "cpu" / "cpu.cfs_period_us") << "100000\n";
+  EXPECT_EQ(GetCPUQuota(dir), std::nullopt);
+
+  std::ofstream(dir / "cpu" / "cpu.cfs_quota_us") << "250000\n";
+  EXPECT_EQ(GetCPUQuota(dir), 2.5);
+  EXPECT_EQ(AvailableCPUs(dir), std::min(std::max(std::thread::hardware_concurrency(), 1U), 3U));
+
+  // cgroup v1, with cpu and cpuacct co-mounted.
+  std::filesystem::remove_all(dir / "cpu");
+  std::filesystem::create_directory(dir / "cpu,cpuacct");
+  std::ofstream(dir / "cpu,cpuacct" / "cpu.cfs_quota_us") << "150000\n";
+  std::ofstream(dir / "cpu,cpuacct" / "cpu.cfs_period_us") << "100000\n";
+  EXPECT_EQ(GetCPUQuota(dir), 1.5);
+
+  // cgroup v2 takes precedence.
+  std::ofstream(dir / "cpu.max") << "max 100000\n";
+  EXPECT_EQ(GetCPUQuota(dir), std::nullopt);
+
+  std::ofstream(dir / "cpu.max") << "50000 100000\n";
+  EXPECT_EQ(GetCPUQuota(dir), 0.5);
+  EXPECT_EQ(AvailableCPUs(dir), 1);
+
+  std::ofstream(dir / "cpu.max") << "invalid\n";
+  EXPECT_EQ(GetCPUQuota(dir), std::nullopt);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST(ParallelForTest, CallsEachIndexOnce) {
+  for (size_t workers : {1, 4, 64}) {
+    std::vector<std::atomic<int>> calls(100);
+    std::vector<std::atomic<int>> calls_by_worker(workers);
+    ParallelFor(workers, calls.size(), [&](size_t worker, size_t i) {
+      calls[i]++;
+      calls_by_worker[worker]++;
+    });
+
+    for (const auto& count : calls) {
+      EXPECT_EQ(count, 1);
+    }
+    int total = 0;
+    for (const auto& count : calls_by_worker) {
+      total += count;
+    }
+    EXPECT_EQ(total, 100);
+  }
+
+  ParallelFor(4, 0, [](size_t, size_t) { FAIL(); });
+}
+
 }  // namespace collector